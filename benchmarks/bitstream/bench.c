@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "networking/packet.h"
+#include "panic.h"
+#include "report.h"
+
+const char kTestPacket[] = "hello world!";
+const int kIterations = 2000000;
+
+// The native header the packets were copied with before the bitstream.
+typedef struct {
+  ResponseType type;
+  uint16_t len;
+  uint16_t sequence;
+  uint16_t ack;
+  uint8_t flags;
+  uint32_t ack_bits;
+} NativeHeader;
+
+Response response;
+Response received;
+Data data;
+volatile size_t sink;
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void NativeEncode(Response* in, Data* out) {
+  NativeHeader* header = (NativeHeader*)out->ptr;
+  header->type = in->type;
+  header->len = in->data.len;
+  header->sequence = in->sequence;
+  header->ack = in->ack;
+  header->ack_bits = in->ack_bits;
+  header->flags = in->flags;
+  memcpy(out->ptr + sizeof(NativeHeader), in->data.ptr, in->data.len);
+  out->len = sizeof(NativeHeader) + in->data.len;
+}
+
+void NativeDecode(Data* in, Response* out) {
+  NativeHeader* header = (NativeHeader*)in->ptr;
+  out->type = header->type;
+  out->data.len = header->len;
+  out->sequence = header->sequence;
+  out->ack = header->ack;
+  out->ack_bits = header->ack_bits;
+  out->flags = header->flags;
+  memcpy(out->data.ptr, in->ptr + sizeof(NativeHeader), out->data.len);
+}
+
+void Print(const char* name, const char* path, double encode, double decode,
+           size_t len) {
+  ReportRow(&report, "%s %s", name, path);
+  ReportMetric(&report, "encode_ns", encode / kIterations);
+  ReportMetric(&report, "decode_ns", decode / kIterations);
+  ReportMetric(&report, "header_bytes", (double)(len - response.data.len));
+  ReportEnd(&report);
+}
+
+void Run(const char* name) {
+  double start = Now();
+  for (int i = 0; i < kIterations; ++i) {
+    data.len = kDataLength;
+    response.sequence = i;
+    NativeEncode(&response, &data);
+    sink += data.len;
+  }
+  double encode = Now() - start;
+  start = Now();
+  for (int i = 0; i < kIterations; ++i) {
+    NativeDecode(&data, &received);
+    sink += received.sequence;
+  }
+  Print(name, "memcpy", encode, Now() - start, data.len);
+
+  start = Now();
+  for (int i = 0; i < kIterations; ++i) {
+    data.len = kDataLength;
+    response.sequence = i;
+    Panic(ResponseToData(&response, &data));
+    sink += data.len;
+  }
+  encode = Now() - start;
+  start = Now();
+  for (int i = 0; i < kIterations; ++i) {
+    Panic(DataToResponse(&data, &received));
+    sink += received.sequence;
+  }
+  Print(name, "bitstream", encode, Now() - start, data.len);
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "bitstream", argc, argv);
+  Panic(ResponseInit(&response));
+  Panic(ResponseInit(&received));
+  Panic(DataInit(&data));
+  ResponseSetData(&response, kTestPacket);
+  ResponseSetType(&response, CONNECT);
+  Run("plain");
+  ResponseSetType(&response, RELIABLE);
+  response.flags = PACKET_HAS_ACKS;
+  Run("reliable");
+  ResponseDestroy(&response);
+  ResponseDestroy(&received);
+  DataDestroy(&data);
+  ReportDestroy(&report);
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "networking/packet.h"
+#include "networking/socket.h"
+#include "panic.h"
+#include "report.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kTestPacket[] = "hello world!";
+const int kPort = 40614;
+const int kClientCounts[] = {1, 10, 100, 1000, 10000};
+const int kRecipients = 1000000;
+
+Address addr;
+Server srv;
+Response response;
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Clients are registered directly, their ports have nobody listening.
+void AddClients(int from, int to) {
+  Address client_addr;
+  ConnectedClient* client;
+  for (int number = from; number < to; ++number) {
+#ifdef __IPV4__
+    Panic(AddressInit(&client_addr, kLocalHost, 20000 + number));
+#else
+#error "Unsupported netcode"
+#endif
+    Panic(RegistratorAddUser(&srv.registrator, &client_addr, &client));
+    AddressDestroy(&client_addr);
+  }
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "broadcast", argc, argv);
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ResponseInit(&response));
+  ResponseSetData(&response, kTestPacket);
+  SocketBackend backends[] = {SOCKET_BACKEND_SYSCALL, SOCKET_BACKEND_IO_URING};
+  int clients = 0;
+  for (size_t i = 0; i < sizeof(kClientCounts) / sizeof(int); ++i) {
+    AddClients(clients, kClientCounts[i]);
+    clients = kClientCounts[i];
+    int broadcasts = kRecipients / clients;
+    for (size_t j = 0; j < sizeof(backends) / sizeof(backends[0]); ++j) {
+      if (ServerSetBackend(&srv, backends[j]) != SUCCESS) {
+        continue;
+      }
+      double start = Now();
+      for (int b = 0; b < broadcasts; ++b) {
+        Panic(ServerSend(&srv, &response));
+      }
+      double elapsed = Now() - start;
+      ReportRow(&report, "%d clients %s", clients,
+                j == 0 ? "syscall" : "io_uring");
+      ReportMetric(&report, "broadcast_us", elapsed / broadcasts / 1e3);
+      ReportMetric(&report, "recipient_ns", elapsed / broadcasts / clients);
+      ReportEnd(&report);
+    }
+  }
+  ResponseDestroy(&response);
+  ServerDestroy(&srv);
+  AddressDestroy(&addr);
+  ReportDestroy(&report);
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "client/client.h"
+#include "common/stats.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "report.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kInput[] = "input";
+const int kPort = 40617;
+const int kTimeoutTime = 1000;
+const int kMessages = 400000;
+#define kBatch 64
+
+Address addr;
+Server srv;
+Client clt;
+Response response;
+Response batch[kBatch];
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The client sends a tick worth of small inputs, the server takes them in
+// batches. Without coalescing every input is a datagram.
+void Run(int per_tick, int coalescing) {
+  Panic(ClientSetCoalescing(&clt, coalescing));
+  StatsSnapshot stats;
+  ClientGetStats(&clt, &stats);
+  uint64_t datagrams = stats.counters.packets_out;
+  double start = Now();
+  for (int message = 0; message < kMessages; message += per_tick) {
+    for (int i = 0; i < per_tick; ++i) {
+      Panic(ClientSend(&clt, &response));
+    }
+    Panic(ClientFlush(&clt));
+    int got = 0;
+    while (got < per_tick) {
+      size_t count;
+      Panic(ServerReceiveBatch(&srv, batch, kBatch, &count));
+      got += (int)count;
+    }
+  }
+  double elapsed = Now() - start;
+  ClientGetStats(&clt, &stats);
+  ReportRow(&report, "%d per tick %s", per_tick,
+            coalescing ? "coalesced" : "plain");
+  ReportMetric(&report, "message_ns", elapsed / kMessages);
+  ReportMetric(&report, "messages_per_datagram",
+               kMessages / (double)(stats.counters.packets_out - datagrams));
+  ReportEnd(&report);
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "coalesce", argc, argv);
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ResponseInit(&response));
+  for (int i = 0; i < kBatch; ++i) {
+    Panic(ResponseInit(&batch[i]));
+  }
+  ResponseSetData(&response, kInput);
+  int ticks[] = {1, 8, 32, 128};
+  for (size_t i = 0; i < sizeof(ticks) / sizeof(ticks[0]); ++i) {
+    Run(ticks[i], 0);
+    Run(ticks[i], 1);
+  }
+  for (int i = 0; i < kBatch; ++i) {
+    ResponseDestroy(&batch[i]);
+  }
+  ResponseDestroy(&response);
+  ClientDestroy(&clt);
+  ServerDestroy(&srv);
+  AddressDestroy(&addr);
+  ReportDestroy(&report);
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "helpers.h"
+#include "networking/huffman.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "report.h"
+
+const int kSamples = 1024;
+const int kIterations = 500000;
+#define kSampleSize 128
+
+HuffmanTrainer trainer;
+HuffmanTable table;
+char samples[1024][kSampleSize];
+size_t lengths[1024];
+Response response;
+Response received;
+Data data;
+volatile size_t sink;
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void Run(const char* name, const HuffmanTable* codec) {
+  size_t bytes = 0;
+  double start = Now();
+  for (int i = 0; i < kIterations; ++i) {
+    int sample = i % kSamples;
+    response.data.ptr = samples[sample];
+    response.data.len = lengths[sample];
+    data.len = kDataLength;
+    Panic(ResponseToDataCompressed(&response, &data, codec));
+    bytes += data.len;
+  }
+  double encode = Now() - start;
+  start = Now();
+  for (int i = 0; i < kIterations; ++i) {
+    Panic(DataToResponseCompressed(&data, &received, codec));
+    sink += received.data.len;
+  }
+  double decode = Now() - start;
+  ReportRow(&report, "%s", name);
+  ReportMetric(&report, "encode_per_s", kIterations / encode * 1e9);
+  ReportMetric(&report, "decode_per_s", kIterations / decode * 1e9);
+  ReportMetric(&report, "bytes_per_packet", (double)bytes / kIterations);
+  ReportEnd(&report);
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "huffman", argc, argv);
+  HuffmanTrainerInit(&trainer);
+  for (int i = 0; i < kSamples; ++i) {
+    lengths[i] = (size_t)snprintf(
+        samples[i], kSampleSize, "unit %u moved to %u.%u %u.%u hp %u",
+        Random() % 64, Random() % 200, Random() % 10, Random() % 200,
+        Random() % 10, Random() % 100);
+    HuffmanTrainerAdd(&trainer, samples[i], lengths[i]);
+  }
+  HuffmanTrainerBuild(&trainer, &table);
+  Panic(ResponseInit(&received));
+  Panic(DataInit(&data));
+  ResponseSetType(&response, CONNECT);
+  Run("raw", NULL);
+  Run("huffman", &table);
+  ResponseDestroy(&received);
+  DataDestroy(&data);
+  ReportDestroy(&report);
+}
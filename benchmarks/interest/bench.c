@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "helpers.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "report.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kTestPacket[] = "hello world!";
+const int kPort = 40616;
+const int kClientCounts[] = {100, 1000, 10000};
+const uint32_t kGridSide = 100;
+const uint16_t kRadius = 3;
+const int kUpdates = 20000;
+const int kRecipients = 1000000;
+const int kMoves = 1000000;
+
+Address addr;
+Server srv;
+Response response;
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Clients are registered directly, their ports have nobody listening. They
+// are spread over the grid uniformly.
+void AddClients(int from, int to) {
+  Address client_addr;
+  ConnectedClient* client;
+  for (int number = from; number < to; ++number) {
+#ifdef __IPV4__
+    Panic(AddressInit(&client_addr, kLocalHost, 20000 + number));
+#else
+#error "Unsupported netcode"
+#endif
+    Panic(RegistratorAddUser(&srv.registrator, &client_addr, &client));
+    Panic(ServerSetInterest(&srv, client->client_id, Random() % kGridSide,
+                            (Random() % kGridSide), kRadius));
+    AddressDestroy(&client_addr);
+  }
+}
+
+// Every update happens in a random cell and goes either to everybody or only
+// to the clients who see the cell.
+void RunUpdates(int clients, int relevant) {
+  // Sending to everybody is bounded by the total number of recipients.
+  int updates = relevant ? kUpdates : kRecipients / clients;
+  double start = Now();
+  for (int i = 0; i < updates; ++i) {
+    if (relevant) {
+      Panic(ServerSendRelevant(&srv, &response, Random() % kGridSide,
+                               (Random() % kGridSide), NULL, NULL));
+    } else {
+      Panic(ServerSend(&srv, &response));
+    }
+  }
+  double elapsed = Now() - start;
+  ReportRow(&report, "%d clients %s", clients,
+            relevant ? "relevant" : "everybody");
+  ReportMetric(&report, "update_us", elapsed / updates / 1e3);
+  ReportMetric(&report, "move_ns", 0);
+  ReportEnd(&report);
+}
+
+// Clients step to a neighbour cell, which touches only the edges of areas.
+void RunMoves(int clients) {
+  double start = Now();
+  for (int i = 0; i < kMoves; ++i) {
+    uint16_t id = (uint16_t)(Random() % clients);
+    Panic(ServerSetInterest(&srv, id, Random() % kGridSide,
+                            Random() % kGridSide, kRadius));
+  }
+  double jumps = Now() - start;
+  start = Now();
+  for (int i = 0; i < kMoves; ++i) {
+    uint16_t id = (uint16_t)(Random() % clients);
+    InterestEntry* entry = &srv.interest.entries[id];
+    uint32_t x = entry->x + 1 < kGridSide ? entry->x + 1 : 0;
+    Panic(ServerSetInterest(&srv, id, x, entry->y, kRadius));
+  }
+  double steps = Now() - start;
+  ReportRow(&report, "%d clients jumps", clients);
+  ReportMetric(&report, "update_us", 0);
+  ReportMetric(&report, "move_ns", jumps / kMoves);
+  ReportEnd(&report);
+  ReportRow(&report, "%d clients steps", clients);
+  ReportMetric(&report, "update_us", 0);
+  ReportMetric(&report, "move_ns", steps / kMoves);
+  ReportEnd(&report);
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "interest", argc, argv);
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ServerSetInterestGrid(&srv, kGridSide, kGridSide));
+  Panic(ResponseInit(&response));
+  ResponseSetData(&response, kTestPacket);
+  int clients = 0;
+  for (size_t i = 0; i < sizeof(kClientCounts) / sizeof(int); ++i) {
+    AddClients(clients, kClientCounts[i]);
+    clients = kClientCounts[i];
+    RunUpdates(clients, 0);
+    RunUpdates(clients, 1);
+    RunMoves(clients);
+  }
+  ResponseDestroy(&response);
+  ServerDestroy(&srv);
+  AddressDestroy(&addr);
+  ReportDestroy(&report);
+}
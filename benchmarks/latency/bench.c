@@ -0,0 +1,104 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "client/client.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "report.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kTestPacket[] = "hello world!";
+const char kStopPacket[] = "stop";
+const int kPort = 40613;
+const int kTimeoutTime = 1000;
+const int kWarmup = 1000;
+#define kSamples 50000
+
+Address addr;
+Server srv;
+Client clt;
+Response response;
+double samples[kSamples];
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int CompareDoubles(const void* lhs, const void* rhs) {
+  double left = *(const double*)lhs;
+  double right = *(const double*)rhs;
+  return left < right ? -1 : left > right;
+}
+
+double Percentile(double percent) {
+  size_t index = (size_t)(percent / 100 * (kSamples - 1));
+  return samples[index];
+}
+
+// Echoes every packet back until the stop packet comes.
+void* Echo(void* arg) {
+  (void)arg;
+  Response echo;
+  Panic(ResponseInit(&echo));
+  while (1) {
+    Panic(ServerReceive(&srv, &echo));
+    if (echo.data.len == sizeof(kStopPacket) - 1) {
+      break;
+    }
+    Panic(ServerSendTo(&srv, &echo));
+  }
+  ResponseDestroy(&echo);
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "latency", argc, argv);
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientSetTimeout(&clt, kTimeoutTime));
+  Panic(ResponseInit(&response));
+  pthread_t server_thread;
+  if (pthread_create(&server_thread, NULL, Echo, NULL) != 0) {
+    fprintf(stderr, "Can't start the echo thread\n");
+    return EXIT_FAILURE;
+  }
+
+  for (int i = -kWarmup; i < kSamples; ++i) {
+    ResponseSetData(&response, kTestPacket);
+    double start = Now();
+    Panic(ClientSend(&clt, &response));
+    Panic(ClientReceive(&clt, &response));
+    if (i >= 0) {
+      samples[i] = (Now() - start) / 1e3;
+    }
+  }
+  ResponseSetData(&response, kStopPacket);
+  Panic(ClientSend(&clt, &response));
+  pthread_join(server_thread, NULL);
+
+  qsort(samples, kSamples, sizeof(double), CompareDoubles);
+  ReportRow(&report, "round trip");
+  ReportMetric(&report, "p50_us", Percentile(50));
+  ReportMetric(&report, "p99_us", Percentile(99));
+  ReportMetric(&report, "p999_us", Percentile(99.9));
+  ReportMetric(&report, "max_us", samples[kSamples - 1]);
+  ReportEnd(&report);
+
+  ResponseDestroy(&response);
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  AddressDestroy(&addr);
+  ReportDestroy(&report);
+}
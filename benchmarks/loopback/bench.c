@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "client/client.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "report.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kTestPacket[] = "hello world!";
+const int kPort = 40612;
+const int kTimeoutTime = 1000;
+const int kPackets = 200000;
+#define kBurst 32
+
+Address addr;
+Server srv;
+Client clt;
+Response response;
+Response received[kBurst];
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Bursts stay well within the socket buffer, so no packet is dropped. The
+// server echoes every burst back, the client side isn't measured.
+void Run(const char* name, int batch) {
+  double receive = 0;
+  double send = 0;
+  for (int packet = 0; packet < kPackets; packet += kBurst) {
+    for (int i = 0; i < kBurst; ++i) {
+      Panic(ClientSend(&clt, &response));
+    }
+    double start = Now();
+    int got = 0;
+    while (got < kBurst) {
+      if (batch) {
+        size_t count;
+        Panic(ServerReceiveBatch(&srv, &received[got], kBurst - got, &count));
+        got += (int)count;
+      } else {
+        Panic(ServerReceive(&srv, &received[got]));
+        ++got;
+      }
+    }
+    double echo = Now();
+    for (int i = 0; i < kBurst; ++i) {
+      Panic(ServerSendTo(&srv, &received[i]));
+    }
+    send += Now() - echo;
+    receive += echo - start;
+    for (int i = 0; i < kBurst; ++i) {
+      Panic(ClientReceive(&clt, &received[0]));
+    }
+  }
+  ReportRow(&report, "%s %s", name,
+            SocketGetBackend(&srv.socket) == SOCKET_BACKEND_IO_URING
+                ? "io_uring"
+                : "syscall");
+  ReportMetric(&report, "receive_ns", receive / kPackets);
+  ReportMetric(&report, "send_ns", send / kPackets);
+  ReportMetric(&report, "packets_per_s", 2 * kPackets / (send + receive) * 1e9);
+  ReportEnd(&report);
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "loopback", argc, argv);
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientSetTimeout(&clt, kTimeoutTime));
+  Panic(ResponseInit(&response));
+  for (int i = 0; i < kBurst; ++i) {
+    Panic(ResponseInit(&received[i]));
+  }
+  ResponseSetData(&response, kTestPacket);
+  // Only the server switches backends, the client stays the same.
+  SocketBackend backends[] = {SOCKET_BACKEND_SYSCALL, SOCKET_BACKEND_IO_URING};
+  for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+    if (ServerSetBackend(&srv, backends[i]) != SUCCESS) {
+      continue;
+    }
+    Run("ServerReceive", 0);
+    Run("ServerReceiveBatch", 1);
+  }
+  for (int i = 0; i < kBurst; ++i) {
+    ResponseDestroy(&received[i]);
+  }
+  ResponseDestroy(&response);
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  AddressDestroy(&addr);
+  ReportDestroy(&report);
+}
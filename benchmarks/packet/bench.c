@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "networking/packet.h"
+#include "panic.h"
+#include "report.h"
+
+const int kIterations = 2000000;
+
+Response response;
+Response received;
+Data data;
+volatile size_t sink;
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void Run(const char* name, size_t len) {
+  memset(response.data.ptr, 'x', len);
+  response.data.len = len;
+  double start = Now();
+  for (int i = 0; i < kIterations; ++i) {
+    data.len = kDataLength;
+    response.sequence = i;
+    Panic(ResponseToData(&response, &data));
+    sink += data.len;
+  }
+  double encode = Now() - start;
+  start = Now();
+  for (int i = 0; i < kIterations; ++i) {
+    Panic(DataToResponse(&data, &received));
+    sink += received.data.len;
+  }
+  double decode = Now() - start;
+  // The view points into the data, only the header is read.
+  Response view;
+  start = Now();
+  for (int i = 0; i < kIterations; ++i) {
+    Panic(DataToResponseView(&data, &view));
+    sink += view.data.len;
+  }
+  double viewed = Now() - start;
+  ReportRow(&report, "%s %zu bytes", name, len);
+  ReportMetric(&report, "encode_ns", encode / kIterations);
+  ReportMetric(&report, "decode_ns", decode / kIterations);
+  ReportMetric(&report, "view_ns", viewed / kIterations);
+  ReportMetric(&report, "encode_mb_s", len * (kIterations / encode) * 1e3);
+  ReportMetric(&report, "decode_mb_s", len * (kIterations / decode) * 1e3);
+  ReportEnd(&report);
+}
+
+void RunSizes(const char* name) {
+  Run(name, 16);
+  Run(name, 128);
+  Run(name, kMaxPayload);
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "packet", argc, argv);
+  Panic(ResponseInit(&response));
+  Panic(ResponseInit(&received));
+  Panic(DataInit(&data));
+  ResponseSetType(&response, CONNECT);
+  RunSizes("plain");
+  ResponseSetType(&response, RELIABLE);
+  response.flags = PACKET_HAS_ACKS;
+  RunSizes("reliable");
+  ResponseDestroy(&response);
+  ResponseDestroy(&received);
+  DataDestroy(&data);
+  ReportDestroy(&report);
+}
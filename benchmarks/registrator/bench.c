@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "panic.h"
+#include "report.h"
+#include "server/registrator.h"
+
+const int kClientCounts[] = {10, 100, 1000, 10000, 65000};
+const int kOperations = 1000000;
+
+Registrator registrator;
+Address addr;
+ConnectedClient* client;
+volatile double sink;
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void MakeAddress(Address* addr, int number) {
+#ifdef __IPV4__
+  addr->ip = 0x0a000000u + (number >> 8);
+  addr->port = 1024 + (number & 0xff);
+#else
+#error "Unsupported netcode"
+#endif
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "registrator", argc, argv);
+  for (size_t i = 0; i < sizeof(kClientCounts) / sizeof(int); ++i) {
+    int count = kClientCounts[i];
+    Panic(RegistratorInit(&registrator));
+    double start = Now();
+    for (int number = 0; number < count; ++number) {
+      MakeAddress(&addr, number);
+      Panic(RegistratorAddUser(&registrator, &addr, &client));
+    }
+    double add = (Now() - start) / count;
+
+    start = Now();
+    for (int op = 0; op < kOperations; ++op) {
+      MakeAddress(&addr, (int)((op * 2654435761u) % count));
+      Panic(RegistratorGetUserByAddress(&registrator, &addr, &client));
+    }
+    double lookup = (Now() - start) / kOperations;
+
+    start = Now();
+    for (int op = 0; op < kOperations; ++op) {
+      MakeAddress(&addr, (int)((op * 2654435761u) % count));
+      RegistratorRemoveUserByAddress(&registrator, &addr);
+      Panic(RegistratorAddUser(&registrator, &addr, &client));
+    }
+    double churn = (Now() - start) / kOperations;
+
+    // Touches what a broadcast reads from every client.
+    start = Now();
+    int passes = kOperations / count + 1;
+    for (int pass = 0; pass < passes; ++pass) {
+      RegistratorIter iter;
+      Panic(RegistratorIterInit(&registrator, &iter));
+      while (!RegistratorIterStopped(&registrator, &iter)) {
+        ConnectedClient* current =
+            RegistratorIterDereference(&registrator, &iter);
+        sink += current->addr.port + current->pacer.tokens;
+        current->last_send = pass;
+        RegistratorIterNext(&registrator, &iter);
+      }
+      RegistratorIterDestroy(&iter);
+    }
+    double iterate = (Now() - start) / ((double)passes * count);
+
+    start = Now();
+    for (int number = 0; number < count; ++number) {
+      MakeAddress(&addr, number);
+      RegistratorRemoveUserByAddress(&registrator, &addr);
+    }
+    double remove = (Now() - start) / count;
+
+    ReportRow(&report, "%d clients", count);
+    ReportMetric(&report, "add_ns", add);
+    ReportMetric(&report, "lookup_ns", lookup);
+    ReportMetric(&report, "remove_ns", remove);
+    ReportMetric(&report, "churn_ns", churn);
+    ReportMetric(&report, "iterate_ns", iterate);
+    ReportEnd(&report);
+    RegistratorDestroy(&registrator);
+  }
+  ReportDestroy(&report);
+}
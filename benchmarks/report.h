@@ -0,0 +1,179 @@
+#pragma once
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Results of benchmarks are printed as rows of named metrics. The format is
+ * chosen with --format=table|csv|json or the GUDP_BENCH_FORMAT environment
+ * variable, table is the default. JSON is printed one object per line. With
+ * --output=FILE or GUDP_BENCH_OUTPUT rows are appended to the file, so
+ * results of several benchmarks and releases can be collected and compared.
+ */
+
+#define kReportMaxMetrics 16
+#define kReportLabelLength 64
+
+typedef enum {
+  REPORT_TABLE,
+  REPORT_CSV,
+  REPORT_JSON,
+} ReportFormat;
+
+typedef struct {
+  const char* benchmark;
+  ReportFormat format;
+  FILE* out;
+  char label[kReportLabelLength];
+  const char* names[kReportMaxMetrics];
+  double values[kReportMaxMetrics];
+  size_t count;
+  const char* header[kReportMaxMetrics];
+  size_t header_count;
+} Report;
+
+static const char* ReportOption(int argc, char** argv, const char* option,
+                         const char* variable) {
+  size_t len = strlen(option);
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], option, len) == 0 && argv[i][len] == '=') {
+      return argv[i] + len + 1;
+    }
+  }
+  return getenv(variable);
+}
+
+static void ReportInit(Report* report, const char* benchmark, int argc,
+                char** argv) {
+  *report = (Report){.benchmark = benchmark, .out = stdout};
+  const char* format =
+      ReportOption(argc, argv, "--format", "GUDP_BENCH_FORMAT");
+  if (format != NULL && strcmp(format, "csv") == 0) {
+    report->format = REPORT_CSV;
+  } else if (format != NULL && strcmp(format, "json") == 0) {
+    report->format = REPORT_JSON;
+  }
+  const char* output =
+      ReportOption(argc, argv, "--output", "GUDP_BENCH_OUTPUT");
+  if (output != NULL) {
+    report->out = fopen(output, "a");
+    if (report->out == NULL) {
+      fprintf(stderr, "Can't open %s\n", output);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void ReportDestroy(Report* report) {
+  if (report->out != stdout) {
+    fclose(report->out);
+  }
+}
+
+static void ReportRow(Report* report, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(report->label, sizeof(report->label), format, args);
+  va_end(args);
+  report->count = 0;
+}
+
+static void ReportMetric(Report* report, const char* name, double value) {
+  if (report->count == kReportMaxMetrics) {
+    fprintf(stderr, "Too many metrics in %s\n", report->benchmark);
+    exit(EXIT_FAILURE);
+  }
+  report->names[report->count] = name;
+  report->values[report->count++] = value;
+}
+
+// The header is printed again whenever the metrics of rows change.
+static int ReportHeaderChanged(Report* report) {
+  if (report->header_count != report->count) {
+    return 1;
+  }
+  for (size_t i = 0; i < report->count; ++i) {
+    if (strcmp(report->header[i], report->names[i]) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void ReportPrintHeader(Report* report) {
+  if (report->format == REPORT_TABLE) {
+    fprintf(report->out, "%-24s", report->benchmark);
+    for (size_t i = 0; i < report->count; ++i) {
+      fprintf(report->out, " %16s", report->names[i]);
+    }
+  } else {
+    fprintf(report->out, "benchmark,case");
+    for (size_t i = 0; i < report->count; ++i) {
+      fprintf(report->out, ",%s", report->names[i]);
+    }
+  }
+  fprintf(report->out, "\n");
+  memcpy(report->header, report->names, sizeof(report->names));
+  report->header_count = report->count;
+}
+
+// Prints the string as a JSON string, escaping quotes and control characters.
+static void ReportPrintString(FILE* out, const char* str) {
+  fputc('"', out);
+  for (; *str != '\0'; ++str) {
+    unsigned char c = (unsigned char)*str;
+    if (c == '"' || c == '\\') {
+      fprintf(out, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+static void ReportEnd(Report* report) {
+  if (report->format != REPORT_JSON && ReportHeaderChanged(report)) {
+    ReportPrintHeader(report);
+  }
+  switch (report->format) {
+    case REPORT_TABLE: {
+      fprintf(report->out, "%-24s", report->label);
+      for (size_t i = 0; i < report->count; ++i) {
+        fprintf(report->out, " %16.1f", report->values[i]);
+      }
+      break;
+    }
+    case REPORT_CSV: {
+      fprintf(report->out, "%s,%s", report->benchmark, report->label);
+      for (size_t i = 0; i < report->count; ++i) {
+        fprintf(report->out, ",%.3f", report->values[i]);
+      }
+      break;
+    }
+    case REPORT_JSON: {
+      fprintf(report->out, "{\"benchmark\": ");
+      ReportPrintString(report->out, report->benchmark);
+      fprintf(report->out, ", \"case\": ");
+      ReportPrintString(report->out, report->label);
+      for (size_t i = 0; i < report->count; ++i) {
+        fprintf(report->out, ", ");
+        ReportPrintString(report->out, report->names[i]);
+        // JSON has no NaN or infinity.
+        if (isfinite(report->values[i])) {
+          fprintf(report->out, ": %.3f", report->values[i]);
+        } else {
+          fprintf(report->out, ": null");
+        }
+      }
+      fprintf(report->out, "}");
+      break;
+    }
+  }
+  fprintf(report->out, "\n");
+  fflush(report->out);
+}
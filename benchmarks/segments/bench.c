@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "networking/packet.h"
+#include "networking/socket.h"
+#include "panic.h"
+#include "report.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40615;
+const int kTimeoutTime = 1000;
+const int kPackets = 400000;
+// The size of a full fragment on the wire.
+#define kSegmentSize 492
+#define kMaxBurst 64
+
+Address addr;
+Socket sender;
+Socket receiver;
+char storage[kMaxBurst][kSegmentSize];
+char buffers[kMaxBurst][kSegmentSize];
+Data segments[kMaxBurst];
+Data received[kMaxBurst];
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Sends bursts to one address the way fragments of a large message go out,
+// and receives them in batches.
+void Run(int offload, int burst) {
+  Panic(SocketSetOffload(&sender, offload));
+  Panic(SocketSetOffload(&receiver, offload));
+  double send = 0;
+  double receive = 0;
+  for (int packet = 0; packet < kPackets; packet += burst) {
+    double start = Now();
+    Panic(SocketSendSegments(&sender, segments, burst, &addr));
+    double sent = Now();
+    int got = 0;
+    while (got < burst) {
+      for (int i = got; i < burst; ++i) {
+        received[i] = (Data){.ptr = buffers[i], .len = kSegmentSize};
+      }
+      size_t count;
+      Panic(SocketReceiveBatch(&receiver, &received[got], NULL, burst - got,
+                               &count));
+      got += (int)count;
+    }
+    receive += Now() - sent;
+    send += sent - start;
+  }
+  ReportRow(&report, "burst %d %s", burst, offload ? "offload" : "plain");
+  ReportMetric(&report, "send_ns", send / kPackets);
+  ReportMetric(&report, "receive_ns", receive / kPackets);
+  ReportMetric(&report, "packets_per_s", kPackets / (send + receive) * 1e9);
+  ReportEnd(&report);
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "segments", argc, argv);
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(SocketInit(&sender));
+  Panic(SocketInit(&receiver));
+  Panic(SocketBind(&receiver, &addr));
+  Panic(SocketSetTimeout(&receiver, kTimeoutTime));
+  // Both ends use system calls, io_uring receives one datagram per buffer.
+  Panic(SocketSetBackend(&receiver, SOCKET_BACKEND_SYSCALL));
+  for (int i = 0; i < kMaxBurst; ++i) {
+    segments[i] = (Data){.ptr = storage[i], .len = kSegmentSize};
+  }
+  int offloaded = SocketSetOffload(&sender, 1) == SUCCESS;
+  int bursts[] = {8, 32, kMaxBurst};
+  for (size_t i = 0; i < sizeof(bursts) / sizeof(bursts[0]); ++i) {
+    Run(0, bursts[i]);
+    if (offloaded) {
+      Run(1, bursts[i]);
+    }
+  }
+  SocketDestroy(&sender);
+  SocketDestroy(&receiver);
+  AddressDestroy(&addr);
+  ReportDestroy(&report);
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "client/client.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "report.h"
+#include "server/sharded.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kTestPacket[] = "hello world!";
+const int kPort = 40611;
+const size_t kShardCounts[] = {1, 2, 4};
+const int kPackets = 200000;
+const double kSettleTime = 2e8;
+#define kClients 16
+
+Address addr;
+ShardedServer srv;
+Client clients[kClients];
+Response response;
+long received;
+Report report;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void OnPacket(ShardedServer* srv, uint32_t client, Response* response,
+              void* user_data) {
+  (void)srv;
+  (void)client;
+  (void)response;
+  (void)user_data;
+  __atomic_fetch_add(&received, 1, __ATOMIC_RELAXED);
+}
+
+int main(int argc, char** argv) {
+  ReportInit(&report, "sharded", argc, argv);
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ResponseInit(&response));
+  ResponseSetData(&response, kTestPacket);
+  for (size_t i = 0; i < sizeof(kShardCounts) / sizeof(size_t); ++i) {
+    ShardedCallbacks callbacks = {.on_packet = OnPacket};
+    Panic(ShardedServerInit(&srv, &addr, kShardCounts[i], &callbacks, NULL));
+    Panic(ShardedServerStart(&srv));
+    for (int c = 0; c < kClients; ++c) {
+      Panic(ClientInit(&clients[c], &addr));
+    }
+    __atomic_store_n(&received, 0, __ATOMIC_RELAXED);
+
+    double start = Now();
+    for (int packet = 0; packet < kPackets; ++packet) {
+      ClientSend(&clients[packet % kClients], &response);
+    }
+    // Wait until the shards drain their sockets.
+    long last = -1;
+    double last_change = Now();
+    while (Now() - last_change < kSettleTime) {
+      long now = __atomic_load_n(&received, __ATOMIC_RELAXED);
+      if (now != last) {
+        last = now;
+        last_change = Now();
+      }
+      if (now == kPackets) {
+        break;
+      }
+    }
+    double elapsed = (last_change - start) / 1e9;
+    ReportRow(&report, "%zu shards", kShardCounts[i]);
+    ReportMetric(&report, "received", (double)last);
+    ReportMetric(&report, "packets_per_s", last / elapsed);
+    ReportEnd(&report);
+
+    for (int c = 0; c < kClients; ++c) {
+      ClientDestroy(&clients[c]);
+    }
+    ShardedServerDestroy(&srv);
+  }
+  ResponseDestroy(&response);
+  AddressDestroy(&addr);
+  ReportDestroy(&report);
+}
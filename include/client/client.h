@@ -10,7 +10,12 @@
 
 #include <stdint.h>
 
+#include "common/stats.h"
+#include "networking/fragment.h"
 #include "networking/packet.h"
+#include "networking/pool.h"
+#include "networking/reliable.h"
+#include "networking/snapshot.h"
 #include "networking/socket.h"
 
 /**
@@ -21,8 +26,39 @@ typedef struct {
   Socket socket;
   /// The address of the server.
   Address addr;
+  /// The pool of packet buffers.
+  BufferPool pool;
+  /// Reliable-ordered channel to the server.
+  ReliableEndpoint reliable;
+  /// Channel of messages larger than one packet.
+  FragmentChannel fragments;
+  /// Snapshots received from the server.
+  SnapshotChannel snapshots;
+  /// Buffer fragments and their acks are written to.
+  Response scratch;
+  /// Table payloads are compressed with, NULL when compression is off.
+  const HuffmanTable* compression;
+  /// Time the last packet was sent to the server, in milliseconds.
+  uint64_t last_send;
+  /// Time after which the server gets a keepalive in milliseconds, zero to
+  /// send none.
+  uint64_t keepalive;
+  /// Runtime statistics.
+  Stats stats;
+  /// Non-zero when packets are coalesced, see ClientSetCoalescing().
+  int coalescing;
+  /// Packets coalesced into the next datagram to the server.
+  PacketQueue queue;
+  /// Unread part of the received datagram, NULL until the first coalesced
+  /// one.
+  Data held;
+  /// Packets of the held datagram.
+  DatagramIter held_iter;
 } Client;
 
+/// Default time after which the server gets a keepalive, in milliseconds.
+extern const uint64_t kClientKeepAlive;
+
 /**
  * @brief      Initializes the client and connects to the server.
  *
@@ -31,9 +67,11 @@ typedef struct {
  *
  * @return     SUCCESS when initialization is succesiful, or traceback of the
  *             following functions:
+ *             - ResponseInit()
  *             - SocketInit()
  *             - AddressInit()
  *             - SocketConnect()
+ *             - BufferPoolInit()
  *
  * @since      0.0.1
  */
@@ -53,22 +91,64 @@ ClientInit(Client* client, Address* addr);
 void ClientDestroy(Client* client);
 
 /**
- * @brief      Receives the packet from the server.
+ * @brief      Receives the packet from the server. Reliable messages received
+ *             earlier and waiting for delivery are returned first.
  *
  * @param      client    The pointer to the client.
  * @param      response  The pointer to the response.
  *
- * @return     SUCCESS when receive is succesiful, or traceback of the following
- *             functions:
- *             - DataInit()
+ * @return     SUCCESS when receive is succesiful, CLIENT_KICKED when the
+ *             server disconnected the client, RELIABLE_PENDING when the packet
+ *             had nothing to deliver: only acks, a reliable message out of
+ *             order, a fragment of an unfinished message, or a snapshot which
+ *             is stale or whose baseline is lost. Otherwise traceback of the
+ *             following functions:
+ *             - BufferPoolAcquire()
  *             - SocketReceive()
  *             - DataToResponse()
+ *             - ReliableEndpointReceive()
+ *             - FragmentChannelReceive()
+ *             - SnapshotChannelReceive()
  *
  * @since      0.0.1
  */
 RETCODE
 ClientReceive(Client* client, Response* response);
 
+/**
+ * @brief      Receives one response without copying its payload out of the
+ *             receive buffer. The data of the response points into a buffer
+ *             of the client pool, which is lent to the caller until
+ *             ClientReleaseView().
+ *
+ * @param      client    The pointer to the client.
+ * @param      response  The pointer to the response. Its data needn't be
+ *                       initialized, it's replaced.
+ *
+ * @return     Same as ClientReceive(). The buffer is lent only on SUCCESS.
+ *
+ * @since      0.0.1
+ *
+ * @note       Only the first packet of a datagram is viewed in place. Reliable
+ *             messages, snapshots, packets coalesced behind others and
+ *             compressed payloads are written into the lent buffer instead,
+ *             since they don't stay in the receive buffer. The pool mustn't be
+ *             resized while a buffer is lent, see ClientSetPoolSize().
+ */
+RETCODE
+ClientReceiveView(Client* client, Response* response);
+
+/**
+ * @brief      Returns the buffer lent by ClientReceiveView() to the pool.
+ *
+ * @param      client    The pointer to the client.
+ * @param      response  The pointer to the response received by
+ *                       ClientReceiveView(). Its data is cleared.
+ *
+ * @since      0.0.1
+ */
+void ClientReleaseView(Client* client, Response* response);
+
 /**
  * @brief      Sends a message to the server.
  *
@@ -77,7 +157,7 @@ ClientReceive(Client* client, Response* response);
  *
  * @return     SUCCESS when send is succesiful, or traceback of the following
  *             functions:
- *             - DataInit()
+ *             - BufferPoolAcquire()
  *             - ResponseToData()
  *             - SocketSend()
  *
@@ -86,6 +166,91 @@ ClientReceive(Client* client, Response* response);
 RETCODE
 ClientSend(Client* client, Response* response);
 
+/**
+ * @brief      Sends a message to the server through the reliable-ordered
+ *             channel. The type of the response is set to RELIABLE.
+ *
+ * @param      client    The pointer to the client.
+ * @param      response  The pointer to the response.
+ *
+ * @return     SUCCESS when the message is queued, or traceback of
+ *             ReliableEndpointSend().
+ *
+ * @since      0.0.1
+ *
+ * @note       Once queued, the message is resent by ClientUpdate() until the
+ *             server acknowledges it, so a failed send counts as a loss.
+ */
+RETCODE
+ClientSendReliable(Client* client, Response* response);
+
+/**
+ * @brief      Resends reliable messages and fragments whose acks are late,
+ *             acknowledges received snapshots, and sends acks when there was
+ *             no other packet to piggyback them on. Also sends a keepalive
+ *             when nothing was sent for a while, so the server doesn't evict
+ *             the client. Coalesced packets are sent at the end. Should be
+ *             called periodically, e.g. every few milliseconds.
+ *
+ * @param      client  The pointer to the client.
+ *
+ * @return     SUCCESS when all the packets are sent, or traceback of
+ *             SocketSend() for the last failed one.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ClientUpdate(Client* client);
+
+/**
+ * @brief      Starts sending the large message to the server through the
+ *             fragment channel. The server gets a FRAGMENT response with empty
+ *             payload when the whole message is received.
+ *
+ * @param      client  The pointer to the client.
+ * @param[in]  data    The pointer to the message.
+ * @param[in]  len     The size of the message, up to kFragmentMaxSize.
+ *
+ * @return     SUCCESS when the transfer is started, or traceback of
+ *             FragmentChannelSend().
+ *
+ * @since      0.0.1
+ *
+ * @note       The first window of fragments is sent right away, the rest go
+ *             out as acks arrive. Lost fragments are sent again by
+ *             ClientUpdate().
+ */
+RETCODE
+ClientSendLarge(Client* client, const char* data, size_t len);
+
+/**
+ * @brief      Takes the large message received from the server. Should be
+ *             called after a FRAGMENT response is received.
+ *
+ * @param      client  The pointer to the client.
+ * @param      out     The pointer to the data the message is moved to. It must
+ *                     be freed with DataDestroy().
+ *
+ * @return     SUCCESS when the message is taken, or traceback of
+ *             FragmentChannelTake().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ClientTakeLarge(Client* client, Data* out);
+
+/**
+ * @brief      Turns compression of payloads on or off. Payloads which don't
+ *             get smaller are still sent as they are.
+ *
+ * @param      client  The pointer to the client.
+ * @param[in]  table   The pointer to the table the server uses too, or NULL to
+ *                     turn compression off. It must outlive the client.
+ *
+ * @since      0.0.1
+ */
+void ClientSetCompression(Client* client, const HuffmanTable* table);
+
 /**
  * @brief      Sets the timeout for ClientReceive().
  *
@@ -101,3 +266,125 @@ ClientSetTimeout(Client* client, time_t milliseconds);
 
 RETCODE
 ClientMakeNonBlocking(Client* client);
+
+/**
+ * @brief      Switches the socket of the client to the backend. Should be
+ *             called before any traffic.
+ *
+ * @param      client   The pointer to the client.
+ * @param[in]  backend  The backend.
+ *
+ * @return     Traceback of SocketSetBackend() function.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ClientSetBackend(Client* client, SocketBackend backend);
+
+/**
+ * @brief      Turns UDP segmentation offload of the client socket on or off.
+ *             See ServerSetOffload().
+ *
+ * @param      client  The pointer to the client.
+ * @param[in]  enable  Non-zero to turn the offload on.
+ *
+ * @return     Traceback of SocketSetOffload() function.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ClientSetOffload(Client* client, int enable);
+
+/**
+ * @brief      Sends the coalesced packets, see ClientSetCoalescing().
+ *
+ * @param      client  The pointer to the client.
+ *
+ * @return     SUCCESS, or traceback of SocketSend().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ClientFlush(Client* client);
+
+/**
+ * @brief      Turns coalescing of packets on or off. See
+ *             ServerSetCoalescing().
+ *
+ * @param      client  The pointer to the client.
+ * @param[in]  enable  Non-zero to turn coalescing on.
+ *
+ * @return     SUCCESS, or traceback of ClientFlush() when coalescing is turned
+ *             off.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ClientSetCoalescing(Client* client, int enable);
+
+/**
+ * @brief      Sets the time after which the server gets an empty keepalive
+ *             packet from ClientUpdate(). The default is kClientKeepAlive.
+ *
+ * @param      client        The pointer to the client.
+ * @param[in]  milliseconds  The interval, or zero to send no keepalives.
+ *
+ * @since      0.0.1
+ *
+ * @note       It should be shorter than the idle timeout of the server.
+ */
+void ClientSetKeepAlive(Client* client, uint64_t milliseconds);
+
+/**
+ * @brief      Sets the number of packet buffers in the client pool.
+ *
+ * @param      client  The pointer to the client.
+ * @param[in]  size    The number of buffers.
+ *
+ * @return     Traceback of BufferPoolResize() function.
+ *
+ * @since      0.0.1
+ *
+ * @note       Every buffer lent by ClientReceiveView() must be released
+ *             before the call.
+ */
+RETCODE
+ClientSetPoolSize(Client* client, size_t size);
+
+/**
+ * @brief      Gets the largest number of packet buffers the client has used at
+ *             once, to size the pool with ClientSetPoolSize().
+ *
+ * @param      client  The pointer to the client.
+ *
+ * @return     The high-water mark of the client pool.
+ *
+ * @since      0.0.1
+ */
+size_t ClientGetPoolHighWater(Client* client);
+
+/**
+ * @brief      Takes a snapshot of the client statistics. Unlike other client
+ *             functions, it can be called from any thread.
+ *
+ * @param      client  The pointer to the client.
+ * @param      stats   The pointer to the snapshot.
+ *
+ * @since      0.0.1
+ *
+ * @note       The latency histogram holds the time spent inside every call
+ *             which receives, sends or updates, without the time spent
+ *             waiting for a packet to arrive.
+ */
+void ClientGetStats(Client* client, StatsSnapshot* stats);
+
+/**
+ * @brief      Gets the round trip time and loss estimates of the link to the
+ *             server.
+ *
+ * @param      client  The pointer to the client.
+ * @param      link    The pointer to the estimates.
+ *
+ * @since      0.0.1
+ */
+void ClientGetLinkStats(Client* client, StatsLink* link);
@@ -0,0 +1,29 @@
+/**
+ * @file clock.h
+ *
+ * @brief      Contains the monotonic clock timers of the library are driven by.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief      Gets the time of the monotonic clock.
+ *
+ * @return     Milliseconds since some unspecified point in the past.
+ *
+ * @since      0.0.1
+ */
+uint64_t ClockNow();
+
+/**
+ * @brief      Gets the time of the monotonic clock with nanosecond precision.
+ *
+ * @return     Nanoseconds since the same point as ClockNow().
+ *
+ * @since      0.0.1
+ */
+uint64_t ClockNowNs();
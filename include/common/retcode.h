@@ -42,4 +42,50 @@ typedef enum {
   SERVER_CROWDED = 13,
   /// Client received disconnect packet while in action.
   CLIENT_KICKED = 14,
+  /// BufferPoolAcquire() error; All the buffers of the pool are in use.
+  POOL_EXHAUSTED = 15,
+  /// EventLoopInit() error; epoll or timer creation failed.
+  EVENT_LOOP_INIT = 16,
+  /// EventLoopAdd*() error; Registration in epoll failed.
+  EVENT_LOOP_ADD = 17,
+  /// EventLoopRunOnce() error; Waiting for events failed.
+  EVENT_LOOP_WAIT = 18,
+  /// SocketSetReusePort() error; Setting failed.
+  SOCKET_REUSEPORT = 19,
+  /// ShardedServerStart() error; Worker thread creation failed. Also returned
+  /// by ShardedServerInit() when there are no shards.
+  SERVER_SHARD_START = 20,
+  /// ReliableEndpointSend() error; Too many messages wait for acks.
+  RELIABLE_WINDOW_FULL = 21,
+  /// The packet was consumed by the reliable, fragment or snapshot channel and
+  /// there's nothing to deliver until the missing messages arrive.
+  RELIABLE_PENDING = 22,
+  /// The payload doesn't fit into the packet or exceeds kFragmentMaxSize.
+  /// Also returned by BitWriter when its buffer is full.
+  PACKET_TOO_LARGE = 23,
+  /// DataToResponse() error; The received packet is truncated or corrupted.
+  /// Also returned by BitReader when it reads past the end or out of range.
+  PACKET_MALFORMED = 24,
+  /// The previous large message is still being transferred.
+  FRAGMENT_BUSY = 25,
+  /// There's no reassembled large message to take.
+  FRAGMENT_NOT_READY = 26,
+  /// BitWriter error; The value is outside of the range it's written with.
+  BITSTREAM_OUT_OF_RANGE = 27,
+  /// HuffmanTableInit() error; The code lengths don't make a prefix code.
+  HUFFMAN_INVALID_TABLE = 28,
+  /// The bandwidth budget of the client is spent, the packet was held back.
+  SEND_THROTTLED = 29,
+  /// SocketSetBackend() error; The kernel doesn't support io_uring or some of
+  /// the features the backend needs.
+  SOCKET_RING = 30,
+  /// SocketSetOffload() error; The kernel supports neither UDP segmentation
+  /// nor coalescing.
+  SOCKET_OFFLOAD = 31,
+  /// The cell is outside of the interest grid, or the grid is off.
+  INTEREST_OUT_OF_GRID = 32,
+  /// ThreadedServerStart() error; Network thread creation failed.
+  SERVER_THREAD_START = 33,
+  /// EventLoopAddTimer() error; The period of the timer isn't positive.
+  EVENT_LOOP_TIMER_PERIOD = 34,
 } RETCODE;
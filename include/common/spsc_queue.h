@@ -0,0 +1,144 @@
+/**
+ * @file spsc_queue.h
+ *
+ * @brief      Contains the lock-free queue between one producer thread and one
+ *             consumer thread.
+ *
+ *             Slots are fixed-size and live in one array whose length is a
+ *             power of two. The producer owns the tail and the consumer owns
+ *             the head, each of them on its own cache line. Slots are written
+ *             and read in place and published in batches, so the indexes the
+ *             threads share are touched once per batch rather than once per
+ *             slot, and neither side copies or locks anything.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/retcode.h"
+
+/// Size of the padding which keeps the indexes on separate cache lines.
+#define kSpscQueuePadding 64
+
+/**
+ * @brief      The queue.
+ */
+typedef struct {
+  /// The slots.
+  char* slots;
+  /// Distance between two neighbour slots.
+  size_t stride;
+  /// Number of slots minus one.
+  uint32_t mask;
+  char producer_padding[kSpscQueuePadding];
+  /// Position of the next slot to write, changed by the producer only.
+  uint32_t tail;
+  char consumer_padding[kSpscQueuePadding];
+  /// Position of the next slot to read, changed by the consumer only.
+  uint32_t head;
+  char end_padding[kSpscQueuePadding];
+} SpscQueue;
+
+/**
+ * @brief      Initializes the queue.
+ *
+ * @param      queue     The pointer to the queue.
+ * @param[in]  capacity  The number of slots, rounded up to a power of two.
+ * @param[in]  size      The size of a slot in bytes.
+ *
+ * @return     SUCCESS, or NOT_ENOUGH_MEMORY.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+SpscQueueInit(SpscQueue* queue, size_t capacity, size_t size);
+
+/**
+ * @brief      Destroys the queue.
+ *
+ * @param      queue  The pointer to the queue.
+ *
+ * @since      0.0.1
+ *
+ * @note       It's guaranteed SpscQueueDestroy() will work correctly after
+ *             unsuccessful SpscQueueInit().
+ */
+void SpscQueueDestroy(SpscQueue* queue);
+
+/**
+ * @brief      Gets the number of slots the producer can write. Called by the
+ *             producer.
+ *
+ * @param      queue  The pointer to the queue.
+ *
+ * @return     The number of free slots.
+ *
+ * @since      0.0.1
+ */
+size_t SpscQueueWritable(SpscQueue* queue);
+
+/**
+ * @brief      Gets the free slot to write. Called by the producer.
+ *
+ * @param      queue   The pointer to the queue.
+ * @param[in]  offset  The position of the slot after the tail, less than
+ *                     SpscQueueWritable().
+ *
+ * @return     The pointer to the slot.
+ *
+ * @since      0.0.1
+ */
+void* SpscQueueSlotToWrite(SpscQueue* queue, size_t offset);
+
+/**
+ * @brief      Publishes the written slots to the consumer. Called by the
+ *             producer.
+ *
+ * @param      queue  The pointer to the queue.
+ * @param[in]  count  The number of slots from the tail, up to
+ *                    SpscQueueWritable().
+ *
+ * @since      0.0.1
+ */
+void SpscQueuePush(SpscQueue* queue, size_t count);
+
+/**
+ * @brief      Gets the number of slots the consumer can read. Called by the
+ *             consumer.
+ *
+ * @param      queue  The pointer to the queue.
+ *
+ * @return     The number of published slots.
+ *
+ * @since      0.0.1
+ */
+size_t SpscQueueReadable(SpscQueue* queue);
+
+/**
+ * @brief      Gets the published slot to read. Called by the consumer.
+ *
+ * @param      queue   The pointer to the queue.
+ * @param[in]  offset  The position of the slot after the head, less than
+ *                     SpscQueueReadable().
+ *
+ * @return     The pointer to the slot.
+ *
+ * @since      0.0.1
+ */
+void* SpscQueueSlotToRead(SpscQueue* queue, size_t offset);
+
+/**
+ * @brief      Gives the read slots back to the producer. Called by the
+ *             consumer.
+ *
+ * @param      queue  The pointer to the queue.
+ * @param[in]  count  The number of slots from the head, up to
+ *                    SpscQueueReadable().
+ *
+ * @since      0.0.1
+ */
+void SpscQueuePop(SpscQueue* queue, size_t count);
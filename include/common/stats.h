@@ -0,0 +1,219 @@
+/**
+ * @file stats.h
+ *
+ * @brief      Contains runtime statistics of servers and clients.
+ *
+ *             Counters are written by the thread owning the server or client
+ *             only, with relaxed atomic stores which compile to plain stores,
+ *             so the hot path takes no locks. Any other thread can take a
+ *             snapshot with StatsTake() at any time. Every value of the
+ *             snapshot is consistent, though different values may be taken at
+ *             slightly different moments.
+ *
+ *             Time spent inside the library is recorded into a log-linear
+ *             histogram in the spirit of HdrHistogram: values are grouped by
+ *             powers of two, and every group is split into kStatsSubBuckets
+ *             linear buckets, so the relative error of percentiles stays
+ *             under 1 / kStatsSubBuckets at any scale.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "networking/reliable.h"
+
+/// Number of linear buckets in every power of two, a power of two itself.
+#define kStatsSubBuckets 16
+/// Number of buckets, covers latencies up to 2^32 nanoseconds.
+#define kStatsBuckets (29 * kStatsSubBuckets)
+/// Size of the padding keeping counters off cache lines of other data.
+#define kStatsCacheLine 64
+
+/**
+ * @brief      Traffic counters.
+ */
+typedef struct {
+  /// Received packets.
+  uint64_t packets_in;
+  /// Sent packets.
+  uint64_t packets_out;
+  /// Received bytes, as they are on the wire.
+  uint64_t bytes_in;
+  /// Sent bytes, as they are on the wire.
+  uint64_t bytes_out;
+  /// Receives which returned SOCKET_TIMEOUT. For non-blocking sockets, the
+  /// receives which found nothing to read.
+  uint64_t receive_timeouts;
+  /// Packets the socket failed to send.
+  uint64_t send_errors;
+  /// Received packets which couldn't be parsed.
+  uint64_t malformed;
+  /// Clients connected to the server.
+  uint64_t connects;
+  /// Clients disconnected from the server, for a client the times it was
+  /// kicked.
+  uint64_t disconnects;
+} StatsCounters;
+
+/**
+ * @brief      The latency histogram.
+ */
+typedef struct {
+  /// Number of recorded values.
+  uint64_t count;
+  /// Sum of recorded values, in nanoseconds.
+  uint64_t sum;
+  /// The largest recorded value, in nanoseconds.
+  uint64_t max;
+  /// Number of values in every bucket.
+  uint64_t buckets[kStatsBuckets];
+} StatsHistogram;
+
+/**
+ * @brief      A snapshot of statistics.
+ */
+typedef struct {
+  /// Traffic counters.
+  StatsCounters counters;
+  /// Time spent inside the library by every call.
+  StatsHistogram latency;
+} StatsSnapshot;
+
+/**
+ * @brief      Live statistics, written by the owning thread.
+ */
+typedef struct {
+  /// Keeps the counters off the cache line of the preceding data.
+  char head[kStatsCacheLine];
+  /// Traffic counters.
+  StatsCounters counters;
+  /// Time spent inside the library by every call.
+  StatsHistogram latency;
+  /// Keeps the histogram off the cache line of the following data.
+  char tail[kStatsCacheLine];
+} Stats;
+
+/**
+ * @brief      Measures the time of one call, see StatsScopeBegin().
+ */
+typedef struct {
+  /// The statistics the time is recorded into.
+  Stats* stats;
+  /// Time the call started, in nanoseconds.
+  uint64_t start;
+} StatsScope;
+
+/**
+ * @brief      Estimates of the link to one peer.
+ */
+typedef struct {
+  /// Smoothed round trip time, in milliseconds.
+  double rtt;
+  /// Round trip time variation, in milliseconds.
+  double rtt_variance;
+  /// Share of reliable messages which had to be resent, from 0 to 1.
+  double loss;
+  /// Bandwidth budget in bytes per second, see ServerGetBandwidth(). Zero on
+  /// the client side, which doesn't pace its sends.
+  uint64_t bandwidth;
+} StatsLink;
+
+/**
+ * @brief      Resets all statistics to zero.
+ *
+ * @param      stats  The pointer to the statistics.
+ *
+ * @since      0.0.1
+ */
+void StatsInit(Stats* stats);
+
+/**
+ * @brief      Adds the value to the counter. Must be called by the owning
+ *             thread only.
+ *
+ * @param      counter  The pointer to the counter.
+ * @param[in]  value    The value.
+ *
+ * @since      0.0.1
+ */
+void StatsAdd(uint64_t* counter, uint64_t value);
+
+/**
+ * @brief      Records the latency. Must be called by the owning thread only.
+ *
+ * @param      stats        The pointer to the statistics.
+ * @param[in]  nanoseconds  The latency.
+ *
+ * @since      0.0.1
+ */
+void StatsRecord(Stats* stats, uint64_t nanoseconds);
+
+/**
+ * @brief      Starts measuring the time of a call. Declared with
+ *             RAII(StatsScopeEnd), the time is recorded whichever way the call
+ *             returns.
+ *
+ * @param      stats  The pointer to the statistics.
+ *
+ * @return     The scope.
+ *
+ * @since      0.0.1
+ */
+StatsScope StatsScopeBegin(Stats* stats);
+
+/**
+ * @brief      Records the time passed since StatsScopeBegin().
+ *
+ * @param      scope  The pointer to the scope.
+ *
+ * @since      0.0.1
+ */
+void StatsScopeEnd(StatsScope* scope);
+
+/**
+ * @brief      Takes a snapshot of the statistics. Can be called from any
+ *             thread.
+ *
+ * @param      stats     The pointer to the statistics.
+ * @param      snapshot  The pointer to the snapshot.
+ *
+ * @since      0.0.1
+ */
+void StatsTake(Stats* stats, StatsSnapshot* snapshot);
+
+/**
+ * @brief      Adds the other snapshot to the snapshot.
+ *
+ * @param      snapshot  The pointer to the snapshot.
+ * @param      other     The pointer to the other snapshot.
+ *
+ * @since      0.0.1
+ */
+void StatsMerge(StatsSnapshot* snapshot, const StatsSnapshot* other);
+
+/**
+ * @brief      Gets the percentile of the histogram.
+ *
+ * @param      histogram  The pointer to the histogram.
+ * @param[in]  percent    The percentile, from 0 to 100.
+ *
+ * @return     The largest value of the bucket the percentile falls into, in
+ *             nanoseconds, or zero when nothing is recorded.
+ *
+ * @since      0.0.1
+ */
+uint64_t StatsPercentile(const StatsHistogram* histogram, double percent);
+
+/**
+ * @brief      Fills the round trip time and loss estimates of the link from
+ *             the reliable channel. The bandwidth is left untouched.
+ *
+ * @param      link      The pointer to the link estimates.
+ * @param      endpoint  The pointer to the reliable channel.
+ *
+ * @since      0.0.1
+ */
+void StatsLinkFill(StatsLink* link, ReliableEndpoint* endpoint);
@@ -0,0 +1,115 @@
+/**
+ * @file timer_wheel.h
+ *
+ * @brief      Contains the hierarchical timer wheel.
+ *
+ *             Timers are kept in kTimerWheelLevels wheels of kTimerWheelSlots
+ *             slots each. The first wheel has one slot per millisecond, every
+ *             next one has slots kTimerWheelSlots times wider. Timers far in
+ *             the future wait in the outer wheels and move inwards as the time
+ *             comes closer, so scheduling and cancelling take O(1), and
+ *             advancing the time costs the number of expired timers plus the
+ *             number of passed milliseconds, regardless of the number of
+ *             scheduled timers.
+ *
+ *             Nodes are embedded into the structures they time, so the wheel
+ *             never allocates memory.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Number of wheels.
+#define kTimerWheelLevels 4
+/// Number of slots in every wheel, a power of two.
+#define kTimerWheelSlots 64
+
+/**
+ * @brief      The timer scheduled on the wheel.
+ */
+typedef struct gudp_timer_node_t TimerNode;
+
+struct gudp_timer_node_t {
+  /// The next timer in the same slot.
+  TimerNode* next;
+  /// The pointer which points to this timer, NULL when it isn't scheduled.
+  TimerNode** link;
+  /// Time the timer expires at, in milliseconds.
+  uint64_t expires;
+};
+
+/**
+ * @brief      The hierarchical timer wheel.
+ */
+typedef struct {
+  /// Lists of timers in every slot of every wheel.
+  TimerNode* slots[kTimerWheelLevels][kTimerWheelSlots];
+  /// Expired timers which aren't taken yet.
+  TimerNode* expired;
+  /// Time the wheel is advanced to, in milliseconds.
+  uint64_t now;
+  /// Number of scheduled timers, including expired ones.
+  size_t count;
+} TimerWheel;
+
+/**
+ * @brief      Initializes the wheel.
+ *
+ * @param      wheel  The pointer to the wheel.
+ * @param[in]  now    The current time, in milliseconds.
+ *
+ * @since      0.0.1
+ */
+void TimerWheelInit(TimerWheel* wheel, uint64_t now);
+
+/**
+ * @brief      Initializes the timer as not scheduled.
+ *
+ * @param      node  The pointer to the timer.
+ *
+ * @since      0.0.1
+ */
+void TimerNodeInit(TimerNode* node);
+
+/**
+ * @brief      Schedules the timer, moving it if it's already scheduled.
+ *
+ * @param      wheel    The pointer to the wheel.
+ * @param      node     The pointer to the timer.
+ * @param[in]  expires  Time the timer expires at, in milliseconds.
+ *
+ * @since      0.0.1
+ *
+ * @note       Timers further than the span of all the wheels expire early,
+ *             at the end of the span, and should be scheduled again.
+ */
+void TimerWheelSchedule(TimerWheel* wheel, TimerNode* node, uint64_t expires);
+
+/**
+ * @brief      Cancels the timer. Does nothing if it isn't scheduled.
+ *
+ * @param      wheel  The pointer to the wheel.
+ * @param      node   The pointer to the timer.
+ *
+ * @since      0.0.1
+ */
+void TimerWheelCancel(TimerWheel* wheel, TimerNode* node);
+
+/**
+ * @brief      Advances the wheel up to the time and takes the next expired
+ *             timer. The taken timer is no longer scheduled.
+ *
+ * @param      wheel  The pointer to the wheel.
+ * @param[in]  now    The current time, in milliseconds.
+ * @param      node   The pointer to the expired timer.
+ *
+ * @return     Non-zero when an expired timer is taken, zero when there are no
+ *             more of them.
+ *
+ * @since      0.0.1
+ */
+int TimerWheelNextExpired(TimerWheel* wheel, uint64_t now, TimerNode** node);
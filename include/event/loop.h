@@ -0,0 +1,260 @@
+/**
+ * @file loop.h
+ *
+ * @brief      Contains the event loop which watches Server and Client sockets
+ *             and timers, and dispatches their events to callbacks. The caller
+ *             sleeps in the kernel until some work arrives instead of polling
+ *             with timeouts.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "client/client.h"
+#include "common/retcode.h"
+#include "networking/packet.h"
+#include "server/server.h"
+
+/**
+ * @brief      The structure representing event loop.
+ */
+typedef struct gudp_event_loop_t EventLoop;
+
+/**
+ * @brief      Callbacks for events of a server.
+ */
+typedef struct {
+  /// Called for every received response. May be NULL.
+  void (*on_packet)(Server* srv, Response* response, void* user_data);
+  /// Called when a new client connects. May be NULL.
+  void (*on_connect)(Server* srv, uint16_t client_id, void* user_data);
+  /// Called when a client disconnects. May be NULL.
+  void (*on_disconnect)(Server* srv, uint16_t client_id, void* user_data);
+} ServerCallbacks;
+
+/**
+ * @brief      Callbacks for events of a client.
+ */
+typedef struct {
+  /// Called for every received response. May be NULL.
+  void (*on_packet)(Client* client, Response* response, void* user_data);
+  /// Called when the server kicks the client. May be NULL.
+  void (*on_disconnect)(Client* client, void* user_data);
+} ClientCallbacks;
+
+/**
+ * @brief      Callback of a periodic timer.
+ */
+typedef void (*TimerCallback)(EventLoop* loop, void* user_data);
+
+/**
+ * @brief      A list of event source kinds.
+ */
+typedef enum {
+  /// Server socket.
+  SERVER_SOURCE,
+  /// Client socket.
+  CLIENT_SOURCE,
+  /// Periodic timer.
+  TIMER_SOURCE,
+} EventSourceKind;
+
+/**
+ * @brief      The source of events watched by the loop.
+ */
+typedef struct gudp_event_source_t EventSource;
+
+#ifdef __LINUX__
+struct gudp_event_source_t {
+  /// The watched file descriptor.
+  int fd;
+  /// The kind of the source.
+  EventSourceKind kind;
+  /// The watched server, client or NULL for timers.
+  void* target;
+  /// The callbacks for servers.
+  ServerCallbacks server_callbacks;
+  /// The callbacks for clients.
+  ClientCallbacks client_callbacks;
+  /// The callback for timers.
+  TimerCallback timer_callback;
+  /// The pointer passed to callbacks.
+  void* user_data;
+  /// Non-zero when the source is removed but not freed yet.
+  int removed;
+};
+
+struct gudp_event_loop_t {
+  /// The epoll instance.
+  int epoll_fd;
+  /// Array of pointers to watched sources.
+  EventSource** sources;
+  /// Number of watched sources.
+  size_t sources_count;
+  /// Capacity of the sources array.
+  size_t sources_capacity;
+  /// Responses received packets are dispatched in.
+  Response* responses;
+  /// Non-zero while EventLoopRun() should keep going.
+  int running;
+};
+#else
+#error "Unsupported platform"
+#endif
+
+/**
+ * @brief      Initializes the event loop.
+ *
+ * @param      loop  The pointer to the loop.
+ *
+ * @return     SUCCESS when initialization is succesiful, NOT_ENOUGH_MEMORY or
+ *             EVENT_LOOP_INIT when error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+EventLoopInit(EventLoop* loop);
+
+/**
+ * @brief      Destroys the event loop. Watched servers and clients aren't
+ *             destroyed.
+ *
+ * @param      loop  The pointer to the loop.
+ *
+ * @since      0.0.1
+ *
+ * @note       It's guaranteed EventLoopDestroy() will work correctly after
+ *             unsuccessful EventLoopInit().
+ */
+void EventLoopDestroy(EventLoop* loop);
+
+/**
+ * @brief      Starts watching the server. The server is made non-blocking and
+ *             its listener is replaced by the loop.
+ *
+ * @param      loop       The pointer to the loop.
+ * @param      srv        The pointer to the server.
+ * @param      callbacks  The pointer to the callbacks.
+ * @param      user_data  The pointer passed to callbacks.
+ *
+ * @return     SUCCESS when the server is added, NOT_ENOUGH_MEMORY,
+ *             EVENT_LOOP_ADD or traceback of ServerMakeNonBlocking().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+EventLoopAddServer(EventLoop* loop, Server* srv, ServerCallbacks* callbacks,
+                   void* user_data);
+
+/**
+ * @brief      Starts watching the client. The client is made non-blocking.
+ *
+ * @param      loop       The pointer to the loop.
+ * @param      client     The pointer to the client.
+ * @param      callbacks  The pointer to the callbacks.
+ * @param      user_data  The pointer passed to callbacks.
+ *
+ * @return     SUCCESS when the client is added, NOT_ENOUGH_MEMORY,
+ *             EVENT_LOOP_ADD or traceback of ClientMakeNonBlocking().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+EventLoopAddClient(EventLoop* loop, Client* client, ClientCallbacks* callbacks,
+                   void* user_data);
+
+/**
+ * @brief      Adds the periodic timer.
+ *
+ * @param      loop          The pointer to the loop.
+ * @param[in]  milliseconds  The period of the timer, should be positive.
+ * @param[in]  callback      The callback to call.
+ * @param      user_data     The pointer passed to callback.
+ * @param      timer         The pointer the handle of the timer is written
+ *                           to. May be NULL.
+ *
+ * @return     SUCCESS when the timer is added, EVENT_LOOP_TIMER_PERIOD when
+ *             the period isn't positive, NOT_ENOUGH_MEMORY, EVENT_LOOP_INIT or
+ *             EVENT_LOOP_ADD when error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+EventLoopAddTimer(EventLoop* loop, time_t milliseconds, TimerCallback callback,
+                  void* user_data, EventSource** timer);
+
+/**
+ * @brief      Stops watching the server.
+ *
+ * @param      loop  The pointer to the loop.
+ * @param      srv   The pointer to the server.
+ *
+ * @since      0.0.1
+ */
+void EventLoopRemoveServer(EventLoop* loop, Server* srv);
+
+/**
+ * @brief      Stops watching the client.
+ *
+ * @param      loop    The pointer to the loop.
+ * @param      client  The pointer to the client.
+ *
+ * @since      0.0.1
+ */
+void EventLoopRemoveClient(EventLoop* loop, Client* client);
+
+/**
+ * @brief      Stops and closes the timer.
+ *
+ * @param      loop   The pointer to the loop.
+ * @param      timer  The handle returned by EventLoopAddTimer().
+ *
+ * @since      0.0.1
+ *
+ * @note       The handle is invalid after the call. Can be called from
+ *             callbacks, including the callback of the timer itself.
+ */
+void EventLoopRemoveTimer(EventLoop* loop, EventSource* timer);
+
+/**
+ * @brief      Waits for events once and dispatches all of them.
+ *
+ * @param      loop          The pointer to the loop.
+ * @param[in]  milliseconds  The maximum time to wait, or -1 to wait until
+ *                           some event arrives.
+ *
+ * @return     SUCCESS when events are dispatched or time is out, and
+ *             EVENT_LOOP_WAIT when error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+EventLoopRunOnce(EventLoop* loop, time_t milliseconds);
+
+/**
+ * @brief      Dispatches events until EventLoopStop() is called.
+ *
+ * @param      loop  The pointer to the loop.
+ *
+ * @return     SUCCESS after EventLoopStop(), or traceback of
+ *             EventLoopRunOnce().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+EventLoopRun(EventLoop* loop);
+
+/**
+ * @brief      Makes EventLoopRun() return after the current iteration. Can be
+ *             called from callbacks.
+ *
+ * @param      loop  The pointer to the loop.
+ *
+ * @since      0.0.1
+ */
+void EventLoopStop(EventLoop* loop);
@@ -0,0 +1,319 @@
+/**
+ * @file bitstream.h
+ *
+ * @brief      Contains the bit-packed serialization stream used for packet
+ *             headers and available for payloads.
+ *
+ *             Values are written with the minimum number of bits their range
+ *             needs, least significant bit first, so the wire format doesn't
+ *             depend on the byte order or padding of the host. Every write and
+ *             read is bounds checked: the writer never writes past its buffer
+ *             and the reader never reads past the received data.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/retcode.h"
+
+/**
+ * @brief      The writer of a bitstream.
+ */
+typedef struct {
+  /// The buffer bytes are written to.
+  char* buffer;
+  /// Size of the buffer.
+  size_t capacity;
+  /// Number of bytes written to the buffer.
+  size_t bytes;
+  /// Bits which aren't written to the buffer yet.
+  uint64_t scratch;
+  /// Number of bits in scratch.
+  unsigned scratch_bits;
+} BitWriter;
+
+/**
+ * @brief      The reader of a bitstream.
+ */
+typedef struct {
+  /// The buffer bytes are read from.
+  const char* buffer;
+  /// Size of the buffer.
+  size_t len;
+  /// Number of bytes loaded from the buffer.
+  size_t bytes;
+  /// Loaded bits which aren't read yet.
+  uint64_t scratch;
+  /// Number of bits in scratch.
+  unsigned scratch_bits;
+} BitReader;
+
+/**
+ * @brief      Gets the number of bits needed to write any value from zero to
+ *             the given one.
+ *
+ * @param[in]  value  The largest value.
+ *
+ * @return     The number of bits, zero for zero.
+ *
+ * @since      0.0.1
+ */
+unsigned BitsRequired(uint32_t value);
+
+/**
+ * @brief      Initializes the writer.
+ *
+ * @param      writer    The pointer to the writer.
+ * @param      buffer    The buffer to write to.
+ * @param[in]  capacity  The size of the buffer.
+ *
+ * @since      0.0.1
+ */
+void BitWriterInit(BitWriter* writer, char* buffer, size_t capacity);
+
+/**
+ * @brief      Writes the lowest bits of the value.
+ *
+ * @param      writer  The pointer to the writer.
+ * @param[in]  value   The value.
+ * @param[in]  bits    The number of bits, up to 32.
+ *
+ * @return     SUCCESS when the bits are written, and PACKET_TOO_LARGE when the
+ *             buffer is full.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitWriterWriteBits(BitWriter* writer, uint32_t value, unsigned bits);
+
+/**
+ * @brief      Writes the boolean as one bit.
+ *
+ * @param      writer  The pointer to the writer.
+ * @param[in]  value   The value, any non-zero one is written as 1.
+ *
+ * @return     Traceback of BitWriterWriteBits().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitWriterWriteBool(BitWriter* writer, int value);
+
+/**
+ * @brief      Writes the integer from the range with BitsRequired(max - min)
+ *             bits.
+ *
+ * @param      writer  The pointer to the writer.
+ * @param[in]  value   The value.
+ * @param[in]  min     The smallest possible value.
+ * @param[in]  max     The largest possible value.
+ *
+ * @return     SUCCESS when the value is written, BITSTREAM_OUT_OF_RANGE when
+ *             it's outside of the range, or traceback of
+ *             BitWriterWriteBits().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitWriterWriteInt(BitWriter* writer, int32_t value, int32_t min, int32_t max);
+
+/**
+ * @brief      Writes the unsigned integer with 8 bits per each 7 bits of its
+ *             value, so small values take less space.
+ *
+ * @param      writer  The pointer to the writer.
+ * @param[in]  value   The value.
+ *
+ * @return     Traceback of BitWriterWriteBits().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitWriterWriteVarint(BitWriter* writer, uint64_t value);
+
+/**
+ * @brief      Writes the float quantized to the resolution within the range.
+ *
+ * @param      writer      The pointer to the writer.
+ * @param[in]  value       The value.
+ * @param[in]  min         The smallest possible value.
+ * @param[in]  max         The largest possible value.
+ * @param[in]  resolution  The largest error allowed after reading.
+ *
+ * @return     SUCCESS when the value is written, BITSTREAM_OUT_OF_RANGE when
+ *             it's outside of the range or the range has more than 2^32
+ *             steps, or traceback of BitWriterWriteBits().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitWriterWriteFloat(BitWriter* writer, float value, float min, float max,
+                    float resolution);
+
+/**
+ * @brief      Pads the stream with zero bits to the byte boundary.
+ *
+ * @param      writer  The pointer to the writer.
+ *
+ * @return     Traceback of BitWriterWriteBits().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitWriterAlign(BitWriter* writer);
+
+/**
+ * @brief      Aligns the stream and copies the bytes into it.
+ *
+ * @param      writer  The pointer to the writer.
+ * @param[in]  data    The pointer to the bytes.
+ * @param[in]  len     The number of bytes.
+ *
+ * @return     SUCCESS when the bytes are written, and PACKET_TOO_LARGE when
+ *             they don't fit into the buffer.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitWriterWriteBytes(BitWriter* writer, const char* data, size_t len);
+
+/**
+ * @brief      Writes the incomplete byte, if any, into the buffer.
+ *
+ * @param      writer  The pointer to the writer.
+ *
+ * @return     The size of the stream in bytes.
+ *
+ * @since      0.0.1
+ *
+ * @note       The incomplete byte is padded with zero bits, so writing after
+ *             the flush continues from the next byte.
+ */
+size_t BitWriterFlush(BitWriter* writer);
+
+/**
+ * @brief      Initializes the reader.
+ *
+ * @param      reader  The pointer to the reader.
+ * @param[in]  buffer  The buffer to read from.
+ * @param[in]  len     The size of the buffer.
+ *
+ * @since      0.0.1
+ */
+void BitReaderInit(BitReader* reader, const char* buffer, size_t len);
+
+/**
+ * @brief      Reads the bits written with BitWriterWriteBits().
+ *
+ * @param      reader  The pointer to the reader.
+ * @param      value   The pointer to the value.
+ * @param[in]  bits    The number of bits, up to 32.
+ *
+ * @return     SUCCESS when the bits are read, and PACKET_MALFORMED when the
+ *             stream ends.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitReaderReadBits(BitReader* reader, uint32_t* value, unsigned bits);
+
+/**
+ * @brief      Reads the boolean written with BitWriterWriteBool().
+ *
+ * @param      reader  The pointer to the reader.
+ * @param      value   The pointer to the value, set to 0 or 1.
+ *
+ * @return     Traceback of BitReaderReadBits().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitReaderReadBool(BitReader* reader, int* value);
+
+/**
+ * @brief      Reads the integer written with BitWriterWriteInt().
+ *
+ * @param      reader  The pointer to the reader.
+ * @param      value   The pointer to the value.
+ * @param[in]  min     The smallest possible value.
+ * @param[in]  max     The largest possible value.
+ *
+ * @return     SUCCESS when the value is read, PACKET_MALFORMED when it's
+ *             outside of the range, or traceback of BitReaderReadBits().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitReaderReadInt(BitReader* reader, int32_t* value, int32_t min, int32_t max);
+
+/**
+ * @brief      Reads the integer written with BitWriterWriteVarint().
+ *
+ * @param      reader  The pointer to the reader.
+ * @param      value   The pointer to the value.
+ *
+ * @return     SUCCESS when the value is read, PACKET_MALFORMED when it
+ *             doesn't fit into 64 bits, or traceback of BitReaderReadBits().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitReaderReadVarint(BitReader* reader, uint64_t* value);
+
+/**
+ * @brief      Reads the float written with BitWriterWriteFloat() with the same
+ *             range and resolution.
+ *
+ * @param      reader      The pointer to the reader.
+ * @param      value       The pointer to the value.
+ * @param[in]  min         The smallest possible value.
+ * @param[in]  max         The largest possible value.
+ * @param[in]  resolution  The resolution the value was written with.
+ *
+ * @return     SUCCESS when the value is read, PACKET_MALFORMED when it's
+ *             outside of the range, or traceback of BitReaderReadBits().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitReaderReadFloat(BitReader* reader, float* value, float min, float max,
+                   float resolution);
+
+/**
+ * @brief      Skips the padding up to the byte boundary.
+ *
+ * @param      reader  The pointer to the reader.
+ *
+ * @since      0.0.1
+ */
+void BitReaderAlign(BitReader* reader);
+
+/**
+ * @brief      Aligns the stream and copies the bytes from it.
+ *
+ * @param      reader  The pointer to the reader.
+ * @param      data    The pointer to the output buffer.
+ * @param[in]  len     The number of bytes.
+ *
+ * @return     SUCCESS when the bytes are read, and PACKET_MALFORMED when the
+ *             stream is shorter.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BitReaderReadBytes(BitReader* reader, char* data, size_t len);
+
+/**
+ * @brief      Gets the number of whole bytes left after aligning the stream.
+ *
+ * @param      reader  The pointer to the reader.
+ *
+ * @return     The number of bytes.
+ *
+ * @since      0.0.1
+ */
+size_t BitReaderRemaining(BitReader* reader);
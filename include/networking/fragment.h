@@ -0,0 +1,261 @@
+/**
+ * @file fragment.h
+ *
+ * @brief      Contains the fragment channel of one connection, which transfers
+ *             messages larger than one packet.
+ *
+ *             The message is split into fragments, each of them fits into one
+ *             packet together with FragmentHeader. The receiver reassembles
+ *             them into a block allocated once for the whole message and
+ *             tracks received fragments in a bitmap. The receiver regularly
+ *             acknowledges the bitmap, and only fragments missing from it are
+ *             sent again. At most kFragmentWindow fragments are in flight.
+ *
+ *             One message per direction is transferred at a time, the next one
+ *             starts after the previous is fully acknowledged.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/retcode.h"
+#include "networking/packet.h"
+
+/// Maximum size of a message sent through the fragment channel.
+extern const size_t kFragmentMaxSize;
+
+/// Maximum number of unacknowledged fragments.
+extern const uint32_t kFragmentWindow;
+
+/// Size of FragmentHeader on the wire.
+extern const size_t kFragmentHeaderSize;
+
+/**
+ * @brief      The header in front of every fragment payload. It's written
+ *             with BitWriter, so the wire format doesn't depend on the host.
+ */
+typedef struct {
+  /// ID of the message the fragment belongs to.
+  uint32_t message_id;
+  /// Size of the whole message.
+  uint32_t total_len;
+  /// Index of the fragment.
+  uint16_t index;
+  /// Number of fragments in the message.
+  uint16_t count;
+} FragmentHeader;
+
+/**
+ * @brief      The sending side of the fragment channel.
+ */
+typedef struct {
+  /// Copy of the message, NULL when nothing is sent.
+  char* data;
+  /// Size of the message.
+  size_t len;
+  /// ID of the message.
+  uint32_t message_id;
+  /// ID of the next message.
+  uint32_t next_message_id;
+  /// Number of fragments in the message.
+  uint32_t count;
+  /// Bitmap of acknowledged fragments.
+  uint64_t* acked;
+  /// Time every fragment was last sent at, in milliseconds.
+  uint64_t* last_sent;
+  /// Number of acknowledged fragments.
+  uint32_t acked_count;
+  /// All the fragments before it are acknowledged.
+  uint32_t first_unacked;
+  /// The first fragment never sent.
+  uint32_t next_unsent;
+  /// Number of sent fragments which aren't acknowledged.
+  uint32_t in_flight;
+} FragmentSender;
+
+/**
+ * @brief      The receiving side of the fragment channel.
+ */
+typedef struct {
+  /// The block the message is reassembled in.
+  char* block;
+  /// Size of the message.
+  size_t len;
+  /// ID of the message.
+  uint32_t message_id;
+  /// Number of fragments in the message.
+  uint32_t count;
+  /// Bitmap of received fragments.
+  uint64_t* received;
+  /// Number of received fragments.
+  uint32_t received_count;
+  /// All the fragments before it are received.
+  uint32_t base;
+  /// Fragments received since the last ack was sent.
+  uint32_t since_ack;
+  /// Non-zero while the message is reassembled or waits to be taken.
+  uint8_t active;
+  /// Non-zero when the message waits to be taken.
+  uint8_t complete;
+  /// Non-zero after the first message has started.
+  uint8_t seen_any;
+  /// Non-zero when the sender doesn't know about received fragments.
+  uint8_t acks_pending;
+  /// Size of the largest message accepted.
+  size_t limit;
+} FragmentAssembler;
+
+/**
+ * @brief      The fragment channel of one connection.
+ */
+typedef struct {
+  /// The sending side.
+  FragmentSender sender;
+  /// The receiving side.
+  FragmentAssembler assembler;
+} FragmentChannel;
+
+/**
+ * @brief      Initializes the fragment channel. Nothing is allocated until a
+ *             message is transferred. Messages up to kFragmentMaxSize are
+ *             accepted.
+ *
+ * @param      channel  The pointer to the channel.
+ *
+ * @since      0.0.1
+ */
+void FragmentChannelInit(FragmentChannel* channel);
+
+/**
+ * @brief      Destroys the fragment channel.
+ *
+ * @param      channel  The pointer to the channel.
+ *
+ * @since      0.0.1
+ */
+void FragmentChannelDestroy(FragmentChannel* channel);
+
+/**
+ * @brief      Sets the size of the largest message accepted from the peer.
+ *             Fragments of larger messages are refused before anything is
+ *             allocated for them.
+ *
+ * @param      channel  The pointer to the channel.
+ * @param[in]  limit    The size in bytes, 0 refuses every message. Values
+ *                      above kFragmentMaxSize act as kFragmentMaxSize.
+ *
+ * @since      0.0.1
+ */
+void FragmentChannelSetLimit(FragmentChannel* channel, size_t limit);
+
+/**
+ * @brief      Starts sending the message. The message is copied.
+ *
+ * @param      channel  The pointer to the channel.
+ * @param[in]  data     The pointer to the message.
+ * @param[in]  len      The size of the message.
+ *
+ * @return     SUCCESS when the transfer is started, FRAGMENT_BUSY when the
+ *             previous message isn't acknowledged yet, PACKET_TOO_LARGE when
+ *             the message exceeds kFragmentMaxSize, and NOT_ENOUGH_MEMORY when
+ *             error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+FragmentChannelSend(FragmentChannel* channel, const char* data, size_t len);
+
+/**
+ * @brief      Checks whether the message is still being sent.
+ *
+ * @param      channel  The pointer to the channel.
+ *
+ * @return     Non-zero until all the fragments are acknowledged.
+ *
+ * @since      0.0.1
+ */
+int FragmentChannelSending(FragmentChannel* channel);
+
+/**
+ * @brief      Writes the next fragment to send: a fragment whose ack is late,
+ *             or a fragment never sent while the window allows.
+ *
+ * @param      channel   The pointer to the channel.
+ * @param[in]  now       The current time, in milliseconds.
+ * @param[in]  timeout   Milliseconds a fragment waits for an ack before it's
+ *                       sent again.
+ * @param      response  The pointer to the response with kDataLength buffer.
+ *
+ * @return     Non-zero when the fragment is written.
+ *
+ * @since      0.0.1
+ */
+int FragmentChannelNextFragment(FragmentChannel* channel, uint64_t now,
+                                uint64_t timeout, Response* response);
+
+/**
+ * @brief      Handles received FRAGMENT and FRAGMENT_ACK responses.
+ *
+ * @param      channel   The pointer to the channel.
+ * @param      response  The pointer to the response.
+ *
+ * @return     SUCCESS when the fragment completes the message, its payload is
+ *             emptied then and the message can be taken with
+ *             FragmentChannelTake(). RELIABLE_PENDING when there's nothing to
+ *             deliver, PACKET_MALFORMED when the headers are inconsistent,
+ *             PACKET_TOO_LARGE when the message exceeds the limit of
+ *             FragmentChannelSetLimit() and NOT_ENOUGH_MEMORY when error
+ *             occures.
+ *
+ * @since      0.0.1
+ *
+ * @note       Fragments of the next message are dropped until the previous one
+ *             is taken, the sender will send them again.
+ */
+RETCODE
+FragmentChannelReceive(FragmentChannel* channel, Response* response);
+
+/**
+ * @brief      Checks whether the ack should be sent right away instead of
+ *             waiting for the periodic update.
+ *
+ * @param      channel  The pointer to the channel.
+ *
+ * @return     Non-zero when enough fragments are received since the last ack,
+ *             or the message is complete.
+ *
+ * @since      0.0.1
+ */
+int FragmentChannelAckDue(FragmentChannel* channel);
+
+/**
+ * @brief      Writes FRAGMENT_ACK with the bitmap of received fragments if the
+ *             sender doesn't know about some of them.
+ *
+ * @param      channel   The pointer to the channel.
+ * @param      response  The pointer to the response with kDataLength buffer.
+ *
+ * @return     Non-zero when the ack is written.
+ *
+ * @since      0.0.1
+ */
+int FragmentChannelNextAck(FragmentChannel* channel, Response* response);
+
+/**
+ * @brief      Takes the reassembled message. The caller owns it afterwards and
+ *             frees it with DataDestroy().
+ *
+ * @param      channel  The pointer to the channel.
+ * @param      out      The pointer to the data the message is moved to.
+ *
+ * @return     SUCCESS when the message is taken, and FRAGMENT_NOT_READY when
+ *             there's no complete message.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+FragmentChannelTake(FragmentChannel* channel, Data* out);
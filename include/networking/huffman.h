@@ -0,0 +1,132 @@
+/**
+ * @file huffman.h
+ *
+ * @brief      Contains the static Huffman coder used to compress payloads.
+ *
+ *             The table is trained offline with HuffmanTrainer on captured
+ *             traffic and shipped to both peers as its 256 code lengths, which
+ *             is all HuffmanTableInit() needs to rebuild the same canonical
+ *             codes. Codes are at most kHuffmanMaxCodeLength bits long, so
+ *             every symbol is decoded with one lookup into the table.
+ *
+ *             Neither encoding nor decoding allocates memory.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/retcode.h"
+
+/// Maximum length of one code in bits.
+#define kHuffmanMaxCodeLength 12
+
+/**
+ * @brief      Counts of bytes in the captured traffic.
+ */
+typedef struct {
+  /// Number of times every byte occured.
+  uint64_t counts[256];
+} HuffmanTrainer;
+
+/**
+ * @brief      The static Huffman table.
+ */
+typedef struct {
+  /// Code length of every byte, zero when the byte can't be encoded.
+  uint8_t lengths[256];
+  /// Code of every byte, its bits are reversed to be written first.
+  uint16_t codes[256];
+  /// The byte and the code length for every kHuffmanMaxCodeLength bits of
+  /// input, packed as byte << 4 | length.
+  uint16_t decode[1 << kHuffmanMaxCodeLength];
+} HuffmanTable;
+
+/**
+ * @brief      Initializes the trainer.
+ *
+ * @param      trainer  The pointer to the trainer.
+ *
+ * @since      0.0.1
+ */
+void HuffmanTrainerInit(HuffmanTrainer* trainer);
+
+/**
+ * @brief      Counts the bytes of one captured payload.
+ *
+ * @param      trainer  The pointer to the trainer.
+ * @param[in]  data     The pointer to the payload.
+ * @param[in]  len      The size of the payload.
+ *
+ * @since      0.0.1
+ */
+void HuffmanTrainerAdd(HuffmanTrainer* trainer, const char* data, size_t len);
+
+/**
+ * @brief      Builds the table for the counted traffic. Every byte gets a
+ *             code, so any payload can be encoded.
+ *
+ * @param      trainer  The pointer to the trainer.
+ * @param      table    The pointer to the table.
+ *
+ * @since      0.0.1
+ *
+ * @note       The lengths field of the table is what should be saved and
+ *             passed to HuffmanTableInit() on the peers.
+ */
+void HuffmanTrainerBuild(HuffmanTrainer* trainer, HuffmanTable* table);
+
+/**
+ * @brief      Builds the table from the code lengths.
+ *
+ * @param      table    The pointer to the table.
+ * @param[in]  lengths  Code length of every byte, zero when the byte doesn't
+ *                      occur.
+ *
+ * @return     SUCCESS when the table is built, and HUFFMAN_INVALID_TABLE when
+ *             a length exceeds kHuffmanMaxCodeLength or the lengths don't make
+ *             a prefix code.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+HuffmanTableInit(HuffmanTable* table, const uint8_t lengths[256]);
+
+/**
+ * @brief      Encodes the data.
+ *
+ * @param      table     The pointer to the table.
+ * @param[in]  in        The pointer to the data.
+ * @param[in]  len       The size of the data, up to 65535.
+ * @param      out       The pointer to the output buffer.
+ * @param[in]  capacity  The size of the output buffer.
+ *
+ * @return     The size of the encoded data, or zero when it doesn't fit into
+ *             the capacity or contains a byte without code.
+ *
+ * @since      0.0.1
+ */
+size_t HuffmanEncode(const HuffmanTable* table, const char* in, size_t len,
+                     char* out, size_t capacity);
+
+/**
+ * @brief      Decodes the data.
+ *
+ * @param      table     The pointer to the table.
+ * @param[in]  in        The pointer to the encoded data.
+ * @param[in]  len       The size of the encoded data.
+ * @param      out       The pointer to the output buffer.
+ * @param[in]  capacity  The size of the output buffer.
+ * @param      out_len   The pointer to the size of the decoded data.
+ *
+ * @return     SUCCESS when the data is decoded, and PACKET_MALFORMED when it's
+ *             truncated, corrupted, or doesn't fit into the capacity.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+HuffmanDecode(const HuffmanTable* table, const char* in, size_t len, char* out,
+              size_t capacity, size_t* out_len);
@@ -0,0 +1,140 @@
+/**
+ * @file pacer.h
+ *
+ * @brief      Contains the send pacer of one connection.
+ *
+ *             The pacer estimates the bandwidth of the link from the round
+ *             trip time and the losses measured by the reliable channel: the
+ *             estimate grows while acks come back in time, and shrinks when
+ *             messages are lost or the round trip time grows past its minimum,
+ *             which means queues build up somewhere on the path. Sends are
+ *             paced by a token bucket refilled at the estimated rate, limited
+ *             by the configured cap. Until the first sign of congestion the
+ *             cap itself is the budget, so connections whose traffic isn't
+ *             acked aren't paced below it. Pacing is opt-in: without the cap
+ *             the estimate is updated, but nothing is held back.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "networking/reliable.h"
+
+/// Estimated bandwidth of a new connection, in bytes per second.
+extern const uint64_t kPacerInitialRate;
+
+/**
+ * @brief      The send pacer of one connection.
+ */
+typedef struct {
+  /// Estimated bandwidth, in bytes per second.
+  double rate;
+  /// Maximum bandwidth, in bytes per second, zero when sends aren't paced.
+  uint64_t cap;
+  /// Bytes which can be sent right now, negative after a forced send.
+  double tokens;
+  /// Time tokens were last added, in milliseconds.
+  uint64_t last_refill;
+  /// Time the current estimation interval started, in milliseconds.
+  uint64_t interval_start;
+  /// acked_count of the reliable channel when the interval started.
+  uint32_t acked;
+  /// lost_count of the reliable channel when the interval started.
+  uint32_t lost;
+  /// The smallest smoothed round trip time seen, in milliseconds.
+  double min_rtt;
+  /// Non-zero after the estimate was lowered by losses or delay once.
+  uint8_t congested;
+  /// Non-zero after the first refill.
+  uint8_t started;
+} Pacer;
+
+/**
+ * @brief      Initializes the pacer. Sends aren't paced until the cap is set.
+ *
+ * @param      pacer  The pointer to the pacer.
+ *
+ * @since      0.0.1
+ */
+void PacerInit(Pacer* pacer);
+
+/**
+ * @brief      Sets the maximum bandwidth and turns pacing on or off.
+ *
+ * @param      pacer  The pointer to the pacer.
+ * @param[in]  cap    The maximum bandwidth, in bytes per second, or zero to
+ *                    stop pacing. The estimate is still updated then.
+ *
+ * @since      0.0.1
+ */
+void PacerSetCap(Pacer* pacer, uint64_t cap);
+
+/**
+ * @brief      Updates the estimate with the acks and losses the reliable
+ *             channel counted since the last update. The estimate changes at
+ *             most once per round trip time, so it's cheap to call after every
+ *             received packet.
+ *
+ * @param      pacer     The pointer to the pacer.
+ * @param      endpoint  The pointer to the reliable channel of the connection.
+ * @param[in]  now       The current time, in milliseconds.
+ *
+ * @since      0.0.1
+ */
+void PacerObserve(Pacer* pacer, ReliableEndpoint* endpoint, uint64_t now);
+
+/**
+ * @brief      Checks whether a packet can be sent right now.
+ *
+ * @param      pacer  The pointer to the pacer.
+ * @param[in]  now    The current time, in milliseconds.
+ *
+ * @return     Non-zero when PacerConsume() will succeed.
+ *
+ * @since      0.0.1
+ */
+int PacerReady(Pacer* pacer, uint64_t now);
+
+/**
+ * @brief      Takes tokens for the packet about to be sent. A packet is let
+ *             through while any tokens are left, so the bucket may go into
+ *             debt by less than one packet.
+ *
+ * @param      pacer  The pointer to the pacer.
+ * @param[in]  bytes  The size of the packet.
+ * @param[in]  now    The current time, in milliseconds.
+ *
+ * @return     Non-zero when the packet may be sent, zero when it should be
+ *             held back.
+ *
+ * @since      0.0.1
+ */
+int PacerConsume(Pacer* pacer, size_t bytes, uint64_t now);
+
+/**
+ * @brief      Takes tokens for the packet which is sent regardless of the
+ *             budget, e.g. an ack.
+ *
+ * @param      pacer  The pointer to the pacer.
+ * @param[in]  bytes  The size of the packet.
+ * @param[in]  now    The current time, in milliseconds.
+ *
+ * @since      0.0.1
+ */
+void PacerCharge(Pacer* pacer, size_t bytes, uint64_t now);
+
+/**
+ * @brief      Gets the current bandwidth budget.
+ *
+ * @param      pacer  The pointer to the pacer.
+ *
+ * @return     The estimated bandwidth limited by the cap, or the cap while no
+ *             congestion was seen, in bytes per second.
+ *
+ * @since      0.0.1
+ */
+uint64_t PacerBudget(Pacer* pacer);
@@ -8,6 +8,21 @@
  *             They make a valid readable Response from received RAW Data and
  *             compressed Data from Responce respectively.
  *
+ *             The header is bit-packed with BitWriter, see bitstream.h:
+ *             - 4 bits of ResponseType;
+ *             - 4 bits of PacketFlag values;
+ *             - 9 bits of payload length, up to kMaxPayload;
+ *             - 16 bits of sequence number, only for RELIABLE;
+ *             - 16 bits of ack and 32 bits of ack_bits, only with
+ *               PACKET_HAS_ACKS.
+ *
+ *             The payload follows from the next byte, so an unreliable packet
+ *             has 3 bytes of header and the largest header has 11.
+ *
+ *             Since every packet knows its length, several small ones can be
+ *             coalesced into one datagram back to back, see PacketQueue. They
+ *             carry PACKET_COALESCED flag and are unpacked with DatagramIter.
+ *
  * @author     Alexander Stanovoy
  */
 
@@ -17,10 +32,14 @@
 #include <stdint.h>
 
 #include "common/retcode.h"
+#include "networking/huffman.h"
 
 /// Maximum packet size to send.
 const size_t kDataLength;
 
+/// Maximum payload of one packet.
+extern const size_t kMaxPayload;
+
 /**
  * @brief      A pair of the pointer to the array and length of the array.
  */
@@ -39,17 +58,32 @@ typedef enum {
   CONNECT,
   /// Kick/Disconnect packet.
   DISCONNECT,
+  /// Message of the reliable-ordered channel. See reliable.h for details.
+  RELIABLE,
+  /// Acknowledgement without payload, sent when there's no other traffic to
+  /// piggyback acks on.
+  ACK,
+  /// Fragment of a large message. See fragment.h for details.
+  FRAGMENT,
+  /// Bitmap of received fragments of a large message.
+  FRAGMENT_ACK,
+  /// State snapshot encoded against a baseline. See snapshot.h for details.
+  SNAPSHOT,
+  /// Sequence number of the newest received snapshot.
+  SNAPSHOT_ACK,
 } ResponseType;
 
 /**
- * @brief      A GUDP packet header.
+ * @brief      A list of packet header flags.
  */
-typedef struct {
-  /// Type of the packet.
-  ResponseType type;
-  /// Length of the data.
-  uint16_t len;
-} PacketHeader;
+typedef enum {
+  /// The ack and ack_bits fields of the header are valid.
+  PACKET_HAS_ACKS = 1,
+  /// The payload is encoded with the static Huffman table, see huffman.h.
+  PACKET_COMPRESSED = 2,
+  /// More packets may follow this one in the same datagram.
+  PACKET_COALESCED = 4,
+} PacketFlag;
 
 /**
  * @brief      A GUDP response.
@@ -61,8 +95,45 @@ typedef struct {
   uint16_t client_id;
   /// RAW data of packet.
   Data data;
+  /// Sequence number of the reliable message.
+  uint16_t sequence;
+  /// The newest reliable message received from the peer.
+  uint16_t ack;
+  /// Bit N acknowledges the reliable message ack - N - 1.
+  uint32_t ack_bits;
+  /// Combination of PacketFlag values.
+  uint8_t flags;
 } Response;
 
+/**
+ * @brief      A response serialized into the wire format once, so the same
+ *             immutable buffer can be sent to any number of clients.
+ */
+typedef struct {
+  /// Serialized packet.
+  Data data;
+} PreparedPacket;
+
+/**
+ * @brief      Iterator over the packets of a received datagram.
+ */
+typedef struct {
+  /// The part of the datagram which isn't read yet.
+  Data rest;
+  /// Non-zero while another packet may follow.
+  int more;
+} DatagramIter;
+
+/**
+ * @brief      Packets of one connection written back to back, to be sent as a
+ *             single datagram.
+ */
+typedef struct {
+  /// The datagram, its len is the number of written bytes. NULL until the
+  /// first packet.
+  Data data;
+} PacketQueue;
+
 /**
  * @brief      Initializes the data with size kDataLength.
  *
@@ -99,7 +170,8 @@ void DataDestroy(Data* data);
 void DataSet(Data* data, const char* str);
 
 /**
- * @brief      Initializes the response by size kDataLength.
+ * @brief      Initializes the response by size kDataLength. Header fields of
+ *             the reliable channel are cleared.
  *
  * @param      response  The pointer to the response.
  *
@@ -181,22 +253,264 @@ uint16_t ResponseGetClientId(Response* response);
  * @param      in    The pointer to the input Data.
  * @param      out   The pointer to the output Response.
  *
- * @return     SUCCESS.
+ * @return     SUCCESS, or PACKET_MALFORMED when the packet is shorter than its
+ *             header says or the header is invalid.
  *
  * @since      0.0.1
  */
 RETCODE
 DataToResponse(Data* in, Response* out);
 
+/**
+ * @brief      Converts the RAW data to response, decoding the compressed
+ *             payload with the table.
+ *
+ * @param      in     The pointer to the input Data.
+ * @param      out    The pointer to the output Response.
+ * @param[in]  table  The pointer to the table the peer compresses with, or
+ *                    NULL when compression isn't used.
+ *
+ * @return     SUCCESS, or PACKET_MALFORMED when the packet is shorter than its
+ *             header says, the header is invalid, or the payload is compressed
+ *             and can't be decoded with the table.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+DataToResponseCompressed(Data* in, Response* out, const HuffmanTable* table);
+
+/**
+ * @brief      Converts the RAW data to response without copying the payload:
+ *             the data of the output Response points into the input Data.
+ *
+ * @param      in    The pointer to the input Data. It must outlive the use of
+ *                   the output Response.
+ * @param      out   The pointer to the output Response. Its data needn't be
+ *                   initialized.
+ *
+ * @return     Same as DataToResponse(). The output Response is left unchanged
+ *             on error.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+DataToResponseView(Data* in, Response* out);
+
 /**
  * @brief      Converts the response to the RAW data.
  *
  * @param      in    The pointer to the input Response.
  * @param      out   The pointer to the output Data.
  *
- * @return     SUCCESS.
+ * @return     SUCCESS, or PACKET_TOO_LARGE when the packet doesn't fit into
+ *             the output Data.
  *
  * @since      0.0.1
+ *
+ * @note       The len of output Data is its capacity on input and is set to
+ *             the size of the packet. Payloads larger than kMaxPayload are
+ *             sent with the fragment channel, see fragment.h.
  */
 RETCODE
 ResponseToData(Response* in, Data* out);
+
+/**
+ * @brief      Converts the response to the RAW data, compressing the payload
+ *             with the table when it gets smaller. Such packets have
+ *             PACKET_COMPRESSED flag set.
+ *
+ * @param      in     The pointer to the input Response.
+ * @param      out    The pointer to the output Data.
+ * @param[in]  table  The pointer to the table, or NULL to send the payload as
+ *                    it is.
+ *
+ * @return     Same as ResponseToData().
+ *
+ * @since      0.0.1
+ *
+ * @note       The payload is encoded straight into the output Data, nothing
+ *             is allocated.
+ */
+RETCODE
+ResponseToDataCompressed(Response* in, Data* out, const HuffmanTable* table);
+
+/**
+ * @brief      Initializes the prepared packet with size kDataLength.
+ *
+ * @param      packet  The pointer to the prepared packet.
+ *
+ * @return     SUCCESS if initialization is successiful, and NOT_ENOUGH_MEMORY
+ *             when error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+PreparedPacketInit(PreparedPacket* packet);
+
+/**
+ * @brief      Destroys the prepared packet.
+ *
+ * @param      packet  The pointer to the prepared packet.
+ *
+ * @since      0.0.1
+ *
+ * @note       It's guaranteed PreparedPacketDestroy() will work correctly
+ *             after unsuccessful PreparedPacketInit().
+ */
+void PreparedPacketDestroy(PreparedPacket* packet);
+
+/**
+ * @brief      Serializes the response into the prepared packet.
+ *
+ * @param      packet    The pointer to the prepared packet.
+ * @param      response  The pointer to the response.
+ *
+ * @return     Traceback of ResponseToData() function.
+ *
+ * @since      0.0.1
+ *
+ * @note       Acks and channel state are per connection, so the prepared
+ *             packet never carries them: PACKET_HAS_ACKS flag is cleared and
+ *             types other than DISCONNECT are sent as CONNECT.
+ */
+RETCODE
+PreparedPacketSet(PreparedPacket* packet, Response* response);
+
+/**
+ * @brief      Serializes the response into the prepared packet, compressing
+ *             the payload with the table.
+ *
+ * @param      packet    The pointer to the prepared packet.
+ * @param      response  The pointer to the response.
+ * @param[in]  table     The pointer to the table, or NULL.
+ *
+ * @return     Traceback of ResponseToDataCompressed() function.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+PreparedPacketSetCompressed(PreparedPacket* packet, Response* response,
+                            const HuffmanTable* table);
+
+/**
+ * @brief      Starts iterating over the packets of the datagram.
+ *
+ * @param      iter      The pointer to the iterator.
+ * @param      datagram  The pointer to the received datagram. It must outlive
+ *                       the iterator.
+ *
+ * @since      0.0.1
+ */
+void DatagramIterInit(DatagramIter* iter, Data* datagram);
+
+/**
+ * @brief      Checks whether every packet of the datagram is read.
+ *
+ * @param      iter  The pointer to the iterator.
+ *
+ * @return     Non-zero when there are no more packets.
+ *
+ * @since      0.0.1
+ *
+ * @note       A datagram without PACKET_COALESCED flag in its first packet
+ *             holds only that packet, whatever follows it is ignored.
+ */
+int DatagramIterStopped(DatagramIter* iter);
+
+/**
+ * @brief      Reads the next packet of the datagram.
+ *
+ * @param      iter   The pointer to the iterator.
+ * @param      out    The pointer to the output Response.
+ * @param[in]  table  The pointer to the table the peer compresses with, or
+ *                    NULL when compression isn't used.
+ *
+ * @return     Same as DataToResponseCompressed(). On error the iterator
+ *             stops, the rest of the datagram can't be trusted.
+ *
+ * @since      0.0.1
+ *
+ * @note       PACKET_COALESCED flag is cleared in the output Response.
+ */
+RETCODE
+DatagramIterNext(DatagramIter* iter, Response* out, const HuffmanTable* table);
+
+/**
+ * @brief      Reads the next packet of the datagram without copying its
+ *             payload, the data of the output Response points into the
+ *             datagram. A compressed payload is still decoded into the data
+ *             of the output Response.
+ *
+ * @param      iter   The pointer to the iterator.
+ * @param      out    The pointer to the output Response.
+ * @param[in]  table  The pointer to the table the peer compresses with, or
+ *                    NULL when compression isn't used.
+ *
+ * @return     Same as DatagramIterNext().
+ *
+ * @since      0.0.1
+ *
+ * @note       Whether the payload was decoded can be told by comparing the
+ *             data pointer of the output Response before and after the call.
+ */
+RETCODE
+DatagramIterNextView(DatagramIter* iter, Response* out,
+                     const HuffmanTable* table);
+
+/**
+ * @brief      Initializes the empty queue. Memory is allocated by the first
+ *             packet.
+ *
+ * @param      queue  The pointer to the queue.
+ *
+ * @since      0.0.1
+ */
+void PacketQueueInit(PacketQueue* queue);
+
+/**
+ * @brief      Destroys the queue, the queued packets are dropped.
+ *
+ * @param      queue  The pointer to the queue.
+ *
+ * @since      0.0.1
+ */
+void PacketQueueDestroy(PacketQueue* queue);
+
+/**
+ * @brief      Appends the response to the datagram with PACKET_COALESCED flag.
+ *
+ * @param      queue     The pointer to the queue.
+ * @param      response  The pointer to the response.
+ * @param[in]  table     The pointer to the table, or NULL. See
+ *                       ResponseToDataCompressed().
+ *
+ * @return     SUCCESS, NOT_ENOUGH_MEMORY, or PACKET_TOO_LARGE when the packet
+ *             doesn't fit into the rest of the datagram. Then the queue is
+ *             left as it was, and the packet fits once the queue is sent and
+ *             cleared unless its payload exceeds kMaxPayload.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+PacketQueuePush(PacketQueue* queue, Response* response,
+                const HuffmanTable* table);
+
+/**
+ * @brief      Checks whether any packet is queued.
+ *
+ * @param      queue  The pointer to the queue.
+ *
+ * @return     Non-zero when the queue is empty.
+ *
+ * @since      0.0.1
+ */
+int PacketQueueEmpty(PacketQueue* queue);
+
+/**
+ * @brief      Empties the queue once its datagram is sent.
+ *
+ * @param      queue  The pointer to the queue.
+ *
+ * @since      0.0.1
+ */
+void PacketQueueClear(PacketQueue* queue);
@@ -0,0 +1,129 @@
+/**
+ * @file pool.h
+ *
+ * @brief      Contains the fixed-capacity pool of packet buffers. Buffers are
+ *             cut from one cache-line-aligned slab and are acquired and
+ *             released in O(1), so steady-state send and receive don't touch
+ *             the heap.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "common/retcode.h"
+#include "networking/packet.h"
+
+/// The number of buffers in a pool by default.
+extern const size_t kBasePoolSize;
+
+/**
+ * @brief      The pool of packet buffers.
+ */
+typedef struct {
+  /// The slab all buffers are cut from.
+  char* slab;
+  /// Stack of free buffers.
+  char** free_buffers;
+  /// Number of free buffers.
+  size_t free_count;
+  /// Total number of buffers.
+  size_t capacity;
+  /// Distance between two neighbour buffers in the slab.
+  size_t stride;
+  /// Maximum number of buffers ever acquired at once.
+  size_t high_water;
+} BufferPool;
+
+/**
+ * @brief      Initializes the pool of capacity buffers of size kDataLength.
+ *
+ * @param      pool      The pointer to the pool.
+ * @param[in]  capacity  The number of buffers.
+ *
+ * @return     SUCCESS if initialization is successiful, and NOT_ENOUGH_MEMORY
+ *             when error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BufferPoolInit(BufferPool* pool, size_t capacity);
+
+/**
+ * @brief      Destroys the pool.
+ *
+ * @param      pool  The pointer to the pool.
+ *
+ * @since      0.0.1
+ *
+ * @note       It's guaranteed BufferPoolDestroy() will work correctly after
+ *             unsuccessful BufferPoolInit().
+ */
+void BufferPoolDestroy(BufferPool* pool);
+
+/**
+ * @brief      Changes the number of buffers in the pool.
+ *
+ * @param      pool      The pointer to the pool.
+ * @param[in]  capacity  The new number of buffers.
+ *
+ * @return     SUCCESS if resize is successiful, and NOT_ENOUGH_MEMORY when
+ *             error occures. The pool is left unchanged on error.
+ *
+ * @since      0.0.1
+ *
+ * @note       All the buffers must be released before the call.
+ */
+RETCODE
+BufferPoolResize(BufferPool* pool, size_t capacity);
+
+/**
+ * @brief      Takes a free buffer from the pool.
+ *
+ * @param      pool  The pointer to the pool.
+ * @param      data  The pointer to the data to point to the buffer.
+ *
+ * @return     SUCCESS if buffer is taken, and POOL_EXHAUSTED when all the
+ *             buffers are in use.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+BufferPoolAcquire(BufferPool* pool, Data* data);
+
+/**
+ * @brief      Returns the buffer to the pool.
+ *
+ * @param      pool  The pointer to the pool.
+ * @param      data  The pointer to the data taken by BufferPoolAcquire().
+ *
+ * @since      0.0.1
+ */
+void BufferPoolRelease(BufferPool* pool, Data* data);
+
+/**
+ * @brief      Returns the buffer the pointer points into to the pool.
+ *
+ * @param      pool  The pointer to the pool.
+ * @param[in]  ptr   The pointer to any byte of the buffer taken by
+ *                   BufferPoolAcquire().
+ *
+ * @since      0.0.1
+ *
+ * @note       Useful when only a part of the buffer is handed out, e.g. the
+ *             payload of a received packet.
+ */
+void BufferPoolReleaseAt(BufferPool* pool, const char* ptr);
+
+/**
+ * @brief      Gets the maximum number of buffers ever acquired at once.
+ *
+ * @param      pool  The pointer to the pool.
+ *
+ * @return     The high-water mark of the pool.
+ *
+ * @since      0.0.1
+ */
+size_t BufferPoolHighWater(BufferPool* pool);
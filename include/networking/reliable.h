@@ -0,0 +1,227 @@
+/**
+ * @file reliable.h
+ *
+ * @brief      Contains the reliable-ordered channel of one connection.
+ *
+ *             Every RELIABLE message gets a 16-bit sequence number. Every
+ *             packet sent to one peer carries the newest received sequence
+ *             and a 32-bit bitfield acknowledging the 32 messages before it,
+ *             so acks ride along with unreliable traffic for free. Messages
+ *             which aren't acknowledged in time are resent, the timeout is
+ *             derived from the measured round trip time. Received messages
+ *             are delivered in order of their sequence numbers, while
+ *             unreliable packets don't wait for them.
+ *
+ *             At most kReliableWindow messages are in flight, so any message
+ *             still waiting for an ack is always covered by the bitfield.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/retcode.h"
+#include "networking/packet.h"
+
+/// Maximum number of unacknowledged messages.
+extern const uint16_t kReliableWindow;
+
+/**
+ * @brief      A reliable message kept in the send or receive window.
+ */
+typedef struct {
+  /// Payload of the message.
+  Data data;
+  /// Sequence number of the message.
+  uint16_t sequence;
+  /// Non-zero when the slot holds a message.
+  uint8_t used;
+  /// Non-zero when the message was sent more than once.
+  uint8_t resent;
+  /// Non-zero once the message is put on the wire.
+  uint8_t sent;
+  /// Time of the first send, in milliseconds.
+  uint64_t sent_time;
+  /// Time of the last send, in milliseconds.
+  uint64_t last_sent;
+} ReliableEntry;
+
+/**
+ * @brief      The reliable channel of one connection.
+ */
+typedef struct {
+  /// Send window, NULL until the channel is used.
+  ReliableEntry* sent;
+  /// Receive window, NULL until the channel is used.
+  ReliableEntry* received;
+  /// Payloads of both windows.
+  char* slab;
+  /// Sequence number of the next sent message.
+  uint16_t next_sequence;
+  /// The oldest sent message which isn't acknowledged yet.
+  uint16_t oldest_unacked;
+  /// The newest received sequence number.
+  uint16_t remote_sequence;
+  /// Received messages before remote_sequence.
+  uint32_t ack_bits;
+  /// Sequence number of the next message to deliver.
+  uint16_t next_delivery;
+  /// Non-zero after the first reliable message is received.
+  uint8_t received_any;
+  /// Non-zero when there are acks the peer doesn't know about.
+  uint8_t acks_pending;
+  /// Non-zero while the owner keeps the channel in its ready list.
+  uint8_t queued;
+  /// Smoothed round trip time, in milliseconds.
+  double rtt;
+  /// Round trip time variation, in milliseconds.
+  double rtt_variance;
+  /// Number of acknowledged messages, wraps around.
+  uint32_t acked_count;
+  /// Number of messages resent because their acks were late, wraps around.
+  uint32_t lost_count;
+} ReliableEndpoint;
+
+/**
+ * @brief      Initializes the reliable channel. Windows are allocated on first
+ *             use, so idle connections cost only the size of the structure.
+ *
+ * @param      endpoint  The pointer to the channel.
+ *
+ * @since      0.0.1
+ */
+void ReliableEndpointInit(ReliableEndpoint* endpoint);
+
+/**
+ * @brief      Destroys the reliable channel.
+ *
+ * @param      endpoint  The pointer to the channel.
+ *
+ * @since      0.0.1
+ */
+void ReliableEndpointDestroy(ReliableEndpoint* endpoint);
+
+/**
+ * @brief      Resets the reliable channel to the state of a new one. The
+ *             windows stay allocated for the next connection.
+ *
+ * @param      endpoint  The pointer to the channel.
+ *
+ * @since      0.0.1
+ */
+void ReliableEndpointReset(ReliableEndpoint* endpoint);
+
+/**
+ * @brief      Puts the response into the send window, and sets its type to
+ *             RELIABLE and its sequence number.
+ *
+ * @param      endpoint  The pointer to the channel.
+ * @param      response  The pointer to the response.
+ * @param[in]  now       The current time, in milliseconds.
+ *
+ * @return     SUCCESS when the message is queued, RELIABLE_WINDOW_FULL when
+ *             kReliableWindow messages are waiting for acks, PACKET_TOO_LARGE
+ *             when the payload exceeds kMaxPayload, and NOT_ENOUGH_MEMORY when
+ *             error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ReliableEndpointSend(ReliableEndpoint* endpoint, Response* response,
+                     uint64_t now);
+
+/**
+ * @brief      Marks the message as not sent yet, e.g. when the owner held it
+ *             back to stay within the bandwidth budget. The next
+ *             ReliableEndpointNextResend() returns it right away and doesn't
+ *             count it as lost.
+ *
+ * @param      endpoint  The pointer to the channel.
+ * @param[in]  sequence  The sequence number of the message.
+ *
+ * @since      0.0.1
+ */
+void ReliableEndpointDefer(ReliableEndpoint* endpoint, uint16_t sequence);
+
+/**
+ * @brief      Writes acks of the channel into the response about to be sent.
+ *
+ * @param      endpoint  The pointer to the channel.
+ * @param      response  The pointer to the response.
+ *
+ * @since      0.0.1
+ */
+void ReliableEndpointWriteAcks(ReliableEndpoint* endpoint, Response* response);
+
+/**
+ * @brief      Handles the received response: applies its acks, and puts it
+ *             into the receive window if it's a RELIABLE message. The
+ *             PACKET_HAS_ACKS flag of the response is cleared.
+ *
+ * @param      endpoint  The pointer to the channel.
+ * @param      response  The pointer to the response.
+ * @param[in]  now       The current time, in milliseconds.
+ *
+ * @return     SUCCESS when the response is handled, NOT_ENOUGH_MEMORY when
+ *             error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ReliableEndpointReceive(ReliableEndpoint* endpoint, Response* response,
+                        uint64_t now);
+
+/**
+ * @brief      Takes the next message in order from the receive window.
+ *
+ * @param      endpoint  The pointer to the channel.
+ * @param      response  The pointer to the response the message is copied to.
+ *
+ * @return     Non-zero when the message is taken, zero when the next message
+ *             isn't received yet.
+ *
+ * @since      0.0.1
+ */
+int ReliableEndpointPop(ReliableEndpoint* endpoint, Response* response);
+
+/**
+ * @brief      Checks whether the next message in order is received.
+ *
+ * @param      endpoint  The pointer to the channel.
+ *
+ * @return     Non-zero when ReliableEndpointPop() will succeed.
+ *
+ * @since      0.0.1
+ */
+int ReliableEndpointReady(ReliableEndpoint* endpoint);
+
+/**
+ * @brief      Finds the next message whose resend timeout has expired or which
+ *             was deferred, and marks it as sent now.
+ *
+ * @param      endpoint  The pointer to the channel.
+ * @param[in]  now       The current time, in milliseconds.
+ * @param      response  The pointer to the response which is set to view the
+ *                       message. Its data points into the send window and must
+ *                       not be modified.
+ *
+ * @return     Non-zero when a message to resend is found.
+ *
+ * @since      0.0.1
+ */
+int ReliableEndpointNextResend(ReliableEndpoint* endpoint, uint64_t now,
+                               Response* response);
+
+/**
+ * @brief      Gets the resend timeout of the channel.
+ *
+ * @param      endpoint  The pointer to the channel.
+ *
+ * @return     Milliseconds a message waits for an ack before it's resent.
+ *
+ * @since      0.0.1
+ */
+uint64_t ReliableEndpointTimeout(ReliableEndpoint* endpoint);
@@ -0,0 +1,128 @@
+/**
+ * @file ring.h
+ *
+ * @brief      Contains the io_uring backend of sockets.
+ *
+ *             Datagrams are received by one multishot recvmsg request into
+ *             buffers registered with the kernel as a provided buffer ring, so
+ *             a busy socket is read without a system call per packet: the
+ *             completions are taken straight from the completion queue.
+ *             Batches of sends are copied into buffers owned by the ring and
+ *             submitted at once, their completions are reaped before the call
+ *             returns, so failed recipients are known.
+ *
+ *             The ring talks to the kernel with raw system calls and needs
+ *             Linux 6.0 or newer. Its layout depends on the kernel headers, so
+ *             it's kept private.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "common/retcode.h"
+#include "networking/packet.h"
+#include "networking/socket.h"
+
+/**
+ * @brief      Creates the ring serving the socket and starts receiving.
+ *
+ * @param      ring       The pointer to the pointer the ring is saved to.
+ * @param[in]  socket_fd  The descriptor of the socket.
+ *
+ * @return     SUCCESS when the ring is created, NOT_ENOUGH_MEMORY or
+ *             SOCKET_RING when the kernel doesn't support io_uring or some of
+ *             its features.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+SocketRingInit(SocketRing** ring, int socket_fd);
+
+/**
+ * @brief      Destroys the ring. Datagrams received by the ring but not taken
+ *             yet are dropped.
+ *
+ * @param      ring  The pointer to the ring.
+ *
+ * @since      0.0.1
+ */
+void SocketRingDestroy(SocketRing* ring);
+
+/**
+ * @brief      Gets the descriptor which becomes readable when the ring has
+ *             completions, to be watched instead of the socket.
+ *
+ * @param      ring  The pointer to the ring.
+ *
+ * @return     The descriptor of the ring.
+ *
+ * @since      0.0.1
+ */
+int SocketRingFd(SocketRing* ring);
+
+/**
+ * @brief      Sends the same message to every address and waits until the
+ *             sends complete.
+ *
+ * @param      ring          The pointer to the ring.
+ * @param      data          The pointer to the message, it's copied.
+ * @param      addrs         The array of addresses, or NULL to send one
+ *                           message to the address the socket is connected
+ *                           to.
+ * @param[in]  count         The number of addresses, ignored when addrs is
+ *                           NULL.
+ * @param      failed        The array of at least count indexes where indexes
+ *                           of addresses the send failed for are saved, or
+ *                           NULL.
+ * @param      failed_count  The pointer to the number of failed addresses, or
+ *                           NULL.
+ *
+ * @return     SUCCESS when every message is sent, and SOCKET_SEND when some
+ *             of them failed or the kernel refuses the submission.
+ *
+ * @since      0.0.1
+ *
+ * @note       Failed indexes are saved in the order the sends complete. Every
+ *             failed send is also counted by SocketRingSendErrors().
+ */
+RETCODE
+SocketRingSend(SocketRing* ring, Data* data, Address* addrs, size_t count,
+               size_t* failed, size_t* failed_count);
+
+/**
+ * @brief      Receives up to max messages.
+ *
+ * @param      ring     The pointer to the ring.
+ * @param      buffers  The array of max buffers, their lengths are set to the
+ *                      received ones.
+ * @param      addrs    The array of max addresses of senders, or NULL.
+ * @param[in]  max      The number of buffers.
+ * @param      got      The pointer to the number of received messages.
+ * @param[in]  timeout  Milliseconds to wait for the first message, zero to
+ *                      return right away and a negative value to wait forever.
+ *
+ * @return     SUCCESS when at least one message is received, SOCKET_TIMEOUT
+ *             when none arrived in time, and SOCKET_RECEIVE when error
+ *             occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+SocketRingReceive(SocketRing* ring, Data* buffers, Address* addrs, size_t max,
+                  size_t* got, time_t timeout);
+
+/**
+ * @brief      Gets the number of sends which failed since the ring is created.
+ *
+ * @param      ring  The pointer to the ring.
+ *
+ * @return     The number of failed sends.
+ *
+ * @since      0.0.1
+ */
+uint64_t SocketRingSendErrors(SocketRing* ring);
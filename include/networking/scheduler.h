@@ -0,0 +1,181 @@
+/**
+ * @file scheduler.h
+ *
+ * @brief      Contains the priority accumulator of outgoing updates of one
+ *             connection.
+ *
+ *             Every update is put under a key, e.g. the ID of the entity it
+ *             describes, so a newer update of the same key replaces the older
+ *             one. Every tick the priority of each waiting update is added to
+ *             its accumulator, and the updates with the largest accumulators
+ *             which fit the byte budget of the tick are sent; their
+ *             accumulators start over. An update which doesn't fit keeps
+ *             accumulating until it outranks the others, so important updates
+ *             go first and the rest never starve.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/retcode.h"
+#include "networking/packet.h"
+
+/**
+ * @brief      An update waiting to be sent.
+ */
+typedef struct {
+  /// The key of the update.
+  uint32_t key;
+  /// Value added to the accumulator every tick.
+  uint32_t priority;
+  /// The accumulated priority.
+  uint64_t accumulated;
+  /// Size of the payload.
+  uint16_t len;
+  /// Non-zero when the update is sent or removed, its slot is reclaimed by
+  /// the next tick.
+  uint8_t gone;
+} SchedulerItem;
+
+/**
+ * @brief      An update in the order of the tick.
+ */
+typedef struct {
+  /// The accumulated priority of the update.
+  uint64_t accumulated;
+  /// Index of the update.
+  uint32_t index;
+} SchedulerRank;
+
+/**
+ * @brief      The priority accumulator of one connection.
+ */
+typedef struct {
+  /// Dense array of updates.
+  SchedulerItem* items;
+  /// Payloads of the updates, kMaxPayload bytes each.
+  char* payloads;
+  /// Number of slots of updates, including the gone ones.
+  uint32_t count;
+  /// Number of waiting updates.
+  uint32_t pending;
+  /// Capacity of the arrays of updates.
+  uint32_t capacity;
+  /// Index from key to update with linear probing, every slot holds the
+  /// index of the update plus one or zero. Its capacity is a power of two.
+  uint32_t* index;
+  /// Capacity of the index.
+  uint32_t index_capacity;
+  /// Updates of the current tick from the largest accumulator.
+  SchedulerRank* order;
+  /// Number of updates in the order.
+  uint32_t order_count;
+  /// Position in the order SchedulerNext() continues from.
+  uint32_t cursor;
+} Scheduler;
+
+/**
+ * @brief      Initializes the empty scheduler. Memory is allocated by the
+ *             first update.
+ *
+ * @param      scheduler  The pointer to the scheduler.
+ *
+ * @since      0.0.1
+ */
+void SchedulerInit(Scheduler* scheduler);
+
+/**
+ * @brief      Destroys the scheduler.
+ *
+ * @param      scheduler  The pointer to the scheduler.
+ *
+ * @since      0.0.1
+ */
+void SchedulerDestroy(Scheduler* scheduler);
+
+/**
+ * @brief      Removes every update. The arrays stay allocated.
+ *
+ * @param      scheduler  The pointer to the scheduler.
+ *
+ * @since      0.0.1
+ */
+void SchedulerReset(Scheduler* scheduler);
+
+/**
+ * @brief      Puts the update under the key, replacing the waiting update of
+ *             the same key. The accumulator of the key is kept, so an update
+ *             which is replaced often still gets its turn.
+ *
+ * @param      scheduler  The pointer to the scheduler.
+ * @param[in]  key        The key of the update.
+ * @param[in]  priority   The value added to the accumulator every tick.
+ * @param[in]  data       The pointer to the payload.
+ * @param[in]  len        The size of the payload, up to kMaxPayload.
+ *
+ * @return     SUCCESS when the update is put, PACKET_TOO_LARGE, or
+ *             NOT_ENOUGH_MEMORY.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+SchedulerPut(Scheduler* scheduler, uint32_t key, uint32_t priority,
+             const char* data, size_t len);
+
+/**
+ * @brief      Drops the waiting update of the key, if there's one.
+ *
+ * @param      scheduler  The pointer to the scheduler.
+ * @param[in]  key        The key of the update.
+ *
+ * @since      0.0.1
+ */
+void SchedulerRemove(Scheduler* scheduler, uint32_t key);
+
+/**
+ * @brief      Gets the number of waiting updates.
+ *
+ * @param      scheduler  The pointer to the scheduler.
+ *
+ * @return     The number of updates.
+ *
+ * @since      0.0.1
+ */
+size_t SchedulerPending(Scheduler* scheduler);
+
+/**
+ * @brief      Starts a new tick: adds the priorities to the accumulators and
+ *             orders the updates.
+ *
+ * @param      scheduler  The pointer to the scheduler.
+ *
+ * @return     SUCCESS, or NOT_ENOUGH_MEMORY. On error the tick has no updates
+ *             to send.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+SchedulerTick(Scheduler* scheduler);
+
+/**
+ * @brief      Takes the update with the largest accumulator among the ones
+ *             which aren't larger than the budget.
+ *
+ * @param      scheduler  The pointer to the scheduler.
+ * @param[in]  budget     The number of bytes left in the tick.
+ * @param      response   The pointer to the initialized response the payload
+ *                        is copied to.
+ *
+ * @return     Non-zero when an update is taken, zero when none of the rest
+ *             fits.
+ *
+ * @since      0.0.1
+ *
+ * @note       Updates skipped for their size stay for the next tick, smaller
+ *             ones behind them may still fit the budget.
+ */
+int SchedulerNext(Scheduler* scheduler, size_t budget, Response* response);
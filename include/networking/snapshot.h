@@ -0,0 +1,156 @@
+/**
+ * @file snapshot.h
+ *
+ * @brief      Contains the snapshot channel of one connection, which sends
+ *             state snapshots as deltas against a baseline the peer has.
+ *
+ *             The sender keeps the last kSnapshotHistory snapshots. Every new
+ *             snapshot is XORed with the newest one the receiver acknowledged,
+ *             and only the runs of changed bytes are sent. The receiver keeps
+ *             the same history of decoded snapshots and rebuilds the snapshot
+ *             from its copy of the baseline. A snapshot is sent whole while
+ *             there's no acknowledged baseline, or when the delta is larger.
+ *
+ *             Snapshots aren't resent: a lost one is superseded by the next,
+ *             which is encoded against a baseline that did arrive.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/retcode.h"
+#include "networking/packet.h"
+
+/// Number of snapshots kept by both sides.
+extern const uint16_t kSnapshotHistory;
+
+/// Size of SnapshotHeader on the wire.
+extern const size_t kSnapshotHeaderSize;
+
+/**
+ * @brief      The header in front of every snapshot payload. It's written
+ *             with BitWriter, so the wire format doesn't depend on the host.
+ */
+typedef struct {
+  /// Sequence number of the snapshot.
+  uint16_t sequence;
+  /// Sequence number of the baseline, equal to sequence when the snapshot is
+  /// sent whole.
+  uint16_t baseline;
+} SnapshotHeader;
+
+/**
+ * @brief      A snapshot kept in the history.
+ */
+typedef struct {
+  /// Contents of the snapshot.
+  Data data;
+  /// Sequence number of the snapshot.
+  uint16_t sequence;
+  /// Non-zero when the slot holds a snapshot.
+  uint8_t used;
+} SnapshotEntry;
+
+/**
+ * @brief      The snapshot channel of one connection.
+ */
+typedef struct {
+  /// Sent snapshots, NULL until the first one is sent.
+  SnapshotEntry* sent;
+  /// Received snapshots, NULL until the first one is received.
+  SnapshotEntry* received;
+  /// Sequence number of the next sent snapshot.
+  uint16_t next_sequence;
+  /// The newest sent snapshot acknowledged by the peer.
+  uint16_t acked;
+  /// Non-zero after the first ack is received.
+  uint8_t acked_any;
+  /// The newest received snapshot.
+  uint16_t newest;
+  /// Non-zero after the first snapshot is received.
+  uint8_t received_any;
+  /// Non-zero when the peer doesn't know about the newest snapshot.
+  uint8_t ack_pending;
+} SnapshotChannel;
+
+/**
+ * @brief      Initializes the snapshot channel. Histories are allocated on
+ *             first use.
+ *
+ * @param      channel  The pointer to the channel.
+ *
+ * @since      0.0.1
+ */
+void SnapshotChannelInit(SnapshotChannel* channel);
+
+/**
+ * @brief      Destroys the snapshot channel.
+ *
+ * @param      channel  The pointer to the channel.
+ *
+ * @since      0.0.1
+ */
+void SnapshotChannelDestroy(SnapshotChannel* channel);
+
+/**
+ * @brief      Resets the snapshot channel to the state of a new one. The
+ *             histories stay allocated for the next connection.
+ *
+ * @param      channel  The pointer to the channel.
+ *
+ * @since      0.0.1
+ */
+void SnapshotChannelReset(SnapshotChannel* channel);
+
+/**
+ * @brief      Puts the snapshot into the history and encodes it into the
+ *             response against the newest acknowledged baseline. The type of
+ *             the response is set to SNAPSHOT.
+ *
+ * @param      channel   The pointer to the channel.
+ * @param      response  The pointer to the response holding the snapshot. Its
+ *                       payload is replaced with the encoded one.
+ *
+ * @return     SUCCESS when the snapshot is encoded, PACKET_TOO_LARGE when the
+ *             snapshot and SnapshotHeader exceed kMaxPayload, and
+ *             NOT_ENOUGH_MEMORY when error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+SnapshotChannelEncode(SnapshotChannel* channel, Response* response);
+
+/**
+ * @brief      Handles received SNAPSHOT and SNAPSHOT_ACK responses. The
+ *             payload of SNAPSHOT is replaced with the decoded snapshot.
+ *
+ * @param      channel   The pointer to the channel.
+ * @param      response  The pointer to the response.
+ *
+ * @return     SUCCESS when the snapshot is decoded. RELIABLE_PENDING when
+ *             there's nothing to deliver: an ack, a snapshot older than the
+ *             newest one, or a snapshot whose baseline isn't kept anymore.
+ *             PACKET_MALFORMED when the payload is inconsistent, and
+ *             NOT_ENOUGH_MEMORY when error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+SnapshotChannelReceive(SnapshotChannel* channel, Response* response);
+
+/**
+ * @brief      Writes SNAPSHOT_ACK for the newest received snapshot if the
+ *             peer doesn't know about it.
+ *
+ * @param      channel   The pointer to the channel.
+ * @param      response  The pointer to the response with kDataLength buffer.
+ *
+ * @return     Non-zero when the ack is written.
+ *
+ * @since      0.0.1
+ */
+int SnapshotChannelNextAck(SnapshotChannel* channel, Response* response);
@@ -12,6 +12,7 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 #ifdef __LINUX__
 #include <arpa/inet.h>
 #endif
@@ -24,9 +25,46 @@
  */
 typedef struct gudp_socket_t Socket;
 
+/**
+ * @brief      The io_uring the socket works through, see ring.h.
+ */
+typedef struct gudp_socket_ring_t SocketRing;
+
+/**
+ * @brief      Datagrams the kernel coalesced into one buffer with UDP_GRO.
+ *             They are handed out one by one, see SocketSetOffload().
+ */
+typedef struct gudp_socket_coalesced_t SocketCoalesced;
+
+/// Maximum number of datagrams SocketSendSegments() passes in one send.
+#define kSocketMaxSegments 64
+
+/**
+ * @brief      The ways a socket talks to the kernel.
+ */
+typedef enum {
+  /// A system call per send and receive, or per batch of them.
+  SOCKET_BACKEND_SYSCALL = 0,
+  /// Multishot receives and batched sends through io_uring.
+  SOCKET_BACKEND_IO_URING = 1,
+} SocketBackend;
+
+/// Backend new sockets use, chosen by the socket-backend build option.
+extern const SocketBackend kSocketDefaultBackend;
+
 #ifdef __LINUX__
 struct gudp_socket_t {
   int socket_fd;
+  /// The ring of the io_uring backend, NULL for the system call backend.
+  SocketRing* ring;
+  /// Receive timeout in milliseconds, zero to wait forever.
+  time_t timeout;
+  /// Non-zero when receives don't wait.
+  int nonblocking;
+  /// Non-zero when the kernel cuts sends of segments with UDP_SEGMENT.
+  int gso;
+  /// Received datagrams, NULL while segmentation offload is off.
+  SocketCoalesced* coalesced;
 };
 #else
 #error "Unsupported platform"
@@ -80,6 +118,10 @@ void SocketsShutdown();
  *             error occures.
  *
  * @since      0.0.1
+ *
+ * @note       The socket uses kSocketDefaultBackend. When it's io_uring and
+ *             the kernel refuses it, the socket quietly falls back to system
+ *             calls.
  */
 RETCODE
 SocketInit(Socket* sock);
@@ -141,6 +183,54 @@ SocketConnect(Socket* sock, Address* addr);
 RETCODE
 SocketSend(Socket* sock, Data* data, Address* addr);
 
+/**
+ * @brief      Sends the same message via socket to every provided address using
+ *             as few system calls as possible.
+ *
+ * @param      sock          The pointer to the socket.
+ * @param      data          The pointer to the data to send.
+ * @param      addrs         The array of recipient addresses.
+ * @param[in]  count         The number of recipients.
+ * @param      failed        The array of at least count indexes where
+ *                           indexes of recipients the send failed for are
+ *                           saved.
+ * @param      failed_count  The pointer to the number of failed recipients.
+ *
+ * @return     SUCCESS if data is sent to every recipient, and SOCKET_SEND if
+ *             sending to at least one of them failed.
+ *
+ * @since      0.0.1
+ *
+ * @note       A failed recipient doesn't abort sending to the rest. When
+ *             pointer to failed indexes is NULL, function won't save them.
+ */
+RETCODE
+SocketSendBatch(Socket* sock, Data* data, Address* addrs, size_t count,
+                size_t* failed, size_t* failed_count);
+
+/**
+ * @brief      Sends several messages via socket to the same address. With
+ *             segmentation offload the kernel cuts every run of messages of
+ *             the same size out of one buffer, so a run costs a single send.
+ *
+ * @param      sock      The pointer to the socket.
+ * @param      segments  The array of messages.
+ * @param[in]  count     The number of messages.
+ * @param      addr      The pointer to the address.
+ *
+ * @return     SUCCESS if every message is sent, and SOCKET_SEND if sending at
+ *             least one of them failed.
+ *
+ * @since      0.0.1
+ *
+ * @note       When pointer to the address is NULL, function sends data to the
+ *             connected server. A failed message doesn't abort sending the
+ *             rest. Runs are longest when all the messages but the last one
+ *             are of the same size.
+ */
+RETCODE
+SocketSendSegments(Socket* sock, Data* segments, size_t count, Address* addr);
+
 /**
  * @brief      Receives a message via socket and saves address of sender to
  *             provided address structure.
@@ -155,10 +245,37 @@ SocketSend(Socket* sock, Data* data, Address* addr);
  * @since      0.0.1
  *
  * @note       When pointer to address is NULL, function won't save address.
+ *             The len of the buffer is its capacity on input and is set to the
+ *             size of the received message.
  */
 RETCODE
 SocketReceive(Socket* sock, Data* buffer, Address* addr);
 
+/**
+ * @brief      Receives up to max messages via socket with one system call and
+ *             saves addresses of senders to provided address array.
+ *
+ * @param      sock     The pointer to the socket.
+ * @param      buffers  The array of at least max buffers.
+ * @param      addrs    The array of at least max addresses.
+ * @param[in]  max      The maximum number of messages to receive.
+ * @param      got      The pointer to the number of received messages.
+ *
+ * @return     SUCCESS if at least one message is received, SOCKET_TIMEOUT if
+ *             there were no messages until timeout or in non-blocking mode, and
+ *             SOCKET_RECEIVE if error occures.
+ *
+ * @since      0.0.1
+ *
+ * @note       The call waits only for the first message, the rest are taken
+ *             if they are already queued. The len of every filled buffer is
+ *             set to the size of the received message. When pointer to
+ *             addresses is NULL, function won't save them.
+ */
+RETCODE
+SocketReceiveBatch(Socket* sock, Data* buffers, Address* addrs, size_t max,
+                   size_t* got);
+
 /**
  * @brief      Sets the timeout for receiving message from socket.
  *
@@ -175,3 +292,114 @@ SocketSetTimeout(Socket* sock, time_t milliseconds);
 
 RETCODE
 SocketMakeNonBlocking(Socket* sock);
+
+/**
+ * @brief      Allows several sockets to bind the same address. Must be called
+ *             before SocketBind().
+ *
+ * @param      sock  The pointer to the socket.
+ *
+ * @return     SUCCESS if setting is successiful, and SOCKET_REUSEPORT when
+ *             error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+SocketSetReusePort(Socket* sock);
+
+/**
+ * @brief      Makes the kernel pick the socket of the reuseport group by hash
+ *             of the sender address, so every sender always hits the same
+ *             socket of the group.
+ *
+ * @param      sock   The pointer to any bound socket of the group.
+ * @param[in]  count  The number of sockets in the group.
+ *
+ * @return     SUCCESS if the hash is attached, and SOCKET_REUSEPORT when error
+ *             occures.
+ *
+ * @since      0.0.1
+ *
+ * @note       The n-th socket of the group is the n-th one bound.
+ */
+RETCODE
+SocketSetReusePortHash(Socket* sock, uint32_t count);
+
+/**
+ * @brief      Switches the socket to the backend. Should be called before any
+ *             traffic, datagrams already taken by the io_uring backend are
+ *             dropped when switching away from it.
+ *
+ * @param      sock     The pointer to the socket.
+ * @param[in]  backend  The backend.
+ *
+ * @return     SUCCESS when the backend is in use, or traceback of
+ *             SocketRingInit(). On error the socket keeps its backend.
+ *
+ * @since      0.0.1
+ *
+ * @note       With io_uring, SocketSendBatch() submits the messages at once and
+ *             reaps their completions before it returns, so failed
+ *             recipients are reported the same way.
+ */
+RETCODE
+SocketSetBackend(Socket* sock, SocketBackend backend);
+
+/**
+ * @brief      Gets the backend of the socket.
+ *
+ * @param      sock  The pointer to the socket.
+ *
+ * @return     The backend.
+ *
+ * @since      0.0.1
+ */
+SocketBackend SocketGetBackend(Socket* sock);
+
+/**
+ * @brief      Gets the descriptor to poll for incoming messages: the ring with
+ *             io_uring, the socket itself otherwise.
+ *
+ * @param      sock  The pointer to the socket.
+ *
+ * @return     The descriptor.
+ *
+ * @since      0.0.1
+ */
+int SocketPollFd(Socket* sock);
+
+/**
+ * @brief      Gets the number of sends of SocketSendBatch() the io_uring
+ *             backend failed. Always zero for system calls.
+ *
+ * @param      sock  The pointer to the socket.
+ *
+ * @return     The number of failed sends.
+ *
+ * @since      0.0.1
+ */
+uint64_t SocketSendErrors(Socket* sock);
+
+/**
+ * @brief      Turns UDP segmentation offload of the socket on or off. Sends of
+ *             SocketSendSegments() are cut by the kernel (UDP_SEGMENT), and
+ *             datagrams of one sender arriving together are received in one
+ *             buffer (UDP_GRO) and handed out one by one.
+ *
+ * @param      sock    The pointer to the socket.
+ * @param[in]  enable  Non-zero to turn the offload on.
+ *
+ * @return     SUCCESS when the offload is set, NOT_ENOUGH_MEMORY, and
+ *             SOCKET_OFFLOAD when the kernel supports neither of the two.
+ *
+ * @since      0.0.1
+ *
+ * @note       Coalesced datagrams are taken by receives before the socket is
+ *             read again, so a socket is polled only after a receive reported
+ *             SOCKET_TIMEOUT. io_uring receives into buffers of one datagram,
+ *             so the kernel doesn't coalesce while the backend is on. Received
+ *             but not taken datagrams are dropped when the offload is turned
+ *             off.
+ */
+RETCODE
+SocketSetOffload(Socket* sock, int enable);
@@ -0,0 +1,145 @@
+/**
+ * @file interest.h
+ *
+ * @brief      Contains the interest grid. The world is cut into a uniform grid
+ *             of cells, every client is placed into one of them and is
+ *             interested in the square of cells within its radius around it.
+ *
+ *             Every cell keeps the list of clients interested in it, so the
+ *             recipients of an update in a cell are found in O(recipients).
+ *             When a client moves, only the cells which enter or leave its
+ *             area are touched, and both adding to a list and removing from
+ *             it take O(1).
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/retcode.h"
+
+/**
+ * @brief      Clients interested in one cell.
+ */
+typedef struct {
+  /// IDs of the clients.
+  uint16_t* ids;
+  /// Number of the clients.
+  uint32_t count;
+  /// Capacity of the ID array.
+  uint32_t capacity;
+} InterestCell;
+
+/**
+ * @brief      The place and the area of interest of one client.
+ */
+typedef struct {
+  /// The column of the cell the client is in.
+  uint32_t x;
+  /// The row of the cell the client is in.
+  uint32_t y;
+  /// Number of cells the area spans in every direction from the client.
+  uint16_t radius;
+  /// Non-zero when the client is placed into the grid.
+  uint8_t placed;
+  /// Positions of the client in the lists of the cells of its area, row by
+  /// row from the top left corner. Cells outside of the grid are skipped.
+  uint32_t* positions;
+} InterestEntry;
+
+/**
+ * @brief      The interest grid.
+ */
+typedef struct {
+  /// Cells row by row, NULL when the grid is off.
+  InterestCell* cells;
+  /// Number of columns.
+  uint32_t width;
+  /// Number of rows.
+  uint32_t height;
+  /// Entries of clients indexed by client ID.
+  InterestEntry* entries;
+  /// Capacity of the entry array.
+  uint32_t entries_capacity;
+} InterestGrid;
+
+/**
+ * @brief      Initializes the grid of width by height cells.
+ *
+ * @param      grid    The pointer to the grid.
+ * @param[in]  width   The number of columns.
+ * @param[in]  height  The number of rows.
+ *
+ * @return     SUCCESS when initialization is succesiful, INTEREST_OUT_OF_GRID
+ *             when the grid is empty, or NOT_ENOUGH_MEMORY.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+InterestGridInit(InterestGrid* grid, uint32_t width, uint32_t height);
+
+/**
+ * @brief      Destroys the grid.
+ *
+ * @param      grid  The pointer to the grid.
+ *
+ * @since      0.0.1
+ *
+ * @note       It's guaranteed InterestGridDestroy() will work correctly after
+ *             unsuccessful InterestGridInit().
+ */
+void InterestGridDestroy(InterestGrid* grid);
+
+/**
+ * @brief      Places the client into the cell, or moves it there, and sets its
+ *             area of interest.
+ *
+ * @param      grid       The pointer to the grid.
+ * @param[in]  client_id  The ID of the client.
+ * @param[in]  x          The column of the cell.
+ * @param[in]  y          The row of the cell.
+ * @param[in]  radius     The number of cells the area spans in every
+ *                        direction, zero for the cell itself.
+ *
+ * @return     SUCCESS when the client is placed, INTEREST_OUT_OF_GRID when the
+ *             cell is outside of the grid, or NOT_ENOUGH_MEMORY. On error the
+ *             client keeps its previous place.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+InterestGridPlace(InterestGrid* grid, uint16_t client_id, uint32_t x,
+                  uint32_t y, uint16_t radius);
+
+/**
+ * @brief      Removes the client from the grid. Does nothing for a client which
+ *             isn't placed.
+ *
+ * @param      grid       The pointer to the grid.
+ * @param[in]  client_id  The ID of the client.
+ *
+ * @since      0.0.1
+ */
+void InterestGridRemove(InterestGrid* grid, uint16_t client_id);
+
+/**
+ * @brief      Gets the clients interested in the cell.
+ *
+ * @param      grid   The pointer to the grid.
+ * @param[in]  x      The column of the cell.
+ * @param[in]  y      The row of the cell.
+ * @param      ids    The pointer the array of client IDs is saved to. It's
+ *                    valid until the grid is changed.
+ * @param      count  The pointer to the number of clients.
+ *
+ * @return     SUCCESS, or INTEREST_OUT_OF_GRID when the cell is outside of the
+ *             grid.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+InterestGridCell(InterestGrid* grid, uint32_t x, uint32_t y,
+                 const uint16_t** ids, size_t* count);
@@ -11,35 +11,112 @@
 #pragma once
 
 #include "common/retcode.h"
+#include "common/timer_wheel.h"
+#include "networking/fragment.h"
+#include "networking/pacer.h"
+#include "networking/reliable.h"
+#include "networking/scheduler.h"
+#include "networking/snapshot.h"
 #include "networking/socket.h"
 
 /// The maximum number of clients supported for the moment.
 static const int kBaseClients;
 
+/// Number of client records allocated at once.
+extern const uint32_t kRegistratorChunkSize;
+
 /**
- * @brief      The structure to represent connected client.
+ * @brief      The structure to represent connected client. Fields touched for
+ *             every client by broadcasts and timers come first, so they share
+ *             the leading cache lines of the record; the channels follow.
  */
 typedef struct {
   /// Address of the Client.
   Address addr;
   /// Internal ID of the Client.
   uint16_t client_id;
+  /// Non-zero while the Client is in the flush list of the server.
+  uint8_t flush_queued;
+  /// Time the last packet was sent to the Client, in milliseconds.
+  uint64_t last_send;
+  /// Time the last packet was received from the Client, in milliseconds.
+  uint64_t last_receive;
+  /// Bandwidth estimate and send pacing of the Client.
+  Pacer pacer;
+  /// Timer of the keepalive and of the idle timeout of the Client.
+  TimerNode timer;
+  /// Packets coalesced into the next datagram to the Client.
+  PacketQueue queue;
+  /// Reliable-ordered channel of the Client.
+  ReliableEndpoint reliable;
+  /// Channel of large messages of the Client.
+  FragmentChannel fragments;
+  /// Snapshot history of the Client.
+  SnapshotChannel snapshots;
+  /// Prioritized updates waiting to be sent to the Client.
+  Scheduler scheduler;
 } ConnectedClient;
 
 /**
- * @brief      Registrator structure.
+ * @brief      Slot of the open addressing index from Address to client ID.
+ */
+typedef struct {
+  /// Packed address of the client.
+  uint64_t key;
+  /// ID of the client with such address.
+  uint16_t client_id;
+  /// Non-zero when the slot is occupied.
+  uint8_t used;
+} RegistratorSlot;
+
+/**
+ * @brief      Registrator structure. Clients are kept in a sparse set: a dense
+ *             array of connected clients and a sparse map from client ID to
+ *             the index in it, so iteration is O(connected clients) and memory
+ *             grows with the number of clients.
+ *
+ *             Records of the clients are cut from chunks of
+ *             kRegistratorChunkSize cache-line-aligned records and are
+ *             addressed by client ID. A chunk is allocated when the first ID
+ *             in it is given and kept until RegistratorDestroy(), so the
+ *             records of a reused ID don't touch the heap and neighbour IDs
+ *             are neighbours in memory.
  */
 typedef struct {
-  /// Array of pointers to clients.
+  /// Dense array of pointers to connected clients.
   ConnectedClient** clients;
+  /// Capacity of the dense array.
+  uint32_t clients_capacity;
+  /// Map from client ID to the index in dense array.
+  uint32_t* sparse;
+  /// Capacity of the sparse map and of the free IDs stack.
+  uint32_t sparse_capacity;
+  /// Address index with linear probing. Its capacity is a power of two.
+  RegistratorSlot* index;
+  /// Capacity of the address index.
+  uint32_t index_capacity;
+  /// Number of connected clients.
+  uint32_t size;
+  /// Stack of released client IDs, the next ID to give is on top.
+  uint16_t* free_ids;
+  /// Number of IDs in the stack.
+  uint32_t free_count;
+  /// The smallest ID that was never given.
+  uint32_t next_id;
+  /// Chunks of client records, one per kRegistratorChunkSize IDs.
+  char** chunks;
+  /// Number of allocated chunks.
+  uint32_t chunk_count;
+  /// Distance between two neighbour records in a chunk.
+  size_t stride;
 } Registrator;
 
 /**
  * @brief      Iterator over ConnectedClient's in Registrator.
  */
 typedef struct {
-  /// Index in ConnectedClient array.
-  uint16_t index;
+  /// Index in dense ConnectedClient array.
+  uint32_t index;
 } RegistratorIter;
 
 /**
@@ -67,6 +144,17 @@ ConnectedClientInit(ConnectedClient* client);
  */
 void ConnectedClientDestroy(ConnectedClient* client);
 
+/**
+ * @brief      Resets the initialized connected client to the state of a new
+ *             one. Buffers of its channels stay allocated, so a reused record
+ *             doesn't allocate them again.
+ *
+ * @param      client  The pointer to the connected client.
+ *
+ * @since      0.0.1
+ */
+void ConnectedClientReset(ConnectedClient* client);
+
 /**
  * @brief      Initializes the registrator.
  *
@@ -156,9 +244,15 @@ RegistratorGetUserByID(Registrator* registrator, uint16_t client_id,
  * @param      client       The pointer ro pointer to the connected client.
  *
  * @return     SUCCESS when client added successifuly, ConnectedClientInit()
- *             error or SERVER_CROWDED when there are no more place.
+ *             error, NOT_ENOUGH_MEMORY when the address index can't grow or
+ *             SERVER_CROWDED when there are no more place.
  *
  * @since      0.0.1
+ *
+ * @note       Lookup, addition and removal by Address take O(1) expected
+ *             time. Pointers to connected clients stay valid until the client
+ *             is removed. Only the first client of every kRegistratorChunkSize
+ *             new IDs allocates records.
  */
 RETCODE
 RegistratorAddUser(Registrator* registrator, Address* addr,
@@ -171,6 +265,10 @@ RegistratorAddUser(Registrator* registrator, Address* addr,
  * @param      addr         The pointer to the address.
  *
  * @since      0.0.1
+ *
+ * @note       The record keeps the buffers of its channels for the next
+ *             client with the same ID, they're freed by RegistratorDestroy().
+ *             A large message in flight is dropped with the client.
  */
 void RegistratorRemoveUserByAddress(Registrator* registrator, Address* addr);
 
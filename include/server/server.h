@@ -9,9 +9,35 @@
 #pragma once
 
 #include "common/retcode.h"
+#include "common/stats.h"
+#include "common/timer_wheel.h"
 #include "networking/packet.h"
+#include "networking/pool.h"
+#include "server/interest.h"
 #include "server/registrator.h"
 
+/// Default time a silent client is kept, in milliseconds.
+extern const uint64_t kServerIdleTimeout;
+
+/// Default time after which an idle client gets a keepalive, in milliseconds.
+extern const uint64_t kServerKeepAlive;
+
+/// Maximum number of datagrams ServerReceiveBatch() takes at once.
+#define kServerBatchSize 64
+
+/**
+ * @brief      Callbacks the server invokes when clients connect and disconnect.
+ */
+typedef struct {
+  /// Called after a new client is registered. May be NULL.
+  void (*on_connect)(void* user_data, uint16_t client_id);
+  /// Called before a client is removed, also when it's evicted after the
+  /// idle timeout. May be NULL.
+  void (*on_disconnect)(void* user_data, uint16_t client_id);
+  /// The pointer passed to callbacks.
+  void* user_data;
+} ServerListener;
+
 /**
  * @brief      The server structure.
  */
@@ -20,6 +46,70 @@ typedef struct {
   Socket socket;
   /// Server registrator.
   Registrator registrator;
+  /// Packet reused by ServerSendTo() and ServerBroadcast().
+  PreparedPacket packet;
+  /// The pool of packet buffers.
+  BufferPool pool;
+  /// Buffers of fragments sent to a client at once.
+  BufferPool burst;
+  /// Addresses of broadcast recipients, reused between broadcasts.
+  Address* recipients;
+  /// IDs of broadcast recipients.
+  uint16_t* recipient_ids;
+  /// Indexes of recipients broadcast failed for.
+  size_t* recipient_failures;
+  /// Capacity of recipient arrays.
+  size_t recipients_capacity;
+  /// Connection callbacks.
+  ServerListener listener;
+  /// IDs of clients with reliable messages ready for delivery.
+  uint16_t* ready_ids;
+  /// Number of IDs in ready_ids.
+  size_t ready_count;
+  /// Capacity of ready_ids.
+  size_t ready_capacity;
+  /// Response fragments and their acks are written to.
+  Response scratch;
+  /// Table payloads are compressed with, NULL when compression is off.
+  const HuffmanTable* compression;
+  /// Bandwidth cap of every client in bytes per second, zero when sends
+  /// aren't paced, which is the default.
+  uint64_t bandwidth_cap;
+  /// Timers of keepalives and idle timeouts of the clients.
+  TimerWheel timers;
+  /// Time a silent client is kept in milliseconds, zero to keep it forever.
+  uint64_t idle_timeout;
+  /// Time after which an idle client gets a keepalive in milliseconds, zero
+  /// to send none.
+  uint64_t keepalive;
+  /// Runtime statistics.
+  Stats stats;
+  /// Areas of interest of the clients, see ServerSendRelevant().
+  InterestGrid interest;
+  /// Payload bytes of enqueued updates sent to every client per
+  /// ServerUpdate(), zero when only pacing limits them.
+  size_t schedule_budget;
+  /// Non-zero when packets to a client are coalesced, see
+  /// ServerSetCoalescing().
+  int coalescing;
+  /// IDs of clients with coalesced packets.
+  uint16_t* flush_ids;
+  /// Number of IDs in flush_ids.
+  size_t flush_count;
+  /// Capacity of flush_ids.
+  size_t flush_capacity;
+  /// Buffers of received datagrams with packets not handed out yet.
+  BufferPool unpacking;
+  /// Unread parts of the received datagrams, from unpacking.
+  Data held[kServerBatchSize];
+  /// Senders of the held datagrams.
+  Address held_addrs[kServerBatchSize];
+  /// Index of the first held datagram.
+  size_t held_head;
+  /// Number of held datagrams.
+  size_t held_count;
+  /// Packets of the first held datagram.
+  DatagramIter held_iter;
 } Server;
 
 /**
@@ -31,6 +121,9 @@ typedef struct {
  * @return     SUCCESS when initialization is succesiful, or traceback of the
  *             following functions:
  *             - RegistratorInit()
+ *             - PreparedPacketInit()
+ *             - ResponseInit()
+ *             - BufferPoolInit()
  *             - SocketInit()
  *             - SocketBind()
  *
@@ -39,6 +132,22 @@ typedef struct {
 RETCODE
 ServerInit(Server* srv, Address* addr);
 
+/**
+ * @brief      Initalizes the server and binds it to the specified address
+ *             shared with other servers. The kernel spreads datagrams among
+ *             all the servers bound this way.
+ *
+ * @param      srv   The pointer to the server.
+ * @param      addr  The pointer to the address.
+ *
+ * @return     SUCCESS when initialization is succesiful, or traceback of the
+ *             functions described in ServerInit() and SocketSetReusePort().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ServerInitShared(Server* srv, Address* addr);
+
 /**
  * @brief      Destroys the server.
  *
@@ -52,35 +161,105 @@ ServerInit(Server* srv, Address* addr);
 void ServerDestroy(Server* srv);
 
 /**
- * @brief      Receives one response.
+ * @brief      Receives one response. Reliable messages received earlier and
+ *             waiting for delivery are returned first.
  *
  * @param      srv       The pointer to the server.
  * @param      response  The pointer to the response.
  *
- * @return     SUCCESS when receive is succesiful, or traceback of the following
- *             functions:
- *             - DataInit()
+ * @return     SUCCESS when receive is succesiful, RELIABLE_PENDING when the
+ *             packet had nothing to deliver: only acks, a reliable message out
+ *             of order, or a fragment of an unfinished message. Otherwise
+ *             traceback of the following functions:
+ *             - BufferPoolAcquire()
  *             - SocketReceive()
  *             - DataToResponse()
  *             - AddressInit()
  *             - RegistratorAddUser()
+ *             - ReliableEndpointReceive()
+ *             - FragmentChannelReceive()
  *
  * @since      0.0.1
  */
 RETCODE
 ServerReceive(Server* srv, Response* response);
 
+/**
+ * @brief      Receives one response without copying its payload out of the
+ *             receive buffer. The data of the response points into a buffer
+ *             of the server pool, which is lent to the caller until
+ *             ServerReleaseView().
+ *
+ * @param      srv       The pointer to the server.
+ * @param      response  The pointer to the response. Its data needn't be
+ *                       initialized, it's replaced.
+ *
+ * @return     Same as ServerReceive(). The buffer is lent only on SUCCESS.
+ *
+ * @since      0.0.1
+ *
+ * @note       Only the first packet of a datagram is viewed in place. Reliable
+ *             messages, packets coalesced behind others and compressed
+ *             payloads are written into the lent buffer instead, since they
+ *             don't stay in the receive buffer. Every lent buffer is taken
+ *             from the pool until released, and the pool mustn't be resized
+ *             meanwhile, see ServerSetPoolSize().
+ */
+RETCODE
+ServerReceiveView(Server* srv, Response* response);
+
+/**
+ * @brief      Returns the buffer lent by ServerReceiveView() to the pool.
+ *
+ * @param      srv       The pointer to the server.
+ * @param      response  The pointer to the response received by
+ *                       ServerReceiveView(). Its data is cleared.
+ *
+ * @since      0.0.1
+ */
+void ServerReleaseView(Server* srv, Response* response);
+
+/**
+ * @brief      Receives up to max responses with one system call.
+ *
+ * @param      srv   The pointer to the server.
+ * @param      out   The array of at least max initialized responses.
+ * @param[in]  max   The maximum number of responses to receive.
+ * @param      got   The pointer to the number of received responses.
+ *
+ * @return     SUCCESS when at least one response is received, or traceback of
+ *             the following functions:
+ *             - BufferPoolAcquire()
+ *             - SocketReceiveBatch()
+ *             - DataToResponse()
+ *             - RegistratorAddUser()
+ *
+ * @since      0.0.1
+ *
+ * @note       Reliable messages waiting for delivery are returned without
+ *             touching the socket. Otherwise waits only for the first
+ *             response, so it works both with ServerSetTimeout() and
+ *             ServerMakeNonBlocking(). At most as many
+ *             responses as there are free buffers in the pool are received at
+ *             once. Responses which can't be handled (e.g. server is crowded)
+ *             are dropped, their error is returned only if nothing else was
+ *             received.
+ */
+RETCODE
+ServerReceiveBatch(Server* srv, Response* out, size_t max, size_t* got);
+
 /**
  * @brief      Sends the response to the specified client. Client ID must be set
- *             on response.
+ *             on response. Acks of the reliable channel are written into it,
+ *             types other than DISCONNECT are replaced with CONNECT.
  *
  * @param      srv       The pointer to the server.
  * @param      response  The pointer to the response.
  *
- * @return     SUCCESS when send to is succesiful, or traceback of the following
- *             functions:
- *             - DataInit()
- *             - ResponseToData()
+ * @return     SUCCESS when send to is succesiful, SEND_THROTTLED when the
+ *             bandwidth budget of the client is spent, or traceback of the
+ *             following functions:
+ *             - PreparedPacketSet()
  *             - RegistratorGetUserByID()
  *             - SocketSend()
  *
@@ -89,6 +268,146 @@ ServerReceive(Server* srv, Response* response);
 RETCODE
 ServerSendTo(Server* srv, Response* response);
 
+/**
+ * @brief      Sends the response to the specified client through the
+ *             reliable-ordered channel. Client ID must be set on response. The
+ *             type of the response is set to RELIABLE.
+ *
+ * @param      srv       The pointer to the server.
+ * @param      response  The pointer to the response.
+ *
+ * @return     SUCCESS when the message is queued, or traceback of the
+ *             following functions:
+ *             - RegistratorGetUserByID()
+ *             - ReliableEndpointSend()
+ *
+ * @since      0.0.1
+ *
+ * @note       Once queued, the message is resent by ServerUpdate() until the
+ *             client acknowledges it, so a failed send counts as a loss. A
+ *             message held back by the bandwidth budget is sent by
+ *             ServerUpdate() once the budget allows.
+ */
+RETCODE
+ServerSendReliable(Server* srv, Response* response);
+
+/**
+ * @brief      Sends the state snapshot to the specified client, encoded as a
+ *             delta against the newest snapshot the client acknowledged.
+ *             Client ID must be set on response. The client gets the decoded
+ *             snapshot as a SNAPSHOT response.
+ *
+ * @param      srv       The pointer to the server.
+ * @param      response  The pointer to the response with the snapshot. It's
+ *                       left unchanged.
+ *
+ * @return     SUCCESS when send is succesiful, SEND_THROTTLED when the
+ *             bandwidth budget of the client is spent, or traceback of the
+ *             following functions:
+ *             - RegistratorGetUserByID()
+ *             - SnapshotChannelEncode()
+ *             - ResponseToData()
+ *             - SocketSend()
+ *
+ * @since      0.0.1
+ *
+ * @note       Snapshots aren't resent, the next one replaces a lost one. The
+ *             smaller the change between snapshots, the smaller the delta.
+ */
+RETCODE
+ServerSendSnapshot(Server* srv, Response* response);
+
+/**
+ * @brief      Resends reliable messages whose acks are late and sends acks to
+ *             clients that got no other packet to piggyback them on. Should be
+ *             called periodically, e.g. every few milliseconds. Resends and
+ *             fragments stay within the bandwidth budget of each client, the
+ *             rest waits for the next call. Enqueued updates are sent by
+ *             their accumulated priority within the schedule budget of each
+ *             client, see ServerEnqueue(). Packets coalesced for a client
+ *             are sent at the end. Also sends keepalives to clients nothing
+ *             was sent to for a while, and evicts clients nothing was received
+ *             from within the idle timeout: they get a DISCONNECT and the
+ *             on_disconnect callback is invoked. The cost of both is
+ *             proportional to the number of due clients, not connected ones.
+ *
+ * @param      srv   The pointer to the server.
+ *
+ * @return     SUCCESS when all the packets are sent, or traceback of
+ *             SocketSend() for the last failed one.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ServerUpdate(Server* srv);
+
+/**
+ * @brief      Starts sending the large message to the specified client through
+ *             the fragment channel. The client gets a FRAGMENT response with
+ *             empty payload when the whole message is received.
+ *
+ * @param      srv        The pointer to the server.
+ * @param[in]  client_id  The ID of the client.
+ * @param[in]  data       The pointer to the message.
+ * @param[in]  len        The size of the message, up to kFragmentMaxSize.
+ *
+ * @return     SUCCESS when the transfer is started, or traceback of the
+ *             following functions:
+ *             - RegistratorGetUserByID()
+ *             - FragmentChannelSend()
+ *
+ * @since      0.0.1
+ *
+ * @note       The first window of fragments is sent right away, the rest go
+ *             out as acks arrive. Lost fragments are sent again by
+ *             ServerUpdate().
+ */
+RETCODE
+ServerSendLarge(Server* srv, uint16_t client_id, const char* data, size_t len);
+
+/**
+ * @brief      Takes the large message received from the client. Should be
+ *             called after a FRAGMENT response is received from the client.
+ *
+ * @param      srv        The pointer to the server.
+ * @param[in]  client_id  The ID of the client.
+ * @param      out        The pointer to the data the message is moved to. It
+ *                        must be freed with DataDestroy().
+ *
+ * @return     SUCCESS when the message is taken, or traceback of the following
+ *             functions:
+ *             - RegistratorGetUserByID()
+ *             - FragmentChannelTake()
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ServerTakeLarge(Server* srv, uint16_t client_id, Data* out);
+
+/**
+ * @brief      Sets the size of the largest message the client may send through
+ *             the fragment channel. Clients can't send large messages until
+ *             it's called, so a peer can't make the server allocate memory
+ *             for reassembly without the application allowing it.
+ *
+ * @param      srv        The pointer to the server.
+ * @param[in]  client_id  The ID of the client.
+ * @param[in]  limit      The size in bytes, up to kFragmentMaxSize. 0 refuses
+ *                        large messages again.
+ *
+ * @return     SUCCESS when the limit is set, or traceback of the following
+ *             functions:
+ *             - RegistratorGetUserByID()
+ *
+ * @since      0.0.1
+ *
+ * @note       Fragments of refused messages make ServerReceive() return
+ *             PACKET_TOO_LARGE. The client keeps sending them, so the
+ *             transfer goes on if the limit is raised later.
+ */
+RETCODE
+ServerSetLargeLimit(Server* srv, uint16_t client_id, size_t limit);
+
 /**
  * @brief      Sends the response to all of the connected clients.
  *
@@ -97,14 +416,252 @@ ServerSendTo(Server* srv, Response* response);
  *
  * @return     SUCCESS when send is succesiful, or traceback of the following
  *             functions:
- *             - RegistratorIterInit()
- *             - ServerSendTo()
+ *             - ServerBroadcast()
  *
  * @since      0.0.1
  */
 RETCODE
 ServerSend(Server* srv, Response* response);
 
+/**
+ * @brief      Sends the response to all of the connected clients and reports
+ *             the clients it failed to reach.
+ *
+ * @param      srv           The pointer to the server.
+ * @param      response      The pointer to the response.
+ * @param      failed_ids    The array of at least ServerClientsCount() IDs
+ *                           where IDs of unreached clients are saved.
+ * @param      failed_count  The pointer to the number of unreached clients.
+ *
+ * @return     SUCCESS when send is succesiful, or traceback of the following
+ *             functions:
+ *             - PreparedPacketSet()
+ *             - ServerBroadcastPrepared()
+ *
+ * @since      0.0.1
+ *
+ * @note       The response is serialized once and flushed with batched system
+ *             calls. A failed recipient doesn't abort sending to the rest.
+ *             When failed_ids or failed_count is NULL, they aren't saved.
+ */
+RETCODE
+ServerBroadcast(Server* srv, Response* response, uint16_t* failed_ids,
+                size_t* failed_count);
+
+/**
+ * @brief      Sends the prepared packet to all of the connected clients.
+ *
+ * @param      srv           The pointer to the server.
+ * @param      packet        The pointer to the prepared packet.
+ * @param      failed_ids    The array of at least ServerClientsCount() IDs
+ *                           where IDs of unreached clients are saved.
+ * @param      failed_count  The pointer to the number of unreached clients.
+ *
+ * @return     SUCCESS when send is succesiful, NOT_ENOUGH_MEMORY,
+ *             SEND_THROTTLED when some clients were skipped because their
+ *             bandwidth budget is spent, or traceback of SocketSendBatch()
+ *             function.
+ *
+ * @since      0.0.1
+ *
+ * @note       Skipped clients are reported as unreached. When failed_ids or
+ *             failed_count is NULL, they aren't saved.
+ */
+RETCODE
+ServerBroadcastPrepared(Server* srv, PreparedPacket* packet,
+                        uint16_t* failed_ids, size_t* failed_count);
+
+/**
+ * @brief      Sends the prepared packet to the specified clients.
+ *
+ * @param      srv           The pointer to the server.
+ * @param      packet        The pointer to the prepared packet.
+ * @param[in]  client_ids    The array of recipient IDs.
+ * @param[in]  count         The number of recipients.
+ * @param      failed_ids    The array of at least count IDs where IDs of
+ *                           unreached clients are saved.
+ * @param      failed_count  The pointer to the number of unreached clients.
+ *
+ * @return     SUCCESS when send is succesiful, NOT_ENOUGH_MEMORY,
+ *             SERVER_USER_NOT_FOUND when some of IDs aren't connected,
+ *             SEND_THROTTLED when some clients were skipped because their
+ *             bandwidth budget is spent, or traceback of SocketSendBatch()
+ *             function.
+ *
+ * @since      0.0.1
+ *
+ * @note       Unknown and skipped IDs are reported as unreached and don't
+ *             abort sending to the rest. When failed_ids or failed_count is
+ *             NULL, they aren't saved.
+ */
+RETCODE
+ServerSendPrepared(Server* srv, PreparedPacket* packet,
+                   const uint16_t* client_ids, size_t count,
+                   uint16_t* failed_ids, size_t* failed_count);
+
+/**
+ * @brief      Turns the interest grid of width by height cells on, see
+ *             interest.h. Clients placed into the previous grid are removed
+ *             from it.
+ *
+ * @param      srv     The pointer to the server.
+ * @param[in]  width   The number of columns.
+ * @param[in]  height  The number of rows.
+ *
+ * @return     Traceback of InterestGridInit() function. On error the grid is
+ *             off.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ServerSetInterestGrid(Server* srv, uint32_t width, uint32_t height);
+
+/**
+ * @brief      Places the client into the cell of the interest grid, or moves
+ *             it there, and sets the radius of its area of interest in cells.
+ *
+ * @param      srv        The pointer to the server.
+ * @param[in]  client_id  The ID of the client.
+ * @param[in]  x          The column of the cell.
+ * @param[in]  y          The row of the cell.
+ * @param[in]  radius     The number of cells the area spans in every
+ *                        direction.
+ *
+ * @return     SUCCESS when the client is placed, or traceback of the following
+ *             functions:
+ *             - RegistratorGetUserByID()
+ *             - InterestGridPlace()
+ *
+ * @since      0.0.1
+ *
+ * @note       Only the cells which enter or leave the area are updated, so
+ *             moving to a neighbour cell costs O(radius). A disconnected
+ *             client is removed from the grid.
+ */
+RETCODE
+ServerSetInterest(Server* srv, uint16_t client_id, uint32_t x, uint32_t y,
+                  uint16_t radius);
+
+/**
+ * @brief      Sends the response to the clients whose area of interest covers
+ *             the cell, and reports the clients it failed to reach.
+ *
+ * @param      srv           The pointer to the server.
+ * @param      response      The pointer to the response.
+ * @param[in]  x             The column of the cell.
+ * @param[in]  y             The row of the cell.
+ * @param      failed_ids    The array of at least ServerClientsCount() IDs
+ *                           where IDs of unreached clients are saved.
+ * @param      failed_count  The pointer to the number of unreached clients.
+ *
+ * @return     SUCCESS when send is succesiful, or traceback of the following
+ *             functions:
+ *             - InterestGridCell()
+ *             - PreparedPacketSet()
+ *             - ServerSendPrepared()
+ *
+ * @since      0.0.1
+ *
+ * @note       The cost is O(recipients) regardless of the number of connected
+ *             clients. Clients which aren't placed into the grid get nothing.
+ *             When failed_ids or failed_count is NULL, they aren't saved.
+ */
+RETCODE
+ServerSendRelevant(Server* srv, Response* response, uint32_t x, uint32_t y,
+                   uint16_t* failed_ids, size_t* failed_count);
+
+/**
+ * @brief      Sends the packets coalesced for every client, see
+ *             ServerSetCoalescing().
+ *
+ * @param      srv   The pointer to the server.
+ *
+ * @return     SUCCESS when every datagram is sent, or traceback of
+ *             SocketSend() for the last failed one.
+ *
+ * @since      0.0.1
+ *
+ * @note       The cost is proportional to the number of clients with
+ *             coalesced packets. ServerUpdate() flushes every client as well,
+ *             so an application which updates the server once per tick needs
+ *             it only to send earlier.
+ */
+RETCODE
+ServerFlush(Server* srv);
+
+/**
+ * @brief      Turns coalescing of packets on or off. With coalescing on,
+ *             packets to a client are written back to back into one datagram
+ *             of up to kDataLength bytes instead of being sent right away. The
+ *             datagram is sent when the next packet doesn't fit, and by
+ *             ServerFlush() and ServerUpdate(), so many small messages cost
+ *             one system call and one IP/UDP header.
+ *
+ * @param      srv     The pointer to the server.
+ * @param[in]  enable  Non-zero to turn coalescing on.
+ *
+ * @return     SUCCESS, or traceback of ServerFlush() when coalescing is turned
+ *             off and the queued packets fail to be sent.
+ *
+ * @since      0.0.1
+ *
+ * @note       Coalesced datagrams are unpacked on receive whether coalescing
+ *             is on or not. Broadcasts, fragments and disconnects are never
+ *             held back.
+ */
+RETCODE
+ServerSetCoalescing(Server* srv, int enable);
+
+/**
+ * @brief      Enqueues the update for the client under the key, replacing its
+ *             waiting update of the same key. Every ServerUpdate() adds the
+ *             priority of each waiting update to its accumulator and sends
+ *             the updates with the largest accumulators which fit the budget
+ *             of the client, see scheduler.h.
+ *
+ * @param      srv        The pointer to the server.
+ * @param[in]  client_id  The ID of the client.
+ * @param[in]  key        The key of the update, e.g. the ID of the entity.
+ * @param[in]  priority   The value added to the accumulator every update.
+ * @param      response   The pointer to the response with the payload.
+ *
+ * @return     SUCCESS when the update is enqueued, or traceback of the
+ *             following functions:
+ *             - RegistratorGetUserByID()
+ *             - SchedulerPut()
+ *
+ * @since      0.0.1
+ *
+ * @note       The update is sent unreliably as a CONNECT response, so the
+ *             application enqueues the latest state of the key rather than
+ *             deltas. Waiting updates are dropped when the client leaves.
+ */
+RETCODE
+ServerEnqueue(Server* srv, uint16_t client_id, uint32_t key,
+              uint32_t priority, Response* response);
+
+/**
+ * @brief      Sets the number of payload bytes of enqueued updates sent to
+ *             every client per ServerUpdate().
+ *
+ * @param      srv    The pointer to the server.
+ * @param[in]  bytes  The budget, or zero to be limited by pacing only.
+ *
+ * @since      0.0.1
+ */
+void ServerSetScheduleBudget(Server* srv, size_t bytes);
+
+/**
+ * @brief      Gets the number of connected clients.
+ *
+ * @param      srv   The pointer to the server.
+ *
+ * @return     The number of connected clients.
+ *
+ * @since      0.0.1
+ */
+size_t ServerClientsCount(Server* srv);
+
 /**
  * @brief      Sets the timeout for ServerReceive().
  *
@@ -120,3 +677,189 @@ ServerSetTimeout(Server* srv, time_t milliseconds);
 
 RETCODE
 ServerMakeNonBlocking(Server* srv);
+
+/**
+ * @brief      Switches the socket of the server to the backend. Should be
+ *             called before clients connect.
+ *
+ * @param      srv      The pointer to the server.
+ * @param[in]  backend  The backend.
+ *
+ * @return     Traceback of SocketSetBackend() function.
+ *
+ * @since      0.0.1
+ *
+ * @note       Event loops and pollers must watch SocketPollFd() of the server
+ *             socket, which changes with the backend.
+ */
+RETCODE
+ServerSetBackend(Server* srv, SocketBackend backend);
+
+/**
+ * @brief      Turns UDP segmentation offload of the server socket on or off.
+ *             Fragments of large messages go out in bursts the kernel cuts
+ *             into datagrams, and bursts from clients are received at once.
+ *
+ * @param      srv     The pointer to the server.
+ * @param[in]  enable  Non-zero to turn the offload on.
+ *
+ * @return     Traceback of SocketSetOffload() function.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ServerSetOffload(Server* srv, int enable);
+
+/**
+ * @brief      Sets the callbacks invoked when clients connect and disconnect.
+ *
+ * @param      srv       The pointer to the server.
+ * @param      listener  The pointer to the callbacks, or NULL to remove them.
+ *
+ * @since      0.0.1
+ */
+void ServerSetListener(Server* srv, ServerListener* listener);
+
+/**
+ * @brief      Turns compression of payloads on or off. Payloads which don't
+ *             get smaller are still sent as they are.
+ *
+ * @param      srv    The pointer to the server.
+ * @param[in]  table  The pointer to the table clients use too, or NULL to turn
+ *                    compression off. It must outlive the server.
+ *
+ * @since      0.0.1
+ *
+ * @note       Compressed packets from clients can't be decoded without the
+ *             table and are dropped as malformed.
+ */
+void ServerSetCompression(Server* srv, const HuffmanTable* table);
+
+/**
+ * @brief      Sets the bandwidth cap of every client and turns pacing on or
+ *             off. With the cap set, packets to a client are paced by a token
+ *             bucket refilled at the bandwidth estimated from its round trip
+ *             time and losses, up to the cap. Pacing is off by default: sends
+ *             are never throttled and SEND_THROTTLED isn't returned until the
+ *             cap is set.
+ *
+ * @param      srv               The pointer to the server.
+ * @param[in]  bytes_per_second  The cap, or zero to send without pacing.
+ *
+ * @since      0.0.1
+ *
+ * @note       Acks and disconnects are never held back, but they're counted
+ *             against the budget.
+ *
+ * @note       The estimate learns from acks of reliable messages. Until
+ *             they show losses or growing delay, the client is paced at the
+ *             cap, so clients which get unreliable packets only are never
+ *             throttled below it. The estimate is kept up to date also while
+ *             pacing is off, see ServerGetBandwidth().
+ */
+void ServerSetBandwidthCap(Server* srv, uint64_t bytes_per_second);
+
+/**
+ * @brief      Gets the current bandwidth budget of the client, e.g. to lower
+ *             the rate of its snapshots when the link degrades.
+ *
+ * @param      srv               The pointer to the server.
+ * @param[in]  client_id         The ID of the client.
+ * @param      bytes_per_second  The pointer to the budget: the estimated
+ *                               bandwidth limited by the cap.
+ *
+ * @return     SUCCESS when the budget is saved, or traceback of
+ *             RegistratorGetUserByID().
+ *
+ * @since      0.0.1
+ *
+ * @note       The estimate is updated from reliable messages. With the cap
+ *             set, the budget is the cap until they show congestion, and
+ *             without it the estimate stays at kPacerInitialRate for clients
+ *             which never exchange them.
+ */
+RETCODE
+ServerGetBandwidth(Server* srv, uint16_t client_id,
+                   uint64_t* bytes_per_second);
+
+/**
+ * @brief      Sets the time a client is kept without receiving anything from
+ *             it. The default is kServerIdleTimeout.
+ *
+ * @param      srv           The pointer to the server.
+ * @param[in]  milliseconds  The timeout, or zero to keep clients until they
+ *                           disconnect.
+ *
+ * @since      0.0.1
+ */
+void ServerSetIdleTimeout(Server* srv, uint64_t milliseconds);
+
+/**
+ * @brief      Sets the time after which a client nothing was sent to gets an
+ *             empty keepalive packet. The default is kServerKeepAlive.
+ *
+ * @param      srv           The pointer to the server.
+ * @param[in]  milliseconds  The interval, or zero to send no keepalives.
+ *
+ * @since      0.0.1
+ */
+void ServerSetKeepAlive(Server* srv, uint64_t milliseconds);
+
+/**
+ * @brief      Sets the number of packet buffers in the server pool.
+ *
+ * @param      srv   The pointer to the server.
+ * @param[in]  size  The number of buffers.
+ *
+ * @return     Traceback of BufferPoolResize() function.
+ *
+ * @since      0.0.1
+ *
+ * @note       Every buffer lent by ServerReceiveView() must be released
+ *             before the call.
+ */
+RETCODE
+ServerSetPoolSize(Server* srv, size_t size);
+
+/**
+ * @brief      Gets the largest number of packet buffers the server has used at
+ *             once, to size the pool with ServerSetPoolSize().
+ *
+ * @param      srv   The pointer to the server.
+ *
+ * @return     The high-water mark of the server pool.
+ *
+ * @since      0.0.1
+ */
+size_t ServerGetPoolHighWater(Server* srv);
+
+/**
+ * @brief      Takes a snapshot of the server statistics. Unlike other server
+ *             functions, it can be called from any thread.
+ *
+ * @param      srv    The pointer to the server.
+ * @param      stats  The pointer to the snapshot.
+ *
+ * @since      0.0.1
+ *
+ * @note       The latency histogram holds the time spent inside every call
+ *             which receives, sends or updates, without the time spent
+ *             waiting for a packet to arrive.
+ */
+void ServerGetStats(Server* srv, StatsSnapshot* stats);
+
+/**
+ * @brief      Gets the round trip time, loss and bandwidth estimates of the
+ *             link to the client.
+ *
+ * @param      srv        The pointer to the server.
+ * @param[in]  client_id  The ID of the client.
+ * @param      link       The pointer to the estimates.
+ *
+ * @return     SUCCESS when the estimates are saved, or traceback of
+ *             RegistratorGetUserByID().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ServerGetClientStats(Server* srv, uint16_t client_id, StatsLink* link);
@@ -0,0 +1,316 @@
+/**
+ * @file sharded.h
+ *
+ * @brief      Contains the sharded server. It opens several servers on the
+ *             same port with SO_REUSEPORT, each one with its own registrator
+ *             slice and worker thread, so packet processing scales with the
+ *             number of cores. Every client always lands on the same shard.
+ *
+ *             Clients of a sharded server are identified by a 32-bit ID: the
+ *             shard index in the high 16 bits and the client ID inside the
+ *             shard in the low 16 bits.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/retcode.h"
+#include "networking/packet.h"
+#include "networking/pool.h"
+#include "server/server.h"
+
+/**
+ * @brief      The structure representing sharded server.
+ */
+typedef struct gudp_sharded_server_t ShardedServer;
+
+/**
+ * @brief      Callbacks of a sharded server. They are called from the worker
+ *             thread of the shard owning the client.
+ */
+typedef struct {
+  /// Called for every received response. May be NULL.
+  void (*on_packet)(ShardedServer* srv, uint32_t client, Response* response,
+                    void* user_data);
+  /// Called when a new client connects. May be NULL.
+  void (*on_connect)(ShardedServer* srv, uint32_t client, void* user_data);
+  /// Called when a client disconnects. May be NULL.
+  void (*on_disconnect)(ShardedServer* srv, uint32_t client, void* user_data);
+} ShardedCallbacks;
+
+/**
+ * @brief      A message posted to a shard from any thread.
+ */
+typedef struct {
+  /// Serialized packet.
+  Data data;
+  /// ID of the recipient inside the shard.
+  uint16_t client_id;
+  /// Non-zero when the packet goes to all clients of the shard.
+  uint8_t broadcast;
+} ShardMessage;
+
+/**
+ * @brief      One shard of the sharded server.
+ */
+typedef struct {
+  /// The server of the shard.
+  Server server;
+  /// The worker thread.
+  pthread_t thread;
+  /// Non-zero when the worker thread is running.
+  int started;
+  /// The sharded server the shard belongs to.
+  ShardedServer* owner;
+  /// Index of the shard.
+  uint16_t index;
+  /// Descriptor the worker is woken up through.
+  int wake_fd;
+  /// Lock of the mailbox.
+  pthread_mutex_t lock;
+  /// Buffers of posted messages.
+  BufferPool mailbox_pool;
+  /// Posted messages.
+  ShardMessage* mailbox;
+  /// Number of posted messages.
+  size_t mailbox_count;
+  /// Messages taken by the worker for sending.
+  ShardMessage* outbox;
+} ServerShard;
+
+struct gudp_sharded_server_t {
+  /// Array of shards.
+  ServerShard* shards;
+  /// Number of shards.
+  size_t count;
+  /// The callbacks.
+  ShardedCallbacks callbacks;
+  /// The pointer passed to callbacks.
+  void* user_data;
+  /// Non-zero while workers should keep going, accessed atomically.
+  int running;
+};
+
+/**
+ * @brief      Makes the 32-bit sharded client ID.
+ *
+ * @param[in]  shard      The index of the shard.
+ * @param[in]  client_id  The ID of the client inside the shard.
+ *
+ * @return     The sharded client ID.
+ *
+ * @since      0.0.1
+ */
+uint32_t ShardedClientId(uint16_t shard, uint16_t client_id);
+
+/**
+ * @brief      Initializes the sharded server and binds all the shards to the
+ *             specified address.
+ *
+ * @param      srv        The pointer to the sharded server.
+ * @param      addr       The pointer to the address.
+ * @param[in]  count      The number of shards.
+ * @param      callbacks  The pointer to the callbacks.
+ * @param      user_data  The pointer passed to callbacks.
+ *
+ * @return     SUCCESS when initialization is succesiful, SERVER_SHARD_START
+ *             when count is zero, NOT_ENOUGH_MEMORY, SOCKET_INIT or traceback
+ *             of the following functions:
+ *             - ServerInitShared()
+ *             - ServerMakeNonBlocking()
+ *             - BufferPoolInit()
+ *             - SocketSetReusePortHash()
+ *
+ * @since      0.0.1
+ *
+ * @note       Client affinity is kept by a hash of the sender address attached
+ *             with SocketSetReusePortHash(), the initialization fails when the
+ *             kernel refuses it.
+ */
+RETCODE
+ShardedServerInit(ShardedServer* srv, Address* addr, size_t count,
+                  ShardedCallbacks* callbacks, void* user_data);
+
+/**
+ * @brief      Stops the workers and destroys the sharded server.
+ *
+ * @param      srv   The pointer to the sharded server.
+ *
+ * @since      0.0.1
+ *
+ * @note       It's guaranteed ShardedServerDestroy() will work correctly after
+ *             unsuccessful ShardedServerInit().
+ */
+void ShardedServerDestroy(ShardedServer* srv);
+
+/**
+ * @brief      Starts worker threads of all the shards.
+ *
+ * @param      srv   The pointer to the sharded server.
+ *
+ * @return     SUCCESS when all the workers are started, and SERVER_SHARD_START
+ *             when error occures. On error the started workers are stopped.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ShardedServerStart(ShardedServer* srv);
+
+/**
+ * @brief      Stops worker threads and waits for them.
+ *
+ * @param      srv   The pointer to the sharded server.
+ *
+ * @since      0.0.1
+ */
+void ShardedServerStop(ShardedServer* srv);
+
+/**
+ * @brief      Posts the response to the client from any thread. The shard
+ *             owning the client sends it from its worker thread.
+ *
+ * @param      srv       The pointer to the sharded server.
+ * @param[in]  client    The sharded client ID.
+ * @param      response  The pointer to the response.
+ *
+ * @return     SUCCESS when the response is posted, SERVER_USER_NOT_FOUND when
+ *             the shard doesn't exist, POOL_EXHAUSTED when the mailbox of the
+ *             shard is full or traceback of PreparedPacketSet().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ShardedServerPost(ShardedServer* srv, uint32_t client, Response* response);
+
+/**
+ * @brief      Posts the response to all of the connected clients of all the
+ *             shards from any thread.
+ *
+ * @param      srv       The pointer to the sharded server.
+ * @param      response  The pointer to the response.
+ *
+ * @return     SUCCESS when the response is posted to every shard, or traceback
+ *             of ShardedServerPost().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ShardedServerPostAll(ShardedServer* srv, Response* response);
+
+/**
+ * @brief      Turns compression of payloads on or off for every shard. Should
+ *             be called before ShardedServerStart().
+ *
+ * @param      srv    The pointer to the sharded server.
+ * @param[in]  table  The pointer to the table, or NULL. See
+ *                    ServerSetCompression().
+ *
+ * @since      0.0.1
+ */
+void ShardedServerSetCompression(ShardedServer* srv, const HuffmanTable* table);
+
+/**
+ * @brief      Sets the bandwidth cap of every client of every shard. Should be
+ *             called before ShardedServerStart().
+ *
+ * @param      srv               The pointer to the sharded server.
+ * @param[in]  bytes_per_second  The cap, or zero. See ServerSetBandwidthCap().
+ *
+ * @since      0.0.1
+ */
+void ShardedServerSetBandwidthCap(ShardedServer* srv,
+                                  uint64_t bytes_per_second);
+
+/**
+ * @brief      Sets the schedule budget of every shard. Should be called before
+ *             ShardedServerStart().
+ *
+ * @param      srv    The pointer to the sharded server.
+ * @param[in]  bytes  The budget, or zero. See ServerSetScheduleBudget().
+ *
+ * @since      0.0.1
+ */
+void ShardedServerSetScheduleBudget(ShardedServer* srv, size_t bytes);
+
+/**
+ * @brief      Turns coalescing of packets on or off in every shard. Should be
+ *             called before ShardedServerStart(). Workers flush the packets
+ *             after every round of receives and posts.
+ *
+ * @param      srv     The pointer to the sharded server.
+ * @param[in]  enable  Non-zero to turn coalescing on. See
+ *                     ServerSetCoalescing().
+ *
+ * @since      0.0.1
+ */
+void ShardedServerSetCoalescing(ShardedServer* srv, int enable);
+
+/**
+ * @brief      Sets the idle timeout of every shard. Should be called before
+ *             ShardedServerStart().
+ *
+ * @param      srv           The pointer to the sharded server.
+ * @param[in]  milliseconds  The timeout, or zero. See ServerSetIdleTimeout().
+ *
+ * @since      0.0.1
+ */
+void ShardedServerSetIdleTimeout(ShardedServer* srv, uint64_t milliseconds);
+
+/**
+ * @brief      Sets the keepalive interval of every shard. Should be called
+ *             before ShardedServerStart().
+ *
+ * @param      srv           The pointer to the sharded server.
+ * @param[in]  milliseconds  The interval, or zero. See ServerSetKeepAlive().
+ *
+ * @since      0.0.1
+ */
+void ShardedServerSetKeepAlive(ShardedServer* srv, uint64_t milliseconds);
+
+/**
+ * @brief      Takes a snapshot of the statistics of all the shards combined.
+ *             Can be called from any thread, also while the workers run.
+ *
+ * @param      srv    The pointer to the sharded server.
+ * @param      stats  The pointer to the snapshot.
+ *
+ * @since      0.0.1
+ */
+void ShardedServerGetStats(ShardedServer* srv, StatsSnapshot* stats);
+
+/**
+ * @brief      Switches the sockets of every shard to the backend. Should be
+ *             called before ShardedServerStart().
+ *
+ * @param      srv      The pointer to the sharded server.
+ * @param[in]  backend  The backend.
+ *
+ * @return     SUCCESS when every shard uses the backend, or traceback of
+ *             ServerSetBackend(). On error the shards switched so far are
+ *             switched back.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ShardedServerSetBackend(ShardedServer* srv, SocketBackend backend);
+
+/**
+ * @brief      Turns UDP segmentation offload of every shard on or off. Should
+ *             be called before ShardedServerStart().
+ *
+ * @param      srv     The pointer to the sharded server.
+ * @param[in]  enable  Non-zero to turn the offload on.
+ *
+ * @return     SUCCESS when every shard is set, or traceback of
+ *             ServerSetOffload(). On error the offload is turned off for
+ *             all the shards.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ShardedServerSetOffload(ShardedServer* srv, int enable);
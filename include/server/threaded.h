@@ -0,0 +1,209 @@
+/**
+ * @file threaded.h
+ *
+ * @brief      Contains the threaded server. The server is run by a network
+ *             thread of its own, which receives, resends and flushes packets,
+ *             while one game thread takes the received responses and queues
+ *             responses to send. The threads exchange them through two
+ *             lock-free queues, so neither of them waits for the other and
+ *             the server itself is touched by the network thread only.
+ *
+ * @author     Alexander Stanovoy
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/retcode.h"
+#include "common/spsc_queue.h"
+#include "common/stats.h"
+#include "networking/packet.h"
+#include "server/server.h"
+
+/**
+ * @brief      The threaded server.
+ */
+typedef struct {
+  /// The server, owned by the network thread once it's started.
+  Server server;
+  /// The network thread.
+  pthread_t thread;
+  /// Non-zero when the network thread is running.
+  int started;
+  /// Non-zero while the network thread should keep going, accessed
+  /// atomically.
+  int running;
+  /// Descriptor the network thread is woken up through.
+  int wake_fd;
+  /// Non-zero while the network thread waits with the outbox empty.
+  int sleeping;
+  /// Received responses, from the network thread to the game thread.
+  SpscQueue inbox;
+  /// Responses to send, from the game thread to the network thread.
+  SpscQueue outbox;
+  /// IDs of evicted clients not reported to the game thread yet.
+  uint16_t* departed;
+  /// Number of IDs in departed.
+  size_t departed_count;
+  /// Capacity of departed.
+  size_t departed_capacity;
+  /// Non-zero while the network thread runs ServerUpdate().
+  int evicting;
+} ThreadedServer;
+
+/**
+ * @brief      Initializes the threaded server and binds it to the specified
+ *             address. The network thread isn't started yet.
+ *
+ * @param      srv   The pointer to the threaded server.
+ * @param      addr  The pointer to the address.
+ *
+ * @return     SUCCESS when initialization is succesiful, NOT_ENOUGH_MEMORY,
+ *             SOCKET_INIT or traceback of the following functions:
+ *             - ServerInit()
+ *             - ServerMakeNonBlocking()
+ *             - SpscQueueInit()
+ *
+ * @since      0.0.1
+ *
+ * @note       The server may be configured through its server field until
+ *             ThreadedServerStart(), e.g. with ServerSetCompression() or
+ *             ServerSetCoalescing(). Its timeout and listener belong to the
+ *             network thread and mustn't be changed.
+ */
+RETCODE
+ThreadedServerInit(ThreadedServer* srv, Address* addr);
+
+/**
+ * @brief      Stops the network thread and destroys the threaded server.
+ *
+ * @param      srv   The pointer to the threaded server.
+ *
+ * @since      0.0.1
+ *
+ * @note       It's guaranteed ThreadedServerDestroy() will work correctly
+ *             after unsuccessful ThreadedServerInit().
+ */
+void ThreadedServerDestroy(ThreadedServer* srv);
+
+/**
+ * @brief      Starts the network thread.
+ *
+ * @param      srv   The pointer to the threaded server.
+ *
+ * @return     SUCCESS when the thread is started, and SERVER_THREAD_START when
+ *             error occures.
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ThreadedServerStart(ThreadedServer* srv);
+
+/**
+ * @brief      Stops the network thread and waits for it. Responses still
+ *             queued are kept until the thread is started again.
+ *
+ * @param      srv   The pointer to the threaded server.
+ *
+ * @since      0.0.1
+ */
+void ThreadedServerStop(ThreadedServer* srv);
+
+/**
+ * @brief      Takes the next received response. Called by the game thread.
+ *
+ * @param      srv       The pointer to the threaded server.
+ * @param      response  The pointer to the initialized response the received
+ *                       one is copied to.
+ *
+ * @return     SUCCESS when a response is taken, and SOCKET_TIMEOUT when
+ *             nothing is received yet.
+ *
+ * @since      0.0.1
+ *
+ * @note       Clients which disconnect or are evicted after the idle timeout
+ *             are reported with a DISCONNECT response, after all the other
+ *             responses received from them.
+ */
+RETCODE
+ThreadedServerReceive(ThreadedServer* srv, Response* response);
+
+/**
+ * @brief      Queues the response to the specified client, see ServerSendTo().
+ *             Called by the game thread.
+ *
+ * @param      srv       The pointer to the threaded server.
+ * @param      response  The pointer to the response. Client ID must be set on
+ *                       response.
+ *
+ * @return     SUCCESS when the response is queued, PACKET_TOO_LARGE when the
+ *             payload exceeds kMaxPayload, and POOL_EXHAUSTED when the queue
+ *             is full.
+ *
+ * @since      0.0.1
+ *
+ * @note       The response is sent by the network thread, so errors of the
+ *             send aren't reported back. Sends the socket failed are counted
+ *             in the statistics.
+ */
+RETCODE
+ThreadedServerSend(ThreadedServer* srv, Response* response);
+
+/**
+ * @brief      Queues the response to the specified client through the
+ *             reliable-ordered channel, see ServerSendReliable(). Called by
+ *             the game thread.
+ *
+ * @param      srv       The pointer to the threaded server.
+ * @param      response  The pointer to the response. Client ID must be set on
+ *                       response.
+ *
+ * @return     Same as ThreadedServerSend().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ThreadedServerSendReliable(ThreadedServer* srv, Response* response);
+
+/**
+ * @brief      Queues the state snapshot to the specified client, see
+ *             ServerSendSnapshot(). Called by the game thread.
+ *
+ * @param      srv       The pointer to the threaded server.
+ * @param      response  The pointer to the response with the snapshot. Client
+ *                       ID must be set on response.
+ *
+ * @return     Same as ThreadedServerSend().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ThreadedServerSendSnapshot(ThreadedServer* srv, Response* response);
+
+/**
+ * @brief      Queues the response to all of the connected clients, see
+ *             ServerSend(). Called by the game thread.
+ *
+ * @param      srv       The pointer to the threaded server.
+ * @param      response  The pointer to the response.
+ *
+ * @return     Same as ThreadedServerSend().
+ *
+ * @since      0.0.1
+ */
+RETCODE
+ThreadedServerBroadcast(ThreadedServer* srv, Response* response);
+
+/**
+ * @brief      Takes a snapshot of the statistics of the server. Can be called
+ *             from any thread, also while the network thread runs.
+ *
+ * @param      srv    The pointer to the threaded server.
+ * @param      stats  The pointer to the snapshot.
+ *
+ * @since      0.0.1
+ */
+void ThreadedServerGetStats(ThreadedServer* srv, StatsSnapshot* stats);
@@ -2,17 +2,45 @@
 
 #include <string.h>
 
+#include "common/clock.h"
 #include "common/macro.h"
 #include "common/retcode.h"
+#include "common/stats.h"
+#include "networking/fragment.h"
 #include "networking/packet.h"
+#include "networking/pool.h"
+#include "networking/reliable.h"
+#include "networking/snapshot.h"
 #include "networking/socket.h"
 
+const uint64_t kClientKeepAlive = 1000;
+static const size_t kClientBurstSize = kSocketMaxSegments;
+
 RETCODE
 ClientInit(Client* client, Address* addr) {
-  THROW_OR_CONTINUE(SocketInit(&client->socket));
-  RETCODE result = AddressInit(&client->addr, NULL, 0);
+  client->pool.slab = NULL;
+  client->pool.free_buffers = NULL;
+  ReliableEndpointInit(&client->reliable);
+  FragmentChannelInit(&client->fragments);
+  SnapshotChannelInit(&client->snapshots);
+  client->compression = NULL;
+  client->last_send = ClockNow();
+  client->keepalive = kClientKeepAlive;
+  StatsInit(&client->stats);
+  client->coalescing = 0;
+  PacketQueueInit(&client->queue);
+  client->held.ptr = NULL;
+  client->held_iter = (DatagramIter){0};
+  THROW_OR_CONTINUE(ResponseInit(&client->scratch));
+  RETCODE result = SocketInit(&client->socket);
+  if (result != SUCCESS) {
+    ResponseDestroy(&client->scratch);
+    return result;
+  }
+  result = AddressInit(&client->addr, NULL, 0);
   if (result != SUCCESS) {
     SocketDestroy(&client->socket);
+    ResponseDestroy(&client->scratch);
     return result;
   }
   AddressCopy(&client->addr, addr);
@@ -20,6 +48,14 @@ ClientInit(Client* client, Address* addr) {
   if (result != SUCCESS) {
     SocketDestroy(&client->socket);
     AddressDestroy(&client->addr);
+    ResponseDestroy(&client->scratch);
+    return result;
+  }
+  result = BufferPoolInit(&client->pool, kBasePoolSize);
+  if (result != SUCCESS) {
+    SocketDestroy(&client->socket);
+    AddressDestroy(&client->addr);
+    ResponseDestroy(&client->scratch);
     return result;
   }
   return SUCCESS;
@@ -28,30 +64,314 @@ ClientInit(Client* client, Address* addr) {
 void ClientDestroy(Client* client) {
   SocketDestroy(&client->socket);
   AddressDestroy(&client->addr);
+  BufferPoolDestroy(&client->pool);
+  ReliableEndpointDestroy(&client->reliable);
+  FragmentChannelDestroy(&client->fragments);
+  SnapshotChannelDestroy(&client->snapshots);
+  ResponseDestroy(&client->scratch);
+  PacketQueueDestroy(&client->queue);
+  DataDestroy(&client->held);
+}
+
+RETCODE
+ClientFlush(Client* client) {
+  if (PacketQueueEmpty(&client->queue)) {
+    return SUCCESS;
+  }
+  RETCODE result =
+      SocketSend(&client->socket, &client->queue.data, &client->addr);
+  if (result == SUCCESS) {
+    StatsAdd(&client->stats.counters.packets_out, 1);
+    StatsAdd(&client->stats.counters.bytes_out, client->queue.data.len);
+    client->last_send = ClockNow();
+  } else {
+    StatsAdd(&client->stats.counters.send_errors, 1);
+  }
+  PacketQueueClear(&client->queue);
+  THROW_OR_CONTINUE(result);
+  return SUCCESS;
+}
+
+// Appends the response to the next datagram, a full one is sent first.
+static RETCODE ClientQueue(Client* client, Response* response) {
+  ReliableEndpointWriteAcks(&client->reliable, response);
+  RETCODE result =
+      PacketQueuePush(&client->queue, response, client->compression);
+  if (result == PACKET_TOO_LARGE && !PacketQueueEmpty(&client->queue)) {
+    ClientFlush(client);
+    result = PacketQueuePush(&client->queue, response, client->compression);
+  }
+  THROW_OR_CONTINUE(result);
+  return SUCCESS;
+}
+
+static RETCODE ClientSendRaw(Client* client, Response* response) {
+  if (client->coalescing && ResponseGetType(response) != DISCONNECT) {
+    THROW_OR_CONTINUE(ClientQueue(client, response));
+    return SUCCESS;
+  }
+  Data data;
+  THROW_OR_CONTINUE(BufferPoolAcquire(&client->pool, &data));
+  ReliableEndpointWriteAcks(&client->reliable, response);
+  RETCODE result =
+      ResponseToDataCompressed(response, &data, client->compression);
+  if (result == SUCCESS) {
+    result = SocketSend(&client->socket, &data, &client->addr);
+    if (result == SUCCESS) {
+      StatsAdd(&client->stats.counters.packets_out, 1);
+      StatsAdd(&client->stats.counters.bytes_out, data.len);
+    } else {
+      StatsAdd(&client->stats.counters.send_errors, 1);
+    }
+  }
+  BufferPoolRelease(&client->pool, &data);
+  THROW_OR_CONTINUE(result);
+  client->last_send = ClockNow();
+  return SUCCESS;
+}
+
+static RETCODE ClientPumpFragments(Client* client, uint64_t now) {
+  RETCODE result = SUCCESS;
+  if (FragmentChannelNextAck(&client->fragments, &client->scratch)) {
+    result = ClientSendRaw(client, &client->scratch);
+  }
+  uint64_t timeout = ReliableEndpointTimeout(&client->reliable);
+  Data burst[kClientBurstSize];
+  size_t count;
+  do {
+    // With segmentation offload the whole burst is a single send.
+    count = 0;
+    while (count < kClientBurstSize &&
+           BufferPoolAcquire(&client->pool, &burst[count]) == SUCCESS) {
+      if (!FragmentChannelNextFragment(&client->fragments, now, timeout,
+                                       &client->scratch)) {
+        BufferPoolRelease(&client->pool, &burst[count]);
+        break;
+      }
+      ReliableEndpointWriteAcks(&client->reliable, &client->scratch);
+      if (ResponseToDataCompressed(&client->scratch, &burst[count],
+                                   client->compression) != SUCCESS) {
+        BufferPoolRelease(&client->pool, &burst[count]);
+        break;
+      }
+      ++count;
+    }
+    RETCODE sent = SUCCESS;
+    if (count != 0) {
+      sent = SocketSendSegments(&client->socket, burst, count, &client->addr);
+    }
+    if (sent != SUCCESS) {
+      StatsAdd(&client->stats.counters.send_errors, 1);
+      result = sent;
+    } else if (count != 0) {
+      StatsAdd(&client->stats.counters.packets_out, count);
+      client->last_send = now;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      if (sent == SUCCESS) {
+        StatsAdd(&client->stats.counters.bytes_out, burst[i].len);
+      }
+      BufferPoolRelease(&client->pool, &burst[i]);
+    }
+  } while (count == kClientBurstSize);
+  return result;
+}
+
+// Keeps the unread packets of the datagram until they're asked for.
+static void ClientHold(Client* client, DatagramIter* iter) {
+  if (client->held.ptr == NULL && DataInit(&client->held) != SUCCESS) {
+    StatsAdd(&client->stats.counters.malformed, 1);
+    return;
+  }
+  memcpy(client->held.ptr, iter->rest.ptr, iter->rest.len);
+  client->held.len = iter->rest.len;
+  DatagramIterInit(&client->held_iter, &client->held);
+}
+
+// With view the response keeps the buffer of the datagram instead of its own
+// one from the pool, unless the payload had to be decoded into it.
+static RETCODE ClientRAWReceive(Client* client, Response* response, int view) {
+  RETCODE result;
+  if (!DatagramIterStopped(&client->held_iter)) {
+    result = DatagramIterNext(&client->held_iter, response,
+                              client->compression);
+    if (result != SUCCESS) {
+      StatsAdd(&client->stats.counters.malformed, 1);
+    }
+    THROW_OR_CONTINUE(result);
+    return SUCCESS;
+  }
+  Data data;
+  THROW_OR_CONTINUE(BufferPoolAcquire(&client->pool, &data));
+  char* own = response->data.ptr;
+  result = SocketReceive(&client->socket, &data, NULL);
+  if (result == SUCCESS) {
+    StatsAdd(&client->stats.counters.packets_in, 1);
+    StatsAdd(&client->stats.counters.bytes_in, data.len);
+    DatagramIter iter;
+    DatagramIterInit(&iter, &data);
+    if (view) {
+      result = DatagramIterNextView(&iter, response, client->compression);
+    } else {
+      result = DatagramIterNext(&iter, response, client->compression);
+    }
+    if (result != SUCCESS) {
+      StatsAdd(&client->stats.counters.malformed, 1);
+    } else if (!DatagramIterStopped(&iter)) {
+      ClientHold(client, &iter);
+    }
+  } else if (result == SOCKET_TIMEOUT) {
+    StatsAdd(&client->stats.counters.receive_timeouts, 1);
+  }
+  if (response->data.ptr != own) {
+    data.ptr = own;
+  }
+  BufferPoolRelease(&client->pool, &data);
+  THROW_OR_CONTINUE(result);
+  return SUCCESS;
+}
+
+static RETCODE ClientReceiveWith(Client* client, Response* response,
+                                 int view) {
+  if (ReliableEndpointPop(&client->reliable, response)) {
+    return SUCCESS;
+  }
+  THROW_OR_CONTINUE(ClientRAWReceive(client, response, view));
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&client->stats);
+  uint64_t now = ClockNow();
+  THROW_OR_CONTINUE(ReliableEndpointReceive(&client->reliable, response, now));
+  switch (ResponseGetType(response)) {
+    case DISCONNECT: {
+      StatsAdd(&client->stats.counters.disconnects, 1);
+      return CLIENT_KICKED;
+    }
+    case RELIABLE: {
+      if (!ReliableEndpointPop(&client->reliable, response)) {
+        return RELIABLE_PENDING;
+      }
+      break;
+    }
+    case ACK: {
+      return RELIABLE_PENDING;
+    }
+    case SNAPSHOT: {
+      return SnapshotChannelReceive(&client->snapshots, response);
+    }
+    case FRAGMENT:
+    case FRAGMENT_ACK: {
+      RETCODE result = FragmentChannelReceive(&client->fragments, response);
+      // Acks are sent in batches, and each of them opens the window further.
+      if (ResponseGetType(response) == FRAGMENT_ACK ||
+          FragmentChannelAckDue(&client->fragments)) {
+        ClientPumpFragments(client, now);
+      }
+      return result;
+    }
+    default: {
+      break;
+    }
+  }
+  return SUCCESS;
 }
 
 RETCODE
 ClientReceive(Client* client, Response* response) {
-  RAII(DataDestroy) Data data;
-  THROW_OR_CONTINUE(DataInit(&data));
-  THROW_OR_CONTINUE(SocketReceive(&client->socket, &data, NULL));
-  THROW_OR_CONTINUE(DataToResponse(&data, response));
-  if (ResponseGetType(response) == DISCONNECT) {
-    return CLIENT_KICKED;
+  THROW_OR_CONTINUE(ClientReceiveWith(client, response, 0));
+  return SUCCESS;
+}
+
+RETCODE
+ClientReceiveView(Client* client, Response* response) {
+  // Packets which can't be viewed in place are copied into this buffer.
+  THROW_OR_CONTINUE(BufferPoolAcquire(&client->pool, &response->data));
+  RETCODE result = ClientReceiveWith(client, response, 1);
+  if (result != SUCCESS) {
+    ClientReleaseView(client, response);
   }
+  THROW_OR_CONTINUE(result);
   return SUCCESS;
 }
 
+void ClientReleaseView(Client* client, Response* response) {
+  BufferPoolReleaseAt(&client->pool, response->data.ptr);
+  response->data.ptr = NULL;
+  response->data.len = 0;
+}
+
 RETCODE
 ClientSend(Client* client, Response* response) {
-  RAII(DataDestroy) Data data;
-  THROW_OR_CONTINUE(DataInit(&data));
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&client->stats);
   ResponseSetType(response, CONNECT);
-  THROW_OR_CONTINUE(ResponseToData(response, &data));
-  THROW_OR_CONTINUE(SocketSend(&client->socket, &data, &client->addr))
+  THROW_OR_CONTINUE(ClientSendRaw(client, response));
+  return SUCCESS;
+}
+
+RETCODE
+ClientSendReliable(Client* client, Response* response) {
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&client->stats);
+  THROW_OR_CONTINUE(
+      ReliableEndpointSend(&client->reliable, response, ClockNow()));
+  ClientSendRaw(client, response);
+  return SUCCESS;
+}
+
+RETCODE
+ClientUpdate(Client* client) {
+  static char kEmpty[1];
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&client->stats);
+  uint64_t now = ClockNow();
+  RETCODE result = SUCCESS;
+  Response response;
+  while (ReliableEndpointNextResend(&client->reliable, now, &response)) {
+    RETCODE sent = ClientSendRaw(client, &response);
+    if (sent != SUCCESS) {
+      result = sent;
+    }
+  }
+  RETCODE sent = ClientPumpFragments(client, now);
+  if (sent != SUCCESS) {
+    result = sent;
+  }
+  if (SnapshotChannelNextAck(&client->snapshots, &client->scratch)) {
+    sent = ClientSendRaw(client, &client->scratch);
+    if (sent != SUCCESS) {
+      result = sent;
+    }
+  }
+  int idle =
+      client->keepalive != 0 && client->last_send + client->keepalive <= now;
+  if (client->reliable.acks_pending || idle) {
+    response = (Response){.type = ACK, .data = {.ptr = kEmpty, .len = 0}};
+    sent = ClientSendRaw(client, &response);
+    if (sent != SUCCESS) {
+      result = sent;
+    }
+  }
+  sent = ClientFlush(client);
+  if (sent != SUCCESS) {
+    result = sent;
+  }
+  return result;
+}
+
+RETCODE
+ClientSendLarge(Client* client, const char* data, size_t len) {
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&client->stats);
+  THROW_OR_CONTINUE(FragmentChannelSend(&client->fragments, data, len));
+  ClientPumpFragments(client, ClockNow());
+  return SUCCESS;
+}
+
+RETCODE
+ClientTakeLarge(Client* client, Data* out) {
+  THROW_OR_CONTINUE(FragmentChannelTake(&client->fragments, out));
   return SUCCESS;
 }
 
+void ClientSetCompression(Client* client, const HuffmanTable* table) {
+  client->compression = table;
+}
+
 RETCODE
 ClientSetTimeout(Client* client, time_t milliseconds) {
   THROW_OR_CONTINUE(SocketSetTimeout(&client->socket, milliseconds));
@@ -63,3 +383,48 @@ ClientMakeNonBlocking(Client* client) {
   THROW_OR_CONTINUE(SocketMakeNonBlocking(&client->socket));
   return SUCCESS;
 }
+
+RETCODE
+ClientSetBackend(Client* client, SocketBackend backend) {
+  THROW_OR_CONTINUE(SocketSetBackend(&client->socket, backend));
+  return SUCCESS;
+}
+
+RETCODE
+ClientSetOffload(Client* client, int enable) {
+  THROW_OR_CONTINUE(SocketSetOffload(&client->socket, enable));
+  return SUCCESS;
+}
+
+RETCODE
+ClientSetCoalescing(Client* client, int enable) {
+  RETCODE result = SUCCESS;
+  if (!enable) {
+    result = ClientFlush(client);
+  }
+  client->coalescing = enable;
+  return result;
+}
+
+void ClientSetKeepAlive(Client* client, uint64_t milliseconds) {
+  client->keepalive = milliseconds;
+}
+
+RETCODE
+ClientSetPoolSize(Client* client, size_t size) {
+  THROW_OR_CONTINUE(BufferPoolResize(&client->pool, size));
+  return SUCCESS;
+}
+
+size_t ClientGetPoolHighWater(Client* client) {
+  return BufferPoolHighWater(&client->pool);
+}
+
+void ClientGetStats(Client* client, StatsSnapshot* stats) {
+  StatsTake(&client->stats, stats);
+}
+
+void ClientGetLinkStats(Client* client, StatsLink* link) {
+  StatsLinkFill(link, &client->reliable);
+  link->bandwidth = 0;
+}
@@ -0,0 +1,19 @@
+#include "common/clock.h"
+
+#include <time.h>
+
+#ifdef __LINUX__
+uint64_t ClockNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t ClockNowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+#else
+#error "Unsupported platform"
+#endif
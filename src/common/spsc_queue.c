@@ -0,0 +1,59 @@
+#include "common/spsc_queue.h"
+
+#include <stdlib.h>
+
+#include "common/retcode.h"
+
+static const size_t kCacheLineSize = 64;
+
+RETCODE
+SpscQueueInit(SpscQueue* queue, size_t capacity, size_t size) {
+  size_t count = 1;
+  while (count < capacity) {
+    count *= 2;
+  }
+  // Neighbour slots written by different threads don't share a cache line.
+  queue->stride = (size + kCacheLineSize - 1) / kCacheLineSize * kCacheLineSize;
+  queue->slots = (char*)aligned_alloc(kCacheLineSize, count * queue->stride);
+  if (queue->slots == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  queue->mask = (uint32_t)(count - 1);
+  queue->tail = 0;
+  queue->head = 0;
+  return SUCCESS;
+}
+
+void SpscQueueDestroy(SpscQueue* queue) {
+  free(queue->slots);
+  queue->slots = NULL;
+}
+
+size_t SpscQueueWritable(SpscQueue* queue) {
+  uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+  return queue->mask + 1 - (queue->tail - head);
+}
+
+void* SpscQueueSlotToWrite(SpscQueue* queue, size_t offset) {
+  uint32_t position = (queue->tail + (uint32_t)offset) & queue->mask;
+  return queue->slots + position * queue->stride;
+}
+
+void SpscQueuePush(SpscQueue* queue, size_t count) {
+  __atomic_store_n(&queue->tail, queue->tail + (uint32_t)count,
+                   __ATOMIC_RELEASE);
+}
+
+size_t SpscQueueReadable(SpscQueue* queue) {
+  return __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) - queue->head;
+}
+
+void* SpscQueueSlotToRead(SpscQueue* queue, size_t offset) {
+  uint32_t position = (queue->head + (uint32_t)offset) & queue->mask;
+  return queue->slots + position * queue->stride;
+}
+
+void SpscQueuePop(SpscQueue* queue, size_t count) {
+  __atomic_store_n(&queue->head, queue->head + (uint32_t)count,
+                   __ATOMIC_RELEASE);
+}
@@ -0,0 +1,127 @@
+#include "common/stats.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "common/clock.h"
+
+// log2(kStatsSubBuckets)
+static const int kStatsSubBits = 4;
+
+static uint64_t StatsLoad(const uint64_t* counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static size_t StatsBucket(uint64_t value) {
+  if (value < kStatsSubBuckets) {
+    return (size_t)value;
+  }
+  int exponent = 63 - __builtin_clzll(value);
+  size_t bucket =
+      (size_t)(exponent - kStatsSubBits + 1) * kStatsSubBuckets +
+      (size_t)((value >> (exponent - kStatsSubBits)) & (kStatsSubBuckets - 1));
+  return bucket < kStatsBuckets ? bucket : kStatsBuckets - 1;
+}
+
+static uint64_t StatsBucketMax(size_t bucket) {
+  if (bucket < kStatsSubBuckets) {
+    return bucket;
+  }
+  int shift = (int)(bucket / kStatsSubBuckets) - 1;
+  uint64_t low = (uint64_t)(kStatsSubBuckets + bucket % kStatsSubBuckets)
+                 << shift;
+  return low + ((uint64_t)1 << shift) - 1;
+}
+
+void StatsInit(Stats* stats) {
+  memset(stats, 0, sizeof(Stats));
+}
+
+void StatsAdd(uint64_t* counter, uint64_t value) {
+  // Only the owner writes, so the read-modify-write needn't be atomic.
+  __atomic_store_n(counter, StatsLoad(counter) + value, __ATOMIC_RELAXED);
+}
+
+void StatsRecord(Stats* stats, uint64_t nanoseconds) {
+  StatsHistogram* latency = &stats->latency;
+  StatsAdd(&latency->buckets[StatsBucket(nanoseconds)], 1);
+  StatsAdd(&latency->count, 1);
+  StatsAdd(&latency->sum, nanoseconds);
+  if (nanoseconds > StatsLoad(&latency->max)) {
+    __atomic_store_n(&latency->max, nanoseconds, __ATOMIC_RELAXED);
+  }
+}
+
+StatsScope StatsScopeBegin(Stats* stats) {
+  return (StatsScope){.stats = stats, .start = ClockNowNs()};
+}
+
+void StatsScopeEnd(StatsScope* scope) {
+  StatsRecord(scope->stats, ClockNowNs() - scope->start);
+}
+
+void StatsTake(Stats* stats, StatsSnapshot* snapshot) {
+  const uint64_t* from = (const uint64_t*)&stats->counters;
+  uint64_t* to = (uint64_t*)&snapshot->counters;
+  for (size_t i = 0; i < sizeof(StatsCounters) / sizeof(uint64_t); ++i) {
+    to[i] = StatsLoad(&from[i]);
+  }
+  StatsHistogram* latency = &snapshot->latency;
+  latency->count = StatsLoad(&stats->latency.count);
+  latency->sum = StatsLoad(&stats->latency.sum);
+  latency->max = StatsLoad(&stats->latency.max);
+  for (size_t i = 0; i < kStatsBuckets; ++i) {
+    latency->buckets[i] = StatsLoad(&stats->latency.buckets[i]);
+  }
+}
+
+void StatsMerge(StatsSnapshot* snapshot, const StatsSnapshot* other) {
+  const uint64_t* from = (const uint64_t*)&other->counters;
+  uint64_t* to = (uint64_t*)&snapshot->counters;
+  for (size_t i = 0; i < sizeof(StatsCounters) / sizeof(uint64_t); ++i) {
+    to[i] += from[i];
+  }
+  StatsHistogram* latency = &snapshot->latency;
+  latency->count += other->latency.count;
+  latency->sum += other->latency.sum;
+  if (other->latency.max > latency->max) {
+    latency->max = other->latency.max;
+  }
+  for (size_t i = 0; i < kStatsBuckets; ++i) {
+    latency->buckets[i] += other->latency.buckets[i];
+  }
+}
+
+uint64_t StatsPercentile(const StatsHistogram* histogram, double percent) {
+  // Buckets are summed up instead of using count, which may run ahead of
+  // them in a snapshot taken from another thread.
+  uint64_t total = 0;
+  for (size_t i = 0; i < kStatsBuckets; ++i) {
+    total += histogram->buckets[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(percent / 100 * (double)total + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kStatsBuckets; ++i) {
+    seen += histogram->buckets[i];
+    // The last bucket also holds everything larger.
+    if (seen >= rank && i != kStatsBuckets - 1) {
+      uint64_t value = StatsBucketMax(i);
+      return value < histogram->max ? value : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+void StatsLinkFill(StatsLink* link, ReliableEndpoint* endpoint) {
+  link->rtt = endpoint->rtt;
+  link->rtt_variance = endpoint->rtt_variance;
+  uint64_t acked = endpoint->acked_count;
+  uint64_t lost = endpoint->lost_count;
+  link->loss = acked + lost == 0 ? 0 : (double)lost / (double)(acked + lost);
+}
@@ -0,0 +1,116 @@
+#include "common/timer_wheel.h"
+
+static const unsigned kTimerWheelSlotBits = 6;
+
+static uint64_t TimerWheelSpan(unsigned level) {
+  return (uint64_t)1 << (kTimerWheelSlotBits * level);
+}
+
+static void TimerListPush(TimerNode** head, TimerNode* node) {
+  node->next = *head;
+  if (node->next != NULL) {
+    node->next->link = &node->next;
+  }
+  *head = node;
+  node->link = head;
+}
+
+static void TimerListUnlink(TimerNode* node) {
+  *node->link = node->next;
+  if (node->next != NULL) {
+    node->next->link = node->link;
+  }
+  node->next = NULL;
+  node->link = NULL;
+}
+
+static void TimerWheelInsert(TimerWheel* wheel, TimerNode* node) {
+  if (node->expires <= wheel->now) {
+    TimerListPush(&wheel->expired, node);
+    return;
+  }
+  uint64_t delta = node->expires - wheel->now;
+  if (delta >= TimerWheelSpan(kTimerWheelLevels)) {
+    node->expires = wheel->now + TimerWheelSpan(kTimerWheelLevels) - 1;
+    delta = node->expires - wheel->now;
+  }
+  unsigned level = 0;
+  while (delta >= TimerWheelSpan(level + 1)) {
+    ++level;
+  }
+  // The slot is reached when the time passes the lower bits of expires.
+  size_t slot = (node->expires >> (kTimerWheelSlotBits * level)) &
+                (kTimerWheelSlots - 1);
+  TimerListPush(&wheel->slots[level][slot], node);
+}
+
+// Moves the timers of the slot reached by the time to the inner wheels.
+static void TimerWheelCascade(TimerWheel* wheel, unsigned level) {
+  size_t slot = (wheel->now >> (kTimerWheelSlotBits * level)) &
+                (kTimerWheelSlots - 1);
+  TimerNode* node = wheel->slots[level][slot];
+  wheel->slots[level][slot] = NULL;
+  while (node != NULL) {
+    TimerNode* next = node->next;
+    TimerWheelInsert(wheel, node);
+    node = next;
+  }
+}
+
+static void TimerWheelTick(TimerWheel* wheel) {
+  ++wheel->now;
+  unsigned top = 0;
+  while (top + 1 < kTimerWheelLevels &&
+         (wheel->now & (TimerWheelSpan(top + 1) - 1)) == 0) {
+    ++top;
+  }
+  for (unsigned level = top; level > 0; --level) {
+    TimerWheelCascade(wheel, level);
+  }
+  TimerNode** slot = &wheel->slots[0][wheel->now & (kTimerWheelSlots - 1)];
+  while (*slot != NULL) {
+    TimerNode* node = *slot;
+    TimerListUnlink(node);
+    TimerListPush(&wheel->expired, node);
+  }
+}
+
+void TimerWheelInit(TimerWheel* wheel, uint64_t now) {
+  *wheel = (TimerWheel){.now = now};
+}
+
+void TimerNodeInit(TimerNode* node) {
+  *node = (TimerNode){0};
+}
+
+void TimerWheelSchedule(TimerWheel* wheel, TimerNode* node, uint64_t expires) {
+  TimerWheelCancel(wheel, node);
+  node->expires = expires;
+  TimerWheelInsert(wheel, node);
+  ++wheel->count;
+}
+
+void TimerWheelCancel(TimerWheel* wheel, TimerNode* node) {
+  if (node->link == NULL) {
+    return;
+  }
+  TimerListUnlink(node);
+  --wheel->count;
+}
+
+int TimerWheelNextExpired(TimerWheel* wheel, uint64_t now, TimerNode** node) {
+  while (wheel->expired == NULL && wheel->now < now) {
+    if (wheel->count == 0) {
+      // Nothing to move, so the idle time is skipped at once.
+      wheel->now = now;
+      break;
+    }
+    TimerWheelTick(wheel);
+  }
+  if (wheel->expired == NULL) {
+    return 0;
+  }
+  *node = wheel->expired;
+  TimerWheelCancel(wheel, *node);
+  return 1;
+}
@@ -0,0 +1,330 @@
+#include "event/loop.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "common/macro.h"
+#include "common/retcode.h"
+
+static const size_t kEventLoopBatchSize = 16;
+static const int kEventLoopMaxEvents = 64;
+
+static void EventLoopOnConnect(void* user_data, uint16_t client_id) {
+  EventSource* source = (EventSource*)user_data;
+  if (source->server_callbacks.on_connect != NULL) {
+    source->server_callbacks.on_connect((Server*)source->target, client_id,
+                                        source->user_data);
+  }
+}
+
+static void EventLoopOnDisconnect(void* user_data, uint16_t client_id) {
+  EventSource* source = (EventSource*)user_data;
+  if (source->server_callbacks.on_disconnect != NULL) {
+    source->server_callbacks.on_disconnect((Server*)source->target, client_id,
+                                           source->user_data);
+  }
+}
+
+static RETCODE EventLoopWatch(EventLoop* loop, EventSource* source) {
+  if (loop->sources_count == loop->sources_capacity) {
+    size_t capacity =
+        loop->sources_capacity == 0 ? 4 : 2 * loop->sources_capacity;
+    EventSource** sources = (EventSource**)realloc(
+        loop->sources, capacity * sizeof(EventSource*));
+    if (sources == NULL) {
+      return NOT_ENOUGH_MEMORY;
+    }
+    loop->sources = sources;
+    loop->sources_capacity = capacity;
+  }
+  struct epoll_event event =
+      (struct epoll_event){.events = EPOLLIN, .data.ptr = source};
+  if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, source->fd, &event) < 0) {
+    return EVENT_LOOP_ADD;
+  }
+  loop->sources[loop->sources_count++] = source;
+  return SUCCESS;
+}
+
+static EventSource* EventLoopNewSource(EventSourceKind kind, int fd,
+                                       void* target, void* user_data) {
+  EventSource* source = (EventSource*)calloc(1, sizeof(EventSource));
+  if (source != NULL) {
+    source->kind = kind;
+    source->fd = fd;
+    source->target = target;
+    source->user_data = user_data;
+  }
+  return source;
+}
+
+static void EventLoopUnwatchSource(EventLoop* loop, EventSource* source) {
+  epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+  if (source->kind == SERVER_SOURCE) {
+    ServerSetListener((Server*)source->target, NULL);
+  } else if (source->kind == TIMER_SOURCE) {
+    close(source->fd);
+  }
+  // Freed after dispatch, pending events may still point to it.
+  source->removed = 1;
+}
+
+static void EventLoopUnwatch(EventLoop* loop, void* target) {
+  for (size_t i = 0; i < loop->sources_count; ++i) {
+    EventSource* source = loop->sources[i];
+    if (source->target == target && !source->removed) {
+      EventLoopUnwatchSource(loop, source);
+    }
+  }
+}
+
+static void EventLoopSweep(EventLoop* loop) {
+  size_t kept = 0;
+  for (size_t i = 0; i < loop->sources_count; ++i) {
+    if (loop->sources[i]->removed) {
+      free(loop->sources[i]);
+    } else {
+      loop->sources[kept++] = loop->sources[i];
+    }
+  }
+  loop->sources_count = kept;
+}
+
+RETCODE
+EventLoopInit(EventLoop* loop) {
+  loop->sources = NULL;
+  loop->sources_count = 0;
+  loop->sources_capacity = 0;
+  loop->running = 0;
+  loop->responses = (Response*)calloc(kEventLoopBatchSize, sizeof(Response));
+  loop->epoll_fd = epoll_create1(0);
+  if (loop->responses == NULL || loop->epoll_fd < 0) {
+    RETCODE result =
+        loop->responses == NULL ? NOT_ENOUGH_MEMORY : EVENT_LOOP_INIT;
+    EventLoopDestroy(loop);
+    return result;
+  }
+  for (size_t i = 0; i < kEventLoopBatchSize; ++i) {
+    RETCODE result = ResponseInit(&loop->responses[i]);
+    if (result != SUCCESS) {
+      EventLoopDestroy(loop);
+      return result;
+    }
+  }
+  return SUCCESS;
+}
+
+void EventLoopDestroy(EventLoop* loop) {
+  for (size_t i = 0; i < loop->sources_count; ++i) {
+    EventSource* source = loop->sources[i];
+    if (!source->removed) {
+      if (source->kind == SERVER_SOURCE) {
+        ServerSetListener((Server*)source->target, NULL);
+      } else if (source->kind == TIMER_SOURCE) {
+        close(source->fd);
+      }
+    }
+    free(source);
+  }
+  free(loop->sources);
+  loop->sources = NULL;
+  loop->sources_count = 0;
+  if (loop->responses != NULL) {
+    for (size_t i = 0; i < kEventLoopBatchSize; ++i) {
+      ResponseDestroy(&loop->responses[i]);
+    }
+    free(loop->responses);
+    loop->responses = NULL;
+  }
+  if (loop->epoll_fd >= 0) {
+    close(loop->epoll_fd);
+    loop->epoll_fd = -1;
+  }
+}
+
+RETCODE
+EventLoopAddServer(EventLoop* loop, Server* srv, ServerCallbacks* callbacks,
+                   void* user_data) {
+  THROW_OR_CONTINUE(ServerMakeNonBlocking(srv));
+  EventSource* source = EventLoopNewSource(
+      SERVER_SOURCE, SocketPollFd(&srv->socket), srv, user_data);
+  if (source == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  source->server_callbacks = *callbacks;
+  RETCODE result = EventLoopWatch(loop, source);
+  if (result != SUCCESS) {
+    free(source);
+    return result;
+  }
+  ServerListener listener =
+      (ServerListener){.on_connect = EventLoopOnConnect,
+                       .on_disconnect = EventLoopOnDisconnect,
+                       .user_data = source};
+  ServerSetListener(srv, &listener);
+  return SUCCESS;
+}
+
+RETCODE
+EventLoopAddClient(EventLoop* loop, Client* client, ClientCallbacks* callbacks,
+                   void* user_data) {
+  THROW_OR_CONTINUE(ClientMakeNonBlocking(client));
+  EventSource* source = EventLoopNewSource(
+      CLIENT_SOURCE, SocketPollFd(&client->socket), client, user_data);
+  if (source == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  source->client_callbacks = *callbacks;
+  RETCODE result = EventLoopWatch(loop, source);
+  if (result != SUCCESS) {
+    free(source);
+    return result;
+  }
+  return SUCCESS;
+}
+
+RETCODE
+EventLoopAddTimer(EventLoop* loop, time_t milliseconds, TimerCallback callback,
+                  void* user_data, EventSource** timer) {
+  // A zero period would disarm the timer, and it would never fire.
+  if (milliseconds <= 0) {
+    return EVENT_LOOP_TIMER_PERIOD;
+  }
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    return EVENT_LOOP_INIT;
+  }
+  struct timespec period =
+      (struct timespec){.tv_sec = milliseconds / 1000,
+                        .tv_nsec = milliseconds % 1000 * 1000000};
+  struct itimerspec spec =
+      (struct itimerspec){.it_interval = period, .it_value = period};
+  if (timerfd_settime(fd, 0, &spec, NULL) < 0) {
+    close(fd);
+    return EVENT_LOOP_INIT;
+  }
+  EventSource* source = EventLoopNewSource(TIMER_SOURCE, fd, NULL, user_data);
+  if (source == NULL) {
+    close(fd);
+    return NOT_ENOUGH_MEMORY;
+  }
+  source->timer_callback = callback;
+  RETCODE result = EventLoopWatch(loop, source);
+  if (result != SUCCESS) {
+    close(fd);
+    free(source);
+    return result;
+  }
+  if (timer != NULL) {
+    *timer = source;
+  }
+  return SUCCESS;
+}
+
+void EventLoopRemoveServer(EventLoop* loop, Server* srv) {
+  EventLoopUnwatch(loop, srv);
+}
+
+void EventLoopRemoveClient(EventLoop* loop, Client* client) {
+  EventLoopUnwatch(loop, client);
+}
+
+void EventLoopRemoveTimer(EventLoop* loop, EventSource* timer) {
+  if (!timer->removed) {
+    EventLoopUnwatchSource(loop, timer);
+  }
+}
+
+static void EventLoopDispatchServer(EventLoop* loop, EventSource* source) {
+  Server* srv = (Server*)source->target;
+  size_t got;
+  RETCODE result;
+  while (!source->removed &&
+         ((result = ServerReceiveBatch(srv, loop->responses,
+                                       kEventLoopBatchSize, &got)) == SUCCESS ||
+          result == RELIABLE_PENDING)) {
+    for (size_t i = 0; i < got && !source->removed; ++i) {
+      if (source->server_callbacks.on_packet != NULL &&
+          ResponseGetType(&loop->responses[i]) != DISCONNECT) {
+        source->server_callbacks.on_packet(srv, &loop->responses[i],
+                                           source->user_data);
+      }
+    }
+  }
+}
+
+static void EventLoopDispatchClient(EventLoop* loop, EventSource* source) {
+  Client* client = (Client*)source->target;
+  while (!source->removed) {
+    RETCODE result = ClientReceive(client, &loop->responses[0]);
+    if (result == CLIENT_KICKED) {
+      if (source->client_callbacks.on_disconnect != NULL) {
+        source->client_callbacks.on_disconnect(client, source->user_data);
+      }
+    } else if (result == RELIABLE_PENDING) {
+      continue;
+    } else if (result != SUCCESS) {
+      break;
+    } else if (source->client_callbacks.on_packet != NULL) {
+      source->client_callbacks.on_packet(client, &loop->responses[0],
+                                         source->user_data);
+    }
+  }
+}
+
+static void EventLoopDispatchTimer(EventLoop* loop, EventSource* source) {
+  uint64_t expirations;
+  if (read(source->fd, &expirations, sizeof(expirations)) !=
+      sizeof(expirations)) {
+    return;
+  }
+  source->timer_callback(loop, source->user_data);
+}
+
+RETCODE
+EventLoopRunOnce(EventLoop* loop, time_t milliseconds) {
+  struct epoll_event events[kEventLoopMaxEvents];
+  int ready =
+      epoll_wait(loop->epoll_fd, events, kEventLoopMaxEvents, milliseconds);
+  if (ready < 0) {
+    return errno == EINTR ? SUCCESS : EVENT_LOOP_WAIT;
+  }
+  for (int i = 0; i < ready; ++i) {
+    EventSource* source = (EventSource*)events[i].data.ptr;
+    if (source->removed) {
+      continue;
+    }
+    switch (source->kind) {
+      case SERVER_SOURCE: {
+        EventLoopDispatchServer(loop, source);
+        break;
+      }
+      case CLIENT_SOURCE: {
+        EventLoopDispatchClient(loop, source);
+        break;
+      }
+      case TIMER_SOURCE: {
+        EventLoopDispatchTimer(loop, source);
+        break;
+      }
+    }
+  }
+  EventLoopSweep(loop);
+  return SUCCESS;
+}
+
+RETCODE
+EventLoopRun(EventLoop* loop) {
+  loop->running = 1;
+  while (loop->running) {
+    THROW_OR_CONTINUE(EventLoopRunOnce(loop, -1));
+  }
+  return SUCCESS;
+}
+
+void EventLoopStop(EventLoop* loop) {
+  loop->running = 0;
+}
@@ -0,0 +1,247 @@
+#include "networking/bitstream.h"
+
+#include <string.h>
+
+#include "common/macro.h"
+#include "common/retcode.h"
+
+static const unsigned kVarintGroupBits = 7;
+static const unsigned kVarintMaxGroups = 10;
+
+static uint32_t BitMask(unsigned bits) {
+  return bits == 32 ? 0xffffffffu : ((uint32_t)1 << bits) - 1;
+}
+
+// Number of quantization steps of the float range, or zero when too many.
+static uint64_t FloatSteps(float min, float max, float resolution) {
+  double steps = ((double)max - min) / resolution;
+  if (!(resolution > 0) || !(steps >= 0) || steps > 0xffffffffu) {
+    return 0;
+  }
+  return (uint64_t)(steps + 0.5) + 1;
+}
+
+static void StoreWord(char* buffer, uint32_t word) {
+  buffer[0] = (char)word;
+  buffer[1] = (char)(word >> 8);
+  buffer[2] = (char)(word >> 16);
+  buffer[3] = (char)(word >> 24);
+}
+
+static uint32_t LoadWord(const char* buffer) {
+  return (uint32_t)(uint8_t)buffer[0] | (uint32_t)(uint8_t)buffer[1] << 8 |
+         (uint32_t)(uint8_t)buffer[2] << 16 |
+         (uint32_t)(uint8_t)buffer[3] << 24;
+}
+
+unsigned BitsRequired(uint32_t value) {
+  return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+void BitWriterInit(BitWriter* writer, char* buffer, size_t capacity) {
+  *writer = (BitWriter){.buffer = buffer, .capacity = capacity};
+}
+
+RETCODE
+BitWriterWriteBits(BitWriter* writer, uint32_t value, unsigned bits) {
+  if ((writer->capacity - writer->bytes) * 8 < writer->scratch_bits + bits) {
+    return PACKET_TOO_LARGE;
+  }
+  writer->scratch |= (uint64_t)(value & BitMask(bits)) << writer->scratch_bits;
+  writer->scratch_bits += bits;
+  // Bits go to the buffer a word at a time, the rest waits in scratch.
+  if (writer->scratch_bits >= 32) {
+    StoreWord(writer->buffer + writer->bytes, (uint32_t)writer->scratch);
+    writer->bytes += 4;
+    writer->scratch >>= 32;
+    writer->scratch_bits -= 32;
+  }
+  return SUCCESS;
+}
+
+RETCODE
+BitWriterWriteBool(BitWriter* writer, int value) {
+  THROW_OR_CONTINUE(BitWriterWriteBits(writer, value != 0, 1));
+  return SUCCESS;
+}
+
+RETCODE
+BitWriterWriteInt(BitWriter* writer, int32_t value, int32_t min, int32_t max) {
+  if (value < min || value > max) {
+    return BITSTREAM_OUT_OF_RANGE;
+  }
+  uint32_t range = (uint32_t)((int64_t)max - min);
+  THROW_OR_CONTINUE(BitWriterWriteBits(
+      writer, (uint32_t)((int64_t)value - min), BitsRequired(range)));
+  return SUCCESS;
+}
+
+RETCODE
+BitWriterWriteVarint(BitWriter* writer, uint64_t value) {
+  do {
+    uint32_t group = value & BitMask(kVarintGroupBits);
+    value >>= kVarintGroupBits;
+    if (value != 0) {
+      group |= 1u << kVarintGroupBits;
+    }
+    THROW_OR_CONTINUE(BitWriterWriteBits(writer, group, kVarintGroupBits + 1));
+  } while (value != 0);
+  return SUCCESS;
+}
+
+RETCODE
+BitWriterWriteFloat(BitWriter* writer, float value, float min, float max,
+                    float resolution) {
+  uint64_t steps = FloatSteps(min, max, resolution);
+  if (steps == 0 || !(value >= min && value <= max)) {
+    return BITSTREAM_OUT_OF_RANGE;
+  }
+  uint64_t quantized = (uint64_t)(((double)value - min) / resolution + 0.5);
+  if (quantized >= steps) {
+    quantized = steps - 1;
+  }
+  THROW_OR_CONTINUE(BitWriterWriteBits(writer, (uint32_t)quantized,
+                                       BitsRequired((uint32_t)(steps - 1))));
+  return SUCCESS;
+}
+
+RETCODE
+BitWriterAlign(BitWriter* writer) {
+  if (writer->scratch_bits % 8 != 0) {
+    THROW_OR_CONTINUE(
+        BitWriterWriteBits(writer, 0, 8 - writer->scratch_bits % 8));
+  }
+  return SUCCESS;
+}
+
+RETCODE
+BitWriterWriteBytes(BitWriter* writer, const char* data, size_t len) {
+  THROW_OR_CONTINUE(BitWriterAlign(writer));
+  BitWriterFlush(writer);
+  if (writer->capacity - writer->bytes < len) {
+    return PACKET_TOO_LARGE;
+  }
+  memcpy(writer->buffer + writer->bytes, data, len);
+  writer->bytes += len;
+  return SUCCESS;
+}
+
+size_t BitWriterFlush(BitWriter* writer) {
+  while (writer->scratch_bits != 0) {
+    writer->buffer[writer->bytes++] = (char)(writer->scratch & 0xff);
+    writer->scratch >>= 8;
+    writer->scratch_bits =
+        writer->scratch_bits < 8 ? 0 : writer->scratch_bits - 8;
+  }
+  writer->scratch = 0;
+  return writer->bytes;
+}
+
+void BitReaderInit(BitReader* reader, const char* buffer, size_t len) {
+  *reader = (BitReader){.buffer = buffer, .len = len};
+}
+
+RETCODE
+BitReaderReadBits(BitReader* reader, uint32_t* value, unsigned bits) {
+  while (reader->scratch_bits < bits) {
+    if (reader->len - reader->bytes >= 4 && reader->scratch_bits <= 32) {
+      reader->scratch |= (uint64_t)LoadWord(reader->buffer + reader->bytes)
+                         << reader->scratch_bits;
+      reader->bytes += 4;
+      reader->scratch_bits += 32;
+      continue;
+    }
+    if (reader->bytes == reader->len) {
+      return PACKET_MALFORMED;
+    }
+    reader->scratch |= (uint64_t)(uint8_t)reader->buffer[reader->bytes++]
+                       << reader->scratch_bits;
+    reader->scratch_bits += 8;
+  }
+  *value = (uint32_t)reader->scratch & BitMask(bits);
+  reader->scratch >>= bits;
+  reader->scratch_bits -= bits;
+  return SUCCESS;
+}
+
+RETCODE
+BitReaderReadBool(BitReader* reader, int* value) {
+  uint32_t bit;
+  THROW_OR_CONTINUE(BitReaderReadBits(reader, &bit, 1));
+  *value = (int)bit;
+  return SUCCESS;
+}
+
+RETCODE
+BitReaderReadInt(BitReader* reader, int32_t* value, int32_t min, int32_t max) {
+  uint32_t range = (uint32_t)((int64_t)max - min);
+  uint32_t offset;
+  THROW_OR_CONTINUE(BitReaderReadBits(reader, &offset, BitsRequired(range)));
+  if (offset > range) {
+    return PACKET_MALFORMED;
+  }
+  *value = (int32_t)((int64_t)min + offset);
+  return SUCCESS;
+}
+
+RETCODE
+BitReaderReadVarint(BitReader* reader, uint64_t* value) {
+  *value = 0;
+  for (unsigned i = 0; i < kVarintMaxGroups; ++i) {
+    uint32_t group;
+    THROW_OR_CONTINUE(BitReaderReadBits(reader, &group, kVarintGroupBits + 1));
+    uint64_t bits = group & BitMask(kVarintGroupBits);
+    unsigned shift = i * kVarintGroupBits;
+    if (shift + kVarintGroupBits > 64 && (bits >> (64 - shift)) != 0) {
+      return PACKET_MALFORMED;
+    }
+    *value |= bits << shift;
+    if ((group >> kVarintGroupBits) == 0) {
+      return SUCCESS;
+    }
+  }
+  return PACKET_MALFORMED;
+}
+
+RETCODE
+BitReaderReadFloat(BitReader* reader, float* value, float min, float max,
+                   float resolution) {
+  uint64_t steps = FloatSteps(min, max, resolution);
+  if (steps == 0) {
+    return PACKET_MALFORMED;
+  }
+  uint32_t quantized;
+  THROW_OR_CONTINUE(BitReaderReadBits(reader, &quantized,
+                                      BitsRequired((uint32_t)(steps - 1))));
+  if (quantized >= steps) {
+    return PACKET_MALFORMED;
+  }
+  // The edges of the range are exact, the rest is within the resolution.
+  double result = (double)min + (double)quantized * resolution;
+  *value = quantized == steps - 1 || result > max ? max : (float)result;
+  return SUCCESS;
+}
+
+void BitReaderAlign(BitReader* reader) {
+  reader->scratch >>= reader->scratch_bits % 8;
+  reader->scratch_bits -= reader->scratch_bits % 8;
+}
+
+RETCODE
+BitReaderReadBytes(BitReader* reader, char* data, size_t len) {
+  BitReaderAlign(reader);
+  // Whole bytes loaded ahead are given back to the buffer.
+  reader->bytes -= reader->scratch_bits / 8;
+  reader->scratch = 0;
+  reader->scratch_bits = 0;
+  if (reader->len - reader->bytes < len) {
+    return PACKET_MALFORMED;
+  }
+  memcpy(data, reader->buffer + reader->bytes, len);
+  reader->bytes += len;
+  return SUCCESS;
+}
+
+size_t BitReaderRemaining(BitReader* reader) {
+  return reader->len - reader->bytes + reader->scratch_bits / 8;
+}
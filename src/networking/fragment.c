@@ -0,0 +1,378 @@
+#include "networking/fragment.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/macro.h"
+#include "common/retcode.h"
+#include "networking/bitstream.h"
+
+const size_t kFragmentMaxSize = 16 * 1024 * 1024;
+const uint32_t kFragmentWindow = 256;
+const size_t kFragmentHeaderSize = 12;
+static const uint32_t kFragmentAckEvery = 32;
+static const uint32_t kFragmentAckWords = 48;
+// Message ID and base, then the bitmap.
+static const size_t kFragmentAckSize = 8 + kFragmentAckWords * 8;
+
+static size_t FragmentSize() {
+  return kMaxPayload - kFragmentHeaderSize;
+}
+
+static uint32_t FragmentCount(size_t len) {
+  return len == 0 ? 1 : (len + FragmentSize() - 1) / FragmentSize();
+}
+
+static size_t FragmentLength(size_t len, uint32_t count, uint32_t index) {
+  return index + 1 == count ? len - index * FragmentSize() : FragmentSize();
+}
+
+static int BitGet(uint64_t* bits, uint32_t index) {
+  return (bits[index / 64] >> (index % 64)) & 1;
+}
+
+static void BitSet(uint64_t* bits, uint32_t index) {
+  bits[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+static int IdGreater(uint32_t lhs, uint32_t rhs) {
+  return lhs != rhs && lhs - rhs < 0x80000000u;
+}
+
+static void FragmentHeaderWrite(const FragmentHeader* header, char* buffer) {
+  BitWriter writer;
+  BitWriterInit(&writer, buffer, kFragmentHeaderSize);
+  // The buffer fits the header, so the writes can't fail.
+  BitWriterWriteBits(&writer, header->message_id, 32);
+  BitWriterWriteBits(&writer, header->total_len, 32);
+  BitWriterWriteBits(&writer, header->index, 16);
+  BitWriterWriteBits(&writer, header->count, 16);
+  BitWriterFlush(&writer);
+}
+
+static RETCODE FragmentHeaderRead(const char* buffer, size_t len,
+                                  FragmentHeader* header) {
+  if (len < kFragmentHeaderSize) {
+    return PACKET_MALFORMED;
+  }
+  BitReader reader;
+  BitReaderInit(&reader, buffer, kFragmentHeaderSize);
+  uint32_t index;
+  uint32_t count;
+  THROW_OR_CONTINUE(BitReaderReadBits(&reader, &header->message_id, 32));
+  THROW_OR_CONTINUE(BitReaderReadBits(&reader, &header->total_len, 32));
+  THROW_OR_CONTINUE(BitReaderReadBits(&reader, &index, 16));
+  THROW_OR_CONTINUE(BitReaderReadBits(&reader, &count, 16));
+  header->index = index;
+  header->count = count;
+  return SUCCESS;
+}
+
+static void FragmentSenderReset(FragmentSender* sender) {
+  free(sender->data);
+  free(sender->acked);
+  free(sender->last_sent);
+  sender->data = NULL;
+  sender->acked = NULL;
+  sender->last_sent = NULL;
+}
+
+static void FragmentAssemblerReset(FragmentAssembler* assembler) {
+  free(assembler->block);
+  free(assembler->received);
+  assembler->block = NULL;
+  assembler->received = NULL;
+  assembler->active = 0;
+  assembler->complete = 0;
+}
+
+static void FragmentSenderAck(FragmentSender* sender, uint32_t index) {
+  if (BitGet(sender->acked, index)) {
+    return;
+  }
+  BitSet(sender->acked, index);
+  ++sender->acked_count;
+  --sender->in_flight;
+}
+
+static void FragmentWrite(FragmentSender* sender, uint32_t index,
+                          Response* response) {
+  FragmentHeader header =
+      (FragmentHeader){.message_id = sender->message_id,
+                       .total_len = sender->len,
+                       .index = index,
+                       .count = sender->count};
+  size_t len = FragmentLength(sender->len, sender->count, index);
+  FragmentHeaderWrite(&header, response->data.ptr);
+  memcpy(response->data.ptr + kFragmentHeaderSize,
+         sender->data + index * FragmentSize(), len);
+  response->data.len = kFragmentHeaderSize + len;
+  ResponseSetType(response, FRAGMENT);
+  response->flags = 0;
+}
+
+void FragmentChannelInit(FragmentChannel* channel) {
+  *channel = (FragmentChannel){0};
+  channel->assembler.limit = kFragmentMaxSize;
+}
+
+void FragmentChannelSetLimit(FragmentChannel* channel, size_t limit) {
+  channel->assembler.limit = limit;
+}
+
+void FragmentChannelDestroy(FragmentChannel* channel) {
+  FragmentSenderReset(&channel->sender);
+  FragmentAssemblerReset(&channel->assembler);
+}
+
+RETCODE
+FragmentChannelSend(FragmentChannel* channel, const char* data, size_t len) {
+  FragmentSender* sender = &channel->sender;
+  if (sender->data != NULL) {
+    return FRAGMENT_BUSY;
+  }
+  if (len > kFragmentMaxSize) {
+    return PACKET_TOO_LARGE;
+  }
+  uint32_t count = FragmentCount(len);
+  sender->data = (char*)malloc(len == 0 ? 1 : len);
+  sender->acked = (uint64_t*)calloc((count + 63) / 64, sizeof(uint64_t));
+  sender->last_sent = (uint64_t*)malloc(count * sizeof(uint64_t));
+  if (sender->data == NULL || sender->acked == NULL ||
+      sender->last_sent == NULL) {
+    FragmentSenderReset(sender);
+    return NOT_ENOUGH_MEMORY;
+  }
+  memcpy(sender->data, data, len);
+  sender->len = len;
+  sender->count = count;
+  sender->message_id = sender->next_message_id++;
+  sender->acked_count = 0;
+  sender->first_unacked = 0;
+  sender->next_unsent = 0;
+  sender->in_flight = 0;
+  return SUCCESS;
+}
+
+int FragmentChannelSending(FragmentChannel* channel) {
+  return channel->sender.data != NULL;
+}
+
+int FragmentChannelNextFragment(FragmentChannel* channel, uint64_t now,
+                                uint64_t timeout, Response* response) {
+  FragmentSender* sender = &channel->sender;
+  if (sender->data == NULL) {
+    return 0;
+  }
+  for (uint32_t index = sender->first_unacked; index < sender->next_unsent;
+       ++index) {
+    if (!BitGet(sender->acked, index) &&
+        now - sender->last_sent[index] >= timeout) {
+      sender->last_sent[index] = now;
+      FragmentWrite(sender, index, response);
+      return 1;
+    }
+  }
+  if (sender->next_unsent < sender->count &&
+      sender->in_flight < kFragmentWindow) {
+    uint32_t index = sender->next_unsent++;
+    ++sender->in_flight;
+    sender->last_sent[index] = now;
+    FragmentWrite(sender, index, response);
+    return 1;
+  }
+  return 0;
+}
+
+static RETCODE FragmentChannelReceiveAck(FragmentChannel* channel,
+                                         Response* response) {
+  FragmentSender* sender = &channel->sender;
+  if (response->data.len != kFragmentAckSize) {
+    return PACKET_MALFORMED;
+  }
+  BitReader reader;
+  BitReaderInit(&reader, response->data.ptr, response->data.len);
+  uint32_t message_id;
+  uint32_t acked_base;
+  THROW_OR_CONTINUE(BitReaderReadBits(&reader, &message_id, 32));
+  THROW_OR_CONTINUE(BitReaderReadBits(&reader, &acked_base, 32));
+  if (sender->data == NULL || message_id != sender->message_id) {
+    return RELIABLE_PENDING;
+  }
+  uint32_t base = acked_base < sender->next_unsent ? acked_base
+                                                   : sender->next_unsent;
+  for (uint32_t index = sender->first_unacked; index < base; ++index) {
+    FragmentSenderAck(sender, index);
+  }
+  for (uint32_t i = 0; i < kFragmentAckWords; ++i) {
+    uint32_t low;
+    uint32_t high;
+    THROW_OR_CONTINUE(BitReaderReadBits(&reader, &low, 32));
+    THROW_OR_CONTINUE(BitReaderReadBits(&reader, &high, 32));
+    uint64_t word = (uint64_t)high << 32 | low;
+    for (uint32_t bit = 0; word != 0; ++bit, word >>= 1) {
+      uint32_t index = base + i * 64 + bit;
+      if ((word & 1) && index < sender->next_unsent) {
+        FragmentSenderAck(sender, index);
+      }
+    }
+  }
+  while (sender->first_unacked < sender->count &&
+         BitGet(sender->acked, sender->first_unacked)) {
+    ++sender->first_unacked;
+  }
+  if (sender->acked_count == sender->count) {
+    FragmentSenderReset(sender);
+  }
+  return RELIABLE_PENDING;
+}
+
+static RETCODE FragmentAssemblerStart(FragmentAssembler* assembler,
+                                      FragmentHeader* header) {
+  if (header->total_len > assembler->limit) {
+    return PACKET_TOO_LARGE;
+  }
+  if (header->total_len > kFragmentMaxSize ||
+      header->count != FragmentCount(header->total_len)) {
+    return PACKET_MALFORMED;
+  }
+  FragmentAssemblerReset(assembler);
+  assembler->block =
+      (char*)malloc(header->total_len == 0 ? 1 : header->total_len);
+  assembler->received =
+      (uint64_t*)calloc((header->count + 63) / 64, sizeof(uint64_t));
+  if (assembler->block == NULL || assembler->received == NULL) {
+    FragmentAssemblerReset(assembler);
+    return NOT_ENOUGH_MEMORY;
+  }
+  assembler->len = header->total_len;
+  assembler->count = header->count;
+  assembler->message_id = header->message_id;
+  assembler->received_count = 0;
+  assembler->base = 0;
+  assembler->since_ack = 0;
+  assembler->active = 1;
+  assembler->seen_any = 1;
+  return SUCCESS;
+}
+
+static RETCODE FragmentChannelReceiveFragment(FragmentChannel* channel,
+                                              Response* response) {
+  FragmentAssembler* assembler = &channel->assembler;
+  FragmentHeader header;
+  THROW_OR_CONTINUE(
+      FragmentHeaderRead(response->data.ptr, response->data.len, &header));
+  if (assembler->seen_any && header.message_id == assembler->message_id) {
+    if (!assembler->active || assembler->complete) {
+      // The sender missed the final ack.
+      assembler->acks_pending = 1;
+      return RELIABLE_PENDING;
+    }
+  } else if (!assembler->seen_any ||
+             IdGreater(header.message_id, assembler->message_id)) {
+    if (assembler->complete) {
+      return RELIABLE_PENDING;
+    }
+    THROW_OR_CONTINUE(FragmentAssemblerStart(assembler, &header));
+  } else {
+    return RELIABLE_PENDING;
+  }
+  if (header.index >= assembler->count || header.count != assembler->count ||
+      header.total_len != assembler->len ||
+      response->data.len - kFragmentHeaderSize !=
+          FragmentLength(assembler->len, assembler->count, header.index)) {
+    return PACKET_MALFORMED;
+  }
+  assembler->acks_pending = 1;
+  ++assembler->since_ack;
+  if (BitGet(assembler->received, header.index)) {
+    return RELIABLE_PENDING;
+  }
+  memcpy(assembler->block + header.index * FragmentSize(),
+         response->data.ptr + kFragmentHeaderSize,
+         response->data.len - kFragmentHeaderSize);
+  BitSet(assembler->received, header.index);
+  ++assembler->received_count;
+  while (assembler->base < assembler->count &&
+         BitGet(assembler->received, assembler->base)) {
+    ++assembler->base;
+  }
+  if (assembler->received_count != assembler->count) {
+    return RELIABLE_PENDING;
+  }
+  assembler->complete = 1;
+  response->data.len = 0;
+  return SUCCESS;
+}
+
+RETCODE
+FragmentChannelReceive(FragmentChannel* channel, Response* response) {
+  switch (ResponseGetType(response)) {
+    case FRAGMENT: {
+      return FragmentChannelReceiveFragment(channel, response);
+    }
+    case FRAGMENT_ACK: {
+      return FragmentChannelReceiveAck(channel, response);
+    }
+    default: {
+      return RELIABLE_PENDING;
+    }
+  }
+}
+
+int FragmentChannelAckDue(FragmentChannel* channel) {
+  FragmentAssembler* assembler = &channel->assembler;
+  return assembler->acks_pending &&
+         (assembler->since_ack >= kFragmentAckEvery || !assembler->active ||
+          assembler->complete);
+}
+
+int FragmentChannelNextAck(FragmentChannel* channel, Response* response) {
+  FragmentAssembler* assembler = &channel->assembler;
+  if (!assembler->acks_pending) {
+    return 0;
+  }
+  uint32_t base = assembler->count;
+  if (assembler->active && !assembler->complete) {
+    base = assembler->base;
+  }
+  BitWriter writer;
+  BitWriterInit(&writer, response->data.ptr, kFragmentAckSize);
+  // The buffer fits the ack, so the writes can't fail.
+  BitWriterWriteBits(&writer, assembler->message_id, 32);
+  BitWriterWriteBits(&writer, base, 32);
+  for (uint32_t i = 0; i < kFragmentAckWords; ++i) {
+    uint64_t word = 0;
+    for (uint32_t bit = 0; bit < 64; ++bit) {
+      uint32_t index = base + i * 64 + bit;
+      if (index >= assembler->count) {
+        break;
+      }
+      if (assembler->received != NULL &&
+          BitGet(assembler->received, index)) {
+        word |= (uint64_t)1 << bit;
+      }
+    }
+    BitWriterWriteBits(&writer, (uint32_t)word, 32);
+    BitWriterWriteBits(&writer, (uint32_t)(word >> 32), 32);
+  }
+  response->data.len = BitWriterFlush(&writer);
+  ResponseSetType(response, FRAGMENT_ACK);
+  response->flags = 0;
+  assembler->acks_pending = 0;
+  assembler->since_ack = 0;
+  return 1;
+}
+
+RETCODE
+FragmentChannelTake(FragmentChannel* channel, Data* out) {
+  FragmentAssembler* assembler = &channel->assembler;
+  if (!assembler->complete) {
+    return FRAGMENT_NOT_READY;
+  }
+  out->ptr = assembler->block;
+  out->len = assembler->len;
+  assembler->block = NULL;
+  FragmentAssemblerReset(assembler);
+  return SUCCESS;
+}
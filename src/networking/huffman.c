@@ -0,0 +1,240 @@
+#include "networking/huffman.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/macro.h"
+#include "common/retcode.h"
+
+static const size_t kSymbols = 256;
+static const unsigned kLengthBits = 16;
+static const uint16_t kDecodeLengthMask = 0xf;
+
+typedef struct {
+  uint64_t count;
+  uint16_t symbol;
+} HuffmanLeaf;
+
+static int HuffmanLeafCompare(const void* lhs, const void* rhs) {
+  const HuffmanLeaf* left = (const HuffmanLeaf*)lhs;
+  const HuffmanLeaf* right = (const HuffmanLeaf*)rhs;
+  if (left->count != right->count) {
+    return left->count < right->count ? -1 : 1;
+  }
+  return left->symbol < right->symbol ? -1 : 1;
+}
+
+static uint16_t ReverseBits(uint16_t code, unsigned len) {
+  uint16_t reversed = 0;
+  for (unsigned i = 0; i < len; ++i) {
+    reversed = (reversed << 1) | ((code >> i) & 1);
+  }
+  return reversed;
+}
+
+/*
+ * Computes Huffman code lengths of the leaves sorted by count with two queues:
+ * one of the leaves, one of the merged nodes, whose counts only grow.
+ */
+static void HuffmanDepths(HuffmanLeaf* leaves, unsigned* depths) {
+  uint64_t counts[2 * 256];
+  uint16_t parents[2 * 256];
+  size_t next_leaf = 0;
+  size_t next_node = kSymbols;
+  size_t nodes = kSymbols;
+  for (size_t i = 0; i < kSymbols; ++i) {
+    counts[i] = leaves[i].count;
+  }
+  while (nodes < 2 * kSymbols - 1) {
+    size_t children[2];
+    for (int c = 0; c < 2; ++c) {
+      if (next_leaf < kSymbols &&
+          (next_node == nodes || counts[next_leaf] <= counts[next_node])) {
+        children[c] = next_leaf++;
+      } else {
+        children[c] = next_node++;
+      }
+    }
+    counts[nodes] = counts[children[0]] + counts[children[1]];
+    parents[children[0]] = nodes;
+    parents[children[1]] = nodes;
+    ++nodes;
+  }
+  // The root is the last node, parents always come after their children.
+  unsigned node_depths[2 * 256];
+  node_depths[nodes - 1] = 0;
+  for (size_t i = nodes - 1; i-- > 0;) {
+    node_depths[i] = node_depths[parents[i]] + 1;
+  }
+  for (size_t i = 0; i < kSymbols; ++i) {
+    depths[i] = node_depths[i];
+  }
+}
+
+/*
+ * Limits the code lengths the way JPEG does: two codes of the longest length
+ * are replaced by one code a bit shorter, and the shortest code which can be
+ * made longer gives the place for the second one.
+ */
+static void HuffmanLimitLengths(unsigned* per_length, unsigned longest) {
+  for (unsigned len = longest; len > kHuffmanMaxCodeLength; --len) {
+    while (per_length[len] > 0) {
+      unsigned shorter = len - 2;
+      while (per_length[shorter] == 0) {
+        --shorter;
+      }
+      per_length[len] -= 2;
+      per_length[len - 1] += 1;
+      per_length[shorter + 1] += 2;
+      per_length[shorter] -= 1;
+    }
+  }
+}
+
+void HuffmanTrainerInit(HuffmanTrainer* trainer) {
+  *trainer = (HuffmanTrainer){0};
+}
+
+void HuffmanTrainerAdd(HuffmanTrainer* trainer, const char* data, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    ++trainer->counts[(uint8_t)data[i]];
+  }
+}
+
+void HuffmanTrainerBuild(HuffmanTrainer* trainer, HuffmanTable* table) {
+  HuffmanLeaf leaves[256];
+  for (size_t i = 0; i < kSymbols; ++i) {
+    // Bytes never seen still get a code, just a long one.
+    leaves[i] = (HuffmanLeaf){.count = trainer->counts[i] + 1,
+                              .symbol = (uint16_t)i};
+  }
+  qsort(leaves, kSymbols, sizeof(HuffmanLeaf), HuffmanLeafCompare);
+  unsigned depths[256];
+  HuffmanDepths(leaves, depths);
+  unsigned per_length[2 * 256] = {0};
+  unsigned longest = 0;
+  for (size_t i = 0; i < kSymbols; ++i) {
+    ++per_length[depths[i]];
+    longest = depths[i] > longest ? depths[i] : longest;
+  }
+  HuffmanLimitLengths(per_length, longest);
+  // The most frequent bytes get the shortest codes.
+  uint8_t lengths[256];
+  size_t leaf = kSymbols;
+  for (unsigned len = 1; len <= kHuffmanMaxCodeLength; ++len) {
+    for (unsigned i = 0; i < per_length[len]; ++i) {
+      lengths[leaves[--leaf].symbol] = (uint8_t)len;
+    }
+  }
+  // The lengths always make a complete prefix code.
+  HuffmanTableInit(table, lengths);
+}
+
+RETCODE
+HuffmanTableInit(HuffmanTable* table, const uint8_t lengths[256]) {
+  unsigned per_length[kHuffmanMaxCodeLength + 1] = {0};
+  uint32_t space = 0;
+  for (size_t i = 0; i < kSymbols; ++i) {
+    if (lengths[i] > kHuffmanMaxCodeLength) {
+      return HUFFMAN_INVALID_TABLE;
+    }
+    if (lengths[i] != 0) {
+      ++per_length[lengths[i]];
+      space += 1u << (kHuffmanMaxCodeLength - lengths[i]);
+    }
+  }
+  if (space > (1u << kHuffmanMaxCodeLength)) {
+    return HUFFMAN_INVALID_TABLE;
+  }
+  // Canonical codes: consecutive within a length, ordered by byte.
+  uint16_t next_code[kHuffmanMaxCodeLength + 1];
+  uint16_t code = 0;
+  for (unsigned len = 1; len <= kHuffmanMaxCodeLength; ++len) {
+    code = (code + per_length[len - 1]) << 1;
+    next_code[len] = code;
+  }
+  memset(table->decode, 0, sizeof(table->decode));
+  for (size_t i = 0; i < kSymbols; ++i) {
+    unsigned len = lengths[i];
+    table->lengths[i] = (uint8_t)len;
+    table->codes[i] = 0;
+    if (len == 0) {
+      continue;
+    }
+    uint16_t reversed = ReverseBits(next_code[len]++, len);
+    table->codes[i] = reversed;
+    for (uint32_t fill = reversed; fill < (1u << kHuffmanMaxCodeLength);
+         fill += 1u << len) {
+      table->decode[fill] = (uint16_t)(i << 4 | len);
+    }
+  }
+  return SUCCESS;
+}
+
+size_t HuffmanEncode(const HuffmanTable* table, const char* in, size_t len,
+                     char* out, size_t capacity) {
+  if (len >> kLengthBits != 0) {
+    return 0;
+  }
+  uint64_t scratch = len;
+  unsigned bits = kLengthBits;
+  size_t written = 0;
+  for (size_t i = 0; i < len; ++i) {
+    uint8_t symbol = (uint8_t)in[i];
+    if (table->lengths[symbol] == 0) {
+      return 0;
+    }
+    scratch |= (uint64_t)table->codes[symbol] << bits;
+    bits += table->lengths[symbol];
+    if (bits >= 32) {
+      if (capacity - written < 4) {
+        return 0;
+      }
+      for (int byte = 0; byte < 4; ++byte) {
+        out[written++] = (char)(scratch >> (8 * byte));
+      }
+      scratch >>= 32;
+      bits -= 32;
+    }
+  }
+  for (; bits > 0; bits = bits > 8 ? bits - 8 : 0) {
+    if (written == capacity) {
+      return 0;
+    }
+    out[written++] = (char)scratch;
+    scratch >>= 8;
+  }
+  return written;
+}
+
+RETCODE
+HuffmanDecode(const HuffmanTable* table, const char* in, size_t len, char* out,
+              size_t capacity, size_t* out_len) {
+  if (len < kLengthBits / 8) {
+    return PACKET_MALFORMED;
+  }
+  size_t total = (uint8_t)in[0] | (size_t)(uint8_t)in[1] << 8;
+  if (total > capacity) {
+    return PACKET_MALFORMED;
+  }
+  uint64_t scratch = 0;
+  unsigned bits = 0;
+  size_t read = kLengthBits / 8;
+  for (size_t i = 0; i < total; ++i) {
+    while (bits <= 56 && read < len) {
+      scratch |= (uint64_t)(uint8_t)in[read++] << bits;
+      bits += 8;
+    }
+    uint16_t entry =
+        table->decode[scratch & ((1u << kHuffmanMaxCodeLength) - 1)];
+    unsigned code_len = entry & kDecodeLengthMask;
+    if (code_len == 0 || code_len > bits) {
+      return PACKET_MALFORMED;
+    }
+    out[i] = (char)(entry >> 4);
+    scratch >>= code_len;
+    bits -= code_len;
+  }
+  *out_len = total;
+  return SUCCESS;
+}
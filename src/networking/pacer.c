@@ -0,0 +1,127 @@
+#include "networking/pacer.h"
+
+#include "networking/packet.h"
+
+const uint64_t kPacerInitialRate = 64 * 1024;
+static const double kPacerMinRate = 4 * 1024;
+static const double kPacerMaxRate = 64 * 1024 * 1024;
+static const uint64_t kPacerMinInterval = 20;
+static const double kPacerBurstTime = 0.02;
+static const double kPacerLossThreshold = 0.02;
+static const double kPacerLossDecrease = 0.75;
+static const double kPacerDelayFactor = 2;
+static const double kPacerDelaySlack = 10;
+static const double kPacerDelayDecrease = 0.9;
+static const double kPacerIncrease = 1.0 / 16;
+
+static double PacerBurst(Pacer* pacer) {
+  double burst = (double)PacerBudget(pacer) * kPacerBurstTime;
+  // The bucket always holds a couple of packets, so slow links aren't stalled.
+  return burst < 2 * kDataLength ? 2 * kDataLength : burst;
+}
+
+static void PacerRefill(Pacer* pacer, uint64_t now) {
+  if (!pacer->started) {
+    pacer->started = 1;
+    pacer->last_refill = now;
+    pacer->tokens = PacerBurst(pacer);
+    return;
+  }
+  pacer->tokens +=
+      (double)PacerBudget(pacer) * (double)(now - pacer->last_refill) / 1000;
+  pacer->last_refill = now;
+  double burst = PacerBurst(pacer);
+  if (pacer->tokens > burst) {
+    pacer->tokens = burst;
+  }
+}
+
+void PacerInit(Pacer* pacer) {
+  *pacer = (Pacer){.rate = (double)kPacerInitialRate};
+}
+
+void PacerSetCap(Pacer* pacer, uint64_t cap) {
+  pacer->cap = cap;
+  pacer->started = 0;
+}
+
+void PacerObserve(Pacer* pacer, ReliableEndpoint* endpoint, uint64_t now) {
+  uint64_t interval = (uint64_t)endpoint->rtt;
+  if (interval < kPacerMinInterval) {
+    interval = kPacerMinInterval;
+  }
+  if (now - pacer->interval_start < interval) {
+    return;
+  }
+  uint32_t acked = endpoint->acked_count - pacer->acked;
+  uint32_t lost = endpoint->lost_count - pacer->lost;
+  pacer->acked = endpoint->acked_count;
+  pacer->lost = endpoint->lost_count;
+  pacer->interval_start = now;
+  if (acked + lost == 0) {
+    // Nothing was learned about the link.
+    return;
+  }
+  if (pacer->min_rtt == 0 || endpoint->rtt < pacer->min_rtt) {
+    pacer->min_rtt = endpoint->rtt;
+  }
+  int loss = lost > (acked + lost) * kPacerLossThreshold;
+  int delay =
+      endpoint->rtt > pacer->min_rtt * kPacerDelayFactor + kPacerDelaySlack;
+  if ((loss || delay) && !pacer->congested) {
+    pacer->congested = 1;
+    // The cap was the budget so far, the first decrease starts from it.
+    if (pacer->cap != 0) {
+      pacer->rate = (double)pacer->cap;
+    }
+  }
+  if (loss) {
+    pacer->rate *= kPacerLossDecrease;
+  } else if (delay) {
+    pacer->rate *= kPacerDelayDecrease;
+  } else {
+    pacer->rate += pacer->rate * kPacerIncrease;
+  }
+  if (pacer->rate < kPacerMinRate) {
+    pacer->rate = kPacerMinRate;
+  }
+  // Growing past the cap would only delay the reaction to congestion.
+  double limit = pacer->cap != 0 ? (double)pacer->cap : kPacerMaxRate;
+  if (pacer->rate > limit) {
+    pacer->rate = limit < kPacerMinRate ? kPacerMinRate : limit;
+  }
+}
+
+int PacerReady(Pacer* pacer, uint64_t now) {
+  if (pacer->cap == 0) {
+    return 1;
+  }
+  PacerRefill(pacer, now);
+  return pacer->tokens > 0;
+}
+
+int PacerConsume(Pacer* pacer, size_t bytes, uint64_t now) {
+  if (!PacerReady(pacer, now)) {
+    return 0;
+  }
+  if (pacer->cap != 0) {
+    pacer->tokens -= (double)bytes;
+  }
+  return 1;
+}
+
+void PacerCharge(Pacer* pacer, size_t bytes, uint64_t now) {
+  if (pacer->cap == 0) {
+    return;
+  }
+  PacerRefill(pacer, now);
+  pacer->tokens -= (double)bytes;
+}
+
+uint64_t PacerBudget(Pacer* pacer) {
+  if (pacer->cap != 0 &&
+      (!pacer->congested || (double)pacer->cap < pacer->rate)) {
+    return pacer->cap;
+  }
+  return (uint64_t)pacer->rate;
+}
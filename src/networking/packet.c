@@ -5,8 +5,16 @@
 
 #include "common/macro.h"
 #include "common/retcode.h"
+#include "networking/bitstream.h"
+#include "networking/huffman.h"
 
 const size_t kDataLength = 500;
+// The largest header takes 81 bits, see packet.h.
+const size_t kMaxPayload = 500 - 11;
+static const unsigned kTypeBits = 4;
+static const unsigned kFlagBits = 4;
+static const unsigned kSequenceBits = 16;
+static const unsigned kAckBitsBits = 32;
 
 RETCODE
 DataInit(Data* data) {
@@ -19,6 +27,7 @@ DataInit(Data* data) {
 
 void DataDestroy(Data* data) {
   free(data->ptr);
+  data->ptr = NULL;
 }
 
 void DataSet(Data* data, const char* str) {
@@ -30,6 +39,10 @@ void DataSet(Data* data, const char* str) {
 RETCODE
 ResponseInit(Response* response) {
   THROW_OR_CONTINUE(DataInit(&response->data));
+  response->sequence = 0;
+  response->ack = 0;
+  response->ack_bits = 0;
+  response->flags = 0;
   return SUCCESS;
 }
 
@@ -59,18 +72,252 @@ uint16_t ResponseGetClientId(Response* response) {
   return response->client_id;
 }
 
+static RETCODE PacketWriteHeader(Response* in, uint8_t flags, size_t len,
+                                 BitWriter* writer) {
+  // Type, flags and length are written at once, they always go together.
+  uint32_t fields = in->type |
+                    (uint32_t)(flags & ((1u << kFlagBits) - 1)) << kTypeBits |
+                    (uint32_t)len << (kTypeBits + kFlagBits);
+  THROW_OR_CONTINUE(BitWriterWriteBits(
+      writer, fields, kTypeBits + kFlagBits + BitsRequired(kMaxPayload)));
+  if (in->type == RELIABLE) {
+    THROW_OR_CONTINUE(BitWriterWriteBits(writer, in->sequence, kSequenceBits));
+  }
+  if (flags & PACKET_HAS_ACKS) {
+    THROW_OR_CONTINUE(BitWriterWriteBits(writer, in->ack, kSequenceBits));
+    THROW_OR_CONTINUE(BitWriterWriteBits(writer, in->ack_bits, kAckBitsBits));
+  }
+  THROW_OR_CONTINUE(BitWriterAlign(writer));
+  return SUCCESS;
+}
+
+static size_t PacketHeaderSize(Response* in, uint8_t flags) {
+  size_t bits = kTypeBits + kFlagBits + BitsRequired(kMaxPayload);
+  if (in->type == RELIABLE) {
+    bits += kSequenceBits;
+  }
+  if (flags & PACKET_HAS_ACKS) {
+    bits += kSequenceBits + kAckBitsBits;
+  }
+  return (bits + 7) / 8;
+}
+
 RETCODE
 DataToResponse(Data* in, Response* out) {
-  memcpy(&out->type, &((PacketHeader*)in->ptr)->type, sizeof(ResponseType));
-  memcpy(&out->data.len, &((PacketHeader*)in->ptr)->len, sizeof(uint16_t));
-  memcpy(out->data.ptr, in->ptr + sizeof(PacketHeader), out->data.len);
+  THROW_OR_CONTINUE(DataToResponseCompressed(in, out, NULL));
+  return SUCCESS;
+}
+
+// Reads the packet at the start of the data, used is set to its size. With
+// view the uncompressed payload is left in place and pointed to.
+static RETCODE PacketRead(Data* in, Response* out, const HuffmanTable* table,
+                          int view, size_t* used) {
+  BitReader reader;
+  BitReaderInit(&reader, in->ptr, in->len);
+  uint32_t fields;
+  THROW_OR_CONTINUE(BitReaderReadBits(
+      &reader, &fields, kTypeBits + kFlagBits + BitsRequired(kMaxPayload)));
+  uint32_t type = fields & ((1u << kTypeBits) - 1);
+  uint32_t flags = (fields >> kTypeBits) & ((1u << kFlagBits) - 1);
+  uint32_t len = fields >> (kTypeBits + kFlagBits);
+  if (len > kMaxPayload) {
+    return PACKET_MALFORMED;
+  }
+  uint32_t sequence = 0;
+  if (type == RELIABLE) {
+    THROW_OR_CONTINUE(BitReaderReadBits(&reader, &sequence, kSequenceBits));
+  }
+  uint32_t ack = 0;
+  uint32_t ack_bits = 0;
+  if (flags & PACKET_HAS_ACKS) {
+    THROW_OR_CONTINUE(BitReaderReadBits(&reader, &ack, kSequenceBits));
+    THROW_OR_CONTINUE(BitReaderReadBits(&reader, &ack_bits, kAckBitsBits));
+  }
+  size_t payload_len = len;
+  if (flags & PACKET_COMPRESSED) {
+    BitReaderAlign(&reader);
+    size_t remaining = BitReaderRemaining(&reader);
+    if (table == NULL || len > remaining) {
+      return PACKET_MALFORMED;
+    }
+    THROW_OR_CONTINUE(HuffmanDecode(table, in->ptr + in->len - remaining, len,
+                                    out->data.ptr, kMaxPayload,
+                                    &payload_len));
+    flags &= ~PACKET_COMPRESSED;
+    *used = in->len - remaining + len;
+  } else if (view) {
+    BitReaderAlign(&reader);
+    size_t remaining = BitReaderRemaining(&reader);
+    if (len > remaining) {
+      return PACKET_MALFORMED;
+    }
+    out->data.ptr = in->ptr + in->len - remaining;
+    *used = in->len - remaining + len;
+  } else {
+    THROW_OR_CONTINUE(BitReaderReadBytes(&reader, out->data.ptr, len));
+    *used = in->len - BitReaderRemaining(&reader);
+  }
+  out->type = (ResponseType)type;
+  out->flags = flags;
+  out->data.len = payload_len;
+  out->sequence = sequence;
+  out->ack = ack;
+  out->ack_bits = ack_bits;
+  return SUCCESS;
+}
+
+RETCODE
+DataToResponseCompressed(Data* in, Response* out, const HuffmanTable* table) {
+  size_t used;
+  THROW_OR_CONTINUE(PacketRead(in, out, table, 0, &used));
+  return SUCCESS;
+}
+
+RETCODE
+DataToResponseView(Data* in, Response* out) {
+  size_t used;
+  THROW_OR_CONTINUE(PacketRead(in, out, NULL, 1, &used));
   return SUCCESS;
 }
 
 RETCODE
 ResponseToData(Response* in, Data* out) {
-  ((PacketHeader*)out->ptr)->type = in->type;
-  ((PacketHeader*)out->ptr)->len = in->data.len;
-  memcpy(out->ptr + sizeof(PacketHeader), in->data.ptr, in->data.len);
+  THROW_OR_CONTINUE(ResponseToDataCompressed(in, out, NULL));
+  return SUCCESS;
+}
+
+RETCODE
+ResponseToDataCompressed(Response* in, Data* out, const HuffmanTable* table) {
+  if (in->data.len > kMaxPayload) {
+    return PACKET_TOO_LARGE;
+  }
+  uint8_t flags = in->flags & ~PACKET_COMPRESSED;
+  BitWriter writer;
+  if (table != NULL) {
+    // The payload is encoded in place, right after the header.
+    size_t header = PacketHeaderSize(in, flags | PACKET_COMPRESSED);
+    size_t capacity = out->len > header ? out->len - header : 0;
+    if (capacity >= in->data.len) {
+      // Only payloads which get smaller are worth decoding.
+      capacity = in->data.len == 0 ? 0 : in->data.len - 1;
+    }
+    size_t len = HuffmanEncode(table, in->data.ptr, in->data.len,
+                               out->ptr + header, capacity);
+    if (len != 0) {
+      BitWriterInit(&writer, out->ptr, header);
+      THROW_OR_CONTINUE(
+          PacketWriteHeader(in, flags | PACKET_COMPRESSED, len, &writer));
+      BitWriterFlush(&writer);
+      out->len = header + len;
+      return SUCCESS;
+    }
+  }
+  BitWriterInit(&writer, out->ptr, out->len);
+  THROW_OR_CONTINUE(PacketWriteHeader(in, flags, in->data.len, &writer));
+  THROW_OR_CONTINUE(
+      BitWriterWriteBytes(&writer, in->data.ptr, in->data.len));
+  out->len = BitWriterFlush(&writer);
+  return SUCCESS;
+}
+
+RETCODE
+PreparedPacketInit(PreparedPacket* packet) {
+  THROW_OR_CONTINUE(DataInit(&packet->data));
+  return SUCCESS;
+}
+
+void PreparedPacketDestroy(PreparedPacket* packet) {
+  DataDestroy(&packet->data);
+}
+
+RETCODE
+PreparedPacketSet(PreparedPacket* packet, Response* response) {
+  THROW_OR_CONTINUE(PreparedPacketSetCompressed(packet, response, NULL));
+  return SUCCESS;
+}
+
+RETCODE
+PreparedPacketSetCompressed(PreparedPacket* packet, Response* response,
+                            const HuffmanTable* table) {
+  Response shared = *response;
+  shared.flags &= ~PACKET_HAS_ACKS;
+  if (shared.type != DISCONNECT) {
+    shared.type = CONNECT;
+  }
+  packet->data.len = kDataLength;
+  THROW_OR_CONTINUE(ResponseToDataCompressed(&shared, &packet->data, table));
   return SUCCESS;
 }
+
+void DatagramIterInit(DatagramIter* iter, Data* datagram) {
+  iter->rest = *datagram;
+  iter->more = 1;
+}
+
+int DatagramIterStopped(DatagramIter* iter) {
+  return !iter->more;
+}
+
+static RETCODE DatagramIterRead(DatagramIter* iter, Response* out,
+                                const HuffmanTable* table, int view) {
+  size_t used;
+  RETCODE result = PacketRead(&iter->rest, out, table, view, &used);
+  if (result != SUCCESS) {
+    iter->more = 0;
+    return result;
+  }
+  iter->rest.ptr += used;
+  iter->rest.len -= used;
+  iter->more = (out->flags & PACKET_COALESCED) && iter->rest.len != 0;
+  out->flags &= ~PACKET_COALESCED;
+  return SUCCESS;
+}
+
+RETCODE
+DatagramIterNext(DatagramIter* iter, Response* out, const HuffmanTable* table) {
+  THROW_OR_CONTINUE(DatagramIterRead(iter, out, table, 0));
+  return SUCCESS;
+}
+
+RETCODE
+DatagramIterNextView(DatagramIter* iter, Response* out,
+                     const HuffmanTable* table) {
+  THROW_OR_CONTINUE(DatagramIterRead(iter, out, table, 1));
+  return SUCCESS;
+}
+
+void PacketQueueInit(PacketQueue* queue) {
+  queue->data.ptr = NULL;
+  queue->data.len = 0;
+}
+
+void PacketQueueDestroy(PacketQueue* queue) {
+  DataDestroy(&queue->data);
+  queue->data.len = 0;
+}
+
+RETCODE
+PacketQueuePush(PacketQueue* queue, Response* response,
+                const HuffmanTable* table) {
+  if (queue->data.ptr == NULL) {
+    THROW_OR_CONTINUE(DataInit(&queue->data));
+    queue->data.len = 0;
+  }
+  Data rest = {.ptr = queue->data.ptr + queue->data.len,
+               .len = kDataLength - queue->data.len};
+  uint8_t flags = response->flags;
+  response->flags |= PACKET_COALESCED;
+  RETCODE result = ResponseToDataCompressed(response, &rest, table);
+  response->flags = flags;
+  THROW_OR_CONTINUE(result);
+  queue->data.len += rest.len;
+  return SUCCESS;
+}
+
+int PacketQueueEmpty(PacketQueue* queue) {
+  return queue->data.len == 0;
+}
+
+void PacketQueueClear(PacketQueue* queue) {
+  queue->data.len = 0;
+}
@@ -0,0 +1,75 @@
+#include "networking/pool.h"
+
+#include <stdlib.h>
+
+#include "common/macro.h"
+#include "common/retcode.h"
+
+const size_t kBasePoolSize = 64;
+static const size_t kCacheLineSize = 64;
+
+RETCODE
+BufferPoolInit(BufferPool* pool, size_t capacity) {
+  pool->stride = (kDataLength + kCacheLineSize - 1) / kCacheLineSize *
+                 kCacheLineSize;
+  pool->slab = aligned_alloc(kCacheLineSize, pool->stride * capacity);
+  pool->free_buffers = (char**)malloc(capacity * sizeof(char*));
+  if ((capacity != 0 && pool->slab == NULL) || pool->free_buffers == NULL) {
+    free(pool->slab);
+    free(pool->free_buffers);
+    pool->slab = NULL;
+    pool->free_buffers = NULL;
+    return NOT_ENOUGH_MEMORY;
+  }
+  for (size_t i = 0; i < capacity; ++i) {
+    pool->free_buffers[i] = pool->slab + (capacity - 1 - i) * pool->stride;
+  }
+  pool->free_count = capacity;
+  pool->capacity = capacity;
+  pool->high_water = 0;
+  return SUCCESS;
+}
+
+void BufferPoolDestroy(BufferPool* pool) {
+  free(pool->slab);
+  free(pool->free_buffers);
+  pool->slab = NULL;
+  pool->free_buffers = NULL;
+}
+
+RETCODE
+BufferPoolResize(BufferPool* pool, size_t capacity) {
+  BufferPool resized;
+  THROW_OR_CONTINUE(BufferPoolInit(&resized, capacity));
+  resized.high_water = pool->high_water;
+  BufferPoolDestroy(pool);
+  *pool = resized;
+  return SUCCESS;
+}
+
+RETCODE
+BufferPoolAcquire(BufferPool* pool, Data* data) {
+  if (pool->free_count == 0) {
+    return POOL_EXHAUSTED;
+  }
+  data->ptr = pool->free_buffers[--pool->free_count];
+  data->len = kDataLength;
+  if (pool->capacity - pool->free_count > pool->high_water) {
+    pool->high_water = pool->capacity - pool->free_count;
+  }
+  return SUCCESS;
+}
+
+void BufferPoolRelease(BufferPool* pool, Data* data) {
+  pool->free_buffers[pool->free_count++] = data->ptr;
+  data->ptr = NULL;
+}
+
+void BufferPoolReleaseAt(BufferPool* pool, const char* ptr) {
+  size_t index = (size_t)(ptr - pool->slab) / pool->stride;
+  pool->free_buffers[pool->free_count++] = pool->slab + index * pool->stride;
+}
+
+size_t BufferPoolHighWater(BufferPool* pool) {
+  return pool->high_water;
+}
@@ -0,0 +1,278 @@
+#include "networking/reliable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/macro.h"
+#include "common/retcode.h"
+
+const uint16_t kReliableWindow = 32;
+static const double kReliableInitialRtt = 100;
+static const uint64_t kReliableMinTimeout = 10;
+static const uint64_t kReliableMaxTimeout = 1000;
+
+static int SequenceGreater(uint16_t lhs, uint16_t rhs) {
+  return lhs != rhs && (uint16_t)(lhs - rhs) < 32768;
+}
+
+static RETCODE ReliableEndpointReserve(ReliableEndpoint* endpoint) {
+  if (endpoint->slab != NULL) {
+    return SUCCESS;
+  }
+  endpoint->slab = (char*)malloc(2 * kReliableWindow * kDataLength);
+  endpoint->sent =
+      (ReliableEntry*)calloc(kReliableWindow, sizeof(ReliableEntry));
+  endpoint->received =
+      (ReliableEntry*)calloc(kReliableWindow, sizeof(ReliableEntry));
+  if (endpoint->slab == NULL || endpoint->sent == NULL ||
+      endpoint->received == NULL) {
+    ReliableEndpointDestroy(endpoint);
+    return NOT_ENOUGH_MEMORY;
+  }
+  for (uint16_t i = 0; i < kReliableWindow; ++i) {
+    endpoint->sent[i].data.ptr = endpoint->slab + i * kDataLength;
+    endpoint->received[i].data.ptr =
+        endpoint->slab + (kReliableWindow + i) * kDataLength;
+  }
+  return SUCCESS;
+}
+
+static void ReliableEndpointSampleRtt(ReliableEndpoint* endpoint,
+                                      double sample) {
+  double error = sample - endpoint->rtt;
+  endpoint->rtt += error / 8;
+  endpoint->rtt_variance +=
+      ((error < 0 ? -error : error) - endpoint->rtt_variance) / 4;
+}
+
+static void ReliableEndpointApplyAcks(ReliableEndpoint* endpoint,
+                                      Response* response, uint64_t now) {
+  if (endpoint->sent == NULL) {
+    return;
+  }
+  for (uint16_t i = 0; i < kReliableWindow; ++i) {
+    ReliableEntry* entry = &endpoint->sent[i];
+    if (!entry->used) {
+      continue;
+    }
+    uint16_t distance = response->ack - entry->sequence;
+    if (distance == 0 ||
+        (distance <= 32 && (response->ack_bits >> (distance - 1)) & 1)) {
+      // Karn's algorithm: a resent message can't tell which send is acked.
+      if (!entry->resent) {
+        ReliableEndpointSampleRtt(endpoint, (double)(now - entry->sent_time));
+      }
+      entry->used = 0;
+      ++endpoint->acked_count;
+    }
+  }
+  while (endpoint->oldest_unacked != endpoint->next_sequence) {
+    ReliableEntry* entry =
+        &endpoint->sent[endpoint->oldest_unacked % kReliableWindow];
+    if (entry->used && entry->sequence == endpoint->oldest_unacked) {
+      break;
+    }
+    ++endpoint->oldest_unacked;
+  }
+}
+
+static void ReliableEndpointMarkReceived(ReliableEndpoint* endpoint,
+                                         uint16_t sequence) {
+  if (!endpoint->received_any) {
+    endpoint->remote_sequence = sequence;
+    endpoint->ack_bits = 0;
+    endpoint->received_any = 1;
+  } else if (SequenceGreater(sequence, endpoint->remote_sequence)) {
+    uint16_t shift = sequence - endpoint->remote_sequence;
+    if (shift <= 32) {
+      endpoint->ack_bits = (shift == 32 ? 0 : endpoint->ack_bits << shift) |
+                           (1u << (shift - 1));
+    } else {
+      endpoint->ack_bits = 0;
+    }
+    endpoint->remote_sequence = sequence;
+  } else if (sequence != endpoint->remote_sequence) {
+    uint16_t distance = endpoint->remote_sequence - sequence;
+    if (distance <= 32) {
+      endpoint->ack_bits |= 1u << (distance - 1);
+    }
+  }
+  endpoint->acks_pending = 1;
+}
+
+void ReliableEndpointInit(ReliableEndpoint* endpoint) {
+  *endpoint = (ReliableEndpoint){.rtt = kReliableInitialRtt,
+                                 .rtt_variance = kReliableInitialRtt / 2};
+}
+
+void ReliableEndpointDestroy(ReliableEndpoint* endpoint) {
+  free(endpoint->slab);
+  free(endpoint->sent);
+  free(endpoint->received);
+  endpoint->slab = NULL;
+  endpoint->sent = NULL;
+  endpoint->received = NULL;
+}
+
+void ReliableEndpointReset(ReliableEndpoint* endpoint) {
+  char* slab = endpoint->slab;
+  ReliableEntry* sent = endpoint->sent;
+  ReliableEntry* received = endpoint->received;
+  ReliableEndpointInit(endpoint);
+  if (slab == NULL) {
+    return;
+  }
+  endpoint->slab = slab;
+  endpoint->sent = sent;
+  endpoint->received = received;
+  for (uint16_t i = 0; i < kReliableWindow; ++i) {
+    sent[i].used = 0;
+    received[i].used = 0;
+  }
+}
+
+RETCODE
+ReliableEndpointSend(ReliableEndpoint* endpoint, Response* response,
+                     uint64_t now) {
+  if ((uint16_t)(endpoint->next_sequence - endpoint->oldest_unacked) >=
+      kReliableWindow) {
+    return RELIABLE_WINDOW_FULL;
+  }
+  if (response->data.len > kMaxPayload) {
+    return PACKET_TOO_LARGE;
+  }
+  THROW_OR_CONTINUE(ReliableEndpointReserve(endpoint));
+  ReliableEntry* entry =
+      &endpoint->sent[endpoint->next_sequence % kReliableWindow];
+  memcpy(entry->data.ptr, response->data.ptr, response->data.len);
+  entry->data.len = response->data.len;
+  entry->sequence = endpoint->next_sequence;
+  entry->used = 1;
+  entry->resent = 0;
+  entry->sent = 1;
+  entry->sent_time = now;
+  entry->last_sent = now;
+  ResponseSetType(response, RELIABLE);
+  response->sequence = endpoint->next_sequence++;
+  return SUCCESS;
+}
+
+void ReliableEndpointDefer(ReliableEndpoint* endpoint, uint16_t sequence) {
+  if (endpoint->sent == NULL) {
+    return;
+  }
+  ReliableEntry* entry = &endpoint->sent[sequence % kReliableWindow];
+  if (entry->used && entry->sequence == sequence) {
+    entry->sent = 0;
+  }
+}
+
+void ReliableEndpointWriteAcks(ReliableEndpoint* endpoint, Response* response) {
+  if (endpoint->received_any) {
+    response->ack = endpoint->remote_sequence;
+    response->ack_bits = endpoint->ack_bits;
+    response->flags |= PACKET_HAS_ACKS;
+  } else {
+    response->flags &= ~PACKET_HAS_ACKS;
+  }
+  endpoint->acks_pending = 0;
+}
+
+RETCODE
+ReliableEndpointReceive(ReliableEndpoint* endpoint, Response* response,
+                        uint64_t now) {
+  if (response->flags & PACKET_HAS_ACKS) {
+    ReliableEndpointApplyAcks(endpoint, response, now);
+    response->flags &= ~PACKET_HAS_ACKS;
+  }
+  if (ResponseGetType(response) != RELIABLE) {
+    return SUCCESS;
+  }
+  uint16_t ahead = response->sequence - endpoint->next_delivery;
+  if (ahead >= 32768) {
+    // Already delivered, the ack must have been lost.
+    endpoint->acks_pending = 1;
+    return SUCCESS;
+  }
+  if (ahead >= kReliableWindow) {
+    // No room until the owner takes older messages, the peer will resend.
+    return SUCCESS;
+  }
+  THROW_OR_CONTINUE(ReliableEndpointReserve(endpoint));
+  ReliableEndpointMarkReceived(endpoint, response->sequence);
+  ReliableEntry* entry =
+      &endpoint->received[response->sequence % kReliableWindow];
+  if (!entry->used) {
+    memcpy(entry->data.ptr, response->data.ptr, response->data.len);
+    entry->data.len = response->data.len;
+    entry->sequence = response->sequence;
+    entry->used = 1;
+  }
+  return SUCCESS;
+}
+
+int ReliableEndpointReady(ReliableEndpoint* endpoint) {
+  if (endpoint->received == NULL) {
+    return 0;
+  }
+  ReliableEntry* entry =
+      &endpoint->received[endpoint->next_delivery % kReliableWindow];
+  return entry->used && entry->sequence == endpoint->next_delivery;
+}
+
+int ReliableEndpointPop(ReliableEndpoint* endpoint, Response* response) {
+  if (!ReliableEndpointReady(endpoint)) {
+    return 0;
+  }
+  ReliableEntry* entry =
+      &endpoint->received[endpoint->next_delivery % kReliableWindow];
+  memcpy(response->data.ptr, entry->data.ptr, entry->data.len);
+  response->data.len = entry->data.len;
+  ResponseSetType(response, RELIABLE);
+  response->sequence = entry->sequence;
+  response->flags = 0;
+  entry->used = 0;
+  ++endpoint->next_delivery;
+  return 1;
+}
+
+int ReliableEndpointNextResend(ReliableEndpoint* endpoint, uint64_t now,
+                               Response* response) {
+  uint64_t timeout = ReliableEndpointTimeout(endpoint);
+  for (uint16_t sequence = endpoint->oldest_unacked;
+       sequence != endpoint->next_sequence; ++sequence) {
+    ReliableEntry* entry = &endpoint->sent[sequence % kReliableWindow];
+    if (!entry->used) {
+      continue;
+    }
+    if (!entry->sent) {
+      // Held back before, so this is the first send rather than a loss.
+      entry->sent = 1;
+      entry->sent_time = now;
+    } else if (now - entry->last_sent >= timeout) {
+      entry->resent = 1;
+      ++endpoint->lost_count;
+    } else {
+      continue;
+    }
+    entry->last_sent = now;
+    response->data = entry->data;
+    ResponseSetType(response, RELIABLE);
+    response->sequence = entry->sequence;
+    response->flags = 0;
+    return 1;
+  }
+  return 0;
+}
+
+uint64_t ReliableEndpointTimeout(ReliableEndpoint* endpoint) {
+  uint64_t timeout =
+      (uint64_t)(endpoint->rtt + 4 * endpoint->rtt_variance + 0.5);
+  if (timeout < kReliableMinTimeout) {
+    return kReliableMinTimeout;
+  }
+  if (timeout > kReliableMaxTimeout) {
+    return kReliableMaxTimeout;
+  }
+  return timeout;
+}
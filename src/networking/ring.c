@@ -0,0 +1,651 @@
+#include "networking/ring.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common/macro.h"
+#include "common/retcode.h"
+
+static const unsigned kRingEntries = 256;
+static const unsigned kRingCompletions = 4096;
+// A power of two, as the kernel requires for provided buffer rings.
+static const unsigned kRingBuffers = 512;
+static const uint16_t kRingBufferGroup = 0;
+static const size_t kRingSends = 1024;
+static const size_t kRingSlots = 256;
+static const uint64_t kRingReceiveTag = UINT64_MAX;
+static const uint64_t kRingWakeTag = UINT64_MAX - 1;
+
+/**
+ * @brief      A copy of a sent payload, shared by all of its recipients.
+ */
+typedef struct {
+  /// Points to the payload.
+  struct iovec iov;
+  /// Number of sends still using the payload.
+  size_t refs;
+  /// The next free slot.
+  size_t next;
+} RingSlot;
+
+/**
+ * @brief      One submitted send.
+ */
+typedef struct {
+  /// Header of the message.
+  struct msghdr msg;
+  /// Address of the recipient.
+  struct sockaddr_in addr;
+  /// Index of the payload slot.
+  size_t slot;
+  /// Index of the recipient in the batch.
+  size_t recipient;
+  /// The next free send.
+  size_t next;
+} RingSend;
+
+/**
+ * @brief      A received datagram waiting to be taken.
+ */
+typedef struct {
+  /// ID of the buffer holding it.
+  uint16_t buffer;
+  /// Number of bytes written into the buffer.
+  uint32_t len;
+} RingReceived;
+
+struct gudp_socket_ring_t {
+  /// Descriptor of the ring.
+  int ring_fd;
+  /// Descriptor of the socket.
+  int socket_fd;
+  /// Mapped submission and completion queues.
+  void* queues;
+  /// Size of the mapping of queues.
+  size_t queues_size;
+  /// Mapped submission entries.
+  struct io_uring_sqe* sqes;
+  /// Size of the mapping of submission entries.
+  size_t sqes_size;
+  /// Head of the submission queue, moved by the kernel.
+  unsigned* sq_head;
+  /// Tail of the submission queue.
+  unsigned* sq_tail;
+  /// Mask of submission queue indexes.
+  unsigned sq_mask;
+  /// Number of submission entries.
+  unsigned sq_entries;
+  /// Entries pushed but not submitted yet.
+  unsigned unsubmitted;
+  /// Head of the completion queue.
+  unsigned* cq_head;
+  /// Tail of the completion queue, moved by the kernel.
+  unsigned* cq_tail;
+  /// Mask of completion queue indexes.
+  unsigned cq_mask;
+  /// Completion entries.
+  struct io_uring_cqe* cqes;
+  /// Provided buffer ring, shared with the kernel.
+  struct io_uring_buf_ring* buffer_ring;
+  /// Size of the buffer ring mapping.
+  size_t buffer_ring_size;
+  /// Receive buffers.
+  char* buffers;
+  /// Size of every receive buffer.
+  size_t buffer_size;
+  /// Header of the multishot receive.
+  struct msghdr receive_msg;
+  /// Non-zero while the multishot receive is armed.
+  int armed;
+  /// Received datagrams which aren't taken yet, a circular queue.
+  RingReceived* received;
+  /// Index of the oldest received datagram.
+  size_t received_head;
+  /// Number of received datagrams.
+  size_t received_count;
+  /// Submitted sends.
+  RingSend* sends;
+  /// The first free send, kRingSends when there's none.
+  size_t free_send;
+  /// Payload slots.
+  RingSlot* slots;
+  /// Payloads of slots.
+  char* slot_data;
+  /// The first free slot, kRingSlots when there's none.
+  size_t free_slot;
+  /// Number of submitted sends which didn't complete yet.
+  size_t in_flight;
+  /// Where indexes of failed recipients of the current batch are saved, NULL
+  /// when they aren't.
+  size_t* failed;
+  /// Number of failed recipients of the current batch.
+  size_t failures;
+  /// Number of sends which failed after submission.
+  uint64_t send_errors;
+};
+
+static int RingEnter(SocketRing* ring, unsigned to_submit,
+                     unsigned min_complete, unsigned flags, void* arg,
+                     size_t arg_size) {
+  int result = (int)syscall(__NR_io_uring_enter, ring->ring_fd, to_submit,
+                            min_complete, flags, arg, arg_size);
+  if (result < 0) {
+    return -errno;
+  }
+  ring->unsubmitted -= (unsigned)result;
+  return result;
+}
+
+static int RingSubmit(SocketRing* ring) {
+  while (ring->unsubmitted != 0) {
+    int result = RingEnter(ring, ring->unsubmitted, 0, 0, NULL, 0);
+    if (result < 0 && result != -EINTR) {
+      return result;
+    }
+  }
+  return 0;
+}
+
+static struct io_uring_sqe* RingNextEntry(SocketRing* ring) {
+  unsigned tail = *ring->sq_tail;
+  if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) ==
+      ring->sq_entries) {
+    if (RingSubmit(ring) < 0) {
+      return NULL;
+    }
+  }
+  struct io_uring_sqe* sqe = &ring->sqes[tail & ring->sq_mask];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  return sqe;
+}
+
+static void RingPush(SocketRing* ring) {
+  __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+  ++ring->unsubmitted;
+}
+
+static void RingArm(SocketRing* ring) {
+  struct io_uring_sqe* sqe = RingNextEntry(ring);
+  if (sqe == NULL) {
+    return;
+  }
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = ring->socket_fd;
+  sqe->addr = (uint64_t)(uintptr_t)&ring->receive_msg;
+  sqe->len = 1;
+  // Reports the real length of truncated datagrams.
+  sqe->msg_flags = MSG_TRUNC;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kRingBufferGroup;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->user_data = kRingReceiveTag;
+  RingPush(ring);
+  ring->armed = 1;
+}
+
+static void RingReturnBuffer(SocketRing* ring, uint16_t buffer) {
+  struct io_uring_buf_ring* buffer_ring = ring->buffer_ring;
+  uint16_t tail = buffer_ring->tail;
+  struct io_uring_buf* entry = &buffer_ring->bufs[tail & (kRingBuffers - 1)];
+  char* ptr = ring->buffers + buffer * ring->buffer_size;
+  entry->addr = (uint64_t)(uintptr_t)ptr;
+  entry->len = (uint32_t)ring->buffer_size;
+  entry->bid = buffer;
+  __atomic_store_n(&buffer_ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+static void RingReleaseSend(SocketRing* ring, size_t index) {
+  RingSend* send = &ring->sends[index];
+  RingSlot* slot = &ring->slots[send->slot];
+  if (--slot->refs == 0) {
+    slot->next = ring->free_slot;
+    ring->free_slot = send->slot;
+  }
+  send->next = ring->free_send;
+  ring->free_send = index;
+}
+
+// Takes every completion, returns the number of received datagrams among
+// them.
+static size_t RingReap(SocketRing* ring) {
+  size_t received = 0;
+  unsigned head = *ring->cq_head;
+  unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    struct io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+    if (cqe->user_data == kRingReceiveTag) {
+      if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        ring->armed = 0;
+      }
+      if (cqe->flags & IORING_CQE_F_BUFFER) {
+        uint16_t buffer = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (cqe->res < 0) {
+          RingReturnBuffer(ring, buffer);
+          continue;
+        }
+        // Every datagram holds a buffer, so the queue never overflows.
+        size_t index =
+            (ring->received_head + ring->received_count) % kRingBuffers;
+        ring->received[index] =
+            (RingReceived){.buffer = buffer, .len = (uint32_t)cqe->res};
+        ++ring->received_count;
+        ++received;
+      }
+    } else if (cqe->user_data != kRingWakeTag) {
+      size_t index = (size_t)cqe->user_data;
+      if (cqe->res < 0) {
+        ++ring->send_errors;
+        if (ring->failed != NULL) {
+          ring->failed[ring->failures] = ring->sends[index].recipient;
+        }
+        ++ring->failures;
+      }
+      --ring->in_flight;
+      RingReleaseSend(ring, index);
+    }
+  }
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+  return received;
+}
+
+// Waits until some send completes, returns non-zero when datagrams were
+// received meanwhile.
+static int RingWaitSends(SocketRing* ring, int* failed) {
+  if (RingSubmit(ring) < 0) {
+    *failed = 1;
+    return 0;
+  }
+  int result = RingEnter(ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+  if (result < 0 && result != -EINTR) {
+    *failed = 1;
+    return 0;
+  }
+  return RingReap(ring) != 0;
+}
+
+static RETCODE RingMapQueues(SocketRing* ring, struct io_uring_params* params) {
+  size_t sq_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+  size_t cq_size =
+      params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+  ring->queues_size = sq_size > cq_size ? sq_size : cq_size;
+  ring->queues = mmap(NULL, ring->queues_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->ring_fd,
+                      IORING_OFF_SQ_RING);
+  if (ring->queues == MAP_FAILED) {
+    ring->queues = NULL;
+    return SOCKET_RING;
+  }
+  ring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = (struct io_uring_sqe*)mmap(
+      NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      ring->ring_fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    ring->sqes = NULL;
+    return SOCKET_RING;
+  }
+  char* queues = (char*)ring->queues;
+  ring->sq_head = (unsigned*)(queues + params->sq_off.head);
+  ring->sq_tail = (unsigned*)(queues + params->sq_off.tail);
+  ring->sq_mask = *(unsigned*)(queues + params->sq_off.ring_mask);
+  ring->sq_entries = params->sq_entries;
+  // Entries are always submitted in order, so the indirection is identity.
+  unsigned* array = (unsigned*)(queues + params->sq_off.array);
+  for (unsigned i = 0; i < params->sq_entries; ++i) {
+    array[i] = i;
+  }
+  ring->cq_head = (unsigned*)(queues + params->cq_off.head);
+  ring->cq_tail = (unsigned*)(queues + params->cq_off.tail);
+  ring->cq_mask = *(unsigned*)(queues + params->cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)(queues + params->cq_off.cqes);
+  return SUCCESS;
+}
+
+static RETCODE RingRegisterBuffers(SocketRing* ring) {
+  ring->buffer_ring_size = kRingBuffers * sizeof(struct io_uring_buf);
+  ring->buffer_ring = (struct io_uring_buf_ring*)mmap(
+      NULL, ring->buffer_ring_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring->buffer_ring == MAP_FAILED) {
+    ring->buffer_ring = NULL;
+    return NOT_ENOUGH_MEMORY;
+  }
+  ring->buffer_size = sizeof(struct io_uring_recvmsg_out) +
+                      sizeof(struct sockaddr_in) + kDataLength;
+  ring->buffers = (char*)malloc(kRingBuffers * ring->buffer_size);
+  if (ring->buffers == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  struct io_uring_buf_reg reg = {
+      .ring_addr = (uint64_t)(uintptr_t)ring->buffer_ring,
+      .ring_entries = kRingBuffers,
+      .bgid = kRingBufferGroup};
+  if (syscall(__NR_io_uring_register, ring->ring_fd,
+              IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    return SOCKET_RING;
+  }
+  for (unsigned i = 0; i < kRingBuffers; ++i) {
+    RingReturnBuffer(ring, (uint16_t)i);
+  }
+  return SUCCESS;
+}
+
+static RETCODE RingAllocate(SocketRing* ring) {
+  ring->received = (RingReceived*)malloc(kRingBuffers * sizeof(RingReceived));
+  ring->sends = (RingSend*)malloc(kRingSends * sizeof(RingSend));
+  ring->slots = (RingSlot*)malloc(kRingSlots * sizeof(RingSlot));
+  ring->slot_data = (char*)malloc(kRingSlots * kDataLength);
+  if (ring->received == NULL || ring->sends == NULL || ring->slots == NULL ||
+      ring->slot_data == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  for (size_t i = 0; i < kRingSends; ++i) {
+    ring->sends[i].next = i + 1;
+  }
+  ring->free_send = 0;
+  for (size_t i = 0; i < kRingSlots; ++i) {
+    ring->slots[i] = (RingSlot){
+        .iov = {.iov_base = ring->slot_data + i * kDataLength}, .next = i + 1};
+  }
+  ring->free_slot = 0;
+  return SUCCESS;
+}
+
+RETCODE
+SocketRingInit(SocketRing** out, int socket_fd) {
+  SocketRing* ring = (SocketRing*)calloc(1, sizeof(SocketRing));
+  if (ring == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  ring->socket_fd = socket_fd;
+  struct io_uring_params params = {.flags = IORING_SETUP_CQSIZE,
+                                   .cq_entries = kRingCompletions};
+  ring->ring_fd = (int)syscall(__NR_io_uring_setup, kRingEntries, &params);
+  if (ring->ring_fd < 0) {
+    free(ring);
+    return SOCKET_RING;
+  }
+  RETCODE result = SOCKET_RING;
+  unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG;
+  if ((params.features & needed) == needed) {
+    result = RingMapQueues(ring, &params);
+  }
+  if (result == SUCCESS) {
+    result = RingAllocate(ring);
+  }
+  if (result == SUCCESS) {
+    result = RingRegisterBuffers(ring);
+  }
+  if (result == SUCCESS) {
+    ring->receive_msg =
+        (struct msghdr){.msg_namelen = sizeof(struct sockaddr_in)};
+    RingArm(ring);
+    if (RingSubmit(ring) < 0) {
+      result = SOCKET_RING;
+    }
+  }
+  if (result != SUCCESS) {
+    SocketRingDestroy(ring);
+    return result;
+  }
+  *out = ring;
+  return SUCCESS;
+}
+
+// Cancels the receive and waits until it ends. The kernel tears a closed
+// ring down later, and the receive would keep the socket bound until then.
+static void RingDisarm(SocketRing* ring) {
+  struct io_uring_sqe* sqe = RingNextEntry(ring);
+  if (sqe == NULL) {
+    return;
+  }
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = kRingReceiveTag;
+  sqe->user_data = kRingWakeTag;
+  RingPush(ring);
+  if (RingSubmit(ring) < 0) {
+    return;
+  }
+  while (ring->armed) {
+    int result = RingEnter(ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (result < 0 && result != -EINTR) {
+      return;
+    }
+    RingReap(ring);
+  }
+}
+
+void SocketRingDestroy(SocketRing* ring) {
+  if (ring->armed) {
+    RingDisarm(ring);
+  }
+  // Closing the ring cancels the rest of its requests, the kernel unpins the
+  // buffers.
+  close(ring->ring_fd);
+  if (ring->queues != NULL) {
+    munmap(ring->queues, ring->queues_size);
+  }
+  if (ring->sqes != NULL) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->buffer_ring != NULL) {
+    munmap(ring->buffer_ring, ring->buffer_ring_size);
+  }
+  free(ring->buffers);
+  free(ring->received);
+  free(ring->sends);
+  free(ring->slots);
+  free(ring->slot_data);
+  free(ring);
+}
+
+int SocketRingFd(SocketRing* ring) {
+  return ring->ring_fd;
+}
+
+RETCODE
+SocketRingSend(SocketRing* ring, Data* data, Address* addrs, size_t count,
+               size_t* failed, size_t* failed_count) {
+  int broken = 0;
+  int woken = 0;
+  if (addrs == NULL) {
+    count = 1;
+  }
+  ring->failed = failed;
+  ring->failures = 0;
+  size_t done = 0;
+  while (done < count && !broken) {
+    while (ring->free_slot == kRingSlots && !broken) {
+      woken |= RingWaitSends(ring, &broken);
+    }
+    if (broken) {
+      break;
+    }
+    size_t index = ring->free_slot;
+    RingSlot* slot = &ring->slots[index];
+    ring->free_slot = slot->next;
+    memcpy(slot->iov.iov_base, data->ptr, data->len);
+    slot->iov.iov_len = data->len;
+    // The slot is held until its last send is pushed.
+    slot->refs = 1;
+    for (; done < count; ++done) {
+      while (ring->free_send == kRingSends && !broken) {
+        woken |= RingWaitSends(ring, &broken);
+      }
+      struct io_uring_sqe* sqe = broken ? NULL : RingNextEntry(ring);
+      if (sqe == NULL) {
+        broken = 1;
+        break;
+      }
+      size_t send_index = ring->free_send;
+      RingSend* send = &ring->sends[send_index];
+      ring->free_send = send->next;
+      send->slot = index;
+      send->recipient = done;
+      send->msg = (struct msghdr){.msg_iov = &slot->iov, .msg_iovlen = 1};
+      if (addrs != NULL) {
+#ifdef __IPV4__
+        send->addr = (struct sockaddr_in){
+            .sin_family = AF_INET,
+            .sin_addr = {.s_addr = addrs[done].ip},
+            .sin_port = addrs[done].port};
+#else
+#error "Unsupported type of netcode"
+#endif
+        send->msg.msg_name = &send->addr;
+        send->msg.msg_namelen = sizeof(struct sockaddr_in);
+      }
+      ++slot->refs;
+      sqe->opcode = IORING_OP_SENDMSG;
+      sqe->fd = ring->socket_fd;
+      sqe->addr = (uint64_t)(uintptr_t)&send->msg;
+      sqe->len = 1;
+      sqe->user_data = send_index;
+      RingPush(ring);
+      ++ring->in_flight;
+    }
+    if (--slot->refs == 0) {
+      slot->next = ring->free_slot;
+      ring->free_slot = index;
+    }
+  }
+  // Datagram sends usually complete during the submission, so waiting for
+  // them to learn the failed recipients rarely blocks.
+  if (RingSubmit(ring) < 0) {
+    broken = 1;
+  }
+  woken |= RingReap(ring) != 0;
+  while (ring->in_flight != 0 && !broken) {
+    woken |= RingWaitSends(ring, &broken);
+  }
+  if (woken) {
+    // Datagrams reaped while waiting left nothing in the completion queue,
+    // the no-op makes the ring readable for whoever polls it.
+    struct io_uring_sqe* sqe = RingNextEntry(ring);
+    if (sqe != NULL) {
+      sqe->opcode = IORING_OP_NOP;
+      sqe->user_data = kRingWakeTag;
+      RingPush(ring);
+      RingSubmit(ring);
+    }
+  }
+  // Sends still in flight after a broken submission are only counted.
+  ring->failed = NULL;
+  for (; done < count; ++done) {
+    if (failed != NULL) {
+      failed[ring->failures] = done;
+    }
+    ++ring->failures;
+  }
+  if (failed_count != NULL) {
+    *failed_count = ring->failures;
+  }
+  return broken || ring->failures != 0 ? SOCKET_SEND : SUCCESS;
+}
+
+static uint64_t RingNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static RETCODE RingWaitReceive(SocketRing* ring, time_t timeout) {
+  uint64_t deadline = timeout > 0 ? RingNow() + (uint64_t)timeout : 0;
+  while (ring->received_count == 0) {
+    if (!ring->armed) {
+      RingArm(ring);
+    }
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg = {.sigmask_sz = _NSIG / 8,
+                                         .ts = (uint64_t)(uintptr_t)&ts};
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    if (timeout > 0) {
+      uint64_t now = RingNow();
+      if (now >= deadline) {
+        return SOCKET_TIMEOUT;
+      }
+      uint64_t left = deadline - now;
+      ts = (struct __kernel_timespec){.tv_sec = left / 1000,
+                                      .tv_nsec = left % 1000 * 1000000};
+      flags |= IORING_ENTER_EXT_ARG;
+    }
+    int result = RingEnter(ring, ring->unsubmitted, 1, flags,
+                           timeout > 0 ? &arg : NULL,
+                           timeout > 0 ? sizeof(arg) : 0);
+    if (result == -ETIME) {
+      return SOCKET_TIMEOUT;
+    }
+    if (result < 0 && result != -EINTR) {
+      return SOCKET_RECEIVE;
+    }
+    RingReap(ring);
+  }
+  return SUCCESS;
+}
+
+RETCODE
+SocketRingReceive(SocketRing* ring, Data* buffers, Address* addrs, size_t max,
+                  size_t* got, time_t timeout) {
+  *got = 0;
+  RingReap(ring);
+  if (ring->received_count == 0) {
+    if (timeout == 0) {
+      if (!ring->armed) {
+        RingArm(ring);
+        RingSubmit(ring);
+      }
+      return SOCKET_TIMEOUT;
+    }
+    THROW_OR_CONTINUE(RingWaitReceive(ring, timeout));
+  }
+  size_t header = sizeof(struct io_uring_recvmsg_out) +
+                  ring->receive_msg.msg_namelen;
+  while (*got < max && ring->received_count != 0) {
+    RingReceived received = ring->received[ring->received_head];
+    ring->received_head = (ring->received_head + 1) % kRingBuffers;
+    --ring->received_count;
+    char* buffer = ring->buffers + received.buffer * ring->buffer_size;
+    struct io_uring_recvmsg_out* out = (struct io_uring_recvmsg_out*)buffer;
+    if (received.len >= header) {
+      size_t len = received.len - header;
+      Data* data = &buffers[*got];
+      if (len > data->len) {
+        len = data->len;
+      }
+      memcpy(data->ptr, buffer + header, len);
+      data->len = len;
+      if (addrs != NULL && out->namelen >= sizeof(struct sockaddr_in)) {
+        struct sockaddr_in* name =
+            (struct sockaddr_in*)(buffer + sizeof(struct io_uring_recvmsg_out));
+#ifdef __IPV4__
+        addrs[*got].ip = name->sin_addr.s_addr;
+        addrs[*got].port = name->sin_port;
+#else
+#error "Unsupported type of netcode"
+#endif
+      }
+      ++*got;
+    }
+    RingReturnBuffer(ring, received.buffer);
+  }
+  if (!ring->armed) {
+    // The receive stopped when buffers ran out, they are back now.
+    RingArm(ring);
+    RingSubmit(ring);
+  }
+  if (*got == 0) {
+    return SOCKET_TIMEOUT;
+  }
+  return SUCCESS;
+}
+
+uint64_t SocketRingSendErrors(SocketRing* ring) {
+  return ring->send_errors;
+}
@@ -0,0 +1,236 @@
+#include "networking/scheduler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/macro.h"
+#include "common/retcode.h"
+
+static uint32_t SchedulerHash(uint32_t key) {
+  // Fibonacci hashing spreads sequential entity IDs over the index.
+  return key * 2654435769u;
+}
+
+static uint32_t SchedulerHome(Scheduler* scheduler, uint32_t key) {
+  return SchedulerHash(key) & (scheduler->index_capacity - 1);
+}
+
+// The slot of the key, or the empty slot the key would take.
+static uint32_t SchedulerSlot(Scheduler* scheduler, uint32_t key) {
+  uint32_t mask = scheduler->index_capacity - 1;
+  uint32_t slot = SchedulerHome(scheduler, key);
+  while (scheduler->index[slot] != 0 &&
+         scheduler->items[scheduler->index[slot] - 1].key != key) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+static RETCODE SchedulerReserveIndex(Scheduler* scheduler) {
+  // The index is kept at most half full.
+  if (2 * ((size_t)scheduler->count + 1) <= scheduler->index_capacity) {
+    return SUCCESS;
+  }
+  uint32_t capacity =
+      scheduler->index_capacity == 0 ? 16 : 2 * scheduler->index_capacity;
+  uint32_t* index = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+  if (index == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  free(scheduler->index);
+  scheduler->index = index;
+  scheduler->index_capacity = capacity;
+  for (uint32_t i = 0; i < scheduler->count; ++i) {
+    scheduler->index[SchedulerSlot(scheduler, scheduler->items[i].key)] = i + 1;
+  }
+  return SUCCESS;
+}
+
+static RETCODE SchedulerReserveItems(Scheduler* scheduler) {
+  if (scheduler->count < scheduler->capacity) {
+    return SUCCESS;
+  }
+  uint32_t capacity = scheduler->capacity == 0 ? 8 : 2 * scheduler->capacity;
+  SchedulerItem* items = (SchedulerItem*)realloc(
+      scheduler->items, capacity * sizeof(SchedulerItem));
+  if (items == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  scheduler->items = items;
+  char* payloads =
+      (char*)realloc(scheduler->payloads, (size_t)capacity * kMaxPayload);
+  if (payloads == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  scheduler->payloads = payloads;
+  scheduler->capacity = capacity;
+  return SUCCESS;
+}
+
+static char* SchedulerPayload(Scheduler* scheduler, uint32_t index) {
+  return scheduler->payloads + (size_t)index * kMaxPayload;
+}
+
+// Empties the slot and shifts back the keys which probed past it.
+static void SchedulerUnindex(Scheduler* scheduler, uint32_t slot) {
+  uint32_t mask = scheduler->index_capacity - 1;
+  uint32_t next = (slot + 1) & mask;
+  while (scheduler->index[next] != 0) {
+    uint32_t home = SchedulerHome(
+        scheduler, scheduler->items[scheduler->index[next] - 1].key);
+    if (((next - home) & mask) >= ((next - slot) & mask)) {
+      scheduler->index[slot] = scheduler->index[next];
+      slot = next;
+    }
+    next = (next + 1) & mask;
+  }
+  scheduler->index[slot] = 0;
+}
+
+// Drops the update at the index, moving the last one into its place.
+static void SchedulerErase(Scheduler* scheduler, uint32_t index) {
+  SchedulerUnindex(scheduler,
+                   SchedulerSlot(scheduler, scheduler->items[index].key));
+  uint32_t last = --scheduler->count;
+  if (index == last) {
+    return;
+  }
+  scheduler->items[index] = scheduler->items[last];
+  memcpy(SchedulerPayload(scheduler, index), SchedulerPayload(scheduler, last),
+         scheduler->items[index].len);
+  scheduler->index[SchedulerSlot(scheduler, scheduler->items[index].key)] =
+      index + 1;
+}
+
+static int SchedulerRankCompare(const void* lhs, const void* rhs) {
+  const SchedulerRank* left = (const SchedulerRank*)lhs;
+  const SchedulerRank* right = (const SchedulerRank*)rhs;
+  if (left->accumulated != right->accumulated) {
+    return left->accumulated > right->accumulated ? -1 : 1;
+  }
+  return left->index < right->index ? -1 : left->index > right->index;
+}
+
+void SchedulerInit(Scheduler* scheduler) {
+  *scheduler = (Scheduler){0};
+}
+
+void SchedulerDestroy(Scheduler* scheduler) {
+  free(scheduler->items);
+  free(scheduler->payloads);
+  free(scheduler->index);
+  free(scheduler->order);
+  *scheduler = (Scheduler){0};
+}
+
+void SchedulerReset(Scheduler* scheduler) {
+  if (scheduler->index != NULL) {
+    memset(scheduler->index, 0,
+           scheduler->index_capacity * sizeof(uint32_t));
+  }
+  scheduler->count = 0;
+  scheduler->pending = 0;
+  scheduler->order_count = 0;
+  scheduler->cursor = 0;
+}
+
+RETCODE
+SchedulerPut(Scheduler* scheduler, uint32_t key, uint32_t priority,
+             const char* data, size_t len) {
+  if (len > kMaxPayload) {
+    return PACKET_TOO_LARGE;
+  }
+  if (scheduler->index_capacity != 0) {
+    uint32_t slot = SchedulerSlot(scheduler, key);
+    if (scheduler->index[slot] != 0) {
+      uint32_t index = scheduler->index[slot] - 1;
+      SchedulerItem* item = &scheduler->items[index];
+      if (item->gone) {
+        // The key was sent or removed this tick, it starts over.
+        item->gone = 0;
+        item->accumulated = 0;
+        ++scheduler->pending;
+      }
+      item->priority = priority;
+      item->len = (uint16_t)len;
+      memcpy(SchedulerPayload(scheduler, index), data, len);
+      return SUCCESS;
+    }
+  }
+  THROW_OR_CONTINUE(SchedulerReserveItems(scheduler));
+  THROW_OR_CONTINUE(SchedulerReserveIndex(scheduler));
+  uint32_t index = scheduler->count++;
+  scheduler->items[index] = (SchedulerItem){
+      .key = key, .priority = priority, .accumulated = 0, .len = (uint16_t)len};
+  memcpy(SchedulerPayload(scheduler, index), data, len);
+  scheduler->index[SchedulerSlot(scheduler, key)] = index + 1;
+  ++scheduler->pending;
+  return SUCCESS;
+}
+
+void SchedulerRemove(Scheduler* scheduler, uint32_t key) {
+  if (scheduler->index_capacity == 0) {
+    return;
+  }
+  uint32_t slot = SchedulerSlot(scheduler, key);
+  if (scheduler->index[slot] == 0) {
+    return;
+  }
+  // The order of the tick refers to updates by index, so the slot is only
+  // marked and reclaimed by the next tick.
+  SchedulerItem* item = &scheduler->items[scheduler->index[slot] - 1];
+  if (!item->gone) {
+    item->gone = 1;
+    --scheduler->pending;
+  }
+}
+
+size_t SchedulerPending(Scheduler* scheduler) {
+  return scheduler->pending;
+}
+
+RETCODE
+SchedulerTick(Scheduler* scheduler) {
+  scheduler->order_count = 0;
+  scheduler->cursor = 0;
+  // Backwards, so the update moved into a freed place is already checked.
+  for (uint32_t i = scheduler->count; i-- > 0;) {
+    if (scheduler->items[i].gone) {
+      SchedulerErase(scheduler, i);
+    }
+  }
+  if (scheduler->count == 0) {
+    return SUCCESS;
+  }
+  SchedulerRank* order = (SchedulerRank*)realloc(
+      scheduler->order, scheduler->capacity * sizeof(SchedulerRank));
+  if (order == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  scheduler->order = order;
+  for (uint32_t i = 0; i < scheduler->count; ++i) {
+    SchedulerItem* item = &scheduler->items[i];
+    item->accumulated += item->priority;
+    order[i] = (SchedulerRank){.accumulated = item->accumulated, .index = i};
+  }
+  qsort(order, scheduler->count, sizeof(SchedulerRank), SchedulerRankCompare);
+  scheduler->order_count = scheduler->count;
+  return SUCCESS;
+}
+
+int SchedulerNext(Scheduler* scheduler, size_t budget, Response* response) {
+  while (scheduler->cursor < scheduler->order_count) {
+    uint32_t index = scheduler->order[scheduler->cursor++].index;
+    SchedulerItem* item = &scheduler->items[index];
+    if (item->gone || item->len > budget) {
+      continue;
+    }
+    memcpy(response->data.ptr, SchedulerPayload(scheduler, index), item->len);
+    response->data.len = item->len;
+    item->gone = 1;
+    item->accumulated = 0;
+    --scheduler->pending;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,344 @@
+#include "networking/snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/macro.h"
+#include "common/retcode.h"
+#include "networking/bitstream.h"
+
+const uint16_t kSnapshotHistory = 32;
+const size_t kSnapshotHeaderSize = 4;
+// The sequence number of the newest received snapshot.
+static const size_t kSnapshotAckSize = 2;
+
+static int SequenceGreater(uint16_t lhs, uint16_t rhs) {
+  return lhs != rhs && (uint16_t)(lhs - rhs) < 32768;
+}
+
+static size_t SnapshotMaxSize() {
+  return kMaxPayload - kSnapshotHeaderSize;
+}
+
+static void SnapshotHeaderWrite(const SnapshotHeader* header, char* buffer) {
+  BitWriter writer;
+  BitWriterInit(&writer, buffer, kSnapshotHeaderSize);
+  // The buffer fits the header, so the writes can't fail.
+  BitWriterWriteBits(&writer, header->sequence, 16);
+  BitWriterWriteBits(&writer, header->baseline, 16);
+  BitWriterFlush(&writer);
+}
+
+static RETCODE SnapshotHeaderRead(const char* buffer, size_t len,
+                                  SnapshotHeader* header) {
+  if (len < kSnapshotHeaderSize) {
+    return PACKET_MALFORMED;
+  }
+  BitReader reader;
+  BitReaderInit(&reader, buffer, kSnapshotHeaderSize);
+  uint32_t sequence;
+  uint32_t baseline;
+  THROW_OR_CONTINUE(BitReaderReadBits(&reader, &sequence, 16));
+  THROW_OR_CONTINUE(BitReaderReadBits(&reader, &baseline, 16));
+  header->sequence = sequence;
+  header->baseline = baseline;
+  return SUCCESS;
+}
+
+static RETCODE SnapshotHistoryReserve(SnapshotEntry** history) {
+  if (*history != NULL) {
+    return SUCCESS;
+  }
+  // The entries and their contents share one allocation.
+  char* block = (char*)malloc(kSnapshotHistory *
+                              (sizeof(SnapshotEntry) + kDataLength));
+  if (block == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  *history = (SnapshotEntry*)block;
+  char* contents = block + kSnapshotHistory * sizeof(SnapshotEntry);
+  for (uint16_t i = 0; i < kSnapshotHistory; ++i) {
+    (*history)[i] = (SnapshotEntry){
+        .data = {.ptr = contents + i * kDataLength, .len = 0}};
+  }
+  return SUCCESS;
+}
+
+// Gets the kept snapshot, if it's still within the history of newest.
+static SnapshotEntry* SnapshotHistoryFind(SnapshotEntry* history,
+                                          uint16_t sequence, uint16_t newest) {
+  SnapshotEntry* entry = &history[sequence % kSnapshotHistory];
+  if (!entry->used || entry->sequence != sequence ||
+      (uint16_t)(newest - sequence) >= kSnapshotHistory) {
+    return NULL;
+  }
+  return entry;
+}
+
+static uint8_t BaselineByte(Data* baseline, size_t index) {
+  return index < baseline->len ? (uint8_t)baseline->ptr[index] : 0;
+}
+
+static uint8_t DeltaByte(Data* baseline, Data* snapshot, size_t index) {
+  return (uint8_t)snapshot->ptr[index] ^ BaselineByte(baseline, index);
+}
+
+static int WriteVarint(char* out, size_t limit, size_t* written,
+                       size_t value) {
+  do {
+    if (*written == limit) {
+      return 0;
+    }
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    out[(*written)++] = (char)(byte | (value != 0 ? 0x80 : 0));
+  } while (value != 0);
+  return 1;
+}
+
+static int ReadVarint(const char* in, size_t len, size_t* read,
+                      size_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 21; shift += 7) {
+    if (*read == len) {
+      return 0;
+    }
+    uint8_t byte = (uint8_t)in[(*read)++];
+    *value |= (size_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * The delta is the length of the snapshot followed by runs of changed bytes:
+ * the number of unchanged bytes to skip, the number of changed bytes, and the
+ * changed bytes XORed with the baseline. Bytes after the last run are equal
+ * to the baseline. Returns the size of the delta, or zero when it doesn't fit
+ * into the limit.
+ */
+static size_t SnapshotDeltaEncode(Data* baseline, Data* snapshot, char* out,
+                                  size_t limit) {
+  size_t written = 0;
+  if (!WriteVarint(out, limit, &written, snapshot->len)) {
+    return 0;
+  }
+  size_t index = 0;
+  while (1) {
+    size_t start = index;
+    while (index < snapshot->len &&
+           DeltaByte(baseline, snapshot, index) == 0) {
+      ++index;
+    }
+    if (index == snapshot->len) {
+      break;
+    }
+    size_t skip = index - start;
+    start = index;
+    // A single unchanged byte is cheaper inside the run than between two.
+    while (index < snapshot->len &&
+           (DeltaByte(baseline, snapshot, index) != 0 ||
+            (index + 1 < snapshot->len &&
+             DeltaByte(baseline, snapshot, index + 1) != 0))) {
+      ++index;
+    }
+    size_t count = index - start;
+    if (!WriteVarint(out, limit, &written, skip) ||
+        !WriteVarint(out, limit, &written, count) ||
+        limit - written < count) {
+      return 0;
+    }
+    for (size_t i = start; i < index; ++i) {
+      out[written++] = (char)DeltaByte(baseline, snapshot, i);
+    }
+  }
+  return written;
+}
+
+static RETCODE SnapshotDeltaDecode(Data* baseline, const char* in, size_t len,
+                                   Data* snapshot) {
+  size_t read = 0;
+  size_t total;
+  if (!ReadVarint(in, len, &read, &total) || total > SnapshotMaxSize()) {
+    return PACKET_MALFORMED;
+  }
+  size_t index = 0;
+  while (read < len) {
+    size_t skip;
+    size_t count;
+    if (!ReadVarint(in, len, &read, &skip) ||
+        !ReadVarint(in, len, &read, &count) || skip > total - index ||
+        count > total - index - skip || count > len - read) {
+      return PACKET_MALFORMED;
+    }
+    for (size_t end = index + skip; index < end; ++index) {
+      snapshot->ptr[index] = (char)BaselineByte(baseline, index);
+    }
+    for (size_t end = index + count; index < end; ++index) {
+      snapshot->ptr[index] =
+          (char)((uint8_t)in[read++] ^ BaselineByte(baseline, index));
+    }
+  }
+  for (; index < total; ++index) {
+    snapshot->ptr[index] = (char)BaselineByte(baseline, index);
+  }
+  snapshot->len = total;
+  return SUCCESS;
+}
+
+void SnapshotChannelInit(SnapshotChannel* channel) {
+  *channel = (SnapshotChannel){0};
+}
+
+void SnapshotChannelDestroy(SnapshotChannel* channel) {
+  free(channel->sent);
+  free(channel->received);
+  channel->sent = NULL;
+  channel->received = NULL;
+}
+
+static void SnapshotHistoryClear(SnapshotEntry* history) {
+  if (history == NULL) {
+    return;
+  }
+  for (uint16_t i = 0; i < kSnapshotHistory; ++i) {
+    history[i].used = 0;
+    history[i].data.len = 0;
+  }
+}
+
+void SnapshotChannelReset(SnapshotChannel* channel) {
+  SnapshotEntry* sent = channel->sent;
+  SnapshotEntry* received = channel->received;
+  SnapshotChannelInit(channel);
+  SnapshotHistoryClear(sent);
+  SnapshotHistoryClear(received);
+  channel->sent = sent;
+  channel->received = received;
+}
+
+RETCODE
+SnapshotChannelEncode(SnapshotChannel* channel, Response* response) {
+  if (response->data.len > SnapshotMaxSize()) {
+    return PACKET_TOO_LARGE;
+  }
+  THROW_OR_CONTINUE(SnapshotHistoryReserve(&channel->sent));
+  uint16_t sequence = channel->next_sequence++;
+  SnapshotEntry* entry = &channel->sent[sequence % kSnapshotHistory];
+  memcpy(entry->data.ptr, response->data.ptr, response->data.len);
+  entry->data.len = response->data.len;
+  entry->sequence = sequence;
+  entry->used = 1;
+
+  SnapshotHeader header =
+      (SnapshotHeader){.sequence = sequence, .baseline = sequence};
+  char* payload = response->data.ptr + kSnapshotHeaderSize;
+  size_t len = 0;
+  SnapshotEntry* baseline =
+      channel->acked_any
+          ? SnapshotHistoryFind(channel->sent, channel->acked, sequence)
+          : NULL;
+  if (baseline != NULL) {
+    // The delta is only worth it when it's smaller than the snapshot itself.
+    len = SnapshotDeltaEncode(&baseline->data, &entry->data, payload,
+                              entry->data.len);
+    header.baseline = baseline->sequence;
+  }
+  if (len == 0) {
+    memcpy(payload, entry->data.ptr, entry->data.len);
+    len = entry->data.len;
+    header.baseline = sequence;
+  }
+  SnapshotHeaderWrite(&header, response->data.ptr);
+  response->data.len = kSnapshotHeaderSize + len;
+  ResponseSetType(response, SNAPSHOT);
+  return SUCCESS;
+}
+
+static RETCODE SnapshotChannelReceiveAck(SnapshotChannel* channel,
+                                         Response* response) {
+  if (response->data.len != kSnapshotAckSize) {
+    return PACKET_MALFORMED;
+  }
+  BitReader reader;
+  BitReaderInit(&reader, response->data.ptr, response->data.len);
+  uint32_t sequence;
+  THROW_OR_CONTINUE(BitReaderReadBits(&reader, &sequence, 16));
+  // Acks of snapshots never sent are ignored.
+  if (SequenceGreater(channel->next_sequence, sequence) &&
+      (!channel->acked_any || SequenceGreater(sequence, channel->acked))) {
+    channel->acked = sequence;
+    channel->acked_any = 1;
+  }
+  return RELIABLE_PENDING;
+}
+
+static RETCODE SnapshotChannelReceiveSnapshot(SnapshotChannel* channel,
+                                              Response* response) {
+  SnapshotHeader header;
+  THROW_OR_CONTINUE(
+      SnapshotHeaderRead(response->data.ptr, response->data.len, &header));
+  if (channel->received_any &&
+      !SequenceGreater(header.sequence, channel->newest)) {
+    // Superseded by the newer snapshot.
+    return RELIABLE_PENDING;
+  }
+  THROW_OR_CONTINUE(SnapshotHistoryReserve(&channel->received));
+  const char* payload = response->data.ptr + kSnapshotHeaderSize;
+  size_t len = response->data.len - kSnapshotHeaderSize;
+  SnapshotEntry* entry = &channel->received[header.sequence % kSnapshotHistory];
+  if (header.baseline == header.sequence) {
+    entry->used = 0;
+    memcpy(entry->data.ptr, payload, len);
+    entry->data.len = len;
+  } else {
+    SnapshotEntry* baseline = SnapshotHistoryFind(
+        channel->received, header.baseline, header.sequence);
+    if (baseline == NULL) {
+      // The baseline is too old, the next snapshots will use a newer one.
+      return RELIABLE_PENDING;
+    }
+    entry->used = 0;
+    THROW_OR_CONTINUE(
+        SnapshotDeltaDecode(&baseline->data, payload, len, &entry->data));
+  }
+  entry->sequence = header.sequence;
+  entry->used = 1;
+  channel->newest = header.sequence;
+  channel->received_any = 1;
+  channel->ack_pending = 1;
+  memcpy(response->data.ptr, entry->data.ptr, entry->data.len);
+  response->data.len = entry->data.len;
+  return SUCCESS;
+}
+
+RETCODE
+SnapshotChannelReceive(SnapshotChannel* channel, Response* response) {
+  switch (ResponseGetType(response)) {
+    case SNAPSHOT: {
+      return SnapshotChannelReceiveSnapshot(channel, response);
+    }
+    case SNAPSHOT_ACK: {
+      return SnapshotChannelReceiveAck(channel, response);
+    }
+    default: {
+      return RELIABLE_PENDING;
+    }
+  }
+}
+
+int SnapshotChannelNextAck(SnapshotChannel* channel, Response* response) {
+  if (!channel->ack_pending) {
+    return 0;
+  }
+  BitWriter writer;
+  BitWriterInit(&writer, response->data.ptr, kSnapshotAckSize);
+  BitWriterWriteBits(&writer, channel->newest, 16);
+  response->data.len = BitWriterFlush(&writer);
+  ResponseSetType(response, SNAPSHOT_ACK);
+  response->flags = 0;
+  channel->ack_pending = 0;
+  return 1;
+}
@@ -6,11 +6,16 @@
  * @author     Alexander Stanovoy
  */
 
+#define _GNU_SOURCE
+
 #include "networking/socket.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/filter.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -18,10 +23,38 @@
 
 #include "common/macro.h"
 #include "common/retcode.h"
+#include "networking/ring.h"
 
 static const int kSocketDomain = AF_INET;
 static const int kSocketType = SOCK_DGRAM;
 static const int kSocketProtocol = 0;
+static const size_t kSocketBatchSize = 64;
+static const size_t kSocketSendBatchSize = 256;
+// The largest UDP payload over IPv4, also the limit of one segmented send.
+static const size_t kSocketCoalescedSize = 65507;
+
+struct gudp_socket_coalesced_t {
+  /// Non-zero while the kernel coalesces datagrams for the socket.
+  int gro;
+  /// The buffer datagrams are received to.
+  char* ptr;
+  /// Number of received bytes.
+  size_t len;
+  /// Offset of the first datagram not taken yet.
+  size_t offset;
+  /// Size of every received datagram but the last one.
+  size_t segment;
+  /// Number of datagrams not taken yet.
+  size_t count;
+  /// The sender of the datagrams.
+  Address from;
+};
+
+#ifdef __SOCKET_BACKEND_IO_URING__
+const SocketBackend kSocketDefaultBackend = SOCKET_BACKEND_IO_URING;
+#else
+const SocketBackend kSocketDefaultBackend = SOCKET_BACKEND_SYSCALL;
+#endif
 
 #ifdef __IPV4__
 RETCODE
@@ -58,14 +91,29 @@ void SocketsShutdown() {
 RETCODE
 SocketInit(Socket* sock) {
   THROW_OR_CONTINUE(SocketsStartup());
+  sock->ring = NULL;
+  sock->timeout = 0;
+  sock->nonblocking = 0;
+  sock->gso = 0;
+  sock->coalesced = NULL;
   sock->socket_fd = socket(kSocketDomain, kSocketType, kSocketProtocol);
   if (sock->socket_fd < 0) {
     return SOCKET_INIT;
   }
+  if (kSocketDefaultBackend == SOCKET_BACKEND_IO_URING &&
+      SocketSetBackend(sock, SOCKET_BACKEND_IO_URING) != SUCCESS) {
+    // System calls work everywhere io_uring doesn't.
+  }
   return SUCCESS;
 }
 
 void SocketDestroy(Socket* sock) {
+  free(sock->coalesced);
+  sock->coalesced = NULL;
+  if (sock->ring != NULL) {
+    SocketRingDestroy(sock->ring);
+    sock->ring = NULL;
+  }
   if (sock->socket_fd != -1) {
     close(sock->socket_fd);
   }
@@ -96,8 +144,18 @@ SocketConnect(Socket* sock, Address* addr) {
   return SUCCESS;
 }
 
+// The ring waits the same way the socket would.
+static time_t SocketRingTimeout(Socket* sock) {
+  if (sock->nonblocking) {
+    return 0;
+  }
+  return sock->timeout == 0 ? -1 : sock->timeout;
+}
+
 RETCODE
 SocketSend(Socket* sock, Data* data, Address* addr) {
+  // A single datagram goes out with one system call either way, the ring
+  // would only add a copy and a completion to reap.
   if (addr == NULL) {
     if (send(sock->socket_fd, data->ptr, data->len, 0) < 0) {
       return SOCKET_SEND;
@@ -116,20 +174,253 @@ SocketSend(Socket* sock, Data* data, Address* addr) {
   return SUCCESS;
 }
 
+RETCODE
+SocketSendBatch(Socket* sock, Data* data, Address* addrs, size_t count,
+                size_t* failed, size_t* failed_count) {
+  if (sock->ring != NULL) {
+    if (count == 0) {
+      if (failed_count != NULL) {
+        *failed_count = 0;
+      }
+      return SUCCESS;
+    }
+    THROW_OR_CONTINUE(
+        SocketRingSend(sock->ring, data, addrs, count, failed, failed_count));
+    return SUCCESS;
+  }
+  struct mmsghdr msgs[kSocketSendBatchSize];
+  struct sockaddr_in client_addrs[kSocketSendBatchSize];
+  struct iovec iovec = (struct iovec){.iov_base = data->ptr,
+                                      .iov_len = data->len};
+  size_t failures = 0;
+  for (size_t begin = 0; begin < count; begin += kSocketSendBatchSize) {
+    size_t len = count - begin;
+    if (len > kSocketSendBatchSize) {
+      len = kSocketSendBatchSize;
+    }
+    for (size_t i = 0; i < len; ++i) {
+      client_addrs[i] =
+          (struct sockaddr_in){.sin_family = kSocketDomain,
+                               .sin_addr = {.s_addr = addrs[begin + i].ip},
+                               .sin_port = addrs[begin + i].port};
+      msgs[i].msg_hdr =
+          (struct msghdr){.msg_name = &client_addrs[i],
+                          .msg_namelen = sizeof(struct sockaddr_in),
+                          .msg_iov = &iovec,
+                          .msg_iovlen = 1};
+    }
+    size_t sent = 0;
+    while (sent < len) {
+      int result = sendmmsg(sock->socket_fd, msgs + sent, len - sent, 0);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      if (result <= 0) {
+        // The kernel stops on the first failed message, skip it and go on.
+        if (failed != NULL) {
+          failed[failures] = begin + sent;
+        }
+        ++failures;
+        ++sent;
+        continue;
+      }
+      sent += result;
+    }
+  }
+  if (failed_count != NULL) {
+    *failed_count = failures;
+  }
+  return failures == 0 ? SUCCESS : SOCKET_SEND;
+}
+
+// Counts the segments from the first one the kernel can cut out of a single
+// buffer: all of the same size but the last, which may be shorter.
+static size_t SocketSegmentRun(Data* segments, size_t count) {
+  size_t len = 1;
+  size_t total = segments[0].len;
+  while (len < count && segments[len - 1].len == segments[0].len &&
+         segments[len].len != 0 && segments[len].len <= segments[0].len &&
+         total + segments[len].len <= kSocketCoalescedSize) {
+    total += segments[len].len;
+    ++len;
+  }
+  return len;
+}
+
+RETCODE
+SocketSendSegments(Socket* sock, Data* segments, size_t count, Address* addr) {
+  struct mmsghdr msgs[kSocketMaxSegments];
+  struct iovec iovecs[kSocketMaxSegments];
+  union {
+    char buffer[CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+  } control;
+  struct sockaddr_in client_addr;
+  if (addr != NULL) {
+    client_addr = (struct sockaddr_in){.sin_family = kSocketDomain,
+                                       .sin_addr = {.s_addr = addr->ip},
+                                       .sin_port = addr->port};
+  }
+  size_t failures = 0;
+  size_t begin = 0;
+  while (begin < count) {
+    size_t len = count - begin;
+    if (len > kSocketMaxSegments) {
+      len = kSocketMaxSegments;
+    }
+    if (sock->gso) {
+      len = SocketSegmentRun(segments + begin, len);
+    }
+    for (size_t i = 0; i < len; ++i) {
+      iovecs[i] = (struct iovec){.iov_base = segments[begin + i].ptr,
+                                 .iov_len = segments[begin + i].len};
+      msgs[i].msg_hdr = (struct msghdr){
+          .msg_name = addr == NULL ? NULL : &client_addr,
+          .msg_namelen = addr == NULL ? 0 : sizeof(struct sockaddr_in),
+          .msg_iov = &iovecs[i],
+          .msg_iovlen = 1};
+    }
+    size_t messages = len;
+    if (sock->gso && len > 1) {
+      // One message of the whole run, the kernel cuts it into datagrams.
+      msgs[0].msg_hdr.msg_iovlen = len;
+      msgs[0].msg_hdr.msg_control = control.buffer;
+      msgs[0].msg_hdr.msg_controllen = sizeof(control.buffer);
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgs[0].msg_hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t segment = segments[begin].len;
+      memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+      messages = 1;
+    }
+    int result = sendmmsg(sock->socket_fd, msgs, messages, 0);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result < 0 && messages != len && (errno == EIO || errno == EINVAL)) {
+      // The route can't segment, e.g. the device has no checksum offload.
+      sock->gso = 0;
+      continue;
+    }
+    if (result <= 0) {
+      // The kernel stops on the first failed message, skip it and go on.
+      ++failures;
+      begin += messages == 1 ? len : 1;
+      continue;
+    }
+    begin += messages == 1 ? len : (size_t)result;
+  }
+  return failures == 0 ? SUCCESS : SOCKET_SEND;
+}
+
+// Takes the next coalesced datagram, returns zero when there's none.
+static int SocketTakeCoalesced(SocketCoalesced* coalesced, Data* buffer,
+                               Address* addr) {
+  if (coalesced == NULL || coalesced->count == 0) {
+    return 0;
+  }
+  size_t len = coalesced->len - coalesced->offset;
+  if (len > coalesced->segment) {
+    len = coalesced->segment;
+  }
+  // Like recv() does, the tail which doesn't fit the buffer is dropped.
+  if (buffer->len > len) {
+    buffer->len = len;
+  }
+  memcpy(buffer->ptr, coalesced->ptr + coalesced->offset, buffer->len);
+  coalesced->offset += len;
+  --coalesced->count;
+  if (addr != NULL) {
+    AddressCopy(addr, &coalesced->from);
+  }
+  return 1;
+}
+
+static void SocketTakeCoalescedBatch(Socket* sock, Data* buffers,
+                                     Address* addrs, size_t max, size_t* got) {
+  while (*got < max &&
+         SocketTakeCoalesced(sock->coalesced, &buffers[*got],
+                             addrs == NULL ? NULL : &addrs[*got])) {
+    ++*got;
+  }
+}
+
+// Receives datagrams the kernel may have coalesced into the buffer.
+static RETCODE SocketReceiveCoalesced(Socket* sock, int flags) {
+  SocketCoalesced* coalesced = sock->coalesced;
+  union {
+    char buffer[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct sockaddr_in seed;
+  struct iovec iovec = (struct iovec){.iov_base = coalesced->ptr,
+                                      .iov_len = kSocketCoalescedSize};
+  struct msghdr msg = (struct msghdr){.msg_name = &seed,
+                                      .msg_namelen = sizeof(seed),
+                                      .msg_iov = &iovec,
+                                      .msg_iovlen = 1,
+                                      .msg_control = control.buffer,
+                                      .msg_controllen = sizeof(control.buffer)};
+  ssize_t received = recvmsg(sock->socket_fd, &msg, flags);
+  if (received < 0) {
+    return errno == EAGAIN ? SOCKET_TIMEOUT : SOCKET_RECEIVE;
+  }
+  coalesced->len = received;
+  coalesced->offset = 0;
+  coalesced->segment = received;
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+      int segment;
+      memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+      coalesced->segment = segment;
+    }
+  }
+  coalesced->count = received == 0 ? 1
+                                   : (coalesced->len + coalesced->segment - 1) /
+                                         coalesced->segment;
+#ifdef __IPV4__
+  memcpy(&coalesced->from.ip, &seed.sin_addr, sizeof(coalesced->from.ip));
+  coalesced->from.port = seed.sin_port;
+#else
+#error "Unsupported type of netcode"
+#endif
+  return SUCCESS;
+}
+
 RETCODE
 SocketReceive(Socket* sock, Data* buffer, Address* addr) {
+  if (SocketTakeCoalesced(sock->coalesced, buffer, addr)) {
+    return SUCCESS;
+  }
+  if (sock->ring != NULL) {
+    size_t got;
+    THROW_OR_CONTINUE(SocketRingReceive(sock->ring, buffer, addr, 1, &got,
+                                        SocketRingTimeout(sock)));
+    return SUCCESS;
+  }
+  if (sock->coalesced != NULL && sock->coalesced->gro) {
+    THROW_OR_CONTINUE(SocketReceiveCoalesced(sock, 0));
+    SocketTakeCoalesced(sock->coalesced, buffer, addr);
+    return SUCCESS;
+  }
   if (addr == NULL) {
-    if (recv(sock->socket_fd, buffer->ptr, buffer->len, 0) < 0) {
+    ssize_t received = recv(sock->socket_fd, buffer->ptr, buffer->len, 0);
+    if (received < 0) {
       return errno == EAGAIN ? SOCKET_TIMEOUT : SOCKET_RECEIVE;
     }
+    buffer->len = received;
     return SUCCESS;
   }
   struct sockaddr_storage seed;
   socklen_t seedlen = sizeof(seed);
-  if (recvfrom(sock->socket_fd, buffer->ptr, buffer->len, 0,
-               (struct sockaddr*)&seed, &seedlen) < 0) {
+  ssize_t received = recvfrom(sock->socket_fd, buffer->ptr, buffer->len, 0,
+                              (struct sockaddr*)&seed, &seedlen);
+  if (received < 0) {
     return errno == EAGAIN ? SOCKET_TIMEOUT : SOCKET_RECEIVE;
   }
+  buffer->len = received;
 #ifdef __IPV4__
   memcpy(&addr->ip, &((struct sockaddr_in*)&seed)->sin_addr, sizeof(addr->ip));
   addr->port = ((struct sockaddr_in*)&seed)->sin_port;
@@ -139,6 +430,65 @@ SocketReceive(Socket* sock, Data* buffer, Address* addr) {
   return SUCCESS;
 }
 
+RETCODE
+SocketReceiveBatch(Socket* sock, Data* buffers, Address* addrs, size_t max,
+                   size_t* got) {
+  *got = 0;
+  SocketTakeCoalescedBatch(sock, buffers, addrs, max, got);
+  if (sock->ring != NULL && *got == 0) {
+    THROW_OR_CONTINUE(SocketRingReceive(sock->ring, buffers, addrs, max, got,
+                                        SocketRingTimeout(sock)));
+    return SUCCESS;
+  }
+  if (sock->ring != NULL || *got == max) {
+    return SUCCESS;
+  }
+  if (sock->coalesced != NULL && sock->coalesced->gro) {
+    // Waits only for the first buffer, like recvmmsg() with MSG_WAITFORONE.
+    RETCODE result = SUCCESS;
+    while (*got < max && (result = SocketReceiveCoalesced(
+                              sock, *got == 0 ? 0 : MSG_DONTWAIT)) == SUCCESS) {
+      SocketTakeCoalescedBatch(sock, buffers, addrs, max, got);
+    }
+    return *got != 0 ? SUCCESS : result;
+  }
+  if (*got != 0) {
+    return SUCCESS;
+  }
+  struct mmsghdr msgs[kSocketBatchSize];
+  struct iovec iovecs[kSocketBatchSize];
+  struct sockaddr_in seeds[kSocketBatchSize];
+  if (max > kSocketBatchSize) {
+    max = kSocketBatchSize;
+  }
+  for (size_t i = 0; i < max; ++i) {
+    iovecs[i] = (struct iovec){.iov_base = buffers[i].ptr,
+                               .iov_len = buffers[i].len};
+    msgs[i].msg_hdr = (struct msghdr){
+        .msg_name = addrs == NULL ? NULL : &seeds[i],
+        .msg_namelen = addrs == NULL ? 0 : sizeof(struct sockaddr_in),
+        .msg_iov = &iovecs[i],
+        .msg_iovlen = 1};
+  }
+  int received = recvmmsg(sock->socket_fd, msgs, max, MSG_WAITFORONE, NULL);
+  if (received < 0) {
+    return errno == EAGAIN ? SOCKET_TIMEOUT : SOCKET_RECEIVE;
+  }
+  for (int i = 0; i < received; ++i) {
+    buffers[i].len = msgs[i].msg_len;
+    if (addrs != NULL) {
+#ifdef __IPV4__
+      memcpy(&addrs[i].ip, &seeds[i].sin_addr, sizeof(addrs[i].ip));
+      addrs[i].port = seeds[i].sin_port;
+#else
+#error "Unsupported type of netcode"
+#endif
+    }
+  }
+  *got = received;
+  return SUCCESS;
+}
+
 RETCODE
 SocketSetTimeout(Socket* sock, time_t milliseconds) {
   struct timeval tv = (struct timeval){.tv_sec = milliseconds / 1000,
@@ -147,6 +497,7 @@ SocketSetTimeout(Socket* sock, time_t milliseconds) {
                  sizeof(struct timeval)) == -1) {
     return SOCKET_SETTIMEOUT;
   }
+  sock->timeout = milliseconds;
   return SUCCESS;
 }
 
@@ -159,5 +510,121 @@ SocketMakeNonBlocking(Socket* sock) {
   if (fcntl(sock->socket_fd, F_SETFL, O_NONBLOCK | old_flags) < 0) {
     return SOCKET_MAKE_NONBLOCKING;
   }
+  sock->nonblocking = 1;
+  return SUCCESS;
+}
+
+RETCODE
+SocketSetReusePort(Socket* sock) {
+  int enable = 1;
+  if (setsockopt(sock->socket_fd, SOL_SOCKET, SO_REUSEPORT, &enable,
+                 sizeof(enable)) == -1) {
+    return SOCKET_REUSEPORT;
+  }
+  return SUCCESS;
+}
+
+RETCODE
+SocketSetReusePortHash(Socket* sock, uint32_t count) {
+#ifdef __IPV4__
+  // Hashes source IP and UDP port of the datagram. IPv4 options are assumed
+  // absent; the kernel falls back to its own hash for out of range results.
+  struct sock_filter code[] = {
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+      BPF_STMT(BPF_MISC | BPF_TAX, 0),
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_NET_OFF + 20),
+      BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+      BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9e3779b1u),
+      BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+      BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, count),
+      BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+#else
+#error "Unsupported type of netcode"
+#endif
+  struct sock_fprog program = (struct sock_fprog){
+      .len = sizeof(code) / sizeof(code[0]), .filter = code};
+  if (setsockopt(sock->socket_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                 &program, sizeof(program)) == -1) {
+    return SOCKET_REUSEPORT;
+  }
+  return SUCCESS;
+}
+
+static void SocketSetCoalescing(Socket* sock, int enable) {
+  if (setsockopt(sock->socket_fd, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) ==
+      0) {
+    sock->coalesced->gro = enable;
+  }
+}
+
+RETCODE
+SocketSetBackend(Socket* sock, SocketBackend backend) {
+  if (backend == SocketGetBackend(sock)) {
+    return SUCCESS;
+  }
+  if (backend == SOCKET_BACKEND_SYSCALL) {
+    SocketRingDestroy(sock->ring);
+    sock->ring = NULL;
+    if (sock->coalesced != NULL) {
+      SocketSetCoalescing(sock, 1);
+    }
+    return SUCCESS;
+  }
+  THROW_OR_CONTINUE(SocketRingInit(&sock->ring, sock->socket_fd));
+  if (sock->coalesced != NULL) {
+    // Buffers of the ring hold a single datagram.
+    SocketSetCoalescing(sock, 0);
+  }
+  return SUCCESS;
+}
+
+SocketBackend SocketGetBackend(Socket* sock) {
+  return sock->ring != NULL ? SOCKET_BACKEND_IO_URING : SOCKET_BACKEND_SYSCALL;
+}
+
+int SocketPollFd(Socket* sock) {
+  return sock->ring != NULL ? SocketRingFd(sock->ring) : sock->socket_fd;
+}
+
+uint64_t SocketSendErrors(Socket* sock) {
+  return sock->ring != NULL ? SocketRingSendErrors(sock->ring) : 0;
+}
+
+RETCODE
+SocketSetOffload(Socket* sock, int enable) {
+  if (!enable) {
+    sock->gso = 0;
+    if (sock->coalesced != NULL) {
+      if (sock->coalesced->gro) {
+        SocketSetCoalescing(sock, 0);
+      }
+      free(sock->coalesced);
+      sock->coalesced = NULL;
+    }
+    return SUCCESS;
+  }
+  int segment;
+  socklen_t len = sizeof(segment);
+  int gso = getsockopt(sock->socket_fd, SOL_UDP, UDP_SEGMENT, &segment,
+                       &len) == 0;
+  if (sock->coalesced == NULL) {
+    SocketCoalesced* coalesced = (SocketCoalesced*)malloc(
+        sizeof(SocketCoalesced) + kSocketCoalescedSize);
+    if (coalesced == NULL) {
+      return NOT_ENOUGH_MEMORY;
+    }
+    *coalesced = (SocketCoalesced){.ptr = (char*)(coalesced + 1)};
+    sock->coalesced = coalesced;
+  }
+  if (sock->ring == NULL) {
+    SocketSetCoalescing(sock, 1);
+  }
+  if (!gso && !sock->coalesced->gro && sock->ring == NULL) {
+    free(sock->coalesced);
+    sock->coalesced = NULL;
+    return SOCKET_OFFLOAD;
+  }
+  sock->gso = gso;
   return SUCCESS;
 }
@@ -0,0 +1,234 @@
+#include "server/interest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/macro.h"
+#include "common/retcode.h"
+
+/**
+ * @brief      Cells of an area clipped by the grid, the ends are exclusive.
+ */
+typedef struct {
+  int64_t left;
+  int64_t top;
+  int64_t right;
+  int64_t bottom;
+} InterestArea;
+
+static InterestArea InterestAreaOf(InterestGrid* grid, uint32_t x, uint32_t y,
+                                   uint16_t radius) {
+  InterestArea area = (InterestArea){.left = (int64_t)x - radius,
+                                     .top = (int64_t)y - radius,
+                                     .right = (int64_t)x + radius + 1,
+                                     .bottom = (int64_t)y + radius + 1};
+  if (area.left < 0) {
+    area.left = 0;
+  }
+  if (area.top < 0) {
+    area.top = 0;
+  }
+  if (area.right > grid->width) {
+    area.right = grid->width;
+  }
+  if (area.bottom > grid->height) {
+    area.bottom = grid->height;
+  }
+  return area;
+}
+
+static int InterestAreaContains(InterestArea* area, int64_t x, int64_t y) {
+  return x >= area->left && x < area->right && y >= area->top &&
+         y < area->bottom;
+}
+
+static InterestCell* InterestCellAt(InterestGrid* grid, int64_t x, int64_t y) {
+  return &grid->cells[y * grid->width + x];
+}
+
+static size_t InterestAreaSize(InterestArea* area) {
+  return (size_t)(area->right - area->left) *
+         (size_t)(area->bottom - area->top);
+}
+
+// The position of the entry in the list of the cell, which is in its area.
+static uint32_t* InterestPosition(uint32_t* positions, InterestArea* area,
+                                  int64_t cell_x, int64_t cell_y) {
+  int64_t column = cell_x - area->left;
+  int64_t row = cell_y - area->top;
+  return &positions[row * (area->right - area->left) + column];
+}
+
+static RETCODE InterestCellReserve(InterestCell* cell) {
+  if (cell->count < cell->capacity) {
+    return SUCCESS;
+  }
+  uint32_t capacity = cell->capacity == 0 ? 4 : 2 * cell->capacity;
+  uint16_t* ids = (uint16_t*)realloc(cell->ids, capacity * sizeof(uint16_t));
+  if (ids == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  cell->ids = ids;
+  cell->capacity = capacity;
+  return SUCCESS;
+}
+
+// Swaps the last client of the cell into the freed place.
+static void InterestCellRemove(InterestGrid* grid, int64_t x, int64_t y,
+                               uint32_t position) {
+  InterestCell* cell = InterestCellAt(grid, x, y);
+  uint16_t moved = cell->ids[--cell->count];
+  if (position == cell->count) {
+    return;
+  }
+  cell->ids[position] = moved;
+  InterestEntry* entry = &grid->entries[moved];
+  InterestArea area = InterestAreaOf(grid, entry->x, entry->y, entry->radius);
+  *InterestPosition(entry->positions, &area, x, y) = position;
+}
+
+static RETCODE InterestGridReserveEntries(InterestGrid* grid,
+                                          uint16_t client_id) {
+  if (client_id < grid->entries_capacity) {
+    return SUCCESS;
+  }
+  uint32_t capacity = grid->entries_capacity == 0 ? 16
+                                                  : 2 * grid->entries_capacity;
+  if (capacity <= client_id) {
+    capacity = (uint32_t)client_id + 1;
+  }
+  InterestEntry* entries = (InterestEntry*)realloc(
+      grid->entries, capacity * sizeof(InterestEntry));
+  if (entries == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  memset(entries + grid->entries_capacity, 0,
+         (capacity - grid->entries_capacity) * sizeof(InterestEntry));
+  grid->entries = entries;
+  grid->entries_capacity = capacity;
+  return SUCCESS;
+}
+
+RETCODE
+InterestGridInit(InterestGrid* grid, uint32_t width, uint32_t height) {
+  grid->cells = NULL;
+  grid->width = 0;
+  grid->height = 0;
+  grid->entries = NULL;
+  grid->entries_capacity = 0;
+  if (width == 0 || height == 0) {
+    return INTEREST_OUT_OF_GRID;
+  }
+  grid->cells = (InterestCell*)calloc((size_t)width * height,
+                                      sizeof(InterestCell));
+  if (grid->cells == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  grid->width = width;
+  grid->height = height;
+  return SUCCESS;
+}
+
+void InterestGridDestroy(InterestGrid* grid) {
+  for (size_t i = 0; i < (size_t)grid->width * grid->height; ++i) {
+    free(grid->cells[i].ids);
+  }
+  for (uint32_t i = 0; i < grid->entries_capacity; ++i) {
+    free(grid->entries[i].positions);
+  }
+  free(grid->cells);
+  free(grid->entries);
+  grid->cells = NULL;
+  grid->entries = NULL;
+  grid->width = 0;
+  grid->height = 0;
+  grid->entries_capacity = 0;
+}
+
+RETCODE
+InterestGridPlace(InterestGrid* grid, uint16_t client_id, uint32_t x,
+                  uint32_t y, uint16_t radius) {
+  if (x >= grid->width || y >= grid->height) {
+    return INTEREST_OUT_OF_GRID;
+  }
+  THROW_OR_CONTINUE(InterestGridReserveEntries(grid, client_id));
+  InterestEntry* entry = &grid->entries[client_id];
+  InterestArea area = InterestAreaOf(grid, x, y, radius);
+  InterestArea old = (InterestArea){0};
+  if (entry->placed) {
+    old = InterestAreaOf(grid, entry->x, entry->y, entry->radius);
+  }
+  // Only the cells within the grid get a position, however large the radius.
+  uint32_t* positions =
+      (uint32_t*)malloc(InterestAreaSize(&area) * sizeof(uint32_t));
+  if (positions == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  // Nothing is changed until every cell the client enters has room for it.
+  for (int64_t row = area.top; row < area.bottom; ++row) {
+    for (int64_t column = area.left; column < area.right; ++column) {
+      if (!InterestAreaContains(&old, column, row) &&
+          InterestCellReserve(InterestCellAt(grid, column, row)) != SUCCESS) {
+        free(positions);
+        return NOT_ENOUGH_MEMORY;
+      }
+    }
+  }
+  for (int64_t row = old.top; row < old.bottom; ++row) {
+    for (int64_t column = old.left; column < old.right; ++column) {
+      uint32_t position =
+          *InterestPosition(entry->positions, &old, column, row);
+      if (InterestAreaContains(&area, column, row)) {
+        *InterestPosition(positions, &area, column, row) = position;
+      } else {
+        InterestCellRemove(grid, column, row, position);
+      }
+    }
+  }
+  for (int64_t row = area.top; row < area.bottom; ++row) {
+    for (int64_t column = area.left; column < area.right; ++column) {
+      if (!InterestAreaContains(&old, column, row)) {
+        InterestCell* cell = InterestCellAt(grid, column, row);
+        *InterestPosition(positions, &area, column, row) = cell->count;
+        cell->ids[cell->count++] = client_id;
+      }
+    }
+  }
+  free(entry->positions);
+  *entry = (InterestEntry){.x = x,
+                           .y = y,
+                           .radius = radius,
+                           .placed = 1,
+                           .positions = positions};
+  return SUCCESS;
+}
+
+void InterestGridRemove(InterestGrid* grid, uint16_t client_id) {
+  if (client_id >= grid->entries_capacity ||
+      !grid->entries[client_id].placed) {
+    return;
+  }
+  InterestEntry* entry = &grid->entries[client_id];
+  InterestArea area = InterestAreaOf(grid, entry->x, entry->y, entry->radius);
+  for (int64_t row = area.top; row < area.bottom; ++row) {
+    for (int64_t column = area.left; column < area.right; ++column) {
+      InterestCellRemove(grid, column, row,
+                         *InterestPosition(entry->positions, &area, column,
+                                           row));
+    }
+  }
+  free(entry->positions);
+  *entry = (InterestEntry){0};
+}
+
+RETCODE
+InterestGridCell(InterestGrid* grid, uint32_t x, uint32_t y,
+                 const uint16_t** ids, size_t* count) {
+  if (x >= grid->width || y >= grid->height) {
+    return INTEREST_OUT_OF_GRID;
+  }
+  InterestCell* cell = InterestCellAt(grid, x, y);
+  *ids = cell->ids;
+  *count = cell->count;
+  return SUCCESS;
+}
@@ -9,43 +9,251 @@
 #include "server/server.h"
 
 static const int kBaseClients = 65535;
+const uint32_t kRegistratorChunkSize = 64;
+static const uint32_t kBaseRegistratorCapacity = 16;
+static const uint32_t kBaseIndexCapacity = 64;
+static const size_t kCacheLineSize = 64;
+
+#ifdef __IPV4__
+static uint64_t RegistratorAddressKey(Address* addr) {
+  return ((uint64_t)addr->ip << 16) | addr->port;
+}
+#else
+#error "Unsupported type of netcode"
+#endif
+
+static uint32_t RegistratorHash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return (uint32_t)key;
+}
+
+static RegistratorSlot* RegistratorFindSlot(Registrator* registrator,
+                                            uint64_t key) {
+  uint32_t mask = registrator->index_capacity - 1;
+  uint32_t pos = RegistratorHash(key) & mask;
+  while (registrator->index[pos].used && registrator->index[pos].key != key) {
+    pos = (pos + 1) & mask;
+  }
+  return &registrator->index[pos];
+}
+
+static RETCODE RegistratorGrowIndex(Registrator* registrator) {
+  uint32_t old_capacity = registrator->index_capacity;
+  RegistratorSlot* old_index = registrator->index;
+  RegistratorSlot* index =
+      (RegistratorSlot*)calloc(2 * old_capacity, sizeof(RegistratorSlot));
+  if (index == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  registrator->index = index;
+  registrator->index_capacity = 2 * old_capacity;
+  for (uint32_t pos = 0; pos < old_capacity; ++pos) {
+    if (old_index[pos].used) {
+      *RegistratorFindSlot(registrator, old_index[pos].key) = old_index[pos];
+    }
+  }
+  free(old_index);
+  return SUCCESS;
+}
+
+static void RegistratorEraseSlot(Registrator* registrator,
+                                 RegistratorSlot* slot) {
+  // Backward shift deletion keeps probe sequences intact without tombstones.
+  uint32_t mask = registrator->index_capacity - 1;
+  uint32_t hole = slot - registrator->index;
+  uint32_t pos = hole;
+  for (;;) {
+    pos = (pos + 1) & mask;
+    if (!registrator->index[pos].used) {
+      break;
+    }
+    uint32_t home = RegistratorHash(registrator->index[pos].key) & mask;
+    if (((pos - home) & mask) >= ((pos - hole) & mask)) {
+      registrator->index[hole] = registrator->index[pos];
+      hole = pos;
+    }
+  }
+  registrator->index[hole].used = 0;
+}
 
 RETCODE
 ConnectedClientInit(ConnectedClient* client) {
   THROW_OR_CONTINUE(AddressInit(&client->addr, NULL, 0));
+  ReliableEndpointInit(&client->reliable);
+  FragmentChannelInit(&client->fragments);
+  SnapshotChannelInit(&client->snapshots);
+  PacerInit(&client->pacer);
+  SchedulerInit(&client->scheduler);
+  PacketQueueInit(&client->queue);
+  client->flush_queued = 0;
+  TimerNodeInit(&client->timer);
+  client->last_receive = 0;
+  client->last_send = 0;
   return SUCCESS;
 }
 
 void ConnectedClientDestroy(ConnectedClient* client) {
   AddressDestroy(&client->addr);
+  ReliableEndpointDestroy(&client->reliable);
+  FragmentChannelDestroy(&client->fragments);
+  SnapshotChannelDestroy(&client->snapshots);
+  SchedulerDestroy(&client->scheduler);
+  PacketQueueDestroy(&client->queue);
+}
+
+void ConnectedClientReset(ConnectedClient* client) {
+  ReliableEndpointReset(&client->reliable);
+  FragmentChannelDestroy(&client->fragments);
+  FragmentChannelInit(&client->fragments);
+  SnapshotChannelReset(&client->snapshots);
+  PacerInit(&client->pacer);
+  SchedulerReset(&client->scheduler);
+  PacketQueueClear(&client->queue);
+  client->flush_queued = 0;
+  TimerNodeInit(&client->timer);
+  client->last_receive = 0;
+  client->last_send = 0;
+}
+
+static RETCODE RegistratorReserveClients(Registrator* registrator,
+                                         uint32_t count) {
+  if (count <= registrator->clients_capacity) {
+    return SUCCESS;
+  }
+  uint32_t capacity = 2 * registrator->clients_capacity;
+  ConnectedClient** clients = (ConnectedClient**)realloc(
+      registrator->clients, capacity * sizeof(ConnectedClient*));
+  if (clients == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  registrator->clients = clients;
+  registrator->clients_capacity = capacity;
+  return SUCCESS;
+}
+
+static RETCODE RegistratorReserveIds(Registrator* registrator,
+                                     uint32_t count) {
+  if (count <= registrator->sparse_capacity) {
+    return SUCCESS;
+  }
+  uint32_t capacity = 2 * registrator->sparse_capacity;
+  if (capacity > kBaseClients) {
+    capacity = kBaseClients;
+  }
+  uint32_t* sparse =
+      (uint32_t*)realloc(registrator->sparse, capacity * sizeof(uint32_t));
+  if (sparse == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  registrator->sparse = sparse;
+  uint16_t* free_ids =
+      (uint16_t*)realloc(registrator->free_ids, capacity * sizeof(uint16_t));
+  if (free_ids == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  registrator->free_ids = free_ids;
+  registrator->sparse_capacity = capacity;
+  return SUCCESS;
+}
+
+static uint32_t RegistratorMaxChunks() {
+  return (kBaseClients + kRegistratorChunkSize - 1) / kRegistratorChunkSize;
+}
+
+static ConnectedClient* RegistratorRecord(Registrator* registrator,
+                                          uint16_t client_id) {
+  char* chunk = registrator->chunks[client_id / kRegistratorChunkSize];
+  size_t slot = client_id % kRegistratorChunkSize;
+  return (ConnectedClient*)(chunk + slot * registrator->stride);
+}
+
+// Makes sure the record of the ID exists, IDs are given in order so it's
+// enough to check the last chunk.
+static RETCODE RegistratorReserveRecord(Registrator* registrator,
+                                        uint32_t client_id) {
+  if (client_id / kRegistratorChunkSize < registrator->chunk_count) {
+    return SUCCESS;
+  }
+  char* chunk = (char*)aligned_alloc(
+      kCacheLineSize, kRegistratorChunkSize * registrator->stride);
+  if (chunk == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  registrator->chunks[registrator->chunk_count++] = chunk;
+  return SUCCESS;
+}
+
+static int RegistratorHasID(Registrator* registrator, uint16_t client_id) {
+  return client_id < registrator->next_id &&
+         registrator->sparse[client_id] < registrator->size &&
+         registrator->clients[registrator->sparse[client_id]]->client_id ==
+             client_id;
 }
 
 RETCODE
 RegistratorInit(Registrator* registrator) {
-  registrator->clients =
-      (ConnectedClient**)malloc(kBaseClients * sizeof(ConnectedClient*));
-  if (registrator->clients == NULL) {
+  registrator->size = 0;
+  registrator->next_id = 0;
+  registrator->clients = (ConnectedClient**)malloc(kBaseRegistratorCapacity *
+                                                   sizeof(ConnectedClient*));
+  registrator->sparse =
+      (uint32_t*)malloc(kBaseRegistratorCapacity * sizeof(uint32_t));
+  registrator->free_ids =
+      (uint16_t*)malloc(kBaseRegistratorCapacity * sizeof(uint16_t));
+  registrator->index =
+      (RegistratorSlot*)calloc(kBaseIndexCapacity, sizeof(RegistratorSlot));
+  registrator->chunks = (char**)malloc(RegistratorMaxChunks() * sizeof(char*));
+  registrator->chunk_count = 0;
+  if (registrator->clients == NULL || registrator->sparse == NULL ||
+      registrator->free_ids == NULL || registrator->index == NULL ||
+      registrator->chunks == NULL) {
+    RegistratorDestroy(registrator);
     return NOT_ENOUGH_MEMORY;
   }
-  for (uint16_t id = 0; id < kBaseClients; ++id) {
-    registrator->clients[id] = NULL;
-  }
+  registrator->clients_capacity = kBaseRegistratorCapacity;
+  registrator->sparse_capacity = kBaseRegistratorCapacity;
+  registrator->index_capacity = kBaseIndexCapacity;
+  registrator->free_count = 0;
+  registrator->stride = (sizeof(ConnectedClient) + kCacheLineSize - 1) /
+                        kCacheLineSize * kCacheLineSize;
   return SUCCESS;
 }
 
 void RegistratorDestroy(Registrator* registrator) {
+  if (registrator->chunks != NULL) {
+    // Records of removed clients keep their buffers too.
+    for (uint32_t id = 0; id < registrator->next_id; ++id) {
+      ConnectedClientDestroy(RegistratorRecord(registrator, (uint16_t)id));
+    }
+    for (uint32_t i = 0; i < registrator->chunk_count; ++i) {
+      free(registrator->chunks[i]);
+    }
+  }
+  free(registrator->chunks);
   free(registrator->clients);
+  free(registrator->sparse);
+  free(registrator->free_ids);
+  free(registrator->index);
+  registrator->clients = NULL;
+  registrator->sparse = NULL;
+  registrator->free_ids = NULL;
+  registrator->index = NULL;
+  registrator->chunks = NULL;
+  registrator->chunk_count = 0;
+  registrator->size = 0;
+  registrator->next_id = 0;
+  registrator->free_count = 0;
 }
 
 RETCODE
 RegistratorIterInit(Registrator* registrator, RegistratorIter* iter) {
+  // Clients are dense, the iterator needs no state from the registrator.
+  (void)registrator;
   iter->index = 0;
-  while (iter->index < kBaseClients) {
-    if (registrator->clients[iter->index] != NULL) {
-      break;
-    }
-    ++iter->index;
-  }
   return SUCCESS;
 }
 
@@ -55,21 +263,20 @@ void RegistratorIterDestroy(RegistratorIter* iter) {
 RETCODE
 RegistratorGetUserByAddress(Registrator* registrator, Address* addr,
                             ConnectedClient** client) {
-  for (uint16_t id = 0; id < kBaseClients; ++id) {
-    if (registrator->clients[id] != NULL &&
-        memcmp(&registrator->clients[id]->addr, addr, sizeof(Address)) == 0) {
-      *client = registrator->clients[id];
-      return SUCCESS;
-    }
+  RegistratorSlot* slot =
+      RegistratorFindSlot(registrator, RegistratorAddressKey(addr));
+  if (!slot->used) {
+    return SERVER_USER_NOT_FOUND;
   }
-  return SERVER_USER_NOT_FOUND;
+  *client = registrator->clients[registrator->sparse[slot->client_id]];
+  return SUCCESS;
 }
 
 RETCODE
 RegistratorGetUserByID(Registrator* registrator, uint16_t client_id,
                        ConnectedClient** client) {
-  if (registrator->clients[client_id] != NULL) {
-    *client = registrator->clients[client_id];
+  if (RegistratorHasID(registrator, client_id)) {
+    *client = registrator->clients[registrator->sparse[client_id]];
     return SUCCESS;
   }
   return SERVER_USER_NOT_FOUND;
@@ -78,40 +285,73 @@ RegistratorGetUserByID(Registrator* registrator, uint16_t client_id,
 RETCODE
 RegistratorAddUser(Registrator* registrator, Address* addr,
                    ConnectedClient** client) {
-  for (uint16_t id = 0; id < kBaseClients; ++id) {
-    if (registrator->clients[id] == NULL) {
-      registrator->clients[id] =
-          (ConnectedClient*)malloc(sizeof(ConnectedClient));
-      THROW_OR_CONTINUE(ConnectedClientInit(registrator->clients[id]));
-      memcpy(&registrator->clients[id]->addr, addr, sizeof(Address));
-      registrator->clients[id]->client_id = id;
-      *client = registrator->clients[id];
-      return SUCCESS;
-    }
+  uint64_t key = RegistratorAddressKey(addr);
+  RegistratorSlot* slot = RegistratorFindSlot(registrator, key);
+  if (slot->used) {
+    *client = registrator->clients[registrator->sparse[slot->client_id]];
+    return SUCCESS;
+  }
+  if (registrator->free_count == 0 && registrator->next_id == kBaseClients) {
+    return SERVER_CROWDED;
   }
-  return SERVER_CROWDED;
+  THROW_OR_CONTINUE(
+      RegistratorReserveClients(registrator, registrator->size + 1));
+  if (registrator->free_count == 0) {
+    THROW_OR_CONTINUE(
+        RegistratorReserveIds(registrator, registrator->next_id + 1));
+  }
+  if (2 * (registrator->size + 1) > registrator->index_capacity) {
+    THROW_OR_CONTINUE(RegistratorGrowIndex(registrator));
+    slot = RegistratorFindSlot(registrator, key);
+  }
+  uint16_t id = registrator->free_count != 0
+                    ? registrator->free_ids[registrator->free_count - 1]
+                    : registrator->next_id;
+  THROW_OR_CONTINUE(RegistratorReserveRecord(registrator, id));
+  ConnectedClient* added = RegistratorRecord(registrator, id);
+  if (registrator->free_count != 0) {
+    ConnectedClientReset(added);
+    --registrator->free_count;
+  } else {
+    THROW_OR_CONTINUE(ConnectedClientInit(added));
+    ++registrator->next_id;
+  }
+  memcpy(&added->addr, addr, sizeof(Address));
+  added->client_id = id;
+  registrator->sparse[id] = registrator->size;
+  registrator->clients[registrator->size++] = added;
+  *slot = (RegistratorSlot){.key = key, .client_id = id, .used = 1};
+  *client = added;
+  return SUCCESS;
 }
 
 void RegistratorRemoveUserByAddress(Registrator* registrator, Address* addr) {
-  for (uint16_t id = 0; id < kBaseClients; ++id) {
-    if (memcmp(&registrator->clients[id]->addr, addr, sizeof(Address)) == 0) {
-      ConnectedClientDestroy(registrator->clients[id]);
-      free(registrator->clients[id]);
-      break;
-    }
+  RegistratorSlot* slot =
+      RegistratorFindSlot(registrator, RegistratorAddressKey(addr));
+  if (!slot->used) {
+    return;
+  }
+  uint16_t id = slot->client_id;
+  RegistratorEraseSlot(registrator, slot);
+  uint32_t position = registrator->sparse[id];
+  // The record stays in its chunk for the next client with this ID, and
+  // keeps the buffers of its channels. Only a large message is let go.
+  FragmentChannelDestroy(&registrator->clients[position]->fragments);
+  ConnectedClient* last = registrator->clients[--registrator->size];
+  if (position != registrator->size) {
+    registrator->clients[position] = last;
+    registrator->sparse[last->client_id] = position;
   }
+  registrator->free_ids[registrator->free_count++] = id;
 }
 
 void RegistratorIterNext(Registrator* registrator, RegistratorIter* iter) {
-  while (iter->index < kBaseClients) {
-    if (registrator->clients[++iter->index] != NULL) {
-      return;
-    }
-  }
+  (void)registrator;
+  ++iter->index;
 }
 
 int RegistratorIterStopped(Registrator* registrator, RegistratorIter* iter) {
-  return iter->index == kBaseClients;
+  return iter->index >= registrator->size;
 }
 
 ConnectedClient* RegistratorIterDereference(Registrator* registrator,
@@ -1,96 +1,1021 @@
 #include "server/server.h"
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "common/clock.h"
 #include "common/macro.h"
 #include "common/retcode.h"
+#include "common/stats.h"
+#include "common/timer_wheel.h"
+#include "networking/fragment.h"
+#include "networking/reliable.h"
+#include "networking/scheduler.h"
+#include "networking/snapshot.h"
 #include "server/registrator.h"
 
-RETCODE
-ServerInit(Server* srv, Address* addr) {
+const uint64_t kServerIdleTimeout = 10000;
+const uint64_t kServerKeepAlive = 1000;
+static const size_t kServerBurstSize = kSocketMaxSegments;
+
+static RETCODE ServerInitWith(Server* srv, Address* addr, int shared) {
+  srv->recipients = NULL;
+  srv->recipient_ids = NULL;
+  srv->recipient_failures = NULL;
+  srv->recipients_capacity = 0;
+  srv->pool.slab = NULL;
+  srv->pool.free_buffers = NULL;
+  srv->burst.slab = NULL;
+  srv->burst.free_buffers = NULL;
+  srv->listener = (ServerListener){0};
+  srv->compression = NULL;
+  srv->bandwidth_cap = 0;
+  srv->idle_timeout = kServerIdleTimeout;
+  srv->keepalive = kServerKeepAlive;
+  TimerWheelInit(&srv->timers, ClockNow());
+  StatsInit(&srv->stats);
+  srv->ready_ids = NULL;
+  srv->ready_count = 0;
+  srv->ready_capacity = 0;
+  srv->scratch.data.ptr = NULL;
+  srv->interest = (InterestGrid){0};
+  srv->schedule_budget = 0;
+  srv->coalescing = 0;
+  srv->flush_ids = NULL;
+  srv->flush_count = 0;
+  srv->flush_capacity = 0;
+  srv->unpacking.slab = NULL;
+  srv->unpacking.free_buffers = NULL;
+  srv->held_head = 0;
+  srv->held_count = 0;
   THROW_OR_CONTINUE(RegistratorInit(&srv->registrator));
-  RETCODE result = SocketInit(&srv->socket);
+  RETCODE result = PreparedPacketInit(&srv->packet);
+  if (result != SUCCESS) {
+    RegistratorDestroy(&srv->registrator);
+    return result;
+  }
+  result = ResponseInit(&srv->scratch);
+  if (result != SUCCESS) {
+    PreparedPacketDestroy(&srv->packet);
+    RegistratorDestroy(&srv->registrator);
+    return result;
+  }
+  result = BufferPoolInit(&srv->pool, kBasePoolSize);
+  if (result == SUCCESS) {
+    result = BufferPoolInit(&srv->burst, kServerBurstSize);
+  }
+  if (result == SUCCESS) {
+    result = BufferPoolInit(&srv->unpacking, kServerBatchSize);
+  }
   if (result != SUCCESS) {
+    BufferPoolDestroy(&srv->unpacking);
+    BufferPoolDestroy(&srv->burst);
+    BufferPoolDestroy(&srv->pool);
+    ResponseDestroy(&srv->scratch);
+    PreparedPacketDestroy(&srv->packet);
     RegistratorDestroy(&srv->registrator);
     return result;
   }
-  result = SocketBind(&srv->socket, addr);
+  result = SocketInit(&srv->socket);
+  if (result != SUCCESS) {
+    BufferPoolDestroy(&srv->unpacking);
+    BufferPoolDestroy(&srv->burst);
+    BufferPoolDestroy(&srv->pool);
+    ResponseDestroy(&srv->scratch);
+    PreparedPacketDestroy(&srv->packet);
+    RegistratorDestroy(&srv->registrator);
+    return result;
+  }
+  if (shared) {
+    result = SocketSetReusePort(&srv->socket);
+  }
+  if (result == SUCCESS) {
+    result = SocketBind(&srv->socket, addr);
+  }
   if (result != SUCCESS) {
     SocketDestroy(&srv->socket);
+    BufferPoolDestroy(&srv->unpacking);
+    BufferPoolDestroy(&srv->burst);
+    BufferPoolDestroy(&srv->pool);
+    ResponseDestroy(&srv->scratch);
+    PreparedPacketDestroy(&srv->packet);
     RegistratorDestroy(&srv->registrator);
     return result;
   }
   return SUCCESS;
 }
 
+RETCODE
+ServerInit(Server* srv, Address* addr) {
+  THROW_OR_CONTINUE(ServerInitWith(srv, addr, 0));
+  return SUCCESS;
+}
+
+RETCODE
+ServerInitShared(Server* srv, Address* addr) {
+  THROW_OR_CONTINUE(ServerInitWith(srv, addr, 1));
+  return SUCCESS;
+}
+
 void ServerDestroy(Server* srv) {
   // Send disconnect packet?
   RegistratorDestroy(&srv->registrator);
   SocketDestroy(&srv->socket);
+  PreparedPacketDestroy(&srv->packet);
+  ResponseDestroy(&srv->scratch);
+  BufferPoolDestroy(&srv->pool);
+  BufferPoolDestroy(&srv->burst);
+  BufferPoolDestroy(&srv->unpacking);
+  free(srv->recipients);
+  free(srv->recipient_ids);
+  free(srv->recipient_failures);
+  free(srv->ready_ids);
+  free(srv->flush_ids);
+  InterestGridDestroy(&srv->interest);
 }
 
-static RETCODE ServerRAWReceive(Server* srv, Response* response,
-                                Address* addr) {
-  RAII(DataDestroy) Data data;
-  THROW_OR_CONTINUE(DataInit(&data));
-  THROW_OR_CONTINUE(SocketReceive(&srv->socket, &data, addr));
-  THROW_OR_CONTINUE(DataToResponse(&data, response));
+// Keeps the unread packets of the datagram until they're asked for.
+static void ServerHold(Server* srv, DatagramIter* iter, Address* addr) {
+  Data held;
+  if (BufferPoolAcquire(&srv->unpacking, &held) != SUCCESS) {
+    // There are as many buffers as datagrams in a batch, it never happens.
+    StatsAdd(&srv->stats.counters.malformed, 1);
+    return;
+  }
+  memcpy(held.ptr, iter->rest.ptr, iter->rest.len);
+  held.len = iter->rest.len;
+  size_t index = (srv->held_head + srv->held_count) % kServerBatchSize;
+  srv->held[index] = held;
+  AddressCopy(&srv->held_addrs[index], addr);
+  if (srv->held_count++ == 0) {
+    DatagramIterInit(&srv->held_iter, &srv->held[index]);
+  }
+}
+
+// Reads the next packet of the held datagrams, returns zero when every one of
+// them is read.
+static int ServerNextHeld(Server* srv, Response* response, Address* addr,
+                          RETCODE* result) {
+  while (srv->held_count != 0) {
+    if (!DatagramIterStopped(&srv->held_iter)) {
+      AddressCopy(addr, &srv->held_addrs[srv->held_head]);
+      *result =
+          DatagramIterNext(&srv->held_iter, response, srv->compression);
+      if (*result != SUCCESS) {
+        StatsAdd(&srv->stats.counters.malformed, 1);
+      }
+      return 1;
+    }
+    BufferPoolRelease(&srv->unpacking, &srv->held[srv->held_head]);
+    srv->held_head = (srv->held_head + 1) % kServerBatchSize;
+    if (--srv->held_count != 0) {
+      DatagramIterInit(&srv->held_iter, &srv->held[srv->held_head]);
+    }
+  }
+  return 0;
+}
+
+// With view the response keeps the buffer of the datagram instead of its own
+// one from the pool, unless the payload had to be decoded into it.
+static RETCODE ServerRAWReceive(Server* srv, Response* response, Address* addr,
+                                int view) {
+  RETCODE result;
+  if (ServerNextHeld(srv, response, addr, &result)) {
+    THROW_OR_CONTINUE(result);
+    return SUCCESS;
+  }
+  Data data;
+  THROW_OR_CONTINUE(BufferPoolAcquire(&srv->pool, &data));
+  char* own = response->data.ptr;
+  result = SocketReceive(&srv->socket, &data, addr);
+  if (result == SUCCESS) {
+    StatsAdd(&srv->stats.counters.packets_in, 1);
+    StatsAdd(&srv->stats.counters.bytes_in, data.len);
+    DatagramIter iter;
+    DatagramIterInit(&iter, &data);
+    if (view) {
+      result = DatagramIterNextView(&iter, response, srv->compression);
+    } else {
+      result = DatagramIterNext(&iter, response, srv->compression);
+    }
+    if (result != SUCCESS) {
+      StatsAdd(&srv->stats.counters.malformed, 1);
+    } else if (!DatagramIterStopped(&iter)) {
+      ServerHold(srv, &iter, addr);
+    }
+  } else if (result == SOCKET_TIMEOUT) {
+    StatsAdd(&srv->stats.counters.receive_timeouts, 1);
+  }
+  if (response->data.ptr != own) {
+    data.ptr = own;
+  }
+  BufferPoolRelease(&srv->pool, &data);
+  THROW_OR_CONTINUE(result);
   return SUCCESS;
 }
 
-RETCODE
-ServerReceive(Server* srv, Response* response) {
-  RAII(AddressDestroy) Address addr;
-  THROW_OR_CONTINUE(AddressInit(&addr, NULL, 0));
-  THROW_OR_CONTINUE(ServerRAWReceive(srv, response, &addr));
+// Acks and disconnects are tiny and holding them back only causes resends.
+static int ServerBypassesPacing(Response* response) {
   switch (ResponseGetType(response)) {
-    case CONNECT: {
-      ConnectedClient* client;
-      if (RegistratorGetUserByAddress(&srv->registrator, &addr, &client) !=
-          SUCCESS) {
-        THROW_OR_CONTINUE(
-            RegistratorAddUser(&srv->registrator, &addr, &client));
+    case DISCONNECT:
+    case ACK:
+    case FRAGMENT_ACK:
+    case SNAPSHOT_ACK: {
+      return 1;
+    }
+    default: {
+      return 0;
+    }
+  }
+}
+
+// Writes the response for the client to data and charges its budget.
+static RETCODE ServerPrepareForClient(Server* srv, ConnectedClient* client,
+                                      Response* response, Data* data,
+                                      uint64_t now) {
+  if (!ServerBypassesPacing(response) && !PacerReady(&client->pacer, now)) {
+    return SEND_THROTTLED;
+  }
+  ReliableEndpointWriteAcks(&client->reliable, response);
+  data->len = kDataLength;
+  THROW_OR_CONTINUE(
+      ResponseToDataCompressed(response, data, srv->compression));
+  PacerCharge(&client->pacer, data->len, now);
+  return SUCCESS;
+}
+
+// Sends the packets coalesced for the client.
+static RETCODE ServerFlushClient(Server* srv, ConnectedClient* client,
+                                 uint64_t now) {
+  if (PacketQueueEmpty(&client->queue)) {
+    return SUCCESS;
+  }
+  RETCODE result =
+      SocketSend(&srv->socket, &client->queue.data, &client->addr);
+  if (result == SUCCESS) {
+    StatsAdd(&srv->stats.counters.packets_out, 1);
+    StatsAdd(&srv->stats.counters.bytes_out, client->queue.data.len);
+    client->last_send = now;
+  } else {
+    StatsAdd(&srv->stats.counters.send_errors, 1);
+  }
+  PacketQueueClear(&client->queue);
+  THROW_OR_CONTINUE(result);
+  return SUCCESS;
+}
+
+// Appends the response to the next datagram to the client, a full one is
+// sent first.
+static RETCODE ServerQueueForClient(Server* srv, ConnectedClient* client,
+                                    Response* response, uint64_t now) {
+  if (!ServerBypassesPacing(response) && !PacerReady(&client->pacer, now)) {
+    return SEND_THROTTLED;
+  }
+  ReliableEndpointWriteAcks(&client->reliable, response);
+  size_t queued = client->queue.data.len;
+  RETCODE result =
+      PacketQueuePush(&client->queue, response, srv->compression);
+  if (result == PACKET_TOO_LARGE && !PacketQueueEmpty(&client->queue)) {
+    ServerFlushClient(srv, client, now);
+    queued = 0;
+    result = PacketQueuePush(&client->queue, response, srv->compression);
+  }
+  THROW_OR_CONTINUE(result);
+  PacerCharge(&client->pacer, client->queue.data.len - queued, now);
+  if (client->flush_queued) {
+    return SUCCESS;
+  }
+  if (srv->flush_count == srv->flush_capacity) {
+    size_t capacity = srv->flush_capacity == 0 ? 16 : 2 * srv->flush_capacity;
+    uint16_t* flush_ids =
+        (uint16_t*)realloc(srv->flush_ids, capacity * sizeof(uint16_t));
+    if (flush_ids == NULL) {
+      // ServerFlush() wouldn't find the client, so it isn't held back.
+      THROW_OR_CONTINUE(ServerFlushClient(srv, client, now));
+      return SUCCESS;
+    }
+    srv->flush_ids = flush_ids;
+    srv->flush_capacity = capacity;
+  }
+  srv->flush_ids[srv->flush_count++] = client->client_id;
+  client->flush_queued = 1;
+  return SUCCESS;
+}
+
+static RETCODE ServerSendToClient(Server* srv, ConnectedClient* client,
+                                  Response* response) {
+  uint64_t now = ClockNow();
+  if (srv->coalescing) {
+    if (ResponseGetType(response) != DISCONNECT) {
+      THROW_OR_CONTINUE(ServerQueueForClient(srv, client, response, now));
+      return SUCCESS;
+    }
+    // The client is about to be dropped with its queue.
+    ServerFlushClient(srv, client, now);
+  }
+  THROW_OR_CONTINUE(
+      ServerPrepareForClient(srv, client, response, &srv->packet.data, now));
+  RETCODE result = SocketSend(&srv->socket, &srv->packet.data, &client->addr);
+  if (result != SUCCESS) {
+    StatsAdd(&srv->stats.counters.send_errors, 1);
+    return result;
+  }
+  StatsAdd(&srv->stats.counters.packets_out, 1);
+  StatsAdd(&srv->stats.counters.bytes_out, srv->packet.data.len);
+  client->last_send = now;
+  return SUCCESS;
+}
+
+// Wakes the client up for the earliest of its keepalive and idle timeout.
+static void ServerScheduleClient(Server* srv, ConnectedClient* client,
+                                 uint64_t now) {
+  uint64_t deadline = UINT64_MAX;
+  if (srv->idle_timeout != 0) {
+    deadline = client->last_receive + srv->idle_timeout;
+  }
+  if (srv->keepalive != 0 && client->last_send + srv->keepalive < deadline) {
+    deadline = client->last_send + srv->keepalive;
+  }
+  if (deadline == UINT64_MAX) {
+    TimerWheelCancel(&srv->timers, &client->timer);
+    return;
+  }
+  // A failed keepalive mustn't make the client due again right away.
+  TimerWheelSchedule(&srv->timers, &client->timer,
+                     deadline > now ? deadline : now + 1);
+}
+
+static void ServerRemoveClient(Server* srv, ConnectedClient* client) {
+  TimerWheelCancel(&srv->timers, &client->timer);
+  StatsAdd(&srv->stats.counters.disconnects, 1);
+  InterestGridRemove(&srv->interest, client->client_id);
+  if (srv->listener.on_disconnect != NULL) {
+    srv->listener.on_disconnect(srv->listener.user_data, client->client_id);
+  }
+  RegistratorRemoveUserByAddress(&srv->registrator, &client->addr);
+}
+
+static RETCODE ServerExpireClients(Server* srv, uint64_t now) {
+  static char kEmpty[1];
+  RETCODE result = SUCCESS;
+  TimerNode* node;
+  while (TimerWheelNextExpired(&srv->timers, now, &node)) {
+    ConnectedClient* client =
+        (ConnectedClient*)((char*)node - offsetof(ConnectedClient, timer));
+    Response response = {.data = {.ptr = kEmpty, .len = 0}};
+    if (srv->idle_timeout != 0 &&
+        client->last_receive + srv->idle_timeout <= now) {
+      // The way back may still work, so the client learns it's dropped.
+      ResponseSetType(&response, DISCONNECT);
+      ServerSendToClient(srv, client, &response);
+      ServerRemoveClient(srv, client);
+      continue;
+    }
+    if (srv->keepalive != 0 && client->last_send + srv->keepalive <= now) {
+      ResponseSetType(&response, ACK);
+      RETCODE sent = ServerSendToClient(srv, client, &response);
+      if (sent != SUCCESS) {
+        result = sent;
       }
+    }
+    ServerScheduleClient(srv, client, now);
+  }
+  return result;
+}
+
+static RETCODE ServerPumpFragments(Server* srv, ConnectedClient* client,
+                                   uint64_t now) {
+  RETCODE result = SUCCESS;
+  if (FragmentChannelNextAck(&client->fragments, &srv->scratch)) {
+    result = ServerSendToClient(srv, client, &srv->scratch);
+  }
+  uint64_t timeout = ReliableEndpointTimeout(&client->reliable);
+  Data burst[kServerBurstSize];
+  size_t count;
+  do {
+    // Fragments are of the same size but the last one, with segmentation
+    // offload the whole burst is a single send.
+    count = 0;
+    while (count < kServerBurstSize && PacerReady(&client->pacer, now) &&
+           BufferPoolAcquire(&srv->burst, &burst[count]) == SUCCESS) {
+      if (!FragmentChannelNextFragment(&client->fragments, now, timeout,
+                                       &srv->scratch) ||
+          ServerPrepareForClient(srv, client, &srv->scratch, &burst[count],
+                                 now) != SUCCESS) {
+        BufferPoolRelease(&srv->burst, &burst[count]);
+        break;
+      }
+      ++count;
+    }
+    RETCODE sent = SUCCESS;
+    if (count != 0) {
+      sent = SocketSendSegments(&srv->socket, burst, count, &client->addr);
+    }
+    if (sent != SUCCESS) {
+      StatsAdd(&srv->stats.counters.send_errors, 1);
+      result = sent;
+    } else if (count != 0) {
+      StatsAdd(&srv->stats.counters.packets_out, count);
+      client->last_send = now;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      if (sent == SUCCESS) {
+        StatsAdd(&srv->stats.counters.bytes_out, burst[i].len);
+      }
+      BufferPoolRelease(&srv->burst, &burst[i]);
+    }
+  } while (count == kServerBurstSize);
+  return result;
+}
+
+static void ServerQueueReady(Server* srv, ConnectedClient* client) {
+  if (client->reliable.queued || !ReliableEndpointReady(&client->reliable)) {
+    return;
+  }
+  if (srv->ready_count == srv->ready_capacity) {
+    size_t capacity = srv->ready_capacity == 0 ? 16 : 2 * srv->ready_capacity;
+    uint16_t* ready_ids =
+        (uint16_t*)realloc(srv->ready_ids, capacity * sizeof(uint16_t));
+    if (ready_ids == NULL) {
+      // Messages stay in the window until the next one from this client.
+      return;
+    }
+    srv->ready_ids = ready_ids;
+    srv->ready_capacity = capacity;
+  }
+  srv->ready_ids[srv->ready_count++] = client->client_id;
+  client->reliable.queued = 1;
+}
+
+static int ServerPopReady(Server* srv, Response* response) {
+  while (srv->ready_count != 0) {
+    uint16_t id = srv->ready_ids[srv->ready_count - 1];
+    ConnectedClient* client;
+    if (RegistratorGetUserByID(&srv->registrator, id, &client) != SUCCESS) {
+      --srv->ready_count;
+      continue;
+    }
+    int popped = ReliableEndpointPop(&client->reliable, response);
+    if (!ReliableEndpointReady(&client->reliable)) {
+      client->reliable.queued = 0;
+      --srv->ready_count;
+    }
+    if (popped) {
+      ResponseSetClientId(response, id);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static RETCODE ServerHandleResponse(Server* srv, Response* response,
+                                    Address* addr, uint64_t now) {
+  ConnectedClient* client;
+  if (ResponseGetType(response) == DISCONNECT) {
+    if (RegistratorGetUserByAddress(&srv->registrator, addr, &client) ==
+        SUCCESS) {
       ResponseSetClientId(response, client->client_id);
+      ServerRemoveClient(srv, client);
+    }
+    return SUCCESS;
+  }
+  // Any other packet connects the client.
+  if (RegistratorGetUserByAddress(&srv->registrator, addr, &client) !=
+      SUCCESS) {
+    THROW_OR_CONTINUE(RegistratorAddUser(&srv->registrator, addr, &client));
+    PacerSetCap(&client->pacer, srv->bandwidth_cap);
+    // Large messages are accepted once the application allows them.
+    FragmentChannelSetLimit(&client->fragments, 0);
+    client->last_send = now;
+    client->last_receive = now;
+    ServerScheduleClient(srv, client, now);
+    StatsAdd(&srv->stats.counters.connects, 1);
+    if (srv->listener.on_connect != NULL) {
+      srv->listener.on_connect(srv->listener.user_data, client->client_id);
+    }
+  }
+  ResponseSetClientId(response, client->client_id);
+  // The timer finds out about it when it expires, so the wheel isn't touched.
+  client->last_receive = now;
+  THROW_OR_CONTINUE(ReliableEndpointReceive(&client->reliable, response, now));
+  PacerObserve(&client->pacer, &client->reliable, now);
+  switch (ResponseGetType(response)) {
+    case RELIABLE: {
+      if (!ReliableEndpointPop(&client->reliable, response)) {
+        return RELIABLE_PENDING;
+      }
+      ServerQueueReady(srv, client);
       break;
     }
-    case DISCONNECT: {
-      ConnectedClient* client;
-      if (RegistratorGetUserByAddress(&srv->registrator, &addr, &client) ==
-          SUCCESS) {
-        RegistratorRemoveUserByAddress(&srv->registrator, &client->addr);
+    case ACK: {
+      return RELIABLE_PENDING;
+    }
+    case SNAPSHOT_ACK: {
+      return SnapshotChannelReceive(&client->snapshots, response);
+    }
+    case FRAGMENT:
+    case FRAGMENT_ACK: {
+      RETCODE result = FragmentChannelReceive(&client->fragments, response);
+      // Acks are sent in batches, and each of them opens the window further.
+      if (ResponseGetType(response) == FRAGMENT_ACK ||
+          FragmentChannelAckDue(&client->fragments)) {
+        ServerPumpFragments(srv, client, now);
       }
+      return result;
+    }
+    default: {
       break;
     }
   }
   return SUCCESS;
 }
 
+static RETCODE ServerReceiveWith(Server* srv, Response* response, int view) {
+  if (ServerPopReady(srv, response)) {
+    return SUCCESS;
+  }
+  RAII(AddressDestroy) Address addr;
+  THROW_OR_CONTINUE(AddressInit(&addr, NULL, 0));
+  THROW_OR_CONTINUE(ServerRAWReceive(srv, response, &addr, view));
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
+  THROW_OR_CONTINUE(ServerHandleResponse(srv, response, &addr, ClockNow()));
+  return SUCCESS;
+}
+
+RETCODE
+ServerReceive(Server* srv, Response* response) {
+  THROW_OR_CONTINUE(ServerReceiveWith(srv, response, 0));
+  return SUCCESS;
+}
+
+RETCODE
+ServerReceiveView(Server* srv, Response* response) {
+  // Packets which can't be viewed in place are copied into this buffer. The
+  // payload of the first packet of a datagram starts within the largest
+  // header, so the view has room for kMaxPayload bytes either way.
+  THROW_OR_CONTINUE(BufferPoolAcquire(&srv->pool, &response->data));
+  RETCODE result = ServerReceiveWith(srv, response, 1);
+  if (result != SUCCESS) {
+    ServerReleaseView(srv, response);
+  }
+  THROW_OR_CONTINUE(result);
+  return SUCCESS;
+}
+
+void ServerReleaseView(Server* srv, Response* response) {
+  BufferPoolReleaseAt(&srv->pool, response->data.ptr);
+  response->data.ptr = NULL;
+  response->data.len = 0;
+}
+
+RETCODE
+ServerReceiveBatch(Server* srv, Response* out, size_t max, size_t* got) {
+  Data buffers[kServerBatchSize];
+  Address addrs[kServerBatchSize];
+  if (max > kServerBatchSize) {
+    max = kServerBatchSize;
+  }
+  *got = 0;
+  while (*got < max && ServerPopReady(srv, &out[*got])) {
+    ++*got;
+  }
+  if (*got != 0) {
+    return SUCCESS;
+  }
+  if (srv->held_count != 0) {
+    // Held packets are all taken before the socket is read again.
+    RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
+    uint64_t now = ClockNow();
+    RETCODE handled;
+    while (*got < max &&
+           ServerNextHeld(srv, &out[*got], &addrs[0], &handled)) {
+      if (handled == SUCCESS &&
+          ServerHandleResponse(srv, &out[*got], &addrs[0], now) == SUCCESS) {
+        ++*got;
+      }
+    }
+    if (*got != 0) {
+      return SUCCESS;
+    }
+  }
+  size_t acquired = 0;
+  while (acquired < max &&
+         BufferPoolAcquire(&srv->pool, &buffers[acquired]) == SUCCESS) {
+    ++acquired;
+  }
+  if (acquired == 0) {
+    return POOL_EXHAUSTED;
+  }
+  size_t received = 0;
+  RETCODE result =
+      SocketReceiveBatch(&srv->socket, buffers, addrs, acquired, &received);
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
+  if (result == SOCKET_TIMEOUT) {
+    StatsAdd(&srv->stats.counters.receive_timeouts, 1);
+  }
+  uint64_t now = ClockNow();
+  for (size_t i = 0; i < received; ++i) {
+    StatsAdd(&srv->stats.counters.packets_in, 1);
+    StatsAdd(&srv->stats.counters.bytes_in, buffers[i].len);
+    DatagramIter iter;
+    DatagramIterInit(&iter, &buffers[i]);
+    while (!DatagramIterStopped(&iter)) {
+      if (*got == max) {
+        // Coalesced packets which don't fit wait for the next call.
+        ServerHold(srv, &iter, &addrs[i]);
+        break;
+      }
+      RETCODE handled =
+          DatagramIterNext(&iter, &out[*got], srv->compression);
+      if (handled != SUCCESS) {
+        StatsAdd(&srv->stats.counters.malformed, 1);
+      } else {
+        handled = ServerHandleResponse(srv, &out[*got], &addrs[i], now);
+      }
+      if (handled == SUCCESS) {
+        ++*got;
+      } else if (*got == 0) {
+        result = handled;
+      }
+    }
+  }
+  if (*got != 0) {
+    result = SUCCESS;
+  }
+  while (acquired != 0) {
+    BufferPoolRelease(&srv->pool, &buffers[--acquired]);
+  }
+  return result;
+}
+
 RETCODE
 ServerSendTo(Server* srv, Response* response) {
-  RAII(DataDestroy) Data data;
-  THROW_OR_CONTINUE(DataInit(&data));
-  THROW_OR_CONTINUE(ResponseToData(response, &data));
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
   ConnectedClient* client;
   THROW_OR_CONTINUE(
       RegistratorGetUserByID(&srv->registrator, response->client_id, &client));
-  THROW_OR_CONTINUE(SocketSend(&srv->socket, &data, &client->addr))
+  if (ResponseGetType(response) != DISCONNECT) {
+    // Echoed channel messages mustn't reuse the state of the client.
+    ResponseSetType(response, CONNECT);
+  }
+  THROW_OR_CONTINUE(ServerSendToClient(srv, client, response));
   return SUCCESS;
 }
 
 RETCODE
-ServerSend(Server* srv, Response* response) {
+ServerSendReliable(Server* srv, Response* response) {
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
+  ConnectedClient* client;
+  THROW_OR_CONTINUE(
+      RegistratorGetUserByID(&srv->registrator, response->client_id, &client));
+  THROW_OR_CONTINUE(
+      ReliableEndpointSend(&client->reliable, response, ClockNow()));
+  if (ServerSendToClient(srv, client, response) == SEND_THROTTLED) {
+    // ServerUpdate() sends it as soon as the budget allows.
+    ReliableEndpointDefer(&client->reliable, response->sequence);
+  }
+  return SUCCESS;
+}
+
+RETCODE
+ServerSendSnapshot(Server* srv, Response* response) {
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
+  ConnectedClient* client;
+  THROW_OR_CONTINUE(
+      RegistratorGetUserByID(&srv->registrator, response->client_id, &client));
+  if (response->data.len > kMaxPayload) {
+    return PACKET_TOO_LARGE;
+  }
+  memcpy(srv->scratch.data.ptr, response->data.ptr, response->data.len);
+  srv->scratch.data.len = response->data.len;
+  srv->scratch.flags = 0;
+  THROW_OR_CONTINUE(SnapshotChannelEncode(&client->snapshots, &srv->scratch));
+  THROW_OR_CONTINUE(ServerSendToClient(srv, client, &srv->scratch));
+  return SUCCESS;
+}
+
+// Sends the updates of the client with the largest accumulators.
+static RETCODE ServerPumpScheduled(Server* srv, ConnectedClient* client,
+                                   uint64_t now) {
+  if (SchedulerPending(&client->scheduler) == 0) {
+    return SUCCESS;
+  }
+  THROW_OR_CONTINUE(SchedulerTick(&client->scheduler));
+  size_t budget = srv->schedule_budget == 0 ? SIZE_MAX : srv->schedule_budget;
+  RETCODE result = SUCCESS;
+  while (PacerReady(&client->pacer, now) &&
+         SchedulerNext(&client->scheduler, budget, &srv->scratch)) {
+    budget -= srv->scratch.data.len;
+    srv->scratch.flags = 0;
+    ResponseSetType(&srv->scratch, CONNECT);
+    RETCODE sent = ServerSendToClient(srv, client, &srv->scratch);
+    if (sent != SUCCESS) {
+      result = sent;
+    }
+  }
+  return result;
+}
+
+RETCODE
+ServerUpdate(Server* srv) {
+  static char kEmpty[1];
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
+  uint64_t now = ClockNow();
+  RETCODE result = ServerExpireClients(srv, now);
+  Response response;
   RAII(RegistratorIterDestroy) RegistratorIter iter;
   THROW_OR_CONTINUE(RegistratorIterInit(&srv->registrator, &iter));
   while (!RegistratorIterStopped(&srv->registrator, &iter)) {
-    response->client_id =
-        RegistratorIterDereference(&srv->registrator, &iter)->client_id;
-    THROW_OR_CONTINUE(ServerSendTo(srv, response));
+    ConnectedClient* client =
+        RegistratorIterDereference(&srv->registrator, &iter);
+    PacerObserve(&client->pacer, &client->reliable, now);
+    while (PacerReady(&client->pacer, now) &&
+           ReliableEndpointNextResend(&client->reliable, now, &response)) {
+      RETCODE sent = ServerSendToClient(srv, client, &response);
+      if (sent != SUCCESS) {
+        result = sent;
+      }
+    }
+    RETCODE sent = ServerPumpFragments(srv, client, now);
+    if (sent != SUCCESS) {
+      result = sent;
+    }
+    sent = ServerPumpScheduled(srv, client, now);
+    if (sent != SUCCESS) {
+      result = sent;
+    }
+    if (client->reliable.acks_pending) {
+      response = (Response){.type = ACK, .data = {.ptr = kEmpty, .len = 0}};
+      sent = ServerSendToClient(srv, client, &response);
+      if (sent != SUCCESS) {
+        result = sent;
+      }
+    }
+    sent = ServerFlushClient(srv, client, now);
+    if (sent != SUCCESS) {
+      result = sent;
+    }
     RegistratorIterNext(&srv->registrator, &iter);
   }
+  return result;
+}
+
+RETCODE
+ServerSendLarge(Server* srv, uint16_t client_id, const char* data,
+                size_t len) {
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
+  ConnectedClient* client;
+  THROW_OR_CONTINUE(
+      RegistratorGetUserByID(&srv->registrator, client_id, &client));
+  THROW_OR_CONTINUE(FragmentChannelSend(&client->fragments, data, len));
+  ServerPumpFragments(srv, client, ClockNow());
   return SUCCESS;
 }
 
+RETCODE
+ServerFlush(Server* srv) {
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
+  uint64_t now = ClockNow();
+  RETCODE result = SUCCESS;
+  for (size_t i = 0; i < srv->flush_count; ++i) {
+    ConnectedClient* client;
+    if (RegistratorGetUserByID(&srv->registrator, srv->flush_ids[i],
+                               &client) != SUCCESS) {
+      continue;
+    }
+    client->flush_queued = 0;
+    RETCODE sent = ServerFlushClient(srv, client, now);
+    if (sent != SUCCESS) {
+      result = sent;
+    }
+  }
+  srv->flush_count = 0;
+  return result;
+}
+
+RETCODE
+ServerSetCoalescing(Server* srv, int enable) {
+  RETCODE result = SUCCESS;
+  if (!enable) {
+    result = ServerFlush(srv);
+  }
+  srv->coalescing = enable;
+  return result;
+}
+
+RETCODE
+ServerEnqueue(Server* srv, uint16_t client_id, uint32_t key,
+              uint32_t priority, Response* response) {
+  ConnectedClient* client;
+  THROW_OR_CONTINUE(
+      RegistratorGetUserByID(&srv->registrator, client_id, &client));
+  THROW_OR_CONTINUE(SchedulerPut(&client->scheduler, key, priority,
+                                 response->data.ptr, response->data.len));
+  return SUCCESS;
+}
+
+void ServerSetScheduleBudget(Server* srv, size_t bytes) {
+  srv->schedule_budget = bytes;
+}
+
+RETCODE
+ServerTakeLarge(Server* srv, uint16_t client_id, Data* out) {
+  ConnectedClient* client;
+  THROW_OR_CONTINUE(
+      RegistratorGetUserByID(&srv->registrator, client_id, &client));
+  THROW_OR_CONTINUE(FragmentChannelTake(&client->fragments, out));
+  return SUCCESS;
+}
+
+RETCODE
+ServerSetLargeLimit(Server* srv, uint16_t client_id, size_t limit) {
+  ConnectedClient* client;
+  THROW_OR_CONTINUE(
+      RegistratorGetUserByID(&srv->registrator, client_id, &client));
+  FragmentChannelSetLimit(&client->fragments, limit);
+  return SUCCESS;
+}
+
+static RETCODE ServerReserveRecipients(Server* srv, size_t count) {
+  if (count <= srv->recipients_capacity) {
+    return SUCCESS;
+  }
+  Address* recipients =
+      (Address*)realloc(srv->recipients, count * sizeof(Address));
+  if (recipients == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  srv->recipients = recipients;
+  uint16_t* recipient_ids =
+      (uint16_t*)realloc(srv->recipient_ids, count * sizeof(uint16_t));
+  if (recipient_ids == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  srv->recipient_ids = recipient_ids;
+  size_t* recipient_failures =
+      (size_t*)realloc(srv->recipient_failures, count * sizeof(size_t));
+  if (recipient_failures == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  srv->recipient_failures = recipient_failures;
+  srv->recipients_capacity = count;
+  return SUCCESS;
+}
+
+static RETCODE ServerSendToRecipients(Server* srv, PreparedPacket* packet,
+                                      size_t count, uint16_t* failed_ids,
+                                      size_t* failed_count) {
+  size_t failures = 0;
+  RETCODE result =
+      SocketSendBatch(&srv->socket, &packet->data, srv->recipients, count,
+                      srv->recipient_failures, &failures);
+  StatsAdd(&srv->stats.counters.packets_out, count - failures);
+  StatsAdd(&srv->stats.counters.bytes_out,
+           (count - failures) * packet->data.len);
+  StatsAdd(&srv->stats.counters.send_errors, failures);
+  if (failed_ids != NULL) {
+    for (size_t i = 0; i < failures; ++i) {
+      failed_ids[*failed_count + i] =
+          srv->recipient_ids[srv->recipient_failures[i]];
+    }
+  }
+  *failed_count += failures;
+  return result;
+}
+
+RETCODE
+ServerBroadcastPrepared(Server* srv, PreparedPacket* packet,
+                        uint16_t* failed_ids, size_t* failed_count) {
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
+  size_t failures = 0;
+  if (failed_count == NULL) {
+    failed_count = &failures;
+  }
+  *failed_count = 0;
+  THROW_OR_CONTINUE(ServerReserveRecipients(srv, srv->registrator.size));
+  RAII(RegistratorIterDestroy) RegistratorIter iter;
+  THROW_OR_CONTINUE(RegistratorIterInit(&srv->registrator, &iter));
+  uint64_t now = ClockNow();
+  size_t count = 0;
+  while (!RegistratorIterStopped(&srv->registrator, &iter)) {
+    ConnectedClient* client =
+        RegistratorIterDereference(&srv->registrator, &iter);
+    if (PacerConsume(&client->pacer, packet->data.len, now)) {
+      client->last_send = now;
+      AddressCopy(&srv->recipients[count], &client->addr);
+      srv->recipient_ids[count++] = client->client_id;
+    } else {
+      if (failed_ids != NULL) {
+        failed_ids[*failed_count] = client->client_id;
+      }
+      ++*failed_count;
+    }
+    RegistratorIterNext(&srv->registrator, &iter);
+  }
+  int throttled = *failed_count != 0;
+  THROW_OR_CONTINUE(
+      ServerSendToRecipients(srv, packet, count, failed_ids, failed_count));
+  return throttled ? SEND_THROTTLED : SUCCESS;
+}
+
+RETCODE
+ServerSendPrepared(Server* srv, PreparedPacket* packet,
+                   const uint16_t* client_ids, size_t count,
+                   uint16_t* failed_ids, size_t* failed_count) {
+  RAII(StatsScopeEnd) StatsScope scope = StatsScopeBegin(&srv->stats);
+  size_t failures = 0;
+  if (failed_count == NULL) {
+    failed_count = &failures;
+  }
+  *failed_count = 0;
+  THROW_OR_CONTINUE(ServerReserveRecipients(srv, count));
+  uint64_t now = ClockNow();
+  size_t found = 0;
+  size_t unknown = 0;
+  for (size_t i = 0; i < count; ++i) {
+    ConnectedClient* client;
+    if (RegistratorGetUserByID(&srv->registrator, client_ids[i], &client) !=
+        SUCCESS) {
+      if (failed_ids != NULL) {
+        failed_ids[*failed_count] = client_ids[i];
+      }
+      ++*failed_count;
+      ++unknown;
+      continue;
+    }
+    if (!PacerConsume(&client->pacer, packet->data.len, now)) {
+      if (failed_ids != NULL) {
+        failed_ids[*failed_count] = client_ids[i];
+      }
+      ++*failed_count;
+      continue;
+    }
+    client->last_send = now;
+    AddressCopy(&srv->recipients[found], &client->addr);
+    srv->recipient_ids[found++] = client->client_id;
+  }
+  int throttled = *failed_count != unknown;
+  THROW_OR_CONTINUE(
+      ServerSendToRecipients(srv, packet, found, failed_ids, failed_count));
+  if (unknown != 0) {
+    return SERVER_USER_NOT_FOUND;
+  }
+  return throttled ? SEND_THROTTLED : SUCCESS;
+}
+
+RETCODE
+ServerSetInterestGrid(Server* srv, uint32_t width, uint32_t height) {
+  InterestGridDestroy(&srv->interest);
+  THROW_OR_CONTINUE(InterestGridInit(&srv->interest, width, height));
+  return SUCCESS;
+}
+
+RETCODE
+ServerSetInterest(Server* srv, uint16_t client_id, uint32_t x, uint32_t y,
+                  uint16_t radius) {
+  ConnectedClient* client;
+  THROW_OR_CONTINUE(
+      RegistratorGetUserByID(&srv->registrator, client_id, &client));
+  THROW_OR_CONTINUE(
+      InterestGridPlace(&srv->interest, client_id, x, y, radius));
+  return SUCCESS;
+}
+
+RETCODE
+ServerSendRelevant(Server* srv, Response* response, uint32_t x, uint32_t y,
+                   uint16_t* failed_ids, size_t* failed_count) {
+  const uint16_t* ids;
+  size_t count;
+  THROW_OR_CONTINUE(InterestGridCell(&srv->interest, x, y, &ids, &count));
+  THROW_OR_CONTINUE(
+      PreparedPacketSetCompressed(&srv->packet, response, srv->compression));
+  THROW_OR_CONTINUE(ServerSendPrepared(srv, &srv->packet, ids, count,
+                                       failed_ids, failed_count));
+  return SUCCESS;
+}
+
+RETCODE
+ServerBroadcast(Server* srv, Response* response, uint16_t* failed_ids,
+                size_t* failed_count) {
+  THROW_OR_CONTINUE(
+      PreparedPacketSetCompressed(&srv->packet, response, srv->compression));
+  THROW_OR_CONTINUE(
+      ServerBroadcastPrepared(srv, &srv->packet, failed_ids, failed_count));
+  return SUCCESS;
+}
+
+RETCODE
+ServerSend(Server* srv, Response* response) {
+  THROW_OR_CONTINUE(ServerBroadcast(srv, response, NULL, NULL));
+  return SUCCESS;
+}
+
+size_t ServerClientsCount(Server* srv) {
+  return srv->registrator.size;
+}
+
 RETCODE
 ServerSetTimeout(Server* srv, time_t milliseconds) {
   THROW_OR_CONTINUE(SocketSetTimeout(&srv->socket, milliseconds));
@@ -99,6 +1024,99 @@ ServerSetTimeout(Server* srv, time_t milliseconds) {
 
 RETCODE
 ServerMakeNonBlocking(Server* server) {
-  THROW_OR_CONTINUE(ServerMakeNonBlocking(&server->socket));
+  THROW_OR_CONTINUE(SocketMakeNonBlocking(&server->socket));
+  return SUCCESS;
+}
+
+RETCODE
+ServerSetBackend(Server* srv, SocketBackend backend) {
+  THROW_OR_CONTINUE(SocketSetBackend(&srv->socket, backend));
+  return SUCCESS;
+}
+
+RETCODE
+ServerSetOffload(Server* srv, int enable) {
+  THROW_OR_CONTINUE(SocketSetOffload(&srv->socket, enable));
+  return SUCCESS;
+}
+
+void ServerSetListener(Server* srv, ServerListener* listener) {
+  srv->listener = listener == NULL ? (ServerListener){0} : *listener;
+}
+
+void ServerSetCompression(Server* srv, const HuffmanTable* table) {
+  srv->compression = table;
+}
+
+static void ServerScheduleAll(Server* srv) {
+  uint64_t now = ClockNow();
+  RegistratorIter iter;
+  if (RegistratorIterInit(&srv->registrator, &iter) != SUCCESS) {
+    return;
+  }
+  while (!RegistratorIterStopped(&srv->registrator, &iter)) {
+    ServerScheduleClient(
+        srv, RegistratorIterDereference(&srv->registrator, &iter), now);
+    RegistratorIterNext(&srv->registrator, &iter);
+  }
+  RegistratorIterDestroy(&iter);
+}
+
+void ServerSetIdleTimeout(Server* srv, uint64_t milliseconds) {
+  srv->idle_timeout = milliseconds;
+  ServerScheduleAll(srv);
+}
+
+void ServerSetKeepAlive(Server* srv, uint64_t milliseconds) {
+  srv->keepalive = milliseconds;
+  ServerScheduleAll(srv);
+}
+
+RETCODE
+ServerSetPoolSize(Server* srv, size_t size) {
+  THROW_OR_CONTINUE(BufferPoolResize(&srv->pool, size));
+  return SUCCESS;
+}
+
+size_t ServerGetPoolHighWater(Server* srv) {
+  return BufferPoolHighWater(&srv->pool);
+}
+
+void ServerSetBandwidthCap(Server* srv, uint64_t bytes_per_second) {
+  srv->bandwidth_cap = bytes_per_second;
+  RegistratorIter iter;
+  if (RegistratorIterInit(&srv->registrator, &iter) != SUCCESS) {
+    return;
+  }
+  while (!RegistratorIterStopped(&srv->registrator, &iter)) {
+    ConnectedClient* client =
+        RegistratorIterDereference(&srv->registrator, &iter);
+    PacerSetCap(&client->pacer, bytes_per_second);
+    RegistratorIterNext(&srv->registrator, &iter);
+  }
+  RegistratorIterDestroy(&iter);
+}
+
+RETCODE
+ServerGetBandwidth(Server* srv, uint16_t client_id,
+                   uint64_t* bytes_per_second) {
+  ConnectedClient* client;
+  THROW_OR_CONTINUE(
+      RegistratorGetUserByID(&srv->registrator, client_id, &client));
+  *bytes_per_second = PacerBudget(&client->pacer);
+  return SUCCESS;
+}
+
+void ServerGetStats(Server* srv, StatsSnapshot* stats) {
+  StatsTake(&srv->stats, stats);
+}
+
+RETCODE
+ServerGetClientStats(Server* srv, uint16_t client_id, StatsLink* link) {
+  ConnectedClient* client;
+  THROW_OR_CONTINUE(
+      RegistratorGetUserByID(&srv->registrator, client_id, &client));
+  StatsLinkFill(link, &client->reliable);
+  link->bandwidth = PacerBudget(&client->pacer);
   return SUCCESS;
 }
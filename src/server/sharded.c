@@ -0,0 +1,373 @@
+#include "server/sharded.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "common/clock.h"
+#include "common/macro.h"
+#include "common/retcode.h"
+#include "common/stats.h"
+
+static const size_t kShardBatchSize = 64;
+static const size_t kShardMailboxSize = 256;
+static const int kShardUpdatePeriod = 10;
+
+static void ShardOnConnect(void* user_data, uint16_t client_id) {
+  ServerShard* shard = (ServerShard*)user_data;
+  ShardedServer* srv = shard->owner;
+  if (srv->callbacks.on_connect != NULL) {
+    srv->callbacks.on_connect(srv, ShardedClientId(shard->index, client_id),
+                              srv->user_data);
+  }
+}
+
+static void ShardOnDisconnect(void* user_data, uint16_t client_id) {
+  ServerShard* shard = (ServerShard*)user_data;
+  ShardedServer* srv = shard->owner;
+  if (srv->callbacks.on_disconnect != NULL) {
+    srv->callbacks.on_disconnect(srv, ShardedClientId(shard->index, client_id),
+                                 srv->user_data);
+  }
+}
+
+static RETCODE ShardInit(ServerShard* shard, ShardedServer* owner,
+                         uint16_t index, Address* addr) {
+  shard->owner = owner;
+  shard->index = index;
+  shard->started = 0;
+  shard->mailbox_count = 0;
+  shard->mailbox = (ShardMessage*)malloc(kShardMailboxSize *
+                                         sizeof(ShardMessage));
+  shard->outbox = (ShardMessage*)malloc(kShardMailboxSize *
+                                        sizeof(ShardMessage));
+  if (shard->mailbox == NULL || shard->outbox == NULL) {
+    free(shard->mailbox);
+    free(shard->outbox);
+    return NOT_ENOUGH_MEMORY;
+  }
+  RETCODE result = BufferPoolInit(&shard->mailbox_pool, kShardMailboxSize);
+  if (result == SUCCESS) {
+    result = ServerInitShared(&shard->server, addr);
+    if (result == SUCCESS) {
+      result = ServerMakeNonBlocking(&shard->server);
+      if (result == SUCCESS) {
+        shard->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (shard->wake_fd >= 0) {
+          pthread_mutex_init(&shard->lock, NULL);
+          ServerListener listener =
+              (ServerListener){.on_connect = ShardOnConnect,
+                               .on_disconnect = ShardOnDisconnect,
+                               .user_data = shard};
+          ServerSetListener(&shard->server, &listener);
+          return SUCCESS;
+        }
+        result = SOCKET_INIT;
+      }
+      ServerDestroy(&shard->server);
+    }
+    BufferPoolDestroy(&shard->mailbox_pool);
+  }
+  free(shard->mailbox);
+  free(shard->outbox);
+  return result;
+}
+
+static void ShardDestroy(ServerShard* shard) {
+  ServerDestroy(&shard->server);
+  BufferPoolDestroy(&shard->mailbox_pool);
+  free(shard->mailbox);
+  free(shard->outbox);
+  close(shard->wake_fd);
+  pthread_mutex_destroy(&shard->lock);
+}
+
+static void ShardWake(ServerShard* shard) {
+  uint64_t one = 1;
+  if (write(shard->wake_fd, &one, sizeof(one)) < 0) {
+    // The counter is already non-zero, the worker will wake up anyway.
+  }
+}
+
+static void ShardFlushMailbox(ServerShard* shard) {
+  pthread_mutex_lock(&shard->lock);
+  ShardMessage* messages = shard->mailbox;
+  size_t count = shard->mailbox_count;
+  shard->mailbox = shard->outbox;
+  shard->mailbox_count = 0;
+  shard->outbox = messages;
+  pthread_mutex_unlock(&shard->lock);
+  if (count == 0) {
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    PreparedPacket packet = (PreparedPacket){.data = messages[i].data};
+    if (messages[i].broadcast) {
+      ServerBroadcastPrepared(&shard->server, &packet, NULL, NULL);
+    } else {
+      ServerSendPrepared(&shard->server, &packet, &messages[i].client_id, 1,
+                         NULL, NULL);
+    }
+  }
+  pthread_mutex_lock(&shard->lock);
+  for (size_t i = 0; i < count; ++i) {
+    BufferPoolRelease(&shard->mailbox_pool, &messages[i].data);
+  }
+  pthread_mutex_unlock(&shard->lock);
+}
+
+static void ShardReceive(ServerShard* shard, Response* responses) {
+  ShardedServer* srv = shard->owner;
+  size_t got;
+  RETCODE result;
+  while ((result = ServerReceiveBatch(&shard->server, responses,
+                                      kShardBatchSize, &got)) == SUCCESS ||
+         result == RELIABLE_PENDING) {
+    for (size_t i = 0; i < got; ++i) {
+      if (srv->callbacks.on_packet != NULL &&
+          ResponseGetType(&responses[i]) != DISCONNECT) {
+        srv->callbacks.on_packet(
+            srv, ShardedClientId(shard->index, responses[i].client_id),
+            &responses[i], srv->user_data);
+      }
+    }
+  }
+}
+
+static void* ShardWorker(void* arg) {
+  ServerShard* shard = (ServerShard*)arg;
+  Response responses[kShardBatchSize];
+  size_t initialized = 0;
+  while (initialized < kShardBatchSize &&
+         ResponseInit(&responses[initialized]) == SUCCESS) {
+    ++initialized;
+  }
+  struct pollfd fds[2] = {
+      {.fd = SocketPollFd(&shard->server.socket), .events = POLLIN},
+      {.fd = shard->wake_fd, .events = POLLIN}};
+  uint64_t last_update = ClockNow();
+  while (initialized == kShardBatchSize &&
+         __atomic_load_n(&shard->owner->running, __ATOMIC_ACQUIRE)) {
+    if (poll(fds, 2, kShardUpdatePeriod) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[1].revents & POLLIN) {
+      uint64_t counter;
+      if (read(shard->wake_fd, &counter, sizeof(counter)) < 0) {
+        // Spurious wake up, nothing to consume.
+      }
+    }
+    ShardFlushMailbox(shard);
+    if (fds[0].revents & POLLIN) {
+      ShardReceive(shard, responses);
+    }
+    uint64_t now = ClockNow();
+    if (now - last_update >= (uint64_t)kShardUpdatePeriod) {
+      ServerUpdate(&shard->server);
+      last_update = now;
+    }
+    ServerFlush(&shard->server);
+  }
+  while (initialized != 0) {
+    ResponseDestroy(&responses[--initialized]);
+  }
+  return NULL;
+}
+
+uint32_t ShardedClientId(uint16_t shard, uint16_t client_id) {
+  return ((uint32_t)shard << 16) | client_id;
+}
+
+RETCODE
+ShardedServerInit(ShardedServer* srv, Address* addr, size_t count,
+                  ShardedCallbacks* callbacks, void* user_data) {
+  srv->count = 0;
+  srv->running = 0;
+  srv->callbacks = *callbacks;
+  srv->user_data = user_data;
+  srv->shards = NULL;
+  if (count == 0) {
+    return SERVER_SHARD_START;
+  }
+  srv->shards = (ServerShard*)calloc(count, sizeof(ServerShard));
+  if (srv->shards == NULL) {
+    return NOT_ENOUGH_MEMORY;
+  }
+  while (srv->count < count) {
+    RETCODE result =
+        ShardInit(&srv->shards[srv->count], srv, srv->count, addr);
+    if (result != SUCCESS) {
+      ShardedServerDestroy(srv);
+      return result;
+    }
+    ++srv->count;
+  }
+  RETCODE result =
+      SocketSetReusePortHash(&srv->shards[0].server.socket, (uint32_t)count);
+  if (result != SUCCESS) {
+    ShardedServerDestroy(srv);
+    return result;
+  }
+  return SUCCESS;
+}
+
+void ShardedServerDestroy(ShardedServer* srv) {
+  ShardedServerStop(srv);
+  for (size_t i = 0; i < srv->count; ++i) {
+    ShardDestroy(&srv->shards[i]);
+  }
+  free(srv->shards);
+  srv->shards = NULL;
+  srv->count = 0;
+}
+
+RETCODE
+ShardedServerStart(ShardedServer* srv) {
+  __atomic_store_n(&srv->running, 1, __ATOMIC_RELEASE);
+  for (size_t i = 0; i < srv->count; ++i) {
+    if (pthread_create(&srv->shards[i].thread, NULL, ShardWorker,
+                       &srv->shards[i]) != 0) {
+      ShardedServerStop(srv);
+      return SERVER_SHARD_START;
+    }
+    srv->shards[i].started = 1;
+  }
+  return SUCCESS;
+}
+
+void ShardedServerStop(ShardedServer* srv) {
+  __atomic_store_n(&srv->running, 0, __ATOMIC_RELEASE);
+  for (size_t i = 0; i < srv->count; ++i) {
+    if (srv->shards[i].started) {
+      ShardWake(&srv->shards[i]);
+      pthread_join(srv->shards[i].thread, NULL);
+      srv->shards[i].started = 0;
+    }
+  }
+}
+
+static RETCODE ShardPost(ServerShard* shard, uint16_t client_id,
+                         uint8_t broadcast, Response* response) {
+  Data data;
+  pthread_mutex_lock(&shard->lock);
+  RETCODE result = BufferPoolAcquire(&shard->mailbox_pool, &data);
+  pthread_mutex_unlock(&shard->lock);
+  THROW_OR_CONTINUE(result);
+  // The buffer is ours until it's posted, so the encode doesn't hold the lock.
+  PreparedPacket packet = (PreparedPacket){.data = data};
+  result =
+      PreparedPacketSetCompressed(&packet, response, shard->server.compression);
+  pthread_mutex_lock(&shard->lock);
+  if (result == SUCCESS) {
+    // Every posted message holds a buffer, so the mailbox has room.
+    shard->mailbox[shard->mailbox_count++] = (ShardMessage){
+        .data = packet.data, .client_id = client_id, .broadcast = broadcast};
+  } else {
+    BufferPoolRelease(&shard->mailbox_pool, &data);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  THROW_OR_CONTINUE(result);
+  ShardWake(shard);
+  return SUCCESS;
+}
+
+RETCODE
+ShardedServerPost(ShardedServer* srv, uint32_t client, Response* response) {
+  uint16_t shard = client >> 16;
+  if (shard >= srv->count) {
+    return SERVER_USER_NOT_FOUND;
+  }
+  THROW_OR_CONTINUE(
+      ShardPost(&srv->shards[shard], client & 0xffff, 0, response));
+  return SUCCESS;
+}
+
+RETCODE
+ShardedServerPostAll(ShardedServer* srv, Response* response) {
+  for (size_t i = 0; i < srv->count; ++i) {
+    THROW_OR_CONTINUE(ShardPost(&srv->shards[i], 0, 1, response));
+  }
+  return SUCCESS;
+}
+
+void ShardedServerSetCompression(ShardedServer* srv,
+                                 const HuffmanTable* table) {
+  for (size_t i = 0; i < srv->count; ++i) {
+    ServerSetCompression(&srv->shards[i].server, table);
+  }
+}
+
+void ShardedServerSetBandwidthCap(ShardedServer* srv,
+                                  uint64_t bytes_per_second) {
+  for (size_t i = 0; i < srv->count; ++i) {
+    ServerSetBandwidthCap(&srv->shards[i].server, bytes_per_second);
+  }
+}
+
+void ShardedServerSetScheduleBudget(ShardedServer* srv, size_t bytes) {
+  for (size_t i = 0; i < srv->count; ++i) {
+    ServerSetScheduleBudget(&srv->shards[i].server, bytes);
+  }
+}
+
+void ShardedServerSetCoalescing(ShardedServer* srv, int enable) {
+  for (size_t i = 0; i < srv->count; ++i) {
+    ServerSetCoalescing(&srv->shards[i].server, enable);
+  }
+}
+
+void ShardedServerSetIdleTimeout(ShardedServer* srv, uint64_t milliseconds) {
+  for (size_t i = 0; i < srv->count; ++i) {
+    ServerSetIdleTimeout(&srv->shards[i].server, milliseconds);
+  }
+}
+
+void ShardedServerSetKeepAlive(ShardedServer* srv, uint64_t milliseconds) {
+  for (size_t i = 0; i < srv->count; ++i) {
+    ServerSetKeepAlive(&srv->shards[i].server, milliseconds);
+  }
+}
+
+void ShardedServerGetStats(ShardedServer* srv, StatsSnapshot* stats) {
+  memset(stats, 0, sizeof(StatsSnapshot));
+  StatsSnapshot shard;
+  for (size_t i = 0; i < srv->count; ++i) {
+    ServerGetStats(&srv->shards[i].server, &shard);
+    StatsMerge(stats, &shard);
+  }
+}
+
+RETCODE
+ShardedServerSetBackend(ShardedServer* srv, SocketBackend backend) {
+  for (size_t i = 0; i < srv->count; ++i) {
+    SocketBackend previous = SocketGetBackend(&srv->shards[i].server.socket);
+    RETCODE result = ServerSetBackend(&srv->shards[i].server, backend);
+    if (result != SUCCESS) {
+      while (i != 0) {
+        ServerSetBackend(&srv->shards[--i].server, previous);
+      }
+      return result;
+    }
+  }
+  return SUCCESS;
+}
+
+RETCODE
+ShardedServerSetOffload(ShardedServer* srv, int enable) {
+  for (size_t i = 0; i < srv->count; ++i) {
+    RETCODE result = ServerSetOffload(&srv->shards[i].server, enable);
+    if (result != SUCCESS) {
+      while (i != 0) {
+        ServerSetOffload(&srv->shards[--i].server, 0);
+      }
+      return result;
+    }
+  }
+  return SUCCESS;
+}
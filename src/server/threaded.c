@@ -0,0 +1,358 @@
+#include "server/threaded.h"
+
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "common/clock.h"
+#include "common/macro.h"
+#include "common/retcode.h"
+#include "common/stats.h"
+
+static const size_t kThreadedQueueSize = 1024;
+static const int kThreadedUpdatePeriod = 10;
+static const int kThreadedReceiveRounds = 16;
+// Client IDs end below it, so it marks responses of unknown senders.
+static const uint16_t kThreadedNoClient = UINT16_MAX;
+
+/**
+ * @brief      What the network thread does with a response of the outbox.
+ */
+typedef enum {
+  THREADED_SEND,
+  THREADED_RELIABLE,
+  THREADED_SNAPSHOT,
+  THREADED_BROADCAST,
+} ThreadedKind;
+
+/**
+ * @brief      A slot of the queues. The payload follows it in the slot and the
+ *             data of the response points there.
+ */
+typedef struct {
+  /// The response.
+  Response response;
+  /// ThreadedKind of a response to send.
+  uint8_t kind;
+} ThreadedSlot;
+
+static char* ThreadedSlotPayload(ThreadedSlot* slot) {
+  return (char*)(slot + 1);
+}
+
+static void ThreadedOnDisconnect(void* user_data, uint16_t client_id) {
+  ThreadedServer* srv = (ThreadedServer*)user_data;
+  // Clients which disconnect themselves are reported by their DISCONNECT.
+  if (!srv->evicting) {
+    return;
+  }
+  if (srv->departed_count == srv->departed_capacity) {
+    size_t capacity =
+        srv->departed_capacity == 0 ? 16 : 2 * srv->departed_capacity;
+    uint16_t* departed =
+        (uint16_t*)realloc(srv->departed, capacity * sizeof(uint16_t));
+    if (departed == NULL) {
+      return;
+    }
+    srv->departed = departed;
+    srv->departed_capacity = capacity;
+  }
+  srv->departed[srv->departed_count++] = client_id;
+}
+
+static void ThreadedWake(ThreadedServer* srv) {
+  uint64_t one = 1;
+  if (write(srv->wake_fd, &one, sizeof(one)) < 0) {
+    // The counter is already non-zero, the thread will wake up anyway.
+  }
+}
+
+static void ThreadedDrainOutbox(ThreadedServer* srv) {
+  size_t count = SpscQueueReadable(&srv->outbox);
+  for (size_t i = 0; i < count; ++i) {
+    ThreadedSlot* slot = (ThreadedSlot*)SpscQueueSlotToRead(&srv->outbox, i);
+    Response* response = &slot->response;
+    response->data.ptr = ThreadedSlotPayload(slot);
+    switch ((ThreadedKind)slot->kind) {
+      case THREADED_SEND: {
+        ServerSendTo(&srv->server, response);
+        break;
+      }
+      case THREADED_RELIABLE: {
+        ServerSendReliable(&srv->server, response);
+        break;
+      }
+      case THREADED_SNAPSHOT: {
+        ServerSendSnapshot(&srv->server, response);
+        break;
+      }
+      case THREADED_BROADCAST: {
+        ServerSend(&srv->server, response);
+        break;
+      }
+    }
+  }
+  if (count != 0) {
+    SpscQueuePop(&srv->outbox, count);
+  }
+}
+
+// Returns non-zero when all the evicted clients are reported.
+static int ThreadedReportDeparted(ThreadedServer* srv) {
+  if (srv->departed_count == 0) {
+    return 1;
+  }
+  size_t count = SpscQueueWritable(&srv->inbox);
+  if (count > srv->departed_count) {
+    count = srv->departed_count;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    ThreadedSlot* slot = (ThreadedSlot*)SpscQueueSlotToWrite(&srv->inbox, i);
+    slot->response.data = (Data){.ptr = ThreadedSlotPayload(slot), .len = 0};
+    ResponseSetType(&slot->response, DISCONNECT);
+    ResponseSetClientId(&slot->response, srv->departed[i]);
+  }
+  if (count != 0) {
+    SpscQueuePush(&srv->inbox, count);
+    srv->departed_count -= count;
+    memmove(srv->departed, srv->departed + count,
+            srv->departed_count * sizeof(uint16_t));
+  }
+  return srv->departed_count == 0;
+}
+
+// Receives straight into the free slots of the inbox until the socket has
+// nothing more or the inbox is full. The rounds are limited, so the outbox and
+// ServerUpdate() get their turn under a flood.
+static void ThreadedReceive(ThreadedServer* srv) {
+  Response responses[kServerBatchSize];
+  size_t max;
+  for (int round = 0; round < kThreadedReceiveRounds &&
+                      (max = SpscQueueWritable(&srv->inbox)) != 0;
+       ++round) {
+    if (max > (size_t)kServerBatchSize) {
+      max = (size_t)kServerBatchSize;
+    }
+    for (size_t i = 0; i < max; ++i) {
+      ThreadedSlot* slot =
+          (ThreadedSlot*)SpscQueueSlotToWrite(&srv->inbox, i);
+      responses[i] = (Response){
+          .client_id = kThreadedNoClient,
+          .data = {.ptr = ThreadedSlotPayload(slot), .len = kDataLength}};
+    }
+    size_t got;
+    RETCODE result = ServerReceiveBatch(&srv->server, responses, max, &got);
+    if (result == RELIABLE_PENDING) {
+      continue;
+    }
+    if (result != SUCCESS) {
+      return;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < got; ++i) {
+      if (ResponseGetType(&responses[i]) == DISCONNECT &&
+          responses[i].client_id == kThreadedNoClient) {
+        continue;
+      }
+      ThreadedSlot* slot =
+          (ThreadedSlot*)SpscQueueSlotToWrite(&srv->inbox, kept++);
+      char* payload = ThreadedSlotPayload(slot);
+      if (responses[i].data.ptr != payload) {
+        memcpy(payload, responses[i].data.ptr, responses[i].data.len);
+        responses[i].data.ptr = payload;
+      }
+      slot->response = responses[i];
+    }
+    SpscQueuePush(&srv->inbox, kept);
+  }
+}
+
+// Sleeps until a packet arrives, the game thread queues a response or the
+// timeout passes. The game thread wakes it only while it's marked sleeping.
+static void ThreadedWait(ThreadedServer* srv, struct pollfd* fds,
+                         int timeout) {
+  __atomic_store_n(&srv->sleeping, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (SpscQueueReadable(&srv->outbox) == 0 &&
+      __atomic_load_n(&srv->running, __ATOMIC_ACQUIRE)) {
+    if (poll(fds, 2, timeout) > 0 && (fds[1].revents & POLLIN)) {
+      uint64_t counter;
+      if (read(srv->wake_fd, &counter, sizeof(counter)) < 0) {
+        // Spurious wake up, nothing to consume.
+      }
+    }
+  }
+  __atomic_store_n(&srv->sleeping, 0, __ATOMIC_RELAXED);
+}
+
+static void* ThreadedWorker(void* arg) {
+  ThreadedServer* srv = (ThreadedServer*)arg;
+  struct pollfd fds[2] = {
+      {.fd = SocketPollFd(&srv->server.socket), .events = POLLIN},
+      {.fd = srv->wake_fd, .events = POLLIN}};
+  uint64_t last_update = ClockNow();
+  while (__atomic_load_n(&srv->running, __ATOMIC_ACQUIRE)) {
+    ThreadedDrainOutbox(srv);
+    // Packets received after an eviction must come after its DISCONNECT.
+    if (ThreadedReportDeparted(srv)) {
+      ThreadedReceive(srv);
+    }
+    uint64_t now = ClockNow();
+    if (now - last_update >= (uint64_t)kThreadedUpdatePeriod) {
+      srv->evicting = 1;
+      ServerUpdate(&srv->server);
+      srv->evicting = 0;
+      last_update = now;
+    }
+    ServerFlush(&srv->server);
+    // A full inbox isn't polled, so it's looked at again after the timeout.
+    fds[0].events = SpscQueueWritable(&srv->inbox) != 0 ? POLLIN : 0;
+    uint64_t elapsed = ClockNow() - last_update;
+    ThreadedWait(srv, fds,
+                 elapsed >= (uint64_t)kThreadedUpdatePeriod
+                     ? 0
+                     : kThreadedUpdatePeriod - (int)elapsed);
+  }
+  return NULL;
+}
+
+RETCODE
+ThreadedServerInit(ThreadedServer* srv, Address* addr) {
+  srv->started = 0;
+  srv->running = 0;
+  srv->sleeping = 0;
+  srv->evicting = 0;
+  srv->departed = NULL;
+  srv->departed_count = 0;
+  srv->departed_capacity = 0;
+  srv->wake_fd = -1;
+  size_t slot_size = sizeof(ThreadedSlot) + kDataLength;
+  RETCODE result = SpscQueueInit(&srv->inbox, kThreadedQueueSize, slot_size);
+  if (result == SUCCESS) {
+    result = SpscQueueInit(&srv->outbox, kThreadedQueueSize, slot_size);
+    if (result == SUCCESS) {
+      result = ServerInit(&srv->server, addr);
+      if (result == SUCCESS) {
+        result = ServerMakeNonBlocking(&srv->server);
+        if (result == SUCCESS) {
+          srv->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+          if (srv->wake_fd >= 0) {
+            ServerListener listener =
+                (ServerListener){.on_disconnect = ThreadedOnDisconnect,
+                                 .user_data = srv};
+            ServerSetListener(&srv->server, &listener);
+            return SUCCESS;
+          }
+          result = SOCKET_INIT;
+        }
+      }
+      ServerDestroy(&srv->server);
+      SpscQueueDestroy(&srv->outbox);
+    }
+    SpscQueueDestroy(&srv->inbox);
+  }
+  srv->inbox.slots = NULL;
+  srv->outbox.slots = NULL;
+  return result;
+}
+
+void ThreadedServerDestroy(ThreadedServer* srv) {
+  ThreadedServerStop(srv);
+  if (srv->inbox.slots == NULL) {
+    return;
+  }
+  ServerDestroy(&srv->server);
+  SpscQueueDestroy(&srv->inbox);
+  SpscQueueDestroy(&srv->outbox);
+  close(srv->wake_fd);
+  free(srv->departed);
+  srv->departed = NULL;
+}
+
+RETCODE
+ThreadedServerStart(ThreadedServer* srv) {
+  __atomic_store_n(&srv->running, 1, __ATOMIC_RELEASE);
+  if (pthread_create(&srv->thread, NULL, ThreadedWorker, srv) != 0) {
+    __atomic_store_n(&srv->running, 0, __ATOMIC_RELEASE);
+    return SERVER_THREAD_START;
+  }
+  srv->started = 1;
+  return SUCCESS;
+}
+
+void ThreadedServerStop(ThreadedServer* srv) {
+  __atomic_store_n(&srv->running, 0, __ATOMIC_RELEASE);
+  if (srv->started) {
+    ThreadedWake(srv);
+    pthread_join(srv->thread, NULL);
+    srv->started = 0;
+  }
+}
+
+RETCODE
+ThreadedServerReceive(ThreadedServer* srv, Response* response) {
+  if (SpscQueueReadable(&srv->inbox) == 0) {
+    return SOCKET_TIMEOUT;
+  }
+  ThreadedSlot* slot = (ThreadedSlot*)SpscQueueSlotToRead(&srv->inbox, 0);
+  char* ptr = response->data.ptr;
+  *response = slot->response;
+  response->data.ptr = ptr;
+  memcpy(ptr, ThreadedSlotPayload(slot), response->data.len);
+  SpscQueuePop(&srv->inbox, 1);
+  return SUCCESS;
+}
+
+static RETCODE ThreadedPost(ThreadedServer* srv, Response* response,
+                            ThreadedKind kind) {
+  if (response->data.len > kMaxPayload) {
+    return PACKET_TOO_LARGE;
+  }
+  if (SpscQueueWritable(&srv->outbox) == 0) {
+    return POOL_EXHAUSTED;
+  }
+  ThreadedSlot* slot = (ThreadedSlot*)SpscQueueSlotToWrite(&srv->outbox, 0);
+  slot->response = *response;
+  slot->response.data.ptr = ThreadedSlotPayload(slot);
+  memcpy(slot->response.data.ptr, response->data.ptr, response->data.len);
+  slot->kind = (uint8_t)kind;
+  SpscQueuePush(&srv->outbox, 1);
+  // Pairs with the fence of ThreadedWait(): either the network thread sees
+  // the response before it sleeps, or it's seen sleeping here.
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&srv->sleeping, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(&srv->sleeping, 0, __ATOMIC_RELAXED)) {
+    ThreadedWake(srv);
+  }
+  return SUCCESS;
+}
+
+RETCODE
+ThreadedServerSend(ThreadedServer* srv, Response* response) {
+  THROW_OR_CONTINUE(ThreadedPost(srv, response, THREADED_SEND));
+  return SUCCESS;
+}
+
+RETCODE
+ThreadedServerSendReliable(ThreadedServer* srv, Response* response) {
+  THROW_OR_CONTINUE(ThreadedPost(srv, response, THREADED_RELIABLE));
+  return SUCCESS;
+}
+
+RETCODE
+ThreadedServerSendSnapshot(ThreadedServer* srv, Response* response) {
+  THROW_OR_CONTINUE(ThreadedPost(srv, response, THREADED_SNAPSHOT));
+  return SUCCESS;
+}
+
+RETCODE
+ThreadedServerBroadcast(ThreadedServer* srv, Response* response) {
+  THROW_OR_CONTINUE(ThreadedPost(srv, response, THREADED_BROADCAST));
+  return SUCCESS;
+}
+
+void ThreadedServerGetStats(ThreadedServer* srv, StatsSnapshot* stats) {
+  ServerGetStats(&srv->server, stats);
+}
@@ -0,0 +1,128 @@
+#include <assert.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kTestPacket[] = "hello world!";
+const int kPort = 36912;
+const int kTimeoutTime = 100;
+#define kBatchSize 8
+
+Address addr;
+Server srv;
+Client clt1;
+Client clt2;
+Client clt3;
+Response response;
+Response batch[kBatchSize];
+size_t got;
+PreparedPacket packet;
+const uint16_t kRecipients[] = {1, 7};
+uint16_t failed_ids[4];
+size_t failed_count;
+
+void SendFrom(Client* client) {
+  ResponseSetData(&response, kTestPacket);
+  Panic(ClientSend(client, &response));
+}
+
+int main() {
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt1, &addr));
+  Panic(ClientInit(&clt2, &addr));
+  Panic(ResponseInit(&response));
+  for (int i = 0; i < kBatchSize; ++i) {
+    Panic(ResponseInit(&batch[i]));
+  }
+
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  SendFrom(&clt1);
+  SendFrom(&clt2);
+  SendFrom(&clt1);
+  Panic(ServerReceiveBatch(&srv, batch, kBatchSize, &got));
+  assert(got == 3);
+  assert(batch[0].client_id == 0);
+  assert(batch[1].client_id == 1);
+  assert(batch[2].client_id == 0);
+  for (size_t i = 0; i < got; ++i) {
+    assert(batch[i].data.len == strlen(kTestPacket));
+    assert(strncmp(batch[i].data.ptr, kTestPacket, strlen(kTestPacket)) == 0);
+  }
+  assert(ServerReceiveBatch(&srv, batch, kBatchSize, &got) == SOCKET_TIMEOUT);
+
+  Panic(ServerMakeNonBlocking(&srv));
+  assert(ServerReceiveBatch(&srv, batch, kBatchSize, &got) == SOCKET_TIMEOUT);
+  SendFrom(&clt2);
+  Panic(ServerReceiveBatch(&srv, batch, kBatchSize, &got));
+  assert(got == 1);
+  assert(batch[0].client_id == 1);
+
+  Panic(ClientSetTimeout(&clt1, kTimeoutTime));
+  Panic(ClientSetTimeout(&clt2, kTimeoutTime));
+  assert(ServerClientsCount(&srv) == 2);
+  ResponseSetData(&response, kTestPacket);
+  Panic(ServerBroadcast(&srv, &response, failed_ids, &failed_count));
+  assert(failed_count == 0);
+  Panic(ClientReceive(&clt1, &batch[0]));
+  Panic(ClientReceive(&clt2, &batch[1]));
+  assert(strncmp(batch[0].data.ptr, kTestPacket, strlen(kTestPacket)) == 0);
+  assert(strncmp(batch[1].data.ptr, kTestPacket, strlen(kTestPacket)) == 0);
+
+  Panic(PreparedPacketInit(&packet));
+  ResponseSetData(&response, kTestPacket);
+  Panic(PreparedPacketSet(&packet, &response));
+  assert(ServerSendPrepared(&srv, &packet, kRecipients, 2, failed_ids,
+                            &failed_count) == SERVER_USER_NOT_FOUND);
+  assert(failed_count == 1);
+  assert(failed_ids[0] == 7);
+  Panic(ClientReceive(&clt2, &batch[0]));
+  assert(strncmp(batch[0].data.ptr, kTestPacket, strlen(kTestPacket)) == 0);
+  assert(ClientReceive(&clt1, &batch[0]) == SOCKET_TIMEOUT);
+  PreparedPacketDestroy(&packet);
+
+  // The kernel refuses the broadcast address without SO_BROADCAST, the
+  // clients after it still get the packet.
+  Address refused;
+  ConnectedClient* client;
+  Panic(AddressInit(&refused, "255.255.255.255", kPort));
+  Panic(RegistratorAddUser(&srv.registrator, &refused, &client));
+  assert(client->client_id == 2);
+  Panic(ClientInit(&clt3, &addr));
+  Panic(ClientSetTimeout(&clt3, kTimeoutTime));
+  SendFrom(&clt3);
+  Panic(ServerReceiveBatch(&srv, batch, kBatchSize, &got));
+  assert(got == 1);
+  assert(batch[0].client_id == 3);
+  ResponseSetData(&response, kTestPacket);
+  assert(ServerBroadcast(&srv, &response, failed_ids, &failed_count) ==
+         SOCKET_SEND);
+  assert(failed_count == 1);
+  assert(failed_ids[0] == 2);
+  Panic(ClientReceive(&clt1, &batch[0]));
+  Panic(ClientReceive(&clt2, &batch[1]));
+  Panic(ClientReceive(&clt3, &batch[2]));
+  for (size_t i = 0; i < 3; ++i) {
+    assert(strncmp(batch[i].data.ptr, kTestPacket, strlen(kTestPacket)) == 0);
+  }
+  AddressDestroy(&refused);
+
+  for (int i = 0; i < kBatchSize; ++i) {
+    ResponseDestroy(&batch[i]);
+  }
+  ServerDestroy(&srv);
+  ClientDestroy(&clt1);
+  ClientDestroy(&clt2);
+  ClientDestroy(&clt3);
+  AddressDestroy(&addr);
+  ResponseDestroy(&response);
+}
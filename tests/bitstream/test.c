@@ -0,0 +1,135 @@
+#include <assert.h>
+#include <string.h>
+
+#include "networking/bitstream.h"
+#include "networking/packet.h"
+#include "panic.h"
+
+char buffer[64];
+BitWriter writer;
+BitReader reader;
+
+void TestRoundTrip() {
+  BitWriterInit(&writer, buffer, sizeof(buffer));
+  Panic(BitWriterWriteBool(&writer, 5));
+  Panic(BitWriterWriteInt(&writer, -3, -10, 10));
+  Panic(BitWriterWriteInt(&writer, 0x7fffffff, -0x7fffffff - 1, 0x7fffffff));
+  Panic(BitWriterWriteVarint(&writer, 300));
+  Panic(BitWriterWriteVarint(&writer, UINT64_MAX));
+  Panic(BitWriterWriteFloat(&writer, 12.34f, -100, 100, 0.01f));
+  Panic(BitWriterWriteFloat(&writer, 100, -100, 100, 0.01f));
+  Panic(BitWriterWriteBytes(&writer, "bytes", 5));
+  Panic(BitWriterWriteBits(&writer, 0x5, 3));
+  // 1 + 5 + 32 + 16 + 80 + 15 + 15 bits, then padding, bytes and 3 bits.
+  size_t len = BitWriterFlush(&writer);
+  assert(len == 21 + 5 + 1);
+
+  int flag;
+  int32_t small;
+  int32_t large;
+  uint64_t varint;
+  uint64_t max_varint;
+  float position;
+  float edge;
+  char bytes[5];
+  uint32_t bits;
+  BitReaderInit(&reader, buffer, len);
+  Panic(BitReaderReadBool(&reader, &flag));
+  Panic(BitReaderReadInt(&reader, &small, -10, 10));
+  Panic(BitReaderReadInt(&reader, &large, -0x7fffffff - 1, 0x7fffffff));
+  Panic(BitReaderReadVarint(&reader, &varint));
+  Panic(BitReaderReadVarint(&reader, &max_varint));
+  Panic(BitReaderReadFloat(&reader, &position, -100, 100, 0.01f));
+  Panic(BitReaderReadFloat(&reader, &edge, -100, 100, 0.01f));
+  Panic(BitReaderReadBytes(&reader, bytes, 5));
+  Panic(BitReaderReadBits(&reader, &bits, 3));
+  assert(flag == 1);
+  assert(small == -3);
+  assert(large == 0x7fffffff);
+  assert(varint == 300);
+  assert(max_varint == UINT64_MAX);
+  assert(position > 12.334f && position < 12.346f);
+  assert(edge == 100);
+  assert(memcmp(bytes, "bytes", 5) == 0);
+  assert(bits == 0x5);
+  assert(BitReaderRemaining(&reader) == 0);
+  // Only the padding of the last byte is left.
+  assert(BitReaderReadBits(&reader, &bits, 6) == PACKET_MALFORMED);
+}
+
+void TestBounds() {
+  BitWriterInit(&writer, buffer, 2);
+  assert(BitWriterWriteInt(&writer, 11, -10, 10) == BITSTREAM_OUT_OF_RANGE);
+  assert(BitWriterWriteFloat(&writer, 101, -100, 100, 0.01f) ==
+         BITSTREAM_OUT_OF_RANGE);
+  Panic(BitWriterWriteBits(&writer, 0x3ff, 10));
+  assert(BitWriterWriteBits(&writer, 0, 7) == PACKET_TOO_LARGE);
+  Panic(BitWriterWriteBits(&writer, 0x3f, 6));
+  assert(BitWriterWriteBytes(&writer, "x", 1) == PACKET_TOO_LARGE);
+  assert(BitWriterFlush(&writer) == 2);
+
+  // 20 fits into 5 bits, but not into the range.
+  BitReaderInit(&reader, buffer, 2);
+  BitWriterInit(&writer, buffer, 2);
+  Panic(BitWriterWriteBits(&writer, 30, 5));
+  BitWriterFlush(&writer);
+  int32_t value;
+  assert(BitReaderReadInt(&reader, &value, -10, 10) == PACKET_MALFORMED);
+
+  // Eleven varint groups don't fit into 64 bits.
+  memset(buffer, 0xff, 11);
+  BitReaderInit(&reader, buffer, 11);
+  uint64_t varint;
+  assert(BitReaderReadVarint(&reader, &varint) == PACKET_MALFORMED);
+  BitReaderInit(&reader, buffer, 4);
+  assert(BitReaderReadVarint(&reader, &varint) == PACKET_MALFORMED);
+}
+
+void TestHeader() {
+  Response response;
+  Response received;
+  Data data;
+  Panic(ResponseInit(&response));
+  Panic(ResponseInit(&received));
+  Panic(DataInit(&data));
+  ResponseSetData(&response, "hello");
+  ResponseSetType(&response, CONNECT);
+  Panic(ResponseToData(&response, &data));
+  // Type, flags and length take 17 bits.
+  assert(data.len == 3 + 5);
+  Panic(DataToResponse(&data, &received));
+  assert(ResponseGetType(&received) == CONNECT);
+  assert(received.data.len == 5);
+  assert(memcmp(received.data.ptr, "hello", 5) == 0);
+
+  ResponseSetType(&response, RELIABLE);
+  response.sequence = 65535;
+  response.ack = 1234;
+  response.ack_bits = 0x80000001u;
+  response.flags = PACKET_HAS_ACKS;
+  response.data.len = kMaxPayload;
+  data.len = kDataLength;
+  Panic(ResponseToData(&response, &data));
+  assert(data.len == kDataLength);
+  Panic(DataToResponse(&data, &received));
+  assert(ResponseGetType(&received) == RELIABLE);
+  assert(received.sequence == 65535);
+  assert(received.ack == 1234);
+  assert(received.ack_bits == 0x80000001u);
+  assert(received.flags == PACKET_HAS_ACKS);
+  assert(received.data.len == kMaxPayload);
+
+  data.len = 2;
+  assert(DataToResponse(&data, &received) == PACKET_MALFORMED);
+  data.len = 4;
+  assert(ResponseToData(&response, &data) == PACKET_TOO_LARGE);
+  ResponseDestroy(&response);
+  ResponseDestroy(&received);
+  DataDestroy(&data);
+}
+
+int main() {
+  TestRoundTrip();
+  TestBounds();
+  TestHeader();
+}
@@ -0,0 +1,182 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "common/stats.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40744;
+const int kTimeoutTime = 1000;
+const int kMessages = 100;
+const size_t kBatch = 8;
+
+Response response;
+
+void Message(int i) {
+  char text[sizeof("message -2147483648")];
+  snprintf(text, sizeof(text), "message %d", i);
+  ResponseSetData(&response, text);
+}
+
+void AssertMessage(Response* got, int i) {
+  char text[sizeof("message -2147483648")];
+  snprintf(text, sizeof(text), "message %d", i);
+  assert(got->data.len == strlen(text));
+  assert(memcmp(got->data.ptr, text, got->data.len) == 0);
+}
+
+void TestQueue() {
+  PacketQueue queue;
+  PacketQueueInit(&queue);
+  assert(PacketQueueEmpty(&queue));
+  int pushed = 0;
+  for (;; ++pushed) {
+    Message(pushed);
+    ResponseSetType(&response, pushed % 2 == 0 ? CONNECT : RELIABLE);
+    response.sequence = (uint16_t)pushed;
+    size_t len = queue.data.len;
+    RETCODE result = PacketQueuePush(&queue, &response, NULL);
+    if (result == PACKET_TOO_LARGE) {
+      assert(queue.data.len == len);
+      break;
+    }
+    Panic(result);
+  }
+  assert(pushed > 1 && queue.data.len <= kDataLength);
+  assert(!(response.flags & PACKET_COALESCED));
+
+  Response out;
+  Panic(ResponseInit(&out));
+  DatagramIter iter;
+  DatagramIterInit(&iter, &queue.data);
+  for (int i = 0; i < pushed; ++i) {
+    assert(!DatagramIterStopped(&iter));
+    Panic(DatagramIterNext(&iter, &out, NULL));
+    assert(ResponseGetType(&out) == (i % 2 == 0 ? CONNECT : RELIABLE));
+    assert(!(out.flags & PACKET_COALESCED));
+    AssertMessage(&out, i);
+  }
+  assert(DatagramIterStopped(&iter));
+
+  // A packet which isn't coalesced ends the datagram.
+  Data data;
+  Panic(DataInit(&data));
+  ResponseSetType(&response, CONNECT);
+  Message(0);
+  Panic(ResponseToData(&response, &data));
+  data.ptr[data.len++] = 0x5a;
+  DatagramIterInit(&iter, &data);
+  Panic(DatagramIterNext(&iter, &out, NULL));
+  assert(DatagramIterStopped(&iter));
+  // A truncated one stops the iterator.
+  PacketQueueClear(&queue);
+  Panic(PacketQueuePush(&queue, &response, NULL));
+  Panic(PacketQueuePush(&queue, &response, NULL));
+  --queue.data.len;
+  DatagramIterInit(&iter, &queue.data);
+  Panic(DatagramIterNext(&iter, &out, NULL));
+  assert(DatagramIterNext(&iter, &out, NULL) == PACKET_MALFORMED);
+  assert(DatagramIterStopped(&iter));
+
+  DataDestroy(&data);
+  ResponseDestroy(&out);
+  PacketQueueDestroy(&queue);
+}
+
+void TestServerClient() {
+  Address addr;
+  Server srv;
+  Client clt;
+  StatsSnapshot stats;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ClientSetTimeout(&clt, kTimeoutTime));
+  Panic(ServerSetCoalescing(&srv, 1));
+  Panic(ClientSetCoalescing(&clt, 1));
+
+  // Nothing leaves until the flush.
+  for (int i = 0; i < kMessages; ++i) {
+    Message(i);
+    Panic(ClientSend(&clt, &response));
+  }
+  Panic(ClientFlush(&clt));
+  ClientGetStats(&clt, &stats);
+  assert(stats.counters.packets_out < (uint64_t)kMessages / 5);
+  for (int i = 0; i < kMessages; ++i) {
+    Panic(ServerReceive(&srv, &response));
+    AssertMessage(&response, i);
+  }
+  ServerGetStats(&srv, &stats);
+  assert(stats.counters.packets_in < (uint64_t)kMessages / 5);
+
+  // Coalesced packets which don't fit into a batch wait for the next one.
+  for (int i = 0; i < kMessages; ++i) {
+    Message(i);
+    Panic(ClientSend(&clt, &response));
+  }
+  Panic(ClientUpdate(&clt));
+  Response batch[kBatch];
+  for (size_t i = 0; i < kBatch; ++i) {
+    Panic(ResponseInit(&batch[i]));
+  }
+  int received = 0;
+  while (received < kMessages) {
+    size_t got;
+    Panic(ServerReceiveBatch(&srv, batch, kBatch, &got));
+    for (size_t i = 0; i < got; ++i) {
+      AssertMessage(&batch[i], received++);
+    }
+  }
+
+  // Reliable messages and acks ride along with the rest.
+  for (int i = 0; i < kMessages; ++i) {
+    Message(i);
+    ResponseSetClientId(&response, 0);
+    if (i % 4 != 0) {
+      Panic(ServerSendTo(&srv, &response));
+    } else {
+      Panic(ServerSendReliable(&srv, &response));
+    }
+  }
+  Panic(ServerFlush(&srv));
+  for (int i = 0; i < kMessages; ++i) {
+    RETCODE result;
+    while ((result = ClientReceive(&clt, &response)) == RELIABLE_PENDING) {
+    }
+    Panic(result);
+    AssertMessage(&response, i);
+  }
+  ServerGetStats(&srv, &stats);
+  assert(stats.counters.packets_out < (uint64_t)kMessages / 5);
+
+  // Without coalescing every message is a datagram again.
+  Panic(ClientSetCoalescing(&clt, 0));
+  Message(0);
+  Panic(ClientSend(&clt, &response));
+  Panic(ServerReceive(&srv, &response));
+  AssertMessage(&response, 0);
+
+  for (size_t i = 0; i < kBatch; ++i) {
+    ResponseDestroy(&batch[i]);
+  }
+  ClientDestroy(&clt);
+  ServerDestroy(&srv);
+  AddressDestroy(&addr);
+}
+
+int main() {
+  Panic(ResponseInit(&response));
+  TestQueue();
+  TestServerClient();
+  ResponseDestroy(&response);
+}
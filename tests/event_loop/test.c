@@ -0,0 +1,133 @@
+#include <assert.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "event/loop.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kTestPacket[] = "hello world!";
+const char kReplyPacket[] = "hello client!";
+const int kPort = 40213;
+const int kTimerPeriod = 10;
+const int kWaitTime = 1000;
+
+Address addr;
+Server srv;
+Client clt;
+EventLoop loop;
+Response response;
+Data data;
+EventSource* timer;
+EventSource* single_timer;
+int timer_ticks;
+int single_ticks;
+int connects;
+int disconnects;
+int server_packets;
+int client_packets;
+
+void OnServerPacket(Server* srv, Response* response, void* user_data) {
+  assert(user_data == &loop);
+  assert(strncmp(response->data.ptr, kTestPacket, strlen(kTestPacket)) == 0);
+  ++server_packets;
+  ResponseSetData(response, kReplyPacket);
+  Panic(ServerSendTo(srv, response));
+}
+
+void OnConnect(Server* srv, uint16_t client_id, void* user_data) {
+  (void)srv;
+  (void)user_data;
+  assert(client_id == 0);
+  ++connects;
+}
+
+void OnDisconnect(Server* srv, uint16_t client_id, void* user_data) {
+  (void)srv;
+  (void)user_data;
+  assert(client_id == 0);
+  ++disconnects;
+  EventLoopStop(&loop);
+}
+
+void OnClientPacket(Client* client, Response* response, void* user_data) {
+  (void)client;
+  (void)user_data;
+  assert(strncmp(response->data.ptr, kReplyPacket, strlen(kReplyPacket)) == 0);
+  ++client_packets;
+}
+
+void OnTimer(EventLoop* loop, void* user_data) {
+  (void)loop;
+  (void)user_data;
+  ++timer_ticks;
+  if (timer_ticks == 1) {
+    ResponseSetData(&response, kTestPacket);
+    Panic(ClientSend(&clt, &response));
+  } else if (timer_ticks == 3) {
+    ResponseSetType(&response, DISCONNECT);
+    response.data.len = 0;
+    Panic(ResponseToData(&response, &data));
+    Panic(SocketSend(&clt.socket, &data, NULL));
+  }
+}
+
+void OnSingleTimer(EventLoop* loop, void* user_data) {
+  (void)user_data;
+  ++single_ticks;
+  EventLoopRemoveTimer(loop, single_timer);
+}
+
+int main() {
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ResponseInit(&response));
+  Panic(DataInit(&data));
+
+  ServerCallbacks server_callbacks = {.on_packet = OnServerPacket,
+                                      .on_connect = OnConnect,
+                                      .on_disconnect = OnDisconnect};
+  ClientCallbacks client_callbacks = {.on_packet = OnClientPacket};
+  Panic(EventLoopInit(&loop));
+  Panic(EventLoopAddServer(&loop, &srv, &server_callbacks, &loop));
+  Panic(EventLoopAddClient(&loop, &clt, &client_callbacks, NULL));
+  Panic(EventLoopAddTimer(&loop, kTimerPeriod, OnTimer, NULL, &timer));
+  Panic(EventLoopAddTimer(&loop, kTimerPeriod, OnSingleTimer, NULL,
+                          &single_timer));
+  // A zero period would never fire.
+  assert(EventLoopAddTimer(&loop, 0, OnTimer, NULL, NULL) ==
+         EVENT_LOOP_TIMER_PERIOD);
+
+  Panic(EventLoopRun(&loop));
+  assert(connects == 1);
+  assert(disconnects == 1);
+  assert(server_packets == 1);
+  assert(client_packets == 1);
+  assert(ServerClientsCount(&srv) == 0);
+
+  EventLoopRemoveClient(&loop, &clt);
+  Panic(EventLoopRunOnce(&loop, kTimerPeriod / 2));
+  Panic(EventLoopRunOnce(&loop, kWaitTime));
+  assert(timer_ticks >= 4);
+  assert(single_ticks == 1);
+
+  // Removed timers don't fire anymore.
+  int ticks = timer_ticks;
+  EventLoopRemoveTimer(&loop, timer);
+  Panic(EventLoopRunOnce(&loop, kTimerPeriod * 3));
+  assert(timer_ticks == ticks);
+
+  EventLoopDestroy(&loop);
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  AddressDestroy(&addr);
+  ResponseDestroy(&response);
+  DataDestroy(&data);
+}
@@ -0,0 +1,219 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "client/client.h"
+#include "helpers.h"
+#include "networking/fragment.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40734;
+const size_t kLossyMessageSize = 1024 * 1024;
+const size_t kLoopbackMessageSize = 200 * 1024;
+const uint32_t kLossPercent = 10;
+const uint64_t kTick = 5;
+const uint64_t kResendTimeout = 50;
+const int kMaxTicks = 100000;
+
+FragmentChannel sender;
+FragmentChannel receiver;
+Response message;
+Response wire_response;
+Data wire;
+int completed;
+
+// Passes the packet through the lossy link, kLossPercent of them are dropped.
+void Transmit(FragmentChannel* to, Response* response) {
+  if (Random() % 100 < kLossPercent) {
+    return;
+  }
+  wire.len = kDataLength;
+  Panic(ResponseToData(response, &wire));
+  Panic(DataToResponse(&wire, &wire_response));
+  RETCODE result = FragmentChannelReceive(to, &wire_response);
+  if (result == SUCCESS) {
+    assert(wire_response.data.len == 0);
+    ++completed;
+    return;
+  }
+  assert(result == RELIABLE_PENDING);
+}
+
+void TestLossyLink() {
+  char* data = MakeMessage(kLossyMessageSize, 7);
+  FragmentChannelInit(&sender);
+  FragmentChannelInit(&receiver);
+  Panic(FragmentChannelSend(&sender, data, kLossyMessageSize));
+  assert(FragmentChannelSend(&sender, data, 1) == FRAGMENT_BUSY);
+  size_t count = sender.sender.count;
+  size_t fragments = 0;
+  uint64_t now = 0;
+  for (int tick = 0; tick < kMaxTicks && FragmentChannelSending(&sender);
+       ++tick) {
+    while (FragmentChannelNextFragment(&sender, now, kResendTimeout,
+                                       &message)) {
+      ++fragments;
+      Transmit(&receiver, &message);
+      if (FragmentChannelAckDue(&receiver) &&
+          FragmentChannelNextAck(&receiver, &message)) {
+        Transmit(&sender, &message);
+      }
+    }
+    if (FragmentChannelNextAck(&receiver, &message)) {
+      Transmit(&sender, &message);
+    }
+    now += kTick;
+  }
+  assert(!FragmentChannelSending(&sender));
+  assert(completed == 1);
+  // Only the lost fragments are sent again, not the whole window after them.
+  assert(fragments < count * 3 / 2);
+
+  Data out;
+  assert(FragmentChannelTake(&sender, &out) == FRAGMENT_NOT_READY);
+  Panic(FragmentChannelTake(&receiver, &out));
+  assert(out.len == kLossyMessageSize);
+  assert(memcmp(out.ptr, data, kLossyMessageSize) == 0);
+  DataDestroy(&out);
+  assert(FragmentChannelTake(&receiver, &out) == FRAGMENT_NOT_READY);
+
+  // The next message gets the next ID and starts over.
+  Panic(FragmentChannelSend(&sender, data, 0));
+  assert(FragmentChannelNextFragment(&sender, now, kResendTimeout, &message));
+  assert(message.data.len == kFragmentHeaderSize);
+  assert(FragmentChannelReceive(&receiver, &message) == SUCCESS);
+  Panic(FragmentChannelTake(&receiver, &out));
+  assert(out.len == 0);
+  DataDestroy(&out);
+  assert(FragmentChannelNextAck(&receiver, &message));
+  assert(FragmentChannelReceive(&sender, &message) == RELIABLE_PENDING);
+  assert(!FragmentChannelSending(&sender));
+
+  // Messages above the limit are refused before they're allocated.
+  FragmentChannelSetLimit(&receiver, 1);
+  Panic(FragmentChannelSend(&sender, data, 2));
+  assert(FragmentChannelNextFragment(&sender, now, kResendTimeout, &message));
+  assert(FragmentChannelReceive(&receiver, &message) == PACKET_TOO_LARGE);
+  assert(receiver.assembler.block == NULL);
+  FragmentChannelSetLimit(&receiver, 2);
+  assert(FragmentChannelReceive(&receiver, &message) == SUCCESS);
+  Panic(FragmentChannelTake(&receiver, &out));
+  assert(out.len == 2);
+  DataDestroy(&out);
+
+  assert(FragmentChannelSend(&sender, data, kFragmentMaxSize + 1) ==
+         FRAGMENT_BUSY);
+  FragmentChannelDestroy(&sender);
+  FragmentChannelInit(&sender);
+  assert(FragmentChannelSend(&sender, data, kFragmentMaxSize + 1) ==
+         PACKET_TOO_LARGE);
+  FragmentChannelDestroy(&sender);
+  FragmentChannelDestroy(&receiver);
+  free(data);
+}
+
+void TestBounds() {
+  message.data.len = kMaxPayload + 1;
+  ResponseSetType(&message, CONNECT);
+  wire.len = kDataLength;
+  assert(ResponseToData(&message, &wire) == PACKET_TOO_LARGE);
+  message.data.len = kMaxPayload;
+  Panic(ResponseToData(&message, &wire));
+  Panic(DataToResponse(&wire, &wire_response));
+  assert(wire_response.data.len == kMaxPayload);
+  // A truncated datagram can't be trusted.
+  wire.len -= 1;
+  assert(DataToResponse(&wire, &wire_response) == PACKET_MALFORMED);
+  wire.len = 1;
+  assert(DataToResponse(&wire, &wire_response) == PACKET_MALFORMED);
+}
+
+void TestServerClient() {
+  Address addr;
+  Server srv;
+  Client clt;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ServerMakeNonBlocking(&srv));
+  Panic(ClientMakeNonBlocking(&clt));
+  char* upload = MakeMessage(kLoopbackMessageSize, 1);
+  char* download = MakeMessage(kLoopbackMessageSize, 2);
+
+  Panic(ClientSendLarge(&clt, upload, kLoopbackMessageSize));
+  int uploaded = 0;
+  int downloaded = 0;
+  int started = 0;
+  Data out;
+  RETCODE result;
+  for (int tick = 0;
+       tick < kMaxTicks &&
+       (!uploaded || !downloaded || FragmentChannelSending(&clt.fragments));
+       ++tick) {
+    while ((result = ServerReceive(&srv, &message)) != SOCKET_TIMEOUT) {
+      if (result == RELIABLE_PENDING) {
+        continue;
+      }
+      if (!started) {
+        // The client is registered now, but its upload is refused until the
+        // server allows it. The reply can go out.
+        assert(result == PACKET_TOO_LARGE);
+        Panic(ServerSetLargeLimit(&srv, 0, kLoopbackMessageSize));
+        Panic(ServerSendLarge(&srv, 0, download, kLoopbackMessageSize));
+        started = 1;
+        continue;
+      }
+      Panic(result);
+      if (ResponseGetType(&message) == FRAGMENT) {
+        Panic(ServerTakeLarge(&srv, message.client_id, &out));
+        assert(out.len == kLoopbackMessageSize);
+        assert(memcmp(out.ptr, upload, kLoopbackMessageSize) == 0);
+        DataDestroy(&out);
+        uploaded = 1;
+      }
+    }
+    while ((result = ClientReceive(&clt, &message)) != SOCKET_TIMEOUT) {
+      if (result == RELIABLE_PENDING) {
+        continue;
+      }
+      Panic(result);
+      assert(ResponseGetType(&message) == FRAGMENT);
+      Panic(ClientTakeLarge(&clt, &out));
+      assert(out.len == kLoopbackMessageSize);
+      assert(memcmp(out.ptr, download, kLoopbackMessageSize) == 0);
+      DataDestroy(&out);
+      downloaded = 1;
+    }
+    Panic(ServerUpdate(&srv));
+    Panic(ClientUpdate(&clt));
+    usleep(1000);
+  }
+  assert(uploaded && downloaded);
+  assert(!FragmentChannelSending(&clt.fragments));
+
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  AddressDestroy(&addr);
+  free(upload);
+  free(download);
+}
+
+int main() {
+  Panic(ResponseInit(&message));
+  Panic(ResponseInit(&wire_response));
+  Panic(DataInit(&wire));
+  TestBounds();
+  TestLossyLink();
+  TestServerClient();
+  ResponseDestroy(&message);
+  ResponseDestroy(&wire_response);
+  DataDestroy(&wire);
+}
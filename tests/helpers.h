@@ -0,0 +1,24 @@
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+uint32_t seed = 1;
+
+// Linear congruential generator, the same sequence on every run.
+uint32_t Random() {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+// Allocates the message filled with the pattern which depends on the salt.
+char* MakeMessage(size_t len, unsigned salt) {
+  char* data = (char*)malloc(len);
+  assert(data != NULL);
+  for (size_t i = 0; i < len; ++i) {
+    data[i] = (char)((i * 31 + salt) >> 3);
+  }
+  return data;
+}
@@ -0,0 +1,161 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "helpers.h"
+#include "networking/huffman.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40736;
+const int kTimeoutTime = 1000;
+const int kSamples = 1000;
+
+HuffmanTrainer trainer;
+HuffmanTable table;
+HuffmanTable loaded;
+Response response;
+Response received;
+Data data;
+char encoded[1024];
+char decoded[1024];
+
+// Makes a payload like the ones a game sends: short text with small numbers.
+size_t MakeSample(char* out, size_t capacity) {
+  return (size_t)snprintf(out, capacity,
+                          "unit %u moved to %u.%u %u.%u hp %u state idle",
+                          Random() % 64, Random() % 200, Random() % 10,
+                          Random() % 200, Random() % 10, Random() % 100);
+}
+
+void TestCoder() {
+  char sample[128];
+  HuffmanTrainerInit(&trainer);
+  for (int i = 0; i < kSamples; ++i) {
+    HuffmanTrainerAdd(&trainer, sample, MakeSample(sample, sizeof(sample)));
+  }
+  HuffmanTrainerBuild(&trainer, &table);
+  for (int i = 0; i < 256; ++i) {
+    assert(table.lengths[i] >= 1 && table.lengths[i] <= kHuffmanMaxCodeLength);
+  }
+  // Only the lengths are shipped to the peers.
+  Panic(HuffmanTableInit(&loaded, table.lengths));
+  assert(memcmp(&loaded, &table, sizeof(table)) == 0);
+
+  size_t raw_bytes = 0;
+  size_t encoded_bytes = 0;
+  for (int i = 0; i < kSamples; ++i) {
+    size_t len = MakeSample(sample, sizeof(sample));
+    size_t encoded_len =
+        HuffmanEncode(&table, sample, len, encoded, sizeof(encoded));
+    assert(encoded_len != 0);
+    size_t decoded_len;
+    Panic(HuffmanDecode(&loaded, encoded, encoded_len, decoded,
+                        sizeof(decoded), &decoded_len));
+    assert(decoded_len == len);
+    assert(memcmp(decoded, sample, len) == 0);
+    raw_bytes += len;
+    encoded_bytes += encoded_len;
+  }
+  assert(encoded_bytes * 10 < raw_bytes * 7);
+
+  // Bytes never seen in training still round trip.
+  for (int i = 0; i < 256; ++i) {
+    sample[i % 128] = (char)i;
+  }
+  size_t encoded_len = HuffmanEncode(&table, sample, 128, encoded, 1024);
+  size_t decoded_len;
+  assert(encoded_len > 128);
+  Panic(HuffmanDecode(&table, encoded, encoded_len, decoded, 1024,
+                      &decoded_len));
+  assert(decoded_len == 128 && memcmp(decoded, sample, 128) == 0);
+  assert(HuffmanEncode(&table, sample, 128, encoded, 128) == 0);
+  assert(HuffmanDecode(&table, encoded, encoded_len - 8, decoded, 1024,
+                       &decoded_len) == PACKET_MALFORMED);
+  assert(HuffmanDecode(&table, encoded, encoded_len, decoded, 127,
+                       &decoded_len) == PACKET_MALFORMED);
+
+  uint8_t lengths[256];
+  memset(lengths, 1, sizeof(lengths));
+  assert(HuffmanTableInit(&loaded, lengths) == HUFFMAN_INVALID_TABLE);
+  memset(lengths, 0, sizeof(lengths));
+  lengths[0] = kHuffmanMaxCodeLength + 1;
+  assert(HuffmanTableInit(&loaded, lengths) == HUFFMAN_INVALID_TABLE);
+}
+
+void TestPackets() {
+  response.data.len = MakeSample(response.data.ptr, kDataLength);
+  ResponseSetType(&response, CONNECT);
+  data.len = kDataLength;
+  Panic(ResponseToData(&response, &data));
+  size_t raw_len = data.len;
+  data.len = kDataLength;
+  Panic(ResponseToDataCompressed(&response, &data, &table));
+  assert(data.len < raw_len);
+  assert(DataToResponse(&data, &received) == PACKET_MALFORMED);
+  Panic(DataToResponseCompressed(&data, &received, &table));
+  assert((received.flags & PACKET_COMPRESSED) == 0);
+  assert(received.data.len == response.data.len);
+  assert(memcmp(received.data.ptr, response.data.ptr, response.data.len) ==
+         0);
+
+  // Payloads which don't get smaller are mixed in as they are.
+  for (size_t i = 0; i < 64; ++i) {
+    response.data.ptr[i] = (char)(i * 4 + 1);
+  }
+  response.data.len = 64;
+  data.len = kDataLength;
+  Panic(ResponseToDataCompressed(&response, &data, &table));
+  Panic(DataToResponse(&data, &received));
+  assert(received.data.len == 64);
+  assert(memcmp(received.data.ptr, response.data.ptr, 64) == 0);
+}
+
+void TestServerClient() {
+  Address addr;
+  Server srv;
+  Client clt;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientSetTimeout(&clt, kTimeoutTime));
+  ServerSetCompression(&srv, &table);
+  ClientSetCompression(&clt, &table);
+
+  for (int i = 0; i < 10; ++i) {
+    response.data.len = MakeSample(response.data.ptr, kDataLength);
+    Panic(ClientSend(&clt, &response));
+    Panic(ServerReceive(&srv, &received));
+    assert(received.data.len == response.data.len);
+    assert(memcmp(received.data.ptr, response.data.ptr, response.data.len) ==
+           0);
+    Panic(ServerSendTo(&srv, &received));
+    Panic(ClientReceive(&clt, &received));
+    assert(memcmp(received.data.ptr, response.data.ptr, response.data.len) ==
+           0);
+  }
+
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  AddressDestroy(&addr);
+}
+
+int main() {
+  Panic(ResponseInit(&response));
+  Panic(ResponseInit(&received));
+  Panic(DataInit(&data));
+  TestCoder();
+  TestPackets();
+  TestServerClient();
+  ResponseDestroy(&response);
+  ResponseDestroy(&received);
+  DataDestroy(&data);
+}
@@ -0,0 +1,193 @@
+#include <assert.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "helpers.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "server/interest.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40742;
+const int kTimeoutTime = 1000;
+const uint32_t kWidth = 20;
+const uint32_t kHeight = 15;
+const int kMoves = 20000;
+#define kGridClients 64
+#define kClients 3
+
+typedef struct {
+  uint32_t x;
+  uint32_t y;
+  uint16_t radius;
+  int placed;
+} Place;
+
+InterestGrid grid;
+Place places[kGridClients];
+
+int Covers(Place* place, uint32_t x, uint32_t y) {
+  int64_t dx = (int64_t)x - place->x;
+  int64_t dy = (int64_t)y - place->y;
+  return place->placed && dx >= -place->radius && dx <= place->radius &&
+         dy >= -place->radius && dy <= place->radius;
+}
+
+// Every cell lists exactly the clients whose area covers it.
+void CheckGrid() {
+  for (uint32_t y = 0; y < kHeight; ++y) {
+    for (uint32_t x = 0; x < kWidth; ++x) {
+      const uint16_t* ids;
+      size_t count;
+      Panic(InterestGridCell(&grid, x, y, &ids, &count));
+      int seen[kGridClients] = {0};
+      for (size_t i = 0; i < count; ++i) {
+        assert(ids[i] < kGridClients && !seen[ids[i]]);
+        assert(Covers(&places[ids[i]], x, y));
+        seen[ids[i]] = 1;
+      }
+      for (int id = 0; id < kGridClients; ++id) {
+        assert(seen[id] == Covers(&places[id], x, y));
+      }
+    }
+  }
+}
+
+void TestGrid() {
+  InterestGrid empty;
+  assert(InterestGridInit(&empty, 0, kHeight) == INTEREST_OUT_OF_GRID);
+  InterestGridDestroy(&empty);
+
+  Panic(InterestGridInit(&grid, kWidth, kHeight));
+  assert(InterestGridPlace(&grid, 0, kWidth, 0, 1) == INTEREST_OUT_OF_GRID);
+  const uint16_t* ids;
+  size_t count;
+  assert(InterestGridCell(&grid, 0, kHeight, &ids, &count) ==
+         INTEREST_OUT_OF_GRID);
+  // Mostly short steps like players make, sometimes a jump or a removal.
+  for (int move = 0; move < kMoves; ++move) {
+    uint16_t id = (uint16_t)(Random() % kGridClients);
+    Place* place = &places[id];
+    uint32_t action = Random() % 10;
+    if (action == 0) {
+      InterestGridRemove(&grid, id);
+      place->placed = 0;
+    } else if (action == 1 || !place->placed) {
+      place->x = Random() % kWidth;
+      place->y = Random() % kHeight;
+      place->radius = (uint16_t)(Random() % 4);
+      place->placed = 1;
+      Panic(InterestGridPlace(&grid, id, place->x, place->y, place->radius));
+    } else {
+      int64_t x = (int64_t)place->x + (int64_t)(Random() % 3) - 1;
+      int64_t y = (int64_t)place->y + (int64_t)(Random() % 3) - 1;
+      if (x >= 0 && x < kWidth && y >= 0 && y < kHeight) {
+        place->x = (uint32_t)x;
+        place->y = (uint32_t)y;
+        Panic(InterestGridPlace(&grid, id, place->x, place->y, place->radius));
+      }
+    }
+    if (move % 1000 == 0) {
+      CheckGrid();
+    }
+  }
+  CheckGrid();
+  InterestGridDestroy(&grid);
+}
+
+// Only the cells within the grid are kept for the area of a client.
+void TestHugeRadius() {
+  memset(places, 0, sizeof(places));
+  Panic(InterestGridInit(&grid, kWidth, kHeight));
+  places[0] = (Place){.x = 3, .y = 4, .radius = UINT16_MAX, .placed = 1};
+  places[1] = (Place){.x = 5, .y = 5, .radius = 1, .placed = 1};
+  places[2] = (Place){.x = 0, .y = 0, .radius = UINT16_MAX, .placed = 1};
+  for (int id = 0; id < 3; ++id) {
+    Panic(InterestGridPlace(&grid, (uint16_t)id, places[id].x, places[id].y,
+                            places[id].radius));
+  }
+  CheckGrid();
+  // Positions of the clients with the huge areas are updated when the small
+  // one leaves the cells.
+  places[1].x = kWidth - 1;
+  Panic(InterestGridPlace(&grid, 1, places[1].x, places[1].y,
+                          places[1].radius));
+  places[0].x = kWidth - 1;
+  places[0].y = kHeight - 1;
+  Panic(InterestGridPlace(&grid, 0, places[0].x, places[0].y,
+                          places[0].radius));
+  CheckGrid();
+  InterestGridRemove(&grid, 2);
+  places[2].placed = 0;
+  CheckGrid();
+  InterestGridDestroy(&grid);
+}
+
+void TestServer() {
+  Address addr;
+  Server srv;
+  Client clients[kClients];
+  Response response;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ResponseInit(&response));
+  Panic(ServerInit(&srv, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  ResponseSetData(&response, "hello");
+  assert(ServerSendRelevant(&srv, &response, 0, 0, NULL, NULL) ==
+         INTEREST_OUT_OF_GRID);
+  Panic(ServerSetInterestGrid(&srv, kWidth, kHeight));
+  for (int i = 0; i < kClients; ++i) {
+    Panic(ClientInit(&clients[i], &addr));
+    Panic(ClientSetTimeout(&clients[i], kTimeoutTime));
+    Panic(ClientSend(&clients[i], &response));
+    Panic(ServerReceive(&srv, &response));
+  }
+  assert(ServerSetInterest(&srv, kClients, 0, 0, 0) == SERVER_USER_NOT_FOUND);
+  // Two clients look at the corner, the third one is far away.
+  Panic(ServerSetInterest(&srv, 0, 1, 1, 1));
+  Panic(ServerSetInterest(&srv, 1, 0, 0, 0));
+  Panic(ServerSetInterest(&srv, 2, 10, 10, 2));
+
+  ResponseSetData(&response, "corner");
+  size_t failed;
+  Panic(ServerSendRelevant(&srv, &response, 0, 0, NULL, &failed));
+  assert(failed == 0);
+  for (int i = 0; i < 2; ++i) {
+    Panic(ClientReceive(&clients[i], &response));
+    assert(response.data.len == strlen("corner"));
+  }
+  ResponseSetData(&response, "far");
+  Panic(ServerSendRelevant(&srv, &response, 12, 12, NULL, NULL));
+  Panic(ClientReceive(&clients[2], &response));
+  assert(memcmp(response.data.ptr, "far", 3) == 0);
+
+  // The third client walks into the corner.
+  Panic(ServerSetInterest(&srv, 2, 2, 2, 2));
+  ResponseSetData(&response, "moved");
+  Panic(ServerSendRelevant(&srv, &response, 0, 0, NULL, NULL));
+  for (int i = 0; i < kClients; ++i) {
+    Panic(ClientReceive(&clients[i], &response));
+    assert(memcmp(response.data.ptr, "moved", 5) == 0);
+  }
+  // Nobody else got anything.
+  Panic(ClientSetTimeout(&clients[0], 10));
+  assert(ClientReceive(&clients[0], &response) == SOCKET_TIMEOUT);
+
+  for (int i = 0; i < kClients; ++i) {
+    ClientDestroy(&clients[i]);
+  }
+  ServerDestroy(&srv);
+  ResponseDestroy(&response);
+  AddressDestroy(&addr);
+}
+
+int main() {
+  TestGrid();
+  TestHugeRadius();
+  TestServer();
+}
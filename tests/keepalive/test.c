@@ -0,0 +1,154 @@
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "common/clock.h"
+#include "common/timer_wheel.h"
+#include "helpers.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40738;
+const int kReceiveTimeout = 5;
+const uint64_t kIdleTimeout = 200;
+const uint64_t kKeepAlive = 40;
+const uint64_t kTestTime = 600;
+#define kTimers 10000
+
+TimerNode timers[kTimers];
+uint64_t expires[kTimers];
+uint8_t fired[kTimers];
+Response response;
+int evicted = -1;
+
+void TestWheel() {
+  TimerWheel wheel;
+  TimerWheelInit(&wheel, 1000);
+  for (int i = 0; i < kTimers; ++i) {
+    TimerNodeInit(&timers[i]);
+    // Spread over every level of the wheel.
+    expires[i] = 1000 + (Random() << (i % 4 * 5)) % 3000000;
+    TimerWheelSchedule(&wheel, &timers[i], expires[i]);
+  }
+  // Every third timer is cancelled, every fifth is moved.
+  for (int i = 0; i < kTimers; i += 3) {
+    TimerWheelCancel(&wheel, &timers[i]);
+    TimerWheelCancel(&wheel, &timers[i]);
+  }
+  for (int i = 1; i < kTimers; i += 5) {
+    if (i % 3 == 0) {
+      continue;
+    }
+    expires[i] += Random() % 5000;
+    TimerWheelSchedule(&wheel, &timers[i], expires[i]);
+  }
+  uint64_t now = 1000;
+  int count = 0;
+  while (now < 3010000) {
+    now += 1 + Random() % 2000;
+    TimerNode* node;
+    while (TimerWheelNextExpired(&wheel, now, &node)) {
+      size_t i = node - timers;
+      assert(i % 3 != 0);
+      assert(!fired[i]);
+      assert(expires[i] <= now);
+      // Nothing is late by more than one step.
+      assert(now - expires[i] <= 2000);
+      fired[i] = 1;
+      ++count;
+    }
+  }
+  for (int i = 0; i < kTimers; ++i) {
+    assert(fired[i] == (i % 3 != 0));
+  }
+  assert(count == kTimers - (kTimers + 2) / 3);
+  assert(wheel.count == 0);
+
+  // Timers beyond the span of the wheel expire at its end.
+  TimerNode node;
+  TimerNode* expired;
+  TimerNodeInit(&node);
+  TimerWheelSchedule(&wheel, &node, now + ((uint64_t)1 << 40));
+  assert(!TimerWheelNextExpired(&wheel, now + 1000, &expired));
+  assert(TimerWheelNextExpired(&wheel, now + ((uint64_t)1 << 24), &expired));
+  assert(expired == &node);
+  // Past timers expire right away.
+  TimerWheelSchedule(&wheel, &node, 0);
+  assert(TimerWheelNextExpired(&wheel, wheel.now, &expired));
+  assert(!TimerWheelNextExpired(&wheel, wheel.now, &expired));
+}
+
+void OnDisconnect(void* user_data, uint16_t client_id) {
+  *(int*)user_data = client_id;
+}
+
+void TestEviction() {
+  Address addr;
+  Server srv;
+  Client silent;
+  Client alive;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&silent, &addr));
+  Panic(ClientInit(&alive, &addr));
+  Panic(ServerSetTimeout(&srv, kReceiveTimeout));
+  Panic(ClientSetTimeout(&silent, kReceiveTimeout));
+  ServerSetIdleTimeout(&srv, kIdleTimeout);
+  ServerSetKeepAlive(&srv, kKeepAlive);
+  ServerListener listener = {.on_disconnect = OnDisconnect,
+                             .user_data = &evicted};
+  ServerSetListener(&srv, &listener);
+  ClientSetKeepAlive(&silent, 0);
+  ClientSetKeepAlive(&alive, kKeepAlive);
+
+  ResponseSetData(&response, "hello");
+  Panic(ClientSend(&silent, &response));
+  Panic(ServerReceive(&srv, &response));
+  assert(response.client_id == 0);
+  ResponseSetData(&response, "hello");
+  Panic(ClientSend(&alive, &response));
+  Panic(ServerReceive(&srv, &response));
+  assert(response.client_id == 1);
+
+  int keepalives = 0;
+  int kicked = 0;
+  uint64_t start = ClockNow();
+  while (ClockNow() - start < kTestTime) {
+    Panic(ClientUpdate(&alive));
+    while (ServerReceive(&srv, &response) == RELIABLE_PENDING) {
+    }
+    Panic(ServerUpdate(&srv));
+    RETCODE result;
+    while ((result = ClientReceive(&silent, &response)) == RELIABLE_PENDING) {
+      ++keepalives;
+    }
+    kicked |= result == CLIENT_KICKED;
+  }
+  // The silent client got keepalives until it was evicted and told so.
+  assert(keepalives >= 2);
+  assert(kicked);
+  assert(evicted == 0);
+  assert(ServerClientsCount(&srv) == 1);
+  ConnectedClient* connected;
+  assert(RegistratorGetUserByID(&srv.registrator, 0, &connected) ==
+         SERVER_USER_NOT_FOUND);
+  Panic(RegistratorGetUserByID(&srv.registrator, 1, &connected));
+
+  ServerDestroy(&srv);
+  ClientDestroy(&silent);
+  ClientDestroy(&alive);
+  AddressDestroy(&addr);
+}
+
+int main() {
+  Panic(ResponseInit(&response));
+  TestWheel();
+  TestEviction();
+  ResponseDestroy(&response);
+}
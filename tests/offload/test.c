@@ -0,0 +1,207 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "client/client.h"
+#include "helpers.h"
+#include "networking/packet.h"
+#include "networking/socket.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40741;
+const int kTimeoutTime = 1000;
+const size_t kSegmentSize = 400;
+const size_t kTailSize = 123;
+const size_t kMessageSize = 200 * 1024;
+const int kMaxTicks = 100000;
+const int kSkipped = 77;
+#define kSegments 44
+#define kBatchSize 16
+#define kBufferSize 512
+
+Address addr;
+Socket sender;
+Socket receiver;
+char storage[kSegments][kBufferSize];
+Data segments[kSegments];
+Response message;
+
+// A full run, a run cut short by its tail and a run of one.
+size_t SegmentSize(int i) {
+  static const size_t kMixed[] = {300, 300, 200, 300};
+  if (i < kSegments - 4) {
+    return i == kSegments - 5 ? kTailSize : kSegmentSize;
+  }
+  return kMixed[i - (kSegments - 4)];
+}
+
+void FillSegments() {
+  for (int i = 0; i < kSegments; ++i) {
+    segments[i] = (Data){.ptr = storage[i], .len = SegmentSize(i)};
+    memset(storage[i], 'a' + i % 26, segments[i].len);
+  }
+}
+
+void CheckSegment(Data* data, int i) {
+  assert(data->len == SegmentSize(i));
+  for (size_t j = 0; j < data->len; ++j) {
+    assert(data->ptr[j] == 'a' + i % 26);
+  }
+}
+
+// Receives every segment in order, with single and batched receives mixed.
+void ReceiveSegments() {
+  char buffers[kBatchSize][kBufferSize];
+  Data batch[kBatchSize];
+  Address from[kBatchSize];
+  int next = 0;
+  while (next < kSegments) {
+    if (next % 2 == 0) {
+      batch[0] = (Data){.ptr = buffers[0], .len = kBufferSize};
+      Panic(SocketReceive(&receiver, &batch[0], &from[0]));
+      assert(from[0].ip == addr.ip);
+      CheckSegment(&batch[0], next++);
+      continue;
+    }
+    for (int i = 0; i < kBatchSize; ++i) {
+      batch[i] = (Data){.ptr = buffers[i], .len = kBufferSize};
+    }
+    size_t got;
+    Panic(SocketReceiveBatch(&receiver, batch, from, kBatchSize, &got));
+    assert(got != 0 && next + (int)got <= kSegments);
+    for (size_t i = 0; i < got; ++i) {
+      assert(from[i].ip == addr.ip);
+      CheckSegment(&batch[i], next++);
+    }
+  }
+}
+
+void TestSegments() {
+  FillSegments();
+  Panic(SocketSendSegments(&sender, segments, kSegments, &addr));
+  ReceiveSegments();
+
+  // The receiver still gets single datagrams when only the sender offloads.
+  Panic(SocketSetOffload(&receiver, 0));
+  Panic(SocketSendSegments(&sender, segments, kSegments, &addr));
+  ReceiveSegments();
+
+  // And coalesces nothing when only the receiver does.
+  Panic(SocketSetOffload(&receiver, 1));
+  Panic(SocketSetOffload(&sender, 0));
+  Panic(SocketSendSegments(&sender, segments, kSegments, &addr));
+  ReceiveSegments();
+  Panic(SocketSetOffload(&sender, 1));
+
+  // Datagrams longer than the buffer are truncated like recv() does.
+  Panic(SocketSendSegments(&sender, segments, 2, &addr));
+  char buffer[kBufferSize];
+  Data data = (Data){.ptr = buffer, .len = 10};
+  Panic(SocketReceive(&receiver, &data, NULL));
+  assert(data.len == 10 && buffer[0] == 'a');
+  data.len = kBufferSize;
+  Panic(SocketReceive(&receiver, &data, NULL));
+  CheckSegment(&data, 1);
+
+  Panic(SocketSetTimeout(&receiver, 10));
+  data.len = kBufferSize;
+  assert(SocketReceive(&receiver, &data, NULL) == SOCKET_TIMEOUT);
+}
+
+void TestServerClient() {
+  Server srv;
+  Client clt;
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ServerSetOffload(&srv, 1));
+  Panic(ClientSetOffload(&clt, 1));
+  Panic(ServerMakeNonBlocking(&srv));
+  Panic(ClientMakeNonBlocking(&clt));
+  char* upload = MakeMessage(kMessageSize, 1);
+  char* download = MakeMessage(kMessageSize, 2);
+
+  Panic(ClientSendLarge(&clt, upload, kMessageSize));
+  int uploaded = 0;
+  int downloaded = 0;
+  int started = 0;
+  Data out;
+  RETCODE result;
+  for (int tick = 0;
+       tick < kMaxTicks &&
+       (!uploaded || !downloaded || FragmentChannelSending(&clt.fragments));
+       ++tick) {
+    while ((result = ServerReceive(&srv, &message)) != SOCKET_TIMEOUT) {
+      if (result == RELIABLE_PENDING) {
+        continue;
+      }
+      if (!started) {
+        // The client is registered now, but its upload is refused until the
+        // server allows it. The reply can go out.
+        assert(result == PACKET_TOO_LARGE);
+        Panic(ServerSetLargeLimit(&srv, 0, kMessageSize));
+        Panic(ServerSendLarge(&srv, 0, download, kMessageSize));
+        started = 1;
+        continue;
+      }
+      Panic(result);
+      if (ResponseGetType(&message) == FRAGMENT) {
+        Panic(ServerTakeLarge(&srv, message.client_id, &out));
+        assert(out.len == kMessageSize);
+        assert(memcmp(out.ptr, upload, kMessageSize) == 0);
+        DataDestroy(&out);
+        uploaded = 1;
+      }
+    }
+    while ((result = ClientReceive(&clt, &message)) != SOCKET_TIMEOUT) {
+      if (result == RELIABLE_PENDING) {
+        continue;
+      }
+      Panic(result);
+      assert(ResponseGetType(&message) == FRAGMENT);
+      Panic(ClientTakeLarge(&clt, &out));
+      assert(out.len == kMessageSize);
+      assert(memcmp(out.ptr, download, kMessageSize) == 0);
+      DataDestroy(&out);
+      downloaded = 1;
+    }
+    Panic(ServerUpdate(&srv));
+    Panic(ClientUpdate(&clt));
+    usleep(1000);
+  }
+  assert(uploaded && downloaded);
+
+  Panic(ServerSetOffload(&srv, 0));
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  free(upload);
+  free(download);
+}
+
+int main() {
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(SocketInit(&sender));
+  Panic(SocketInit(&receiver));
+  Panic(SocketBind(&receiver, &addr));
+  Panic(SocketSetTimeout(&receiver, kTimeoutTime));
+  RETCODE result = SocketSetOffload(&receiver, 1);
+  if (result == SOCKET_OFFLOAD) {
+    return kSkipped;
+  }
+  Panic(result);
+  Panic(SocketSetOffload(&sender, 1));
+  Panic(ResponseInit(&message));
+  TestSegments();
+  SocketDestroy(&sender);
+  SocketDestroy(&receiver);
+  TestServerClient();
+  ResponseDestroy(&message);
+  AddressDestroy(&addr);
+  return 0;
+}
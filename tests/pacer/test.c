@@ -0,0 +1,237 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "client/client.h"
+#include "networking/pacer.h"
+#include "networking/packet.h"
+#include "networking/reliable.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40737;
+const int kTimeoutTime = 1000;
+const uint64_t kCap = 8000;
+const uint64_t kHighCap = 16 * 1024 * 1024;
+const int kBurstPackets = 100;
+const size_t kPacketSize = 400;
+
+Response message;
+
+void TestTokenBucket() {
+  Pacer pacer;
+  PacerInit(&pacer);
+  // Without the cap nothing is held back.
+  for (int i = 0; i < 1000; ++i) {
+    assert(PacerConsume(&pacer, kDataLength, 0));
+  }
+  PacerSetCap(&pacer, kCap);
+  assert(PacerBudget(&pacer) == kCap);
+  // The bucket starts with two packets worth of tokens.
+  assert(PacerConsume(&pacer, kDataLength, 0));
+  assert(PacerConsume(&pacer, kDataLength, 0));
+  assert(!PacerReady(&pacer, 0));
+  // 10 milliseconds at kCap refill 80 bytes, enough to let a packet through
+  // and go into debt.
+  assert(PacerConsume(&pacer, kDataLength, 10));
+  assert(!PacerConsume(&pacer, kDataLength, 10));
+  assert(!PacerReady(&pacer, 60));
+  assert(PacerReady(&pacer, 100));
+  // Acks go through anyway and put the bucket deeper into debt.
+  PacerCharge(&pacer, kDataLength, 100);
+  assert(!PacerReady(&pacer, 110));
+  assert(PacerReady(&pacer, 1000));
+}
+
+void TestEstimate() {
+  Pacer pacer;
+  ReliableEndpoint endpoint;
+  PacerInit(&pacer);
+  ReliableEndpointInit(&endpoint);
+  endpoint.rtt = 50;
+  uint64_t now = 0;
+  // A healthy link lets the estimate grow.
+  for (int i = 0; i < 20; ++i) {
+    now += 60;
+    endpoint.acked_count += 10;
+    PacerObserve(&pacer, &endpoint, now);
+  }
+  uint64_t healthy = PacerBudget(&pacer);
+  assert(healthy > kPacerInitialRate);
+  // Nothing new is learned without acks.
+  now += 60;
+  PacerObserve(&pacer, &endpoint, now);
+  assert(PacerBudget(&pacer) == healthy);
+  // Losses shrink it quickly.
+  now += 60;
+  endpoint.acked_count += 10;
+  endpoint.lost_count += 5;
+  PacerObserve(&pacer, &endpoint, now);
+  uint64_t lossy = PacerBudget(&pacer);
+  assert(lossy < healthy);
+  // So does the growing round trip time.
+  endpoint.rtt = 500;
+  now += 600;
+  endpoint.acked_count += 10;
+  PacerObserve(&pacer, &endpoint, now);
+  assert(PacerBudget(&pacer) < lossy);
+  // The estimate never exceeds the cap.
+  PacerSetCap(&pacer, kCap);
+  endpoint.rtt = 50;
+  for (int i = 0; i < 100; ++i) {
+    now += 60;
+    endpoint.acked_count += 10;
+    PacerObserve(&pacer, &endpoint, now);
+  }
+  assert(PacerBudget(&pacer) == kCap);
+  assert(pacer.rate <= kCap);
+}
+
+void TestUncongested() {
+  Pacer pacer;
+  ReliableEndpoint endpoint;
+  PacerInit(&pacer);
+  ReliableEndpointInit(&endpoint);
+  PacerSetCap(&pacer, kHighCap);
+  // Without any congestion the cap is the budget, even with no acks at all.
+  assert(PacerBudget(&pacer) == kHighCap);
+  endpoint.rtt = 50;
+  uint64_t now = 0;
+  for (int i = 0; i < 5; ++i) {
+    now += 60;
+    endpoint.acked_count += 10;
+    PacerObserve(&pacer, &endpoint, now);
+  }
+  assert(PacerBudget(&pacer) == kHighCap);
+  // The first loss lowers the budget from the cap, not from the initial rate.
+  now += 60;
+  endpoint.acked_count += 10;
+  endpoint.lost_count += 5;
+  PacerObserve(&pacer, &endpoint, now);
+  assert(PacerBudget(&pacer) < kHighCap);
+  assert(PacerBudget(&pacer) > kHighCap / 2);
+}
+
+void TestDefer() {
+  ReliableEndpoint endpoint;
+  Response view;
+  ReliableEndpointInit(&endpoint);
+  ResponseSetData(&message, "deferred");
+  Panic(ReliableEndpointSend(&endpoint, &message, 0));
+  assert(!ReliableEndpointNextResend(&endpoint, 1, &view));
+  ReliableEndpointDefer(&endpoint, message.sequence);
+  assert(ReliableEndpointNextResend(&endpoint, 1, &view));
+  assert(view.sequence == message.sequence);
+  assert(endpoint.lost_count == 0);
+  assert(!ReliableEndpointNextResend(&endpoint, 2, &view));
+  ReliableEndpointDestroy(&endpoint);
+}
+
+void TestServerClient() {
+  Address addr;
+  Server srv;
+  Client clt;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientSetTimeout(&clt, kTimeoutTime));
+  ServerSetBandwidthCap(&srv, kCap);
+
+  ResponseSetData(&message, "hello");
+  Panic(ClientSend(&clt, &message));
+  Panic(ServerReceive(&srv, &message));
+  uint64_t budget;
+  Panic(ServerGetBandwidth(&srv, 0, &budget));
+  assert(budget == kCap);
+  assert(ServerGetBandwidth(&srv, 1, &budget) == SERVER_USER_NOT_FOUND);
+
+  // A burst is cut off once the budget is spent.
+  memset(message.data.ptr, 'x', kPacketSize);
+  message.data.len = kPacketSize;
+  int sent = 0;
+  RETCODE result = SUCCESS;
+  while (result == SUCCESS) {
+    ResponseSetClientId(&message, 0);
+    result = ServerSendTo(&srv, &message);
+    sent += result == SUCCESS;
+  }
+  assert(result == SEND_THROTTLED);
+  assert(sent >= 1 && sent <= 4);
+  assert(ServerSend(&srv, &message) == SEND_THROTTLED);
+
+  // The held back reliable message goes out once the budget refills.
+  ResponseSetData(&message, "reliable");
+  ResponseSetClientId(&message, 0);
+  Panic(ServerSendReliable(&srv, &message));
+  usleep(200 * 1000);
+  Panic(ServerUpdate(&srv));
+  for (int i = 0; i < sent; ++i) {
+    Panic(ClientReceive(&clt, &message));
+    assert(message.data.len == kPacketSize);
+  }
+  Panic(ClientReceive(&clt, &message));
+  assert(ResponseGetType(&message) == RELIABLE);
+  assert(message.data.len == strlen("reliable"));
+  assert(strncmp(message.data.ptr, "reliable", message.data.len) == 0);
+
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  AddressDestroy(&addr);
+}
+
+void TestUnreliableBurst() {
+  Address addr;
+  Server srv;
+  Client clt;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientSetTimeout(&clt, kTimeoutTime));
+  ServerSetBandwidthCap(&srv, kHighCap);
+
+  ResponseSetData(&message, "hello");
+  Panic(ClientSend(&clt, &message));
+  Panic(ServerReceive(&srv, &message));
+  uint64_t budget;
+  Panic(ServerGetBandwidth(&srv, 0, &budget));
+  assert(budget == kHighCap);
+
+  // Nothing is acked, yet a burst well below the cap isn't throttled.
+  memset(message.data.ptr, 'x', kPacketSize);
+  message.data.len = kPacketSize;
+  for (int i = 0; i < kBurstPackets; ++i) {
+    ResponseSetClientId(&message, 0);
+    Panic(ServerSendTo(&srv, &message));
+  }
+  for (int i = 0; i < kBurstPackets; ++i) {
+    Panic(ClientReceive(&clt, &message));
+    assert(message.data.len == kPacketSize);
+  }
+
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  AddressDestroy(&addr);
+}
+
+int main() {
+  Panic(ResponseInit(&message));
+  TestTokenBucket();
+  TestEstimate();
+  TestUncongested();
+  TestDefer();
+  TestServerClient();
+  TestUnreliableBurst();
+  ResponseDestroy(&message);
+}
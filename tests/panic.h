@@ -62,6 +62,67 @@ void TryThrow(RETCODE result, int line) {
     case CLIENT_KICKED: {
       ThrowThis("Client received disconnect packet while in action.");
     }
+    case POOL_EXHAUSTED: {
+      ThrowThis("BufferPoolAcquire() error; All the buffers are in use.");
+    }
+    case EVENT_LOOP_INIT: {
+      ThrowThis("EventLoopInit() error; epoll or timer creation failed.");
+    }
+    case EVENT_LOOP_ADD: {
+      ThrowThis("EventLoopAdd*() error; Registration in epoll failed.");
+    }
+    case EVENT_LOOP_WAIT: {
+      ThrowThis("EventLoopRunOnce() error; Waiting for events failed.");
+    }
+    case SOCKET_REUSEPORT: {
+      ThrowThis("SocketSetReusePort() error; Setting failed.");
+    }
+    case SERVER_SHARD_START: {
+      ThrowThis("ShardedServer error; No shards or worker creation failed.");
+    }
+    case RELIABLE_WINDOW_FULL: {
+      ThrowThis(
+          "ReliableEndpointSend() error; Too many messages wait for acks.");
+    }
+    case RELIABLE_PENDING: {
+      ThrowThis("Reliable channel has nothing to deliver yet.");
+    }
+    case PACKET_TOO_LARGE: {
+      ThrowThis("The payload doesn't fit into the packet.");
+    }
+    case PACKET_MALFORMED: {
+      ThrowThis("The packet is truncated or corrupted.");
+    }
+    case FRAGMENT_BUSY: {
+      ThrowThis("The previous large message is still being transferred.");
+    }
+    case FRAGMENT_NOT_READY: {
+      ThrowThis("There's no reassembled large message to take.");
+    }
+    case BITSTREAM_OUT_OF_RANGE: {
+      ThrowThis("BitWriter error; The value is outside of its range.");
+    }
+    case HUFFMAN_INVALID_TABLE: {
+      ThrowThis("HuffmanTableInit() error; The lengths aren't a prefix code.");
+    }
+    case SEND_THROTTLED: {
+      ThrowThis("The bandwidth budget of the client is spent.");
+    }
+    case SOCKET_RING: {
+      ThrowThis("SocketSetBackend() error; io_uring isn't available.");
+    }
+    case SOCKET_OFFLOAD: {
+      ThrowThis("SocketSetOffload() error; UDP offload isn't available.");
+    }
+    case INTEREST_OUT_OF_GRID: {
+      ThrowThis("The cell is outside of the interest grid.");
+    }
+    case SERVER_THREAD_START: {
+      ThrowThis("ThreadedServerStart() error; Thread creation failed.");
+    }
+    case EVENT_LOOP_TIMER_PERIOD: {
+      ThrowThis("EventLoopAddTimer() error; The period isn't positive.");
+    }
     default: {
       ThrowThis("Unhandled retcode!");
     }
@@ -0,0 +1,44 @@
+#include <assert.h>
+#include <stdint.h>
+
+#include "networking/pool.h"
+#include "panic.h"
+
+const size_t kPoolSize = 2;
+const uintptr_t kCacheLineSize = 64;
+
+BufferPool pool;
+Data data1;
+Data data2;
+Data data3;
+
+int main() {
+  Panic(BufferPoolInit(&pool, kPoolSize));
+  assert(BufferPoolHighWater(&pool) == 0);
+
+  Panic(BufferPoolAcquire(&pool, &data1));
+  Panic(BufferPoolAcquire(&pool, &data2));
+  assert(BufferPoolAcquire(&pool, &data3) == POOL_EXHAUSTED);
+  assert(data1.ptr != data2.ptr);
+  assert(data1.len == kDataLength);
+  assert((uintptr_t)data1.ptr % kCacheLineSize == 0);
+  assert((uintptr_t)data2.ptr % kCacheLineSize == 0);
+  assert(BufferPoolHighWater(&pool) == 2);
+
+  char* released = data2.ptr;
+  BufferPoolRelease(&pool, &data2);
+  Panic(BufferPoolAcquire(&pool, &data3));
+  assert(data3.ptr == released);
+  BufferPoolRelease(&pool, &data3);
+  BufferPoolRelease(&pool, &data1);
+  assert(BufferPoolHighWater(&pool) == 2);
+
+  Panic(BufferPoolResize(&pool, 3 * kPoolSize));
+  for (size_t i = 0; i < 3 * kPoolSize; ++i) {
+    Panic(BufferPoolAcquire(&pool, &data1));
+  }
+  assert(BufferPoolAcquire(&pool, &data1) == POOL_EXHAUSTED);
+  assert(BufferPoolHighWater(&pool) == 3 * kPoolSize);
+
+  BufferPoolDestroy(&pool);
+}
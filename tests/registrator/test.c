@@ -0,0 +1,102 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "panic.h"
+#include "server/registrator.h"
+
+const int kClients = 1000;
+
+Registrator registrator;
+RegistratorIter iter;
+Address addr;
+ConnectedClient* client;
+
+void MakeAddress(Address* addr, int number) {
+#ifdef __IPV4__
+  addr->ip = 0x7f000001u;
+  addr->port = 1024 + number;
+#else
+#error "Unsupported netcode"
+#endif
+}
+
+int CountClients() {
+  int count = 0;
+  Panic(RegistratorIterInit(&registrator, &iter));
+  while (!RegistratorIterStopped(&registrator, &iter)) {
+    ConnectedClient* current = RegistratorIterDereference(&registrator, &iter);
+    Panic(RegistratorGetUserByID(&registrator, current->client_id, &client));
+    assert(client == current);
+    ++count;
+    RegistratorIterNext(&registrator, &iter);
+  }
+  RegistratorIterDestroy(&iter);
+  return count;
+}
+
+int main() {
+  Panic(RegistratorInit(&registrator));
+  ConnectedClient* first = NULL;
+  for (int number = 0; number < kClients; ++number) {
+    MakeAddress(&addr, number);
+    Panic(RegistratorAddUser(&registrator, &addr, &client));
+    assert(client->client_id == number);
+    if (first == NULL) {
+      first = client;
+    }
+    // Records of a chunk are neighbours and never move.
+    if (number % kRegistratorChunkSize != 0) {
+      assert((char*)client - (char*)first ==
+             (ptrdiff_t)(number % kRegistratorChunkSize * registrator.stride));
+    } else {
+      first = client;
+    }
+    assert((uintptr_t)client % 64 == 0);
+  }
+  assert(CountClients() == kClients);
+  Panic(RegistratorGetUserByID(&registrator, kClients - 4, &client));
+  ConnectedClient* kept = client;
+  Response message;
+  Panic(ResponseInit(&message));
+  ResponseSetData(&message, "state");
+  Panic(ReliableEndpointSend(&kept->reliable, &message, 0));
+  Panic(SchedulerPut(&kept->scheduler, 1, 1, "update", 6));
+  char* slab = kept->reliable.slab;
+  SchedulerItem* items = kept->scheduler.items;
+
+  for (int number = 0; number < kClients; number += 2) {
+    MakeAddress(&addr, number);
+    RegistratorRemoveUserByAddress(&registrator, &addr);
+    assert(RegistratorGetUserByAddress(&registrator, &addr, &client) ==
+           SERVER_USER_NOT_FOUND);
+    assert(RegistratorGetUserByID(&registrator, number, &client) ==
+           SERVER_USER_NOT_FOUND);
+  }
+  assert(CountClients() == kClients / 2);
+  for (int number = 1; number < kClients; number += 2) {
+    MakeAddress(&addr, number);
+    Panic(RegistratorGetUserByAddress(&registrator, &addr, &client));
+    assert(client->client_id == number);
+  }
+
+  MakeAddress(&addr, kClients);
+  Panic(RegistratorAddUser(&registrator, &addr, &client));
+  assert(client->client_id == kClients - 2);
+  assert(CountClients() == kClients / 2 + 1);
+
+  // A reused ID gets the record it had before, with the buffers but without
+  // the state of the previous client.
+  MakeAddress(&addr, kClients + 1);
+  Panic(RegistratorAddUser(&registrator, &addr, &client));
+  assert(client->client_id == kClients - 4);
+  assert(client == kept);
+  assert(client->reliable.slab == slab);
+  assert(client->reliable.next_sequence == 0);
+  assert(!ReliableEndpointNextResend(&client->reliable, 1000, &message));
+  assert(client->scheduler.items == items);
+  assert(SchedulerPending(&client->scheduler) == 0);
+  ResponseDestroy(&message);
+
+  RegistratorDestroy(&registrator);
+}
@@ -0,0 +1,184 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "helpers.h"
+#include "networking/packet.h"
+#include "networking/reliable.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40733;
+const int kTimeoutTime = 1000;
+const int kMessages = 500;
+const uint32_t kLossPercent = 25;
+const uint64_t kTick = 5;
+const int kMaxTicks = 100000;
+
+ReliableEndpoint sender;
+ReliableEndpoint receiver;
+Response message;
+Response wire_response;
+Data wire;
+int delivered;
+
+void ExpectMessage(Response* response, int number) {
+  char text[32];
+  snprintf(text, sizeof(text), "message %d", number);
+  assert(ResponseGetType(response) == RELIABLE);
+  assert(response->data.len == strlen(text));
+  assert(strncmp(response->data.ptr, text, strlen(text)) == 0);
+}
+
+// Passes the packet through the lossy link, kLossPercent of them are dropped.
+void Transmit(ReliableEndpoint* from, ReliableEndpoint* to, Response* response,
+              uint64_t now) {
+  ReliableEndpointWriteAcks(from, response);
+  if (Random() % 100 < kLossPercent) {
+    return;
+  }
+  wire.len = kDataLength;
+  Panic(ResponseToData(response, &wire));
+  Panic(DataToResponse(&wire, &wire_response));
+  Panic(ReliableEndpointReceive(to, &wire_response, now));
+  assert((wire_response.flags & PACKET_HAS_ACKS) == 0);
+  while (ReliableEndpointPop(to, &wire_response)) {
+    ExpectMessage(&wire_response, delivered++);
+  }
+}
+
+void TestLossyLink() {
+  ReliableEndpointInit(&sender);
+  ReliableEndpointInit(&receiver);
+  char text[32];
+  int sent = 0;
+  uint64_t now = 0;
+  for (int tick = 0; tick < kMaxTicks && delivered < kMessages; ++tick) {
+    while (sent < kMessages) {
+      snprintf(text, sizeof(text), "message %d", sent);
+      ResponseSetData(&message, text);
+      RETCODE result = ReliableEndpointSend(&sender, &message, now);
+      if (result == RELIABLE_WINDOW_FULL) {
+        break;
+      }
+      Panic(result);
+      assert(message.sequence == sent);
+      Transmit(&sender, &receiver, &message, now);
+      ++sent;
+    }
+    Response view;
+    while (ReliableEndpointNextResend(&sender, now, &view)) {
+      Transmit(&sender, &receiver, &view, now);
+    }
+    if (receiver.acks_pending) {
+      ResponseSetType(&message, ACK);
+      message.data.len = 0;
+      Transmit(&receiver, &sender, &message, now);
+    }
+    now += kTick;
+  }
+  assert(delivered == kMessages);
+  // Let the last acks come through.
+  for (int tick = 0;
+       tick < kMaxTicks && sender.oldest_unacked != sender.next_sequence;
+       ++tick) {
+    Response view;
+    while (ReliableEndpointNextResend(&sender, now, &view)) {
+      Transmit(&sender, &receiver, &view, now);
+    }
+    ResponseSetType(&message, ACK);
+    message.data.len = 0;
+    Transmit(&receiver, &sender, &message, now);
+    now += kTick;
+  }
+  assert(sender.oldest_unacked == sender.next_sequence);
+  assert(delivered == kMessages);
+  assert(ReliableEndpointTimeout(&sender) >= kTick);
+  ReliableEndpointDestroy(&sender);
+  ReliableEndpointDestroy(&receiver);
+}
+
+void TestWindow() {
+  ReliableEndpointInit(&sender);
+  ResponseSetData(&message, "message");
+  for (uint16_t i = 0; i < kReliableWindow; ++i) {
+    Panic(ReliableEndpointSend(&sender, &message, 0));
+  }
+  assert(ReliableEndpointSend(&sender, &message, 0) == RELIABLE_WINDOW_FULL);
+  // Acking the first message frees one slot.
+  ReliableEndpointInit(&receiver);
+  message.sequence = 0;
+  Panic(ReliableEndpointReceive(&receiver, &message, 0));
+  ReliableEndpointWriteAcks(&receiver, &wire_response);
+  Panic(ReliableEndpointReceive(&sender, &wire_response, 1));
+  Panic(ReliableEndpointSend(&sender, &message, 1));
+  assert(ReliableEndpointSend(&sender, &message, 1) == RELIABLE_WINDOW_FULL);
+  ReliableEndpointDestroy(&sender);
+  ReliableEndpointDestroy(&receiver);
+}
+
+void TestServerClient() {
+  Address addr;
+  Server srv;
+  Client clt;
+  char text[32];
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientSetTimeout(&clt, kTimeoutTime));
+
+  for (int i = 0; i < 5; ++i) {
+    snprintf(text, sizeof(text), "message %d", i);
+    ResponseSetData(&message, text);
+    Panic(ClientSendReliable(&clt, &message));
+  }
+  for (int i = 0; i < 5; ++i) {
+    Panic(ServerReceive(&srv, &message));
+    assert(message.client_id == 0);
+    ExpectMessage(&message, i);
+  }
+
+  // Replies carry acks of the client messages.
+  for (int i = 0; i < 3; ++i) {
+    snprintf(text, sizeof(text), "message %d", i);
+    ResponseSetData(&message, text);
+    ResponseSetClientId(&message, 0);
+    Panic(ServerSendReliable(&srv, &message));
+  }
+  for (int i = 0; i < 3; ++i) {
+    Panic(ClientReceive(&clt, &message));
+    ExpectMessage(&message, i);
+  }
+  assert(clt.reliable.oldest_unacked == clt.reliable.next_sequence);
+
+  // Nothing else goes to the server, so the client sends a bare ack.
+  Panic(ClientUpdate(&clt));
+  assert(ServerReceive(&srv, &message) == RELIABLE_PENDING);
+  ConnectedClient* connected;
+  Panic(RegistratorGetUserByID(&srv.registrator, 0, &connected));
+  assert(connected->reliable.oldest_unacked ==
+         connected->reliable.next_sequence);
+
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  AddressDestroy(&addr);
+}
+
+int main() {
+  Panic(ResponseInit(&message));
+  Panic(ResponseInit(&wire_response));
+  Panic(DataInit(&wire));
+  TestWindow();
+  TestLossyLink();
+  TestServerClient();
+  ResponseDestroy(&message);
+  ResponseDestroy(&wire_response);
+  DataDestroy(&wire);
+}
@@ -0,0 +1,151 @@
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "common/clock.h"
+#include "networking/packet.h"
+#include "networking/socket.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kTestPacket[] = "hello world!";
+const int kPort = 40740;
+const int kTimeoutTime = 1000;
+const int kShortTimeout = 20;
+const int kEchoes = 100;
+// More than the ring has buffers, so the receive has to be rearmed.
+const int kBurst = 600;
+const int kSkipped = 77;
+#define kBatchSize 64
+
+Address addr;
+Server srv;
+Client ring_client;
+Client plain_client;
+Response response;
+Response batch[kBatchSize];
+
+void SendFrom(Client* client, int number) {
+  char payload[16];
+  snprintf(payload, sizeof(payload), "%d", number);
+  ResponseSetData(&response, payload);
+  Panic(ClientSend(client, &response));
+}
+
+void TestEcho() {
+  for (int i = 0; i < kEchoes; ++i) {
+    SendFrom(&ring_client, i);
+    Panic(ServerReceive(&srv, &response));
+    Panic(ServerSendTo(&srv, &response));
+    Panic(ClientReceive(&ring_client, &response));
+    char payload[16];
+    snprintf(payload, sizeof(payload), "%d", i);
+    assert(response.data.len == strlen(payload));
+    assert(memcmp(response.data.ptr, payload, response.data.len) == 0);
+  }
+}
+
+void TestBurst() {
+  for (int i = 0; i < kBurst; ++i) {
+    SendFrom(&plain_client, i);
+  }
+  int next = 0;
+  while (next < kBurst) {
+    size_t got;
+    Panic(ServerReceiveBatch(&srv, batch, kBatchSize, &got));
+    assert(got != 0);
+    for (size_t i = 0; i < got; ++i, ++next) {
+      // Datagrams of one sender keep their order on loopback.
+      char payload[16];
+      snprintf(payload, sizeof(payload), "%d", next);
+      assert(batch[i].data.len == strlen(payload));
+      assert(memcmp(batch[i].data.ptr, payload, batch[i].data.len) == 0);
+    }
+  }
+}
+
+void TestBroadcast() {
+  ResponseSetData(&response, kTestPacket);
+  Panic(ServerSend(&srv, &response));
+  Panic(ClientReceive(&ring_client, &response));
+  assert(response.data.len == sizeof(kTestPacket) - 1);
+  Panic(ClientReceive(&plain_client, &response));
+  assert(response.data.len == sizeof(kTestPacket) - 1);
+  assert(SocketSendErrors(&srv.socket) == 0);
+}
+
+void TestTimeouts() {
+  Panic(ServerSetTimeout(&srv, kShortTimeout));
+  uint64_t start = ClockNow();
+  assert(ServerReceive(&srv, &response) == SOCKET_TIMEOUT);
+  assert(ClockNow() - start >= (uint64_t)kShortTimeout - 1);
+
+  Panic(ServerMakeNonBlocking(&srv));
+  assert(ServerReceive(&srv, &response) == SOCKET_TIMEOUT);
+  // The ring, not the socket, signals incoming packets.
+  SendFrom(&plain_client, 0);
+  struct pollfd fd = {.fd = SocketPollFd(&srv.socket), .events = POLLIN};
+  assert(fd.fd != srv.socket.socket_fd);
+  assert(poll(&fd, 1, kTimeoutTime) == 1);
+  Panic(ServerReceive(&srv, &response));
+  assert(ServerReceive(&srv, &response) == SOCKET_TIMEOUT);
+}
+
+void TestSwitchBack() {
+  Panic(ServerSetBackend(&srv, SOCKET_BACKEND_SYSCALL));
+  assert(SocketGetBackend(&srv.socket) == SOCKET_BACKEND_SYSCALL);
+  assert(SocketPollFd(&srv.socket) == srv.socket.socket_fd);
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  SendFrom(&ring_client, 1);
+  struct pollfd fd = {.fd = SocketPollFd(&srv.socket), .events = POLLIN};
+  assert(poll(&fd, 1, kTimeoutTime) == 1);
+  Panic(ServerReceive(&srv, &response));
+  Panic(ServerSendTo(&srv, &response));
+  Panic(ClientReceive(&ring_client, &response));
+}
+
+int main() {
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  RETCODE result = ServerSetBackend(&srv, SOCKET_BACKEND_IO_URING);
+  if (result == SOCKET_RING) {
+    printf("io_uring isn't available, skipping\n");
+    ServerDestroy(&srv);
+    return kSkipped;
+  }
+  Panic(result);
+  assert(SocketGetBackend(&srv.socket) == SOCKET_BACKEND_IO_URING);
+  Panic(ClientInit(&ring_client, &addr));
+  Panic(ClientSetBackend(&ring_client, SOCKET_BACKEND_IO_URING));
+  Panic(ClientInit(&plain_client, &addr));
+  Panic(ClientSetBackend(&plain_client, SOCKET_BACKEND_SYSCALL));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientSetTimeout(&ring_client, kTimeoutTime));
+  Panic(ClientSetTimeout(&plain_client, kTimeoutTime));
+  Panic(ResponseInit(&response));
+  for (int i = 0; i < kBatchSize; ++i) {
+    Panic(ResponseInit(&batch[i]));
+  }
+
+  TestEcho();
+  TestBurst();
+  TestBroadcast();
+  TestTimeouts();
+  TestSwitchBack();
+
+  for (int i = 0; i < kBatchSize; ++i) {
+    ResponseDestroy(&batch[i]);
+  }
+  ResponseDestroy(&response);
+  ServerDestroy(&srv);
+  ClientDestroy(&ring_client);
+  ClientDestroy(&plain_client);
+  AddressDestroy(&addr);
+}
@@ -0,0 +1,194 @@
+#include <assert.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "networking/packet.h"
+#include "networking/scheduler.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40743;
+const int kTimeoutTime = 1000;
+const int kTicks = 1000;
+const uint32_t kKeys = 1000;
+
+Scheduler scheduler;
+Response response;
+
+void Put(uint32_t key, uint32_t priority, const char* str) {
+  Panic(SchedulerPut(&scheduler, key, priority, str, strlen(str)));
+}
+
+// Takes the next update and checks its payload.
+void Expect(size_t budget, const char* str) {
+  assert(SchedulerNext(&scheduler, budget, &response));
+  assert(response.data.len == strlen(str));
+  assert(memcmp(response.data.ptr, str, response.data.len) == 0);
+}
+
+void TestOrder() {
+  SchedulerInit(&scheduler);
+  Put(1, 10, "first");
+  Put(2, 1, "third");
+  Put(3, 5, "second");
+  assert(SchedulerPending(&scheduler) == 3);
+  Panic(SchedulerTick(&scheduler));
+  Expect(kMaxPayload, "first");
+  Expect(kMaxPayload, "second");
+  Expect(kMaxPayload, "third");
+  assert(!SchedulerNext(&scheduler, kMaxPayload, &response));
+  assert(SchedulerPending(&scheduler) == 0);
+  SchedulerDestroy(&scheduler);
+}
+
+void TestBudget() {
+  char large[100];
+  memset(large, 'x', sizeof(large));
+  SchedulerInit(&scheduler);
+  Panic(SchedulerPut(&scheduler, 1, 10, large, sizeof(large)));
+  Put(2, 1, "small");
+  // The large update doesn't fit, the small one behind it does.
+  Panic(SchedulerTick(&scheduler));
+  Expect(50, "small");
+  assert(!SchedulerNext(&scheduler, 50, &response));
+  assert(SchedulerPending(&scheduler) == 1);
+  Panic(SchedulerTick(&scheduler));
+  assert(SchedulerNext(&scheduler, sizeof(large), &response));
+  assert(response.data.len == sizeof(large));
+  SchedulerDestroy(&scheduler);
+}
+
+void TestStarvation() {
+  SchedulerInit(&scheduler);
+  int sent[2] = {0};
+  // Both keys are updated every tick, but only one update fits.
+  for (int tick = 0; tick < kTicks; ++tick) {
+    Put(1, 100, "a");
+    Put(2, 1, "b");
+    Panic(SchedulerTick(&scheduler));
+    assert(SchedulerNext(&scheduler, 1, &response));
+    assert(!SchedulerNext(&scheduler, 0, &response));
+    ++sent[response.data.ptr[0] - 'a'];
+  }
+  // The low priority key catches up once every 101 ticks.
+  assert(sent[1] >= kTicks / 101);
+  assert(sent[0] > sent[1]);
+  SchedulerDestroy(&scheduler);
+}
+
+void TestReplace() {
+  SchedulerInit(&scheduler);
+  Put(1, 3, "old");
+  Put(2, 2, "other");
+  Panic(SchedulerTick(&scheduler));
+  Panic(SchedulerTick(&scheduler));
+  // The replaced update keeps 6 and gets 1 more, the other one has 6.
+  Put(1, 1, "new");
+  assert(SchedulerPending(&scheduler) == 2);
+  Panic(SchedulerTick(&scheduler));
+  Expect(kMaxPayload, "new");
+  Expect(kMaxPayload, "other");
+  SchedulerDestroy(&scheduler);
+}
+
+void TestRemove() {
+  SchedulerInit(&scheduler);
+  SchedulerRemove(&scheduler, 1);
+  Put(1, 1, "removed");
+  Put(2, 1, "kept");
+  SchedulerRemove(&scheduler, 1);
+  assert(SchedulerPending(&scheduler) == 1);
+  Panic(SchedulerTick(&scheduler));
+  Expect(kMaxPayload, "kept");
+  assert(!SchedulerNext(&scheduler, kMaxPayload, &response));
+  // Removal in the middle of a tick.
+  Put(1, 2, "first");
+  Put(2, 1, "second");
+  Panic(SchedulerTick(&scheduler));
+  SchedulerRemove(&scheduler, 1);
+  Expect(kMaxPayload, "second");
+  assert(!SchedulerNext(&scheduler, kMaxPayload, &response));
+  assert(SchedulerPut(&scheduler, 3, 1, response.data.ptr, kMaxPayload + 1) ==
+         PACKET_TOO_LARGE);
+  SchedulerDestroy(&scheduler);
+}
+
+void TestMany() {
+  SchedulerInit(&scheduler);
+  for (uint32_t key = 0; key < kKeys; ++key) {
+    Panic(SchedulerPut(&scheduler, key, key, (const char*)&key, sizeof(key)));
+  }
+  for (uint32_t key = 0; key < kKeys; key += 2) {
+    SchedulerRemove(&scheduler, key);
+  }
+  assert(SchedulerPending(&scheduler) == kKeys / 2);
+  Panic(SchedulerTick(&scheduler));
+  // Odd keys from the largest priority.
+  for (uint32_t key = kKeys - 1; key < kKeys; key -= 2) {
+    assert(SchedulerNext(&scheduler, kMaxPayload, &response));
+    uint32_t got;
+    memcpy(&got, response.data.ptr, sizeof(got));
+    assert(got == key);
+  }
+  assert(SchedulerPending(&scheduler) == 0);
+  // Slots of the sent updates are reclaimed and the keys can come back.
+  Panic(SchedulerTick(&scheduler));
+  assert(scheduler.count == 0);
+  for (uint32_t key = 0; key < kKeys; ++key) {
+    Panic(SchedulerPut(&scheduler, key, 1, (const char*)&key, sizeof(key)));
+  }
+  assert(SchedulerPending(&scheduler) == kKeys);
+  SchedulerDestroy(&scheduler);
+}
+
+void TestServer() {
+  Address addr;
+  Server srv;
+  Client client;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientInit(&client, &addr));
+  Panic(ClientSetTimeout(&client, kTimeoutTime));
+  ResponseSetData(&response, "hello");
+  Panic(ClientSend(&client, &response));
+  Panic(ServerReceive(&srv, &response));
+  assert(ServerEnqueue(&srv, 1, 0, 1, &response) == SERVER_USER_NOT_FOUND);
+
+  // One update per ServerUpdate(), the important one first.
+  ServerSetScheduleBudget(&srv, strlen("important"));
+  ResponseSetData(&response, "minor");
+  Panic(ServerEnqueue(&srv, 0, 1, 1, &response));
+  ResponseSetData(&response, "important");
+  Panic(ServerEnqueue(&srv, 0, 2, 10, &response));
+  Panic(ServerUpdate(&srv));
+  Panic(ClientReceive(&client, &response));
+  assert(memcmp(response.data.ptr, "important", 9) == 0);
+  Panic(ServerUpdate(&srv));
+  Panic(ClientReceive(&client, &response));
+  assert(memcmp(response.data.ptr, "minor", 5) == 0);
+  Panic(ServerUpdate(&srv));
+  Panic(ClientSetTimeout(&client, 10));
+  assert(ClientReceive(&client, &response) == SOCKET_TIMEOUT);
+
+  ClientDestroy(&client);
+  ServerDestroy(&srv);
+  AddressDestroy(&addr);
+}
+
+int main() {
+  Panic(ResponseInit(&response));
+  TestOrder();
+  TestBudget();
+  TestStarvation();
+  TestReplace();
+  TestRemove();
+  TestMany();
+  TestServer();
+  ResponseDestroy(&response);
+}
@@ -0,0 +1,110 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "server/sharded.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kReplyPacket[] = "hello client!";
+const int kPort = 40517;
+const int kTimeoutTime = 1000;
+const size_t kShards = 4;
+#define kClients 8
+#define kRounds 4
+
+Address addr;
+ShardedServer srv;
+Client clients[kClients];
+Response response;
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+uint32_t client_ids[kClients];
+int packets[kClients];
+int connects;
+
+void OnPacket(ShardedServer* srv, uint32_t client, Response* response,
+              void* user_data) {
+  (void)user_data;
+  int number = -1;
+  sscanf(response->data.ptr, "client %d", &number);
+  assert(number >= 0 && number < kClients);
+  pthread_mutex_lock(&lock);
+  // Every packet of a client must land on the same shard with the same ID.
+  if (packets[number]++ == 0) {
+    client_ids[number] = client;
+  }
+  assert(client_ids[number] == client);
+  pthread_mutex_unlock(&lock);
+  ResponseSetData(response, kReplyPacket);
+  Panic(ShardedServerPost(srv, client, response));
+}
+
+void OnConnect(ShardedServer* srv, uint32_t client, void* user_data) {
+  assert(user_data == srv);
+  assert((client >> 16) < kShards);
+  pthread_mutex_lock(&lock);
+  ++connects;
+  pthread_mutex_unlock(&lock);
+}
+
+int main() {
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  ShardedCallbacks callbacks = {.on_packet = OnPacket,
+                                .on_connect = OnConnect};
+  assert(ShardedServerInit(&srv, &addr, 0, &callbacks, &srv) ==
+         SERVER_SHARD_START);
+  ShardedServerDestroy(&srv);
+  Panic(ShardedServerInit(&srv, &addr, kShards, &callbacks, &srv));
+  Panic(ShardedServerStart(&srv));
+  Panic(ResponseInit(&response));
+  for (int i = 0; i < kClients; ++i) {
+    Panic(ClientInit(&clients[i], &addr));
+    Panic(ClientSetTimeout(&clients[i], kTimeoutTime));
+  }
+
+  char text[32];
+  for (int round = 0; round < kRounds; ++round) {
+    for (int i = 0; i < kClients; ++i) {
+      snprintf(text, sizeof(text), "client %d", i);
+      ResponseSetData(&response, text);
+      Panic(ClientSend(&clients[i], &response));
+      Panic(ClientReceive(&clients[i], &response));
+      assert(strncmp(response.data.ptr, kReplyPacket, strlen(kReplyPacket)) ==
+             0);
+    }
+  }
+  pthread_mutex_lock(&lock);
+  assert(connects == kClients);
+  for (int i = 0; i < kClients; ++i) {
+    assert(packets[i] == kRounds);
+  }
+  pthread_mutex_unlock(&lock);
+
+  // A shard that doesn't exist.
+  assert(ShardedServerPost(&srv, ShardedClientId(kShards, 0), &response) ==
+         SERVER_USER_NOT_FOUND);
+
+  // Broadcast reaches every client whatever shard it lives on.
+  ResponseSetData(&response, kReplyPacket);
+  Panic(ShardedServerPostAll(&srv, &response));
+  for (int i = 0; i < kClients; ++i) {
+    Panic(ClientReceive(&clients[i], &response));
+    assert(strncmp(response.data.ptr, kReplyPacket, strlen(kReplyPacket)) ==
+           0);
+  }
+
+  ShardedServerStop(&srv);
+  for (int i = 0; i < kClients; ++i) {
+    ClientDestroy(&clients[i]);
+  }
+  ResponseDestroy(&response);
+  ShardedServerDestroy(&srv);
+  AddressDestroy(&addr);
+}
@@ -0,0 +1,162 @@
+#include <assert.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "helpers.h"
+#include "networking/bitstream.h"
+#include "networking/packet.h"
+#include "networking/snapshot.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40735;
+const int kTimeoutTime = 1000;
+const size_t kGridSize = 400;
+const int kTicks = 1000;
+const int kChangesPerTick = 4;
+const uint32_t kLossPercent = 10;
+
+SnapshotChannel sender;
+SnapshotChannel receiver;
+Response message;
+Response wire_response;
+Data wire;
+char grid[400];
+char history[1000][400];
+
+// Moves a few units around the tile grid.
+void Tick() {
+  for (int i = 0; i < kChangesPerTick; ++i) {
+    grid[Random() % kGridSize] = (char)Random();
+  }
+}
+
+// Passes the packet through the lossy link, kLossPercent of them are dropped.
+RETCODE Transmit(SnapshotChannel* to, Response* response) {
+  if (Random() % 100 < kLossPercent) {
+    return SOCKET_TIMEOUT;
+  }
+  wire.len = kDataLength;
+  Panic(ResponseToData(response, &wire));
+  Panic(DataToResponse(&wire, &wire_response));
+  return SnapshotChannelReceive(to, &wire_response);
+}
+
+// Writes the snapshot header the way the sender does.
+void WriteHeader(uint16_t sequence, uint16_t baseline) {
+  BitWriter writer;
+  BitWriterInit(&writer, message.data.ptr, kSnapshotHeaderSize);
+  Panic(BitWriterWriteBits(&writer, sequence, 16));
+  Panic(BitWriterWriteBits(&writer, baseline, 16));
+  assert(BitWriterFlush(&writer) == kSnapshotHeaderSize);
+}
+
+void TestLossyLink() {
+  SnapshotChannelInit(&sender);
+  SnapshotChannelInit(&receiver);
+  size_t raw_bytes = 0;
+  size_t sent_bytes = 0;
+  int decoded = 0;
+  for (int tick = 0; tick < kTicks; ++tick) {
+    Tick();
+    memcpy(history[tick], grid, kGridSize);
+    memcpy(message.data.ptr, grid, kGridSize);
+    message.data.len = kGridSize;
+    Panic(SnapshotChannelEncode(&sender, &message));
+    assert(ResponseGetType(&message) == SNAPSHOT);
+    raw_bytes += kGridSize;
+    sent_bytes += message.data.len;
+    RETCODE result = Transmit(&receiver, &message);
+    if (result == SUCCESS) {
+      assert(wire_response.data.len == kGridSize);
+      assert(memcmp(wire_response.data.ptr, history[tick], kGridSize) == 0);
+      ++decoded;
+    } else {
+      assert(result == SOCKET_TIMEOUT);
+    }
+    if (SnapshotChannelNextAck(&receiver, &message)) {
+      result = Transmit(&sender, &message);
+      assert(result == RELIABLE_PENDING || result == SOCKET_TIMEOUT);
+    }
+  }
+  assert(decoded > kTicks * 8 / 10);
+  // Only a few tiles change per tick, the deltas are tiny.
+  assert(sent_bytes * 10 < raw_bytes);
+
+  // A snapshot older than the newest one is stale.
+  assert(SnapshotChannelReceive(&receiver, &wire_response) ==
+         RELIABLE_PENDING);
+
+  // The baseline which left the history can't be used.
+  WriteHeader(receiver.newest + 1, receiver.newest - kSnapshotHistory);
+  message.data.len = kSnapshotHeaderSize + 1;
+  ResponseSetType(&message, SNAPSHOT);
+  assert(SnapshotChannelReceive(&receiver, &message) == RELIABLE_PENDING);
+  // Runs past the end of the snapshot are rejected.
+  WriteHeader(receiver.newest + 1, receiver.newest);
+  char delta[] = {4, 3, 1, 1, 1};
+  memcpy(message.data.ptr + kSnapshotHeaderSize, delta, sizeof(delta));
+  message.data.len = kSnapshotHeaderSize + sizeof(delta);
+  assert(SnapshotChannelReceive(&receiver, &message) == PACKET_MALFORMED);
+
+  message.data.len = kMaxPayload;
+  assert(SnapshotChannelEncode(&sender, &message) == PACKET_TOO_LARGE);
+  SnapshotChannelDestroy(&sender);
+  SnapshotChannelDestroy(&receiver);
+}
+
+void TestServerClient() {
+  Address addr;
+  Server srv;
+  Client clt;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientSetTimeout(&clt, kTimeoutTime));
+
+  ResponseSetData(&message, "hello");
+  Panic(ClientSend(&clt, &message));
+  Panic(ServerReceive(&srv, &message));
+
+  memset(grid, 0, kGridSize);
+  for (int tick = 0; tick < 10; ++tick) {
+    Tick();
+    memcpy(message.data.ptr, grid, kGridSize);
+    message.data.len = kGridSize;
+    ResponseSetClientId(&message, 0);
+    Panic(ServerSendSnapshot(&srv, &message));
+    assert(message.data.len == kGridSize);
+    if (tick == 0) {
+      assert(srv.scratch.data.len == kSnapshotHeaderSize + kGridSize);
+    } else {
+      assert(srv.scratch.data.len < kGridSize / 10);
+    }
+    Panic(ClientReceive(&clt, &message));
+    assert(ResponseGetType(&message) == SNAPSHOT);
+    assert(message.data.len == kGridSize);
+    assert(memcmp(message.data.ptr, grid, kGridSize) == 0);
+    Panic(ClientUpdate(&clt));
+    assert(ServerReceive(&srv, &message) == RELIABLE_PENDING);
+  }
+
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  AddressDestroy(&addr);
+}
+
+int main() {
+  Panic(ResponseInit(&message));
+  Panic(ResponseInit(&wire_response));
+  Panic(DataInit(&wire));
+  TestLossyLink();
+  TestServerClient();
+  ResponseDestroy(&message);
+  ResponseDestroy(&wire_response);
+  DataDestroy(&wire);
+}
@@ -0,0 +1,170 @@
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "common/stats.h"
+#include "networking/pacer.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const char kTestPacket[] = "hello world!";
+const int kPort = 40739;
+const int kTimeoutTime = 1000;
+const int kShortTimeout = 5;
+const int kPackets = 100;
+const uint64_t kValues = 100000;
+
+Stats stats;
+Server srv;
+Client clt;
+Response response;
+int watching = 1;
+
+// Relative error of a percentile is below 1 / kStatsSubBuckets.
+void AssertClose(uint64_t value, uint64_t expected) {
+  assert(value >= expected);
+  assert(value - expected <= expected / kStatsSubBuckets);
+}
+
+void TestHistogram() {
+  StatsInit(&stats);
+  StatsSnapshot snapshot;
+  StatsTake(&stats, &snapshot);
+  assert(StatsPercentile(&snapshot.latency, 50) == 0);
+  for (uint64_t value = 1; value <= kValues; ++value) {
+    StatsRecord(&stats, value);
+  }
+  StatsTake(&stats, &snapshot);
+  assert(snapshot.latency.count == kValues);
+  assert(snapshot.latency.sum == kValues * (kValues + 1) / 2);
+  assert(snapshot.latency.max == kValues);
+  AssertClose(StatsPercentile(&snapshot.latency, 50), kValues / 2);
+  AssertClose(StatsPercentile(&snapshot.latency, 99), kValues * 99 / 100);
+  AssertClose(StatsPercentile(&snapshot.latency, 99.9), kValues * 999 / 1000);
+  assert(StatsPercentile(&snapshot.latency, 100) == kValues);
+  // Small values are exact, huge ones land in the last bucket.
+  StatsInit(&stats);
+  StatsRecord(&stats, 3);
+  StatsTake(&stats, &snapshot);
+  assert(StatsPercentile(&snapshot.latency, 50) == 3);
+  StatsRecord(&stats, UINT64_MAX);
+  StatsTake(&stats, &snapshot);
+  assert(snapshot.latency.buckets[kStatsBuckets - 1] == 1);
+  assert(StatsPercentile(&snapshot.latency, 100) == UINT64_MAX);
+
+  StatsInit(&stats);
+  StatsAdd(&stats.counters.packets_in, 2);
+  StatsRecord(&stats, 10);
+  StatsTake(&stats, &snapshot);
+  StatsSnapshot total = snapshot;
+  StatsMerge(&total, &snapshot);
+  assert(total.counters.packets_in == 4);
+  assert(total.latency.count == 2);
+  assert(total.latency.buckets[10] == 2);
+}
+
+// Snapshots taken while the server works never go backwards.
+void* Watch(void* arg) {
+  (void)arg;
+  StatsSnapshot previous = {0};
+  StatsSnapshot snapshot;
+  while (__atomic_load_n(&watching, __ATOMIC_ACQUIRE)) {
+    ServerGetStats(&srv, &snapshot);
+    assert(snapshot.counters.packets_in >= previous.counters.packets_in);
+    assert(snapshot.counters.bytes_out >= previous.counters.bytes_out);
+    assert(snapshot.latency.count >= previous.latency.count);
+    previous = snapshot;
+  }
+  return NULL;
+}
+
+void TestCounters() {
+  pthread_t watcher;
+  assert(pthread_create(&watcher, NULL, Watch, NULL) == 0);
+  size_t wire = 0;
+  for (int i = 0; i < kPackets; ++i) {
+    ResponseSetData(&response, kTestPacket);
+    Panic(ClientSend(&clt, &response));
+    Panic(ServerReceive(&srv, &response));
+    Data data;
+    Panic(DataInit(&data));
+    Panic(ResponseToData(&response, &data));
+    wire += data.len;
+    DataDestroy(&data);
+    Panic(ServerSendTo(&srv, &response));
+    Panic(ClientReceive(&clt, &response));
+  }
+  __atomic_store_n(&watching, 0, __ATOMIC_RELEASE);
+  pthread_join(watcher, NULL);
+
+  StatsSnapshot server;
+  StatsSnapshot client;
+  ServerGetStats(&srv, &server);
+  ClientGetStats(&clt, &client);
+  assert(server.counters.packets_in == (uint64_t)kPackets);
+  assert(server.counters.packets_out == (uint64_t)kPackets);
+  assert(server.counters.bytes_in == wire);
+  assert(server.counters.connects == 1);
+  assert(server.counters.disconnects == 0);
+  assert(server.counters.malformed == 0);
+  assert(server.latency.count == 2 * (uint64_t)kPackets);
+  assert(client.counters.packets_in == (uint64_t)kPackets);
+  assert(client.counters.packets_out == (uint64_t)kPackets);
+  assert(client.counters.bytes_out == server.counters.bytes_in);
+  assert(client.counters.bytes_in == server.counters.bytes_out);
+  assert(client.latency.count == 2 * (uint64_t)kPackets);
+  assert(StatsPercentile(&server.latency, 50) > 0);
+
+  StatsLink link;
+  Panic(ServerGetClientStats(&srv, response.client_id, &link));
+  assert(link.loss == 0);
+  assert(link.bandwidth == kPacerInitialRate);
+  assert(ServerGetClientStats(&srv, response.client_id + 1, &link) ==
+         SERVER_USER_NOT_FOUND);
+  ClientGetLinkStats(&clt, &link);
+  assert(link.loss == 0);
+  assert(link.bandwidth == 0);
+}
+
+void TestErrors(Address* addr) {
+  // A packet too short for a header.
+  Socket sock;
+  Panic(SocketInit(&sock));
+  char garbage[1] = {0x7f};
+  Data data = {.ptr = garbage, .len = sizeof(garbage)};
+  Panic(SocketSend(&sock, &data, addr));
+  SocketDestroy(&sock);
+  assert(ServerReceive(&srv, &response) == PACKET_MALFORMED);
+
+  Panic(ServerSetTimeout(&srv, kShortTimeout));
+  assert(ServerReceive(&srv, &response) == SOCKET_TIMEOUT);
+  StatsSnapshot server;
+  ServerGetStats(&srv, &server);
+  assert(server.counters.malformed == 1);
+  assert(server.counters.receive_timeouts == 1);
+  assert(server.counters.packets_in == (uint64_t)kPackets + 1);
+}
+
+int main() {
+  TestHistogram();
+
+  Address addr;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ClientInit(&clt, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientSetTimeout(&clt, kTimeoutTime));
+  Panic(ResponseInit(&response));
+  TestCounters();
+  TestErrors(&addr);
+  ResponseDestroy(&response);
+  ServerDestroy(&srv);
+  ClientDestroy(&clt);
+  AddressDestroy(&addr);
+}
@@ -0,0 +1,195 @@
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "client/client.h"
+#include "common/clock.h"
+#include "common/spsc_queue.h"
+#include "networking/packet.h"
+#include "panic.h"
+#include "server/threaded.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40746;
+const int kTimeoutTime = 1000;
+const uint64_t kIdleTimeout = 50;
+const uint32_t kValues = 100000;
+const size_t kStressCapacity = 64;
+const size_t kMaxChunk = 7;
+
+SpscQueue queue;
+Response response;
+
+void TestQueue() {
+  Panic(SpscQueueInit(&queue, 5, sizeof(uint32_t)));
+  // The capacity is rounded up and neighbour slots are a cache line apart.
+  assert(SpscQueueWritable(&queue) == 8);
+  assert(SpscQueueReadable(&queue) == 0);
+  assert((char*)SpscQueueSlotToWrite(&queue, 1) -
+             (char*)SpscQueueSlotToWrite(&queue, 0) ==
+         64);
+  uint32_t next = 0;
+  uint32_t expected = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    *(uint32_t*)SpscQueueSlotToWrite(&queue, i) = next++;
+  }
+  SpscQueuePush(&queue, 3);
+  // The indexes wrap around the slots several times.
+  for (int round = 0; round < 10; ++round) {
+    assert(SpscQueueWritable(&queue) == 5);
+    for (size_t i = 0; i < 5; ++i) {
+      *(uint32_t*)SpscQueueSlotToWrite(&queue, i) = next++;
+    }
+    assert(SpscQueueReadable(&queue) == 3);
+    SpscQueuePush(&queue, 5);
+    assert(SpscQueueReadable(&queue) == 8);
+    assert(SpscQueueWritable(&queue) == 0);
+    for (size_t i = 0; i < 5; ++i) {
+      assert(*(uint32_t*)SpscQueueSlotToRead(&queue, i) == expected++);
+    }
+    SpscQueuePop(&queue, 5);
+  }
+  SpscQueuePush(&queue, 5);
+  assert(SpscQueueWritable(&queue) == 0);
+  assert(SpscQueueReadable(&queue) == 8);
+  SpscQueueDestroy(&queue);
+  SpscQueueDestroy(&queue);
+}
+
+void* Produce(void* arg) {
+  (void)arg;
+  uint32_t next = 0;
+  size_t chunk = 1;
+  while (next < kValues) {
+    size_t count = SpscQueueWritable(&queue);
+    if (count == 0) {
+      // The consumer may share the core.
+      sched_yield();
+      continue;
+    }
+    if (count > chunk) {
+      count = chunk;
+    }
+    if (count > kValues - next) {
+      count = kValues - next;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      *(uint32_t*)SpscQueueSlotToWrite(&queue, i) = next++;
+    }
+    SpscQueuePush(&queue, count);
+    chunk = chunk % kMaxChunk + 1;
+  }
+  return NULL;
+}
+
+void TestStress() {
+  Panic(SpscQueueInit(&queue, kStressCapacity, sizeof(uint32_t)));
+  pthread_t producer;
+  assert(pthread_create(&producer, NULL, Produce, NULL) == 0);
+  uint32_t expected = 0;
+  while (expected < kValues) {
+    size_t count = SpscQueueReadable(&queue);
+    assert(count <= kStressCapacity);
+    if (count == 0) {
+      sched_yield();
+      continue;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      assert(*(uint32_t*)SpscQueueSlotToRead(&queue, i) == expected++);
+    }
+    SpscQueuePop(&queue, count);
+  }
+  pthread_join(producer, NULL);
+  assert(SpscQueueReadable(&queue) == 0);
+  SpscQueueDestroy(&queue);
+}
+
+// Waits on the game thread for the next response of the network thread.
+RETCODE Receive(ThreadedServer* srv) {
+  uint64_t start = ClockNow();
+  RETCODE result;
+  while ((result = ThreadedServerReceive(srv, &response)) == SOCKET_TIMEOUT &&
+         ClockNow() - start < (uint64_t)kTimeoutTime) {
+    usleep(1000);
+  }
+  return result;
+}
+
+void TestServer() {
+  Address addr;
+  ThreadedServer srv;
+  Client client;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ThreadedServerInit(&srv, &addr));
+  ServerSetIdleTimeout(&srv.server, kIdleTimeout);
+  Panic(ThreadedServerStart(&srv));
+  Panic(ClientInit(&client, &addr));
+  Panic(ClientSetTimeout(&client, kTimeoutTime));
+  ClientSetKeepAlive(&client, 0);
+  assert(ThreadedServerReceive(&srv, &response) == SOCKET_TIMEOUT);
+
+  ResponseSetData(&response, "hello");
+  Panic(ClientSend(&client, &response));
+  Panic(Receive(&srv));
+  assert(response.client_id == 0);
+  assert(memcmp(response.data.ptr, "hello", 5) == 0);
+
+  ResponseSetData(&response, "plain");
+  Panic(ThreadedServerSend(&srv, &response));
+  Panic(ClientReceive(&client, &response));
+  assert(memcmp(response.data.ptr, "plain", 5) == 0);
+  ResponseSetData(&response, "reliable");
+  Panic(ThreadedServerSendReliable(&srv, &response));
+  Panic(ClientReceive(&client, &response));
+  assert(ResponseGetType(&response) == RELIABLE);
+  assert(memcmp(response.data.ptr, "reliable", 8) == 0);
+  ResponseSetData(&response, "everyone");
+  Panic(ThreadedServerBroadcast(&srv, &response));
+  Panic(ClientReceive(&client, &response));
+  assert(memcmp(response.data.ptr, "everyone", 8) == 0);
+  response.data.len = kMaxPayload + 1;
+  assert(ThreadedServerSend(&srv, &response) == PACKET_TOO_LARGE);
+
+  // The silent client is evicted and the game thread learns about it.
+  while (Receive(&srv) == SUCCESS &&
+         ResponseGetType(&response) != DISCONNECT) {
+  }
+  assert(ResponseGetType(&response) == DISCONNECT);
+  assert(response.client_id == 0);
+  assert(response.data.len == 0);
+
+  // Responses wait for the network thread while it's stopped.
+  ThreadedServerStop(&srv);
+  ResponseSetClientId(&response, 0);
+  ResponseSetData(&response, "queued");
+  size_t queued = 0;
+  RETCODE result;
+  while ((result = ThreadedServerSend(&srv, &response)) == SUCCESS) {
+    ++queued;
+  }
+  assert(result == POOL_EXHAUSTED);
+  assert(queued >= 1000);
+  StatsSnapshot stats;
+  ThreadedServerGetStats(&srv, &stats);
+  assert(stats.counters.connects == 1);
+  assert(stats.counters.disconnects == 1);
+
+  ClientDestroy(&client);
+  ThreadedServerDestroy(&srv);
+  ThreadedServerDestroy(&srv);
+  AddressDestroy(&addr);
+}
+
+int main() {
+  Panic(ResponseInit(&response));
+  TestQueue();
+  TestStress();
+  TestServer();
+  ResponseDestroy(&response);
+}
@@ -0,0 +1,198 @@
+#include <assert.h>
+#include <string.h>
+
+#include "client/client.h"
+#include "networking/huffman.h"
+#include "networking/packet.h"
+#include "networking/pool.h"
+#include "panic.h"
+#include "server/server.h"
+
+const char kLocalHost[] = "127.0.0.1";
+const int kPort = 40745;
+const int kTimeoutTime = 1000;
+
+Response response;
+
+// Checks the pointer is inside the slab of the pool.
+int InPool(BufferPool* pool, const char* ptr) {
+  return ptr >= pool->slab && ptr < pool->slab + pool->capacity * pool->stride;
+}
+
+// Checks the pointer is past the start of a buffer, i.e. past the header.
+int InPlace(BufferPool* pool, const char* ptr) {
+  return (size_t)(ptr - pool->slab) % pool->stride != 0;
+}
+
+void AssertPayload(Response* got, const char* str) {
+  assert(got->data.len == strlen(str));
+  assert(memcmp(got->data.ptr, str, got->data.len) == 0);
+}
+
+void TestPacket() {
+  Data data;
+  Panic(DataInit(&data));
+  ResponseSetType(&response, CONNECT);
+  ResponseSetData(&response, "payload");
+  response.flags = 0;
+  Panic(ResponseToData(&response, &data));
+  Response view;
+  Panic(DataToResponseView(&data, &view));
+  assert(view.data.ptr > data.ptr && view.data.ptr < data.ptr + data.len);
+  AssertPayload(&view, "payload");
+  assert(ResponseGetType(&view) == CONNECT);
+  // The payload is shorter than the header says.
+  Data cut = {.ptr = data.ptr, .len = data.len - 1};
+  assert(DataToResponseView(&cut, &view) == PACKET_MALFORMED);
+
+  // Coalesced packets are viewed one after another.
+  PacketQueue queue;
+  PacketQueueInit(&queue);
+  ResponseSetData(&response, "first");
+  Panic(PacketQueuePush(&queue, &response, NULL));
+  ResponseSetData(&response, "second");
+  Panic(PacketQueuePush(&queue, &response, NULL));
+  DatagramIter iter;
+  DatagramIterInit(&iter, &queue.data);
+  Panic(DatagramIterNextView(&iter, &view, NULL));
+  AssertPayload(&view, "first");
+  Panic(DatagramIterNextView(&iter, &view, NULL));
+  AssertPayload(&view, "second");
+  assert(view.data.ptr < queue.data.ptr + queue.data.len);
+  assert(DatagramIterStopped(&iter));
+  PacketQueueDestroy(&queue);
+  DataDestroy(&data);
+}
+
+void TestPool() {
+  BufferPool pool;
+  Panic(BufferPoolInit(&pool, 2));
+  Data data;
+  Panic(BufferPoolAcquire(&pool, &data));
+  BufferPoolReleaseAt(&pool, data.ptr + 10);
+  assert(pool.free_count == 2);
+  // The same buffer is taken again.
+  Data again;
+  Panic(BufferPoolAcquire(&pool, &again));
+  assert(again.ptr == data.ptr);
+  BufferPoolRelease(&pool, &again);
+  BufferPoolDestroy(&pool);
+}
+
+void TestServerClient() {
+  Address addr;
+  Server srv;
+  Client client;
+#ifdef __IPV4__
+  Panic(AddressInit(&addr, kLocalHost, kPort));
+#else
+#error "Unsupported netcode"
+#endif
+  Panic(ServerInit(&srv, &addr));
+  Panic(ServerSetTimeout(&srv, kTimeoutTime));
+  Panic(ClientInit(&client, &addr));
+  Panic(ClientSetTimeout(&client, kTimeoutTime));
+  size_t server_free = srv.pool.free_count;
+  size_t client_free = client.pool.free_count;
+
+  // The payload stays in the receive buffer until it's released.
+  Response view;
+  ResponseSetData(&response, "hello");
+  Panic(ClientSend(&client, &response));
+  Panic(ServerReceiveView(&srv, &view));
+  AssertPayload(&view, "hello");
+  assert(InPool(&srv.pool, view.data.ptr));
+  assert(InPlace(&srv.pool, view.data.ptr));
+  assert(srv.pool.free_count == server_free - 1);
+  uint16_t client_id = ResponseGetClientId(&view);
+  ServerReleaseView(&srv, &view);
+  assert(srv.pool.free_count == server_free);
+
+  // Views are independent, several of them may be kept at once.
+  Response views[3];
+  const char* texts[] = {"one", "two", "three"};
+  for (int i = 0; i < 3; ++i) {
+    ResponseSetData(&response, texts[i]);
+    Panic(ClientSend(&client, &response));
+    Panic(ServerReceiveView(&srv, &views[i]));
+  }
+  assert(srv.pool.free_count == server_free - 3);
+  assert(ServerGetPoolHighWater(&srv) >= 3);
+  for (int i = 0; i < 3; ++i) {
+    AssertPayload(&views[i], texts[i]);
+    ServerReleaseView(&srv, &views[i]);
+  }
+  assert(srv.pool.free_count == server_free);
+
+  // Reliable messages and coalesced packets are copied into the lent buffer.
+  ResponseSetData(&response, "reliable");
+  Panic(ClientSendReliable(&client, &response));
+  Panic(ServerReceiveView(&srv, &view));
+  assert(ResponseGetType(&view) == RELIABLE);
+  AssertPayload(&view, "reliable");
+  ServerReleaseView(&srv, &view);
+  Panic(ClientSetCoalescing(&client, 1));
+  for (int i = 0; i < 3; ++i) {
+    ResponseSetData(&response, texts[i]);
+    Panic(ClientSend(&client, &response));
+  }
+  Panic(ClientFlush(&client));
+  for (int i = 0; i < 3; ++i) {
+    Panic(ServerReceiveView(&srv, &view));
+    AssertPayload(&view, texts[i]);
+    assert(InPool(&srv.pool, view.data.ptr));
+    ServerReleaseView(&srv, &view);
+  }
+  Panic(ClientSetCoalescing(&client, 0));
+  assert(srv.pool.free_count == server_free);
+
+  // Compressed payloads are decoded into the lent buffer.
+  HuffmanTrainer trainer;
+  HuffmanTable table;
+  HuffmanTrainerInit(&trainer);
+  HuffmanTrainerAdd(&trainer, "aaaaaaaaaaaaaaaab", 17);
+  HuffmanTrainerBuild(&trainer, &table);
+  ServerSetCompression(&srv, &table);
+  ClientSetCompression(&client, &table);
+  ResponseSetData(&response, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab");
+  Panic(ClientSend(&client, &response));
+  Panic(ServerReceiveView(&srv, &view));
+  AssertPayload(&view, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab");
+  assert(!InPlace(&srv.pool, view.data.ptr));
+  ServerReleaseView(&srv, &view);
+  ServerSetCompression(&srv, NULL);
+  ClientSetCompression(&client, NULL);
+  assert(srv.pool.free_count == server_free);
+
+  // The same goes for the client.
+  ResponseSetClientId(&response, client_id);
+  ResponseSetData(&response, "welcome");
+  Panic(ServerSendTo(&srv, &response));
+  Panic(ClientReceiveView(&client, &view));
+  AssertPayload(&view, "welcome");
+  assert(InPlace(&client.pool, view.data.ptr));
+  assert(client.pool.free_count == client_free - 1);
+  assert(ClientGetPoolHighWater(&client) >= 1);
+  ClientReleaseView(&client, &view);
+  assert(client.pool.free_count == client_free);
+
+  // Nothing is lent on error.
+  Panic(ServerSetTimeout(&srv, 10));
+  assert(ServerReceiveView(&srv, &view) == SOCKET_TIMEOUT);
+  assert(srv.pool.free_count == server_free);
+  Panic(ClientSetTimeout(&client, 10));
+  assert(ClientReceiveView(&client, &view) == SOCKET_TIMEOUT);
+  assert(client.pool.free_count == client_free);
+
+  ClientDestroy(&client);
+  ServerDestroy(&srv);
+  AddressDestroy(&addr);
+}
+
+int main() {
+  Panic(ResponseInit(&response));
+  TestPacket();
+  TestPool();
+  TestServerClient();
+  ResponseDestroy(&response);
+}